@@ -0,0 +1,499 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+
+// Portable benchmark of the line unpackers the V210 and packed RGB formatters are built on, formatting whole
+// frames on one thread and striped over a CWorkerPool like the renderers do. Builds with CMake on any
+// platform with a C++14 compiler, see CMakeLists.txt.
+//
+// Every case is timed for thousands of frames and reported as CSV with the latency percentiles, once
+// for every frame rate of its resolution so the cost can be read against the frame time it has to fit in.
+// --benchmark v210 compares the V210 unpack to P010 and P210 per instruction set instead.
+
+#include <pch.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CpuFeatures.h>
+#include <WorkerPool.h>
+#include <video_frame_formatter/RGBUnpack.h>
+#include <video_frame_formatter/V210Unpack.h>
+
+#include <BenchmarkStatistics.h>
+
+
+using Tests::Percentile;
+
+
+struct BenchmarkOptions
+{
+	unsigned int iterations = 2000;
+	unsigned int warmupIterations = 20;
+	unsigned int workers = std::max(std::thread::hardware_concurrency(), 1u);
+	unsigned int resolution = 0;  // Lines, 0 is all
+	std::string filter;
+	std::string benchmark = "suite";
+};
+
+
+struct BenchmarkResolution
+{
+	uint32_t width;
+	uint32_t height;
+};
+
+
+struct BenchmarkRate
+{
+	const char* name;
+	unsigned int numerator;
+	unsigned int denominator;
+};
+
+
+static const BenchmarkResolution BENCHMARK_RESOLUTIONS[] =
+{
+	{ 1920, 1080 },
+	{ 3840, 2160 }
+};
+
+
+static const BenchmarkRate BENCHMARK_RATES[] =
+{
+	{ "23.976", 24000, 1001 },
+	{ "24", 24, 1 },
+	{ "29.97", 30000, 1001 },
+	{ "30", 30, 1 },
+	{ "59.94", 60000, 1001 },
+	{ "60", 60, 1 }
+};
+
+
+static const CpuInstructionSet BENCHMARK_INSTRUCTION_SETS[] =
+{
+	CpuInstructionSet::SCALAR,
+	CpuInstructionSet::SSE41,
+	CpuInstructionSet::AVX2
+};
+
+
+// Not the library's ToString(), that one is TCHAR
+static const char* InstructionSetName(const CpuInstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+	case CpuInstructionSet::SCALAR:
+		return "Scalar";
+
+	case CpuInstructionSet::SSE41:
+		return "SSE4.1";
+
+	case CpuInstructionSet::AVX2:
+		return "AVX2";
+	}
+
+	throw std::runtime_error("InstructionSetName() failed, value not recognized");
+}
+
+
+static void FillRandom(std::vector<uint8_t>& data)
+{
+	std::mt19937 generator(1234);
+	for (uint8_t& byte : data)
+		byte = (uint8_t)generator();
+}
+
+
+/**
+ * A frame which is formatted line range by line range, the way a formatter's FormatLines() does
+ */
+class CBenchmarkFrame
+{
+public:
+
+	virtual ~CBenchmarkFrame() {}
+
+	// Format lines [firstLine, endLine)
+	virtual void FormatLines(uint32_t firstLine, uint32_t endLine) = 0;
+
+	uint32_t Height() const { return m_height; }
+
+	// Stripe boundaries have to be a multiple of this
+	uint32_t LineAlignment() const { return m_lineAlignment; }
+
+	size_t InBytes() const { return m_in.size(); }
+
+protected:
+
+	CBenchmarkFrame(uint32_t height, uint32_t lineAlignment, size_t inBytes):
+		m_height(height),
+		m_lineAlignment(lineAlignment),
+		m_in(inBytes)
+	{
+		FillRandom(m_in);
+	}
+
+	const uint32_t m_height;
+	const uint32_t m_lineAlignment;
+	std::vector<uint8_t> m_in;
+};
+
+
+// V210 to P010 (4:2:0, chroma of the even lines only) or P210 (4:2:2), as CV210toP010VideoFrameFormatter
+// and CV210toP210VideoFrameFormatter
+class CV210BenchmarkFrame:
+	public CBenchmarkFrame
+{
+public:
+
+	CV210BenchmarkFrame(const BenchmarkResolution& resolution, bool p010, CpuInstructionSet instructionSet):
+		CBenchmarkFrame(resolution.height, p010 ? 2 : 1, (size_t)V210BytesPerLine(resolution.width) * resolution.height),
+		m_width(resolution.width),
+		m_p010(p010),
+		m_unpackLine(V210UnpackLineFunctionGet(instructionSet)),
+		m_out((size_t)resolution.width * resolution.height * (p010 ? 3 : 4) / 2)
+	{
+	}
+
+	void FormatLines(uint32_t firstLine, uint32_t endLine) override
+	{
+		const uint32_t inLineWords = V210BytesPerLine(m_width) / sizeof(uint32_t);
+		const uint32_t packs = m_width / V210_PIXELS_PER_PACK;
+		uint16_t* const dstY = m_out.data();
+		uint16_t* const dstUV = dstY + (size_t)m_width * m_height;
+
+		for (uint32_t line = firstLine; line < endLine; ++line)
+		{
+			const uint32_t* src = (const uint32_t*)m_in.data() + (size_t)line * inLineWords;
+			uint16_t* lineY = dstY + (size_t)line * m_width;
+			uint16_t* lineUV = nullptr;
+			if (!m_p010)
+				lineUV = dstUV + (size_t)line * m_width;
+			else if (line % 2 == 0)
+				lineUV = dstUV + (size_t)(line / 2) * m_width;
+
+			m_unpackLine(src, lineY, lineUV, packs);
+		}
+	}
+
+private:
+
+	const uint32_t m_width;
+	const bool m_p010;
+	const V210UnpackLineFunction m_unpackLine;
+	std::vector<uint16_t> m_out;
+};
+
+
+// Packed 10 and 12-bit RGB to RGB48, as CRGBtoRGB48VideoFrameFormatter
+class CRGBBenchmarkFrame:
+	public CBenchmarkFrame
+{
+public:
+
+	CRGBBenchmarkFrame(const BenchmarkResolution& resolution, VideoFrameEncoding encoding, CpuInstructionSet instructionSet):
+		CBenchmarkFrame(resolution.height, 1, InBytesPerRow(resolution.width, encoding) * resolution.height),
+		m_width(resolution.width),
+		m_inBytesPerRow(InBytesPerRow(resolution.width, encoding)),
+		m_unpackLine(RGBUnpackLineFunctionGet(encoding, instructionSet)),
+		m_out((size_t)resolution.width * resolution.height * 3)
+	{
+	}
+
+	void FormatLines(uint32_t firstLine, uint32_t endLine) override
+	{
+		for (uint32_t line = firstLine; line < endLine; ++line)
+			m_unpackLine(
+				m_in.data() + line * m_inBytesPerRow,
+				m_out.data() + (size_t)line * m_width * 3,
+				m_width);
+	}
+
+private:
+
+	const uint32_t m_width;
+	const size_t m_inBytesPerRow;
+	const RGBUnpackLineFunction m_unpackLine;
+	std::vector<uint16_t> m_out;
+
+	// As VideoState::BytesPerRow()
+	static size_t InBytesPerRow(uint32_t width, VideoFrameEncoding encoding)
+	{
+		switch (encoding)
+		{
+		case VideoFrameEncoding::R210:
+		case VideoFrameEncoding::R10b:
+		case VideoFrameEncoding::R10l:
+			return ((width + 63) / 64) * 256;
+
+		case VideoFrameEncoding::R12B:
+		case VideoFrameEncoding::R12L:
+			return (width * 36) / 8;
+
+		default:
+			throw std::runtime_error("CRGBBenchmarkFrame: Encoding not supported");
+		}
+	}
+};
+
+
+// Format frame for as many iterations as asked and return the times in ns, sorted.
+// A pool of more than one worker formats it in as many stripes as there are workers.
+static std::vector<double> BenchmarkFrameTimes(CBenchmarkFrame& frame, CWorkerPool* workerPool, const BenchmarkOptions& options)
+{
+	const auto formatFrame = [&]()
+	{
+		if (!workerPool || workerPool->Workers() == 1)
+		{
+			frame.FormatLines(0, frame.Height());
+			return;
+		}
+
+		const unsigned int stripes = workerPool->Workers();
+		workerPool->Run(stripes, [&](unsigned int stripe)
+		{
+			uint32_t firstLine, endLine;
+			WorkerPoolSplit(frame.Height(), stripes, stripe, frame.LineAlignment(), firstLine, endLine);
+			frame.FormatLines(firstLine, endLine);
+		});
+	};
+
+	for (unsigned int i = 0; i < options.warmupIterations; ++i)
+		formatFrame();
+
+	std::vector<double> frameTimes;
+	frameTimes.reserve(options.iterations);
+
+	for (unsigned int i = 0; i < options.iterations; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		formatFrame();
+		const auto end = std::chrono::steady_clock::now();
+
+		frameTimes.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	}
+
+	std::sort(frameTimes.begin(), frameTimes.end());
+	return frameTimes;
+}
+
+
+// Time the frame single threaded and striped, print a CSV row for every rate
+static void BenchmarkFrameReport(
+	const char* formatter, const BenchmarkResolution& resolution, CpuInstructionSet instructionSet,
+	CBenchmarkFrame& frame, CWorkerPool& workerPool, const BenchmarkOptions& options)
+{
+	for (unsigned int workers : { 1u, workerPool.Workers() })
+	{
+		const std::vector<double> frameTimes = BenchmarkFrameTimes(frame, workers == 1 ? nullptr : &workerPool, options);
+
+		double totalNs = 0.0;
+		for (double frameTime : frameTimes)
+			totalNs += frameTime;
+		const double meanNs = totalNs / frameTimes.size();
+
+		for (const BenchmarkRate& rate : BENCHMARK_RATES)
+		{
+			const double frameBudgetNs = 1e9 * rate.denominator / rate.numerator;
+
+			printf("%s,%s,%up%s,%u,%zu,%.0f,%.2f,%.0f,%.0f,%.0f,%.0f,%.0f,%.1f,%.1f\n",
+				formatter,
+				InstructionSetName(instructionSet),
+				resolution.height, rate.name,
+				workers,
+				frameTimes.size(),
+				meanNs,
+				frame.InBytes() / meanNs,  // bytes/ns = GB/s
+				Percentile(frameTimes, 50),
+				Percentile(frameTimes, 90),
+				Percentile(frameTimes, 99),
+				Percentile(frameTimes, 99.9),
+				frameTimes.back(),
+				100.0 * meanNs / frameBudgetNs,
+				100.0 * Percentile(frameTimes, 99) / frameBudgetNs);
+		}
+		fflush(stdout);
+
+		// Striping with one worker is the same as not striping
+		if (workerPool.Workers() == 1)
+			break;
+	}
+}
+
+
+// Every unpacker for every instruction set this machine has
+static void BenchmarkFormatterSuite(CWorkerPool& workerPool, const BenchmarkOptions& options)
+{
+	struct RGBFormatter
+	{
+		const char* name;
+		VideoFrameEncoding encoding;
+	};
+
+	static const RGBFormatter RGB_FORMATTERS[] =
+	{
+		{ "R210 to RGB48", VideoFrameEncoding::R210 },
+		{ "R10b to RGB48", VideoFrameEncoding::R10b },
+		{ "R10l to RGB48", VideoFrameEncoding::R10l },
+		{ "R12B to RGB48", VideoFrameEncoding::R12B },
+		{ "R12L to RGB48", VideoFrameEncoding::R12L }
+	};
+
+	const auto selected = [&](const char* formatter, const BenchmarkResolution& resolution)
+	{
+		return
+			(options.resolution == 0 || options.resolution == resolution.height) &&
+			(options.filter.empty() || strstr(formatter, options.filter.c_str()));
+	};
+
+	for (const BenchmarkResolution& resolution : BENCHMARK_RESOLUTIONS)
+	{
+		for (CpuInstructionSet instructionSet : BENCHMARK_INSTRUCTION_SETS)
+		{
+			if (CpuClampInstructionSet(instructionSet) != instructionSet)
+				continue;
+
+			for (bool p010 : { true, false })
+			{
+				const char* formatter = p010 ? "V210 to P010" : "V210 to P210";
+				if (!selected(formatter, resolution))
+					continue;
+
+				CV210BenchmarkFrame frame(resolution, p010, instructionSet);
+				BenchmarkFrameReport(formatter, resolution, instructionSet, frame, workerPool, options);
+			}
+
+			for (const RGBFormatter& rgbFormatter : RGB_FORMATTERS)
+			{
+				if (!selected(rgbFormatter.name, resolution))
+					continue;
+
+				CRGBBenchmarkFrame frame(resolution, rgbFormatter.encoding, instructionSet);
+				BenchmarkFrameReport(rgbFormatter.name, resolution, instructionSet, frame, workerPool, options);
+			}
+		}
+	}
+}
+
+
+// V210 unpack throughput per instruction set on one thread, P010 against P210
+static void BenchmarkV210Unpack(const BenchmarkOptions& options)
+{
+	for (const BenchmarkResolution& resolution : BENCHMARK_RESOLUTIONS)
+	{
+		if (options.resolution != 0 && options.resolution != resolution.height)
+			continue;
+
+		for (CpuInstructionSet instructionSet : BENCHMARK_INSTRUCTION_SETS)
+		{
+			if (CpuClampInstructionSet(instructionSet) != instructionSet)
+				continue;
+
+			CV210BenchmarkFrame p010(resolution, true, instructionSet);
+			CV210BenchmarkFrame p210(resolution, false, instructionSet);
+
+			const std::vector<double> p010Times = BenchmarkFrameTimes(p010, nullptr, options);
+			const std::vector<double> p210Times = BenchmarkFrameTimes(p210, nullptr, options);
+
+			// Median rather than mean so a few preempted frames don't move it
+			printf("%u,%s,%zu,%.1f,%.1f,%.0f,%.0f\n",
+				resolution.height,
+				InstructionSetName(instructionSet),
+				p010Times.size(),
+				p010.InBytes() / Percentile(p010Times, 50) * 1e3,  // bytes/ns * 1e3 = MB/s
+				p210.InBytes() / Percentile(p210Times, 50) * 1e3,
+				Percentile(p010Times, 99),
+				Percentile(p210Times, 99));
+			fflush(stdout);
+		}
+	}
+}
+
+
+static void Usage(const char* program)
+{
+	fprintf(stderr,
+		"Usage: %s [--benchmark suite|v210] [--iterations N] [--workers N] [--resolution 1080|2160] [--filter TEXT]\n"
+		"\n"
+		"  --benchmark NAME   suite (default) times every formatter single threaded and striped for every rate,\n"
+		"                     v210 is the V210 unpack throughput for P010 and P210 per instruction set\n"
+		"  --iterations N     Timed frames per case (default 2000)\n"
+		"  --workers N        Workers of the striped runs (default all logical processors)\n"
+		"  --resolution L     Only run 1080 or 2160 line cases\n"
+		"  --filter TEXT      Only run formatters whose name contains TEXT, like \"V210\" or \"R12B\"\n",
+		program);
+}
+
+
+int main(int argc, char* argv[])
+{
+	BenchmarkOptions options;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool hasValue = i + 1 < argc;
+
+		if (strcmp(argv[i], "--iterations") == 0 && hasValue)
+			options.iterations = (unsigned int)strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--workers") == 0 && hasValue)
+			options.workers = (unsigned int)strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--resolution") == 0 && hasValue)
+			options.resolution = (unsigned int)strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--filter") == 0 && hasValue)
+			options.filter = argv[++i];
+		else if (strcmp(argv[i], "--benchmark") == 0 && hasValue)
+			options.benchmark = argv[++i];
+		else
+		{
+			Usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (options.iterations == 0 || options.workers == 0 ||
+		(options.benchmark != "suite" && options.benchmark != "v210"))
+	{
+		Usage(argv[0]);
+		return 2;
+	}
+
+	fprintf(stderr, "Best instruction set: %s, %u iterations, %u workers\n",
+		InstructionSetName(CpuBestInstructionSet()), options.iterations, options.workers);
+
+	try
+	{
+		if (options.benchmark == "v210")
+		{
+			printf("lines,instruction_set,iterations,p010_mb_per_s,p210_mb_per_s,p010_p99_ns,p210_p99_ns\n");
+			BenchmarkV210Unpack(options);
+		}
+		else
+		{
+			CWorkerPool workerPool(options.workers);
+
+			printf("formatter,instruction_set,mode,workers,iterations,mean_ns,gb_per_s,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,frame_budget_pct,p99_frame_budget_pct\n");
+			BenchmarkFormatterSuite(workerPool, options);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		fprintf(stderr, "Failed: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
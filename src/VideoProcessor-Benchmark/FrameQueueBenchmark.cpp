@@ -0,0 +1,202 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+
+// Portable benchmark of the time from a frame being queued by the capture thread to the delivery thread
+// having it, for the deque the buffered pin used to poll every millisecond and the CSpscRingBuffer which
+// wakes the delivery thread. See CMakeLists.txt.
+//
+// Frames are pushed at 59.94 and 23.976 Hz and the pickup latency percentiles are reported as CSV.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <SpscRingBuffer.h>
+
+#include <BenchmarkStatistics.h>
+
+
+using Tests::Percentile;
+
+
+typedef std::chrono::steady_clock::rep FrameQueueTimestamp;
+
+
+static FrameQueueTimestamp FrameQueueNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Pushes the time at a steady frame rate through the queue and returns how long every frame took
+// to be picked up on the other side in ns, sorted
+static std::vector<double> BenchmarkFrameQueueWakeup(
+	const std::function<void(FrameQueueTimestamp)>& push,
+	const std::function<bool(FrameQueueTimestamp&)>& pop,
+	const std::function<void()>& stop,
+	size_t frames, std::chrono::nanoseconds frameInterval)
+{
+	std::vector<double> latencies;
+	latencies.reserve(frames);
+
+	std::thread consumer([&]() {
+		FrameQueueTimestamp pushed;
+		while (pop(pushed))
+			latencies.push_back((double)(FrameQueueNow() - pushed));
+	});
+
+	auto next = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; i++)
+	{
+		next += frameInterval;
+		std::this_thread::sleep_until(next);
+
+		push(FrameQueueNow());
+	}
+
+	// Let the last one arrive
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	stop();
+	consumer.join();
+
+	std::sort(latencies.begin(), latencies.end());
+	return latencies;
+}
+
+
+// As the buffered pin did before, take the lock every ms and look. The pin used Sleep(1), which is
+// a millisecond at best and the scheduler tick (up to 15.6 ms) at worst on Windows, so this is the
+// optimistic version of it.
+static std::vector<double> BenchmarkPolledDeque(size_t frames, std::chrono::nanoseconds frameInterval)
+{
+	std::deque<FrameQueueTimestamp> queue;
+	std::mutex mutex;
+	bool running = true;
+
+	return BenchmarkFrameQueueWakeup(
+		[&](FrameQueueTimestamp t) {
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(t);
+		},
+		[&](FrameQueueTimestamp& t) {
+			while (true)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!running)
+					return false;
+
+				if (queue.empty())
+					continue;
+
+				t = queue.front();
+				queue.pop_front();
+				return true;
+			}
+		},
+		[&]() {
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		},
+		frames, frameInterval);
+}
+
+
+static std::vector<double> BenchmarkSpscRing(size_t frames, std::chrono::nanoseconds frameInterval)
+{
+	CSpscRingBuffer<FrameQueueTimestamp> ring(32);
+
+	return BenchmarkFrameQueueWakeup(
+		[&](FrameQueueTimestamp t) { ring.PushBack(t); },
+		[&](FrameQueueTimestamp& t) {
+			while (ring.WaitForSize(1))
+			{
+				if (ring.PopFront(t))
+					return true;
+			}
+			return false;
+		},
+		[&]() { ring.Close(); },
+		frames, frameInterval);
+}
+
+
+int main(int argc, char* argv[])
+{
+	size_t frames = 1000;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = (size_t)strtoul(argv[++i], nullptr, 10);
+		else
+			frames = 0;
+	}
+
+	if (frames == 0)
+	{
+		fprintf(stderr,
+			"Usage: %s [--frames N]\n"
+			"\n"
+			"  --frames N   Frames pushed per queue and rate (default 1000)\n",
+			argv[0]);
+		return 2;
+	}
+
+	struct FrameQueueRate
+	{
+		const char* name;
+		std::chrono::nanoseconds frameInterval;
+	};
+
+	const FrameQueueRate rates[] =
+	{
+		{ "59.94", std::chrono::nanoseconds(1000000000LL * 1001 / 60000) },
+		{ "23.976", std::chrono::nanoseconds(1000000000LL * 1001 / 24000) }
+	};
+
+	printf("queue,rate,frames,p50_us,p90_us,p99_us,p999_us,max_us\n");
+
+	for (const FrameQueueRate& rate : rates)
+	{
+		const std::pair<const char*, std::vector<double>> results[] =
+		{
+			{ "deque_sleep1", BenchmarkPolledDeque(frames, rate.frameInterval) },
+			{ "spsc_ring", BenchmarkSpscRing(frames, rate.frameInterval) }
+		};
+
+		for (const auto& result : results)
+		{
+			const std::vector<double>& latencies = result.second;
+
+			printf("%s,%s,%zu,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+				result.first,
+				rate.name,
+				latencies.size(),
+				Percentile(latencies, 50.0) / 1000.0,
+				Percentile(latencies, 90.0) / 1000.0,
+				Percentile(latencies, 99.0) / 1000.0,
+				Percentile(latencies, 99.9) / 1000.0,
+				latencies.back() / 1000.0);
+			fflush(stdout);
+		}
+	}
+
+	return 0;
+}
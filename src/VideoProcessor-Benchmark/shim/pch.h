@@ -0,0 +1,73 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+// Stands in for the pch.h of VideoProcessor-Lib, which pulls in MFC and DirectShow, for the few
+// library sources the benchmark builds. Only what those sources use is here.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdexcept>
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <pthread.h>
+#include <sched.h>
+
+typedef int BOOL;
+typedef uintptr_t DWORD_PTR;
+typedef void* HANDLE;
+
+
+inline HANDLE GetCurrentProcess()
+{
+	return nullptr;
+}
+
+
+// Like Windows within a processor group, only the first 64 processors can be in a mask
+inline BOOL GetProcessAffinityMask(HANDLE, DWORD_PTR* processMask, DWORD_PTR* systemMask)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) != 0)
+		return 0;
+
+	*processMask = 0;
+	for (unsigned int cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu)
+		if (CPU_ISSET(cpu, &set))
+			*processMask |= (DWORD_PTR)1 << cpu;
+
+	*systemMask = *processMask;
+	return *processMask != 0;
+}
+
+
+// Returns 0 on failure like Windows, the previous mask is not known and not used
+inline DWORD_PTR SetThreadAffinityMask(pthread_t thread, DWORD_PTR mask)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (unsigned int cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu)
+		if (mask & ((DWORD_PTR)1 << cpu))
+			CPU_SET(cpu, &set);
+
+	return pthread_setaffinity_np(thread, sizeof(set), &set) == 0 ? mask : 0;
+}
+
+#endif
+
+// No DirectShow debug log
+#define DbgLog(x)
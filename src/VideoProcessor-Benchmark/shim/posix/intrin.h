@@ -0,0 +1,47 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+
+// MSVC's <intrin.h> CPUID and XGETBV as used by CpuFeatures.cpp, for GCC and Clang
+
+#include <stdint.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+
+// Named differently and swapped in by macro as some versions of <cpuid.h> have their own __cpuidex
+inline void BenchmarkCpuidex(int regs[4], int leaf, int subleaf)
+{
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+}
+
+
+inline void BenchmarkCpuid(int regs[4], int leaf)
+{
+	BenchmarkCpuidex(regs, leaf, 0);
+}
+
+
+#undef __cpuid
+#undef __cpuidex
+#define __cpuid BenchmarkCpuid
+#define __cpuidex BenchmarkCpuidex
+
+
+// Not the compiler's own, that one needs XSAVE to be enabled for the whole file
+#undef _xgetbv
+inline unsigned long long BenchmarkXgetbv(unsigned int index)
+{
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+	return ((unsigned long long)edx << 32) | eax;
+}
+#define _xgetbv BenchmarkXgetbv
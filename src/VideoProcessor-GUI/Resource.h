@@ -65,6 +65,8 @@
 #define IDC_STATIC_RENDERER_VIDEO_CONVERSION_GROUP 1069
 #define IDC_STATIC_LATENCY_GROUP2       1070
 #define IDC_VIDEO_DATA_GROUP2           1071
+#define IDC_TIMING_CLOCK_SMOOTH_CHECK   1073
+#define IDC_TIMING_CLOCK_JITTER_STATIC  1074
 #define IDC_HDR_LUMINANCE_MAXCLL_EDIT   1075
 #define IDC_HDR_LUMINANCE_MAXFALL_EDIT  1076
 #define IDC_HDR_COLORSPACE_G_EDIT       1077
@@ -73,17 +75,19 @@
 #define IDC_HDR_COLORSPACE_WP_EDIT      1080
 #define IDC_HDR_LUMINANCE_MASTER_MIN_EDIT 1081
 #define IDC_HDR_LUMINANCE_MASTER_MAX_EDIT 1082
+#define IDC_RENDERER_VIDEO_FRAME_QUEUE_SIZE_AUTO_CHECK 1083
 #define ID_COMMAND_FULLSCREEN_TOGGLE    32772
 #define ID_COMMAND_FULLSCREEN_EXIT      32778
 #define ID_COMMAND_RENDERER_RESET       32780
+#define ID_COMMAND_PIPELINE_TRACE_TOGGLE 32781
 
 // Next default values for new objects
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        134
-#define _APS_NEXT_COMMAND_VALUE         32781
-#define _APS_NEXT_CONTROL_VALUE         1073
+#define _APS_NEXT_COMMAND_VALUE         32782
+#define _APS_NEXT_CONTROL_VALUE         1084
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
@@ -59,6 +59,7 @@ BOOL CVideoProcessorApp::InitInstance()
 		// https://docs.microsoft.com/en-us/cpp/c-runtime-library/argc-argv-wargv
 		int iNumOfArgs;
 		LPWSTR* pArgs = CommandLineToArgvW(GetCommandLine(), &iNumOfArgs);
+		FrameQueueDropPolicyConfig frameQueueDropPolicy;
 		for (int i = 1; i < iNumOfArgs; i++)
 		{
 			// /fullscreen
@@ -67,6 +68,12 @@ BOOL CVideoProcessorApp::InitInstance()
 				dlg.StartFullScreen();
 			}
 
+			// /capture_large_pages
+			if (wcscmp(pArgs[i], L"/capture_large_pages") == 0)
+			{
+				dlg.DefaultCaptureLargePages(true);
+			}
+
 			// /renderer "name"
 			if (wcscmp(pArgs[i], L"/renderer") == 0 && (i + 1) < iNumOfArgs)
 			{
@@ -440,8 +447,75 @@ BOOL CVideoProcessorApp::InitInstance()
 
 				dlg.DefaultRendererPrimaries(primaries);
 			}
+
+			// /renderer_formatter_threads N
+			if (wcscmp(pArgs[i], L"/renderer_formatter_threads") == 0 && (i + 1) < iNumOfArgs)
+			{
+				const int formatterThreads = _wtoi(pArgs[i + 1]);
+				if (formatterThreads < 1 || formatterThreads > 64)
+					throw std::runtime_error("Invalid option for /renderer_formatter_threads, needs to be 1-64");
+
+				dlg.DefaultRendererFormatterThreads((unsigned int)formatterThreads);
+			}
+
+			// Set which frames the renderer's queue drops
+			if (wcscmp(pArgs[i], L"/renderer_frame_queue_drop_policy") == 0 && (i + 1) < iNumOfArgs)
+			{
+				if (wcscmp(pArgs[i + 1], L"OLDEST") == 0)
+				{
+					frameQueueDropPolicy.type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_OLDEST;
+				}
+				else if (wcscmp(pArgs[i + 1], L"NEWEST") == 0)
+				{
+					frameQueueDropPolicy.type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_NEWEST;
+				}
+				else if (wcscmp(pArgs[i + 1], L"LATENCY_BOUNDED") == 0)
+				{
+					frameQueueDropPolicy.type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_LATENCY_BOUNDED;
+				}
+				else if (wcscmp(pArgs[i + 1], L"CADENCE") == 0)
+				{
+					frameQueueDropPolicy.type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_CADENCE;
+				}
+				else
+				{
+					throw std::runtime_error("Invalid option for /renderer_frame_queue_drop_policy");
+				}
+			}
+
+			// /renderer_frame_queue_latency_bound N, in ms for LATENCY_BOUNDED
+			if (wcscmp(pArgs[i], L"/renderer_frame_queue_latency_bound") == 0 && (i + 1) < iNumOfArgs)
+			{
+				const int latencyBoundMs = _wtoi(pArgs[i + 1]);
+				if (latencyBoundMs < 1 || latencyBoundMs > 1000)
+					throw std::runtime_error("Invalid option for /renderer_frame_queue_latency_bound, needs to be 1-1000");
+
+				frameQueueDropPolicy.latencyBoundMs = latencyBoundMs;
+			}
+
+			// /renderer_frame_queue_cadence_phase N, counter of a frame which starts a 3:2 cycle for CADENCE
+			if (wcscmp(pArgs[i], L"/renderer_frame_queue_cadence_phase") == 0 && (i + 1) < iNumOfArgs)
+			{
+				const int cadencePhase = _wtoi(pArgs[i + 1]);
+				if (cadencePhase < 0)
+					throw std::runtime_error("Invalid option for /renderer_frame_queue_cadence_phase, needs to be >= 0");
+
+				frameQueueDropPolicy.cadencePhase = (uint64_t)cadencePhase;
+			}
+
+			// /renderer_frame_queue_max_mb N, most memory the renderer's queue may hold, 0 is no limit
+			if (wcscmp(pArgs[i], L"/renderer_frame_queue_max_mb") == 0 && (i + 1) < iNumOfArgs)
+			{
+				const int frameQueueMaxMB = _wtoi(pArgs[i + 1]);
+				if (frameQueueMaxMB < 0 || frameQueueMaxMB > 65536)
+					throw std::runtime_error("Invalid option for /renderer_frame_queue_max_mb, needs to be 0-65536");
+
+				dlg.DefaultRendererFrameQueueMaxBytes((size_t)frameQueueMaxMB * 1024 * 1024);
+			}
 		}
 
+		dlg.DefaultRendererFrameQueueDropPolicy(frameQueueDropPolicy);
+
 		// Set set ourselves to high prio.
 		if (!SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS))
 			throw std::runtime_error("Failed to set process priority");
@@ -10,10 +10,14 @@
 
 #include <atlstr.h>
 #include <algorithm>
+#include <ctime>
+#include <fstream>
 #include <vector>
 
 #include <version.h>
 #include <cie.h>
+#include <InterpolatedTimingClock.h>
+#include <PipelineTrace.h>
 #include <resource.h>
 #include <StringUtils.h>
 #include <VideoProcessorApp.h>
@@ -29,6 +33,12 @@
 
 const static UINT_PTR TIMER_ID_1SECOND = 1;
 
+// Length of the window over which the renderer latencies are shown, the timer moves it every second
+const static size_t RENDERER_LATENCY_WINDOW_SECONDS = 5;
+
+// Capture buffers out downstream of the capture driver, on top of the ones it holds itself
+const static size_t CAPTURE_BUFFER_HELD_FRAMES = 2;
+
 
 BEGIN_MESSAGE_MAP(CVideoProcessorDlg, CDialog)
 
@@ -46,6 +56,7 @@ BEGIN_MESSAGE_MAP(CVideoProcessorDlg, CDialog)
 	ON_CBN_SELCHANGE(IDC_CAPTURE_INPUT_COMBO, &CVideoProcessorDlg::OnCaptureInputSelected)
 	ON_BN_CLICKED(IDC_CAPTURE_RESTART_BUTTON, &CVideoProcessorDlg::OnBnClickedCaptureRestart)
 	ON_BN_CLICKED(IDC_TIMING_CLOCK_FRAME_OFFSET_AUTO_CHECK, &CVideoProcessorDlg::OnBnClickedTimingClockFrameOffsetAutoCheck)
+	ON_BN_CLICKED(IDC_TIMING_CLOCK_SMOOTH_CHECK, &CVideoProcessorDlg::OnBnClickedTimingClockSmoothCheck)
 	ON_CBN_SELCHANGE(IDC_COLORSPACE_CONTAINER_COMBO, &CVideoProcessorDlg::OnColorSpaceContainerSelected)
 	ON_CBN_SELCHANGE(IDC_HDR_COLORSPACE_COMBO, &CVideoProcessorDlg::OnHdrColorSpaceSelected)
 	ON_CBN_SELCHANGE(IDC_HDR_LUMINANCE_COMBO, &CVideoProcessorDlg::OnHdrLuminanceSelected)
@@ -53,6 +64,7 @@ BEGIN_MESSAGE_MAP(CVideoProcessorDlg, CDialog)
 	ON_BN_CLICKED(IDC_RENDERER_RESTART_BUTTON, &CVideoProcessorDlg::OnBnClickedRendererRestart)
 	ON_CBN_SELCHANGE(IDC_RENDERER_VIDEO_CONVERSION_COMBO, &CVideoProcessorDlg::OnRendererVideoConversionSelected)
 	ON_BN_CLICKED(IDC_RENDERER_VIDEO_FRAME_USE_QUEUE_CHECK, &CVideoProcessorDlg::OnBnClickedRendererVideoFrameUseQueueCheck)
+	ON_BN_CLICKED(IDC_RENDERER_VIDEO_FRAME_QUEUE_SIZE_AUTO_CHECK, &CVideoProcessorDlg::OnBnClickedRendererVideoFrameQueueSizeAutoCheck)
 	ON_BN_CLICKED(IDC_RENDERER_RESET_BUTTON, &CVideoProcessorDlg::OnBnClickedRendererReset)
 	ON_BN_CLICKED(IDC_RENDERER_RESET_AUTO_CHECK, &CVideoProcessorDlg::OnBnClickedRendererResetAutoCheck)
 	ON_CBN_SELCHANGE(IDC_RENDERER_DIRECTSHOW_START_STOP_TIME_METHOD_COMBO, &CVideoProcessorDlg::OnRendererDirectShowStartStopTimeMethodSelected)
@@ -77,6 +89,7 @@ BEGIN_MESSAGE_MAP(CVideoProcessorDlg, CDialog)
 	ON_COMMAND(ID_COMMAND_FULLSCREEN_TOGGLE, &CVideoProcessorDlg::OnCommandFullScreenToggle)
 	ON_COMMAND(ID_COMMAND_FULLSCREEN_EXIT, &CVideoProcessorDlg::OnCommandFullScreenExit)
 	ON_COMMAND(ID_COMMAND_RENDERER_RESET, &CVideoProcessorDlg::OnCommandRendererReset)
+	ON_COMMAND(ID_COMMAND_PIPELINE_TRACE_TOGGLE, &CVideoProcessorDlg::OnCommandPipelineTraceToggle)
 
 END_MESSAGE_MAP()
 
@@ -296,6 +309,30 @@ void CVideoProcessorDlg::DefaultRendererPrimaries(DXVA_VideoPrimaries primaries)
 }
 
 
+void CVideoProcessorDlg::DefaultRendererFormatterThreads(unsigned int formatterThreads)
+{
+	m_defaultFormatterThreads = formatterThreads;
+}
+
+
+void CVideoProcessorDlg::DefaultRendererFrameQueueDropPolicy(const FrameQueueDropPolicyConfig& frameQueueDropPolicy)
+{
+	m_defaultFrameQueueDropPolicy = frameQueueDropPolicy;
+}
+
+
+void CVideoProcessorDlg::DefaultRendererFrameQueueMaxBytes(size_t frameQueueMaxBytes)
+{
+	m_defaultFrameQueueMaxBytes = frameQueueMaxBytes;
+}
+
+
+void CVideoProcessorDlg::DefaultCaptureLargePages(bool largePages)
+{
+	m_defaultCaptureLargePages = largePages;
+}
+
+
 //
 // UI-related handlers
 //
@@ -355,6 +392,25 @@ void CVideoProcessorDlg::OnBnClickedTimingClockFrameOffsetAutoCheck()
 	const bool checked = m_timingClockFrameOffsetAutoCheck.GetCheck();
 
 	m_timingClockFrameOffsetEdit.EnableWindow(!checked);
+
+	if (checked)
+	{
+		LatencyControllerConfig latencyControllerConfig;
+		latencyControllerConfig.targetDelayMs = GetTimingClockFrameOffsetMs();
+
+		m_latencyController.reset(new CLatencyController(latencyControllerConfig, latencyControllerConfig.targetDelayMs));
+	}
+	else
+	{
+		m_latencyController.reset();
+	}
+}
+
+
+void CVideoProcessorDlg::OnBnClickedTimingClockSmoothCheck()
+{
+	if (m_captureDevice)
+		m_captureDevice->SetTimestampSmoothing(m_timingClockSmoothCheck.GetCheck());
 }
 
 
@@ -419,6 +475,18 @@ void CVideoProcessorDlg::OnBnClickedRendererVideoFrameUseQueueCheck()
 }
 
 
+void CVideoProcessorDlg::OnBnClickedRendererVideoFrameQueueSizeAutoCheck()
+{
+	const bool checked = m_rendererVideoFrameQueueSizeAutoCheck.GetCheck();
+
+	// The timer builds a new one when checked, back to the maximum otherwise
+	m_queueDepthController.reset();
+
+	if (!checked && m_rendererState == RendererState::RENDERSTATE_RENDERING && GetRendererVideoFrameUseQueue())
+		m_videoRenderer->SetFrameQueueMaxSize(GetRendererVideoFrameQueueSizeMax());
+}
+
+
 void CVideoProcessorDlg::OnBnClickedRendererReset()
 {
 	DbgLog((LOG_TRACE, 1, TEXT("CVideoProcessorDlg::OnBnClickedRendererReset()")));
@@ -427,6 +495,9 @@ void CVideoProcessorDlg::OnBnClickedRendererReset()
 		return;
 
 	m_videoRenderer->Reset();
+
+	if (m_clockDriftEstimator)
+		m_clockDriftEstimator->Rebase();
 }
 
 
@@ -645,8 +716,17 @@ LRESULT CVideoProcessorDlg::OnMessageCaptureDeviceVideoStateChange(WPARAM wParam
 
 LRESULT CVideoProcessorDlg::OnMessageCaptureDeviceError(WPARAM wParam, LPARAM lParam)
 {
-	CString error(*(CString*)wParam);
-	delete (CString*)wParam;
+	CString error;
+	{
+		std::lock_guard<std::mutex> lock(m_captureDeviceErrorMutex);
+
+		error = m_captureDeviceError;
+		if (m_captureDeviceErrorsDropped > 0)
+			error.AppendFormat(TEXT("\n\n(And %u more errors)"), m_captureDeviceErrorsDropped);
+
+		m_captureDeviceErrorPosted = false;
+		m_captureDeviceErrorsDropped = 0;
+	}
 
 	// TODO: DO something with the error
 	::MessageBox(nullptr, error, TEXT("Capture error"), MB_OK | MB_ICONERROR | MB_SYSTEMMODAL);
@@ -774,6 +854,37 @@ void CVideoProcessorDlg::OnCommandRendererReset()
 	{
 		m_videoRenderer->Reset();
 	}
+
+	if (m_clockDriftEstimator)
+		m_clockDriftEstimator->Rebase();
+}
+
+
+void CVideoProcessorDlg::OnCommandPipelineTraceToggle()
+{
+	if (!PipelineTrace::IsEnabled())
+	{
+		DbgLog((LOG_TRACE, 1, TEXT("CVideoProcessorDlg::OnCommandPipelineTraceToggle(): Start")));
+
+		PipelineTrace::Start();
+		return;
+	}
+
+	PipelineTrace::Stop();
+
+	// Written to the working directory, open in ui.perfetto.dev or chrome://tracing
+	const time_t now = time(nullptr);
+	struct tm localNow;
+	localtime_s(&localNow, &now);
+
+	char filename[64];
+	strftime(filename, sizeof(filename), "VideoProcessor-trace-%Y%m%d-%H%M%S.json", &localNow);
+
+	std::ofstream file(filename);
+	PipelineTrace::WriteChromeTrace(file);
+
+	DbgLog((LOG_TRACE, 1, TEXT("CVideoProcessorDlg::OnCommandPipelineTraceToggle(): Written to %S (%s)"),
+		filename, file.good() ? TEXT("ok") : TEXT("failed")));
 }
 
 
@@ -873,11 +984,23 @@ void CVideoProcessorDlg::OnCaptureDeviceError(const CString& error)
 {
 	// WARNING: Most likely to be called from some internal capture card thread!
 
-	CString* postedError = new CString(error);
+	{
+		std::lock_guard<std::mutex> lock(m_captureDeviceErrorMutex);
+
+		// GUI didn't get to the previous one yet
+		if (m_captureDeviceErrorPosted)
+		{
+			++m_captureDeviceErrorsDropped;
+			return;
+		}
+
+		_tcsncpy_s(m_captureDeviceError, (LPCTSTR)error, _TRUNCATE);
+		m_captureDeviceErrorPosted = true;
+	}
 
 	PostMessage(
 		WM_MESSAGE_CAPTURE_DEVICE_ERROR,
-		(WPARAM)postedError,
+		0,
 		0);
 }
 
@@ -965,6 +1088,8 @@ void CVideoProcessorDlg::UpdateState()
 			m_captureDevice = m_desiredCaptureDevice;
 			m_captureDevice->SetCallbackHandler(this);
 			m_captureDevice->SetFrameOffsetMs(GetTimingClockFrameOffsetMs());
+			m_captureDevice->SetTimestampSmoothing(m_timingClockSmoothCheck.GetCheck());
+			m_clockDriftEstimator.reset();
 
 			RefreshInputConnectionCombo();
 
@@ -1241,6 +1366,11 @@ void CVideoProcessorDlg::CaptureStart()
 	// Update internal state before call to StartCapture as that might be synchronous
 	m_captureDeviceState = CaptureDeviceState::CAPTUREDEVICESTATE_STARTING;
 
+	// The renderers format every frame out of its capture buffer on arrival and queue the result, so past
+	// what the driver holds itself only the frame being formatted and one on its way back are out
+	m_captureDevice->SetCaptureBuffering(CAPTURE_BUFFER_HELD_FRAMES, m_defaultCaptureLargePages);
+	m_captureBufferStarvedLogged = 0;
+
 	m_captureDevice->StartCapture();
 
 	// Update GUI
@@ -1423,6 +1553,9 @@ void CVideoProcessorDlg::RenderStart()
 		if (m_captureDeviceVideoState)
 			m_videoRenderer->OnVideoState(m_builtVideoState);
 
+		m_videoRenderer->SetFormatterThreads(m_defaultFormatterThreads);
+		m_videoRenderer->SetFrameQueueDropPolicy(m_defaultFrameQueueDropPolicy);
+		m_videoRenderer->SetFrameQueueMaxBytes(m_defaultFrameQueueMaxBytes);
 		m_videoRenderer->Build();
 		m_videoRenderer->Start();
 
@@ -1488,6 +1621,9 @@ void CVideoProcessorDlg::RenderStart()
 			if (m_captureDeviceVideoState)
 				m_videoRenderer->OnVideoState(m_builtVideoState);
 
+			m_videoRenderer->SetFormatterThreads(m_defaultFormatterThreads);
+			m_videoRenderer->SetFrameQueueDropPolicy(m_defaultFrameQueueDropPolicy);
+			m_videoRenderer->SetFrameQueueMaxBytes(m_defaultFrameQueueMaxBytes);
 			m_videoRenderer->Build();
 			m_videoRenderer->Start();
 
@@ -1552,6 +1688,12 @@ void CVideoProcessorDlg::RenderRemove()
 	assert(m_rendererState == RendererState::RENDERSTATE_STOPPED);
 	assert(!m_deliverCaptureDataToRenderer);
 
+	// These point into the renderer
+	m_rendererEntryLatencyWindows.reset();
+	m_rendererExitLatencyWindows.reset();
+	m_rendererQueueWaitLatencyWindows.reset();
+	m_rendererDeliverLatencyWindows.reset();
+
 	delete m_videoRenderer;
 	m_videoRenderer = nullptr;
 
@@ -1991,6 +2133,8 @@ void CVideoProcessorDlg::DoDataExchange(CDataExchange* pDX)
 	DDX_Control(pDX, IDC_TIMING_CLOCK_DESCRIPTION_STATIC, m_timingClockDescriptionText);
 	DDX_Control(pDX, IDC_TIMING_CLOCK_FRAME_OFFSET_EDIT, m_timingClockFrameOffsetEdit);
 	DDX_Control(pDX, IDC_TIMING_CLOCK_FRAME_OFFSET_AUTO_CHECK, m_timingClockFrameOffsetAutoCheck);
+	DDX_Control(pDX, IDC_TIMING_CLOCK_SMOOTH_CHECK, m_timingClockSmoothCheck);
+	DDX_Control(pDX, IDC_TIMING_CLOCK_JITTER_STATIC, m_timingClockJitterText);
 
 	// colorSpace group
 	DDX_Control(pDX, IDC_COLORSPACE_CONTAINER_COMBO, m_colorspaceContainerCombo);
@@ -2023,6 +2167,7 @@ void CVideoProcessorDlg::DoDataExchange(CDataExchange* pDX)
 	DDX_Control(pDX, IDC_RENDERER_VIDEO_FRAME_USE_QUEUE_CHECK, m_rendererVideoFrameUseQeueueCheck);
 	DDX_Control(pDX, IDC_RENDERER_VIDEO_FRAME_QUEUE_SIZE_STATIC, m_rendererVideoFrameQueueSizeText);
 	DDX_Control(pDX, IDC_RENDERER_VIDEO_FRAME_QUEUE_SIZE_MAX_EDIT, m_rendererVideoFrameQueueSizeMaxEdit);
+	DDX_Control(pDX, IDC_RENDERER_VIDEO_FRAME_QUEUE_SIZE_AUTO_CHECK, m_rendererVideoFrameQueueSizeAutoCheck);
 	DDX_Control(pDX, IDC_RENDERER_DROPPED_FRAME_COUNT_STATIC, m_rendererDroppedFrameCountText);
 	DDX_Control(pDX, IDC_RENDERER_RESET_BUTTON, m_rendererResetButton);
 	DDX_Control(pDX, IDC_RENDERER_RESET_AUTO_CHECK, m_rendererResetAutoCheck);
@@ -2214,6 +2359,9 @@ void CVideoProcessorDlg::OnOK()
 			if (m_videoRenderer)
 			{
 				m_videoRenderer->SetFrameQueueMaxSize(GetRendererVideoFrameQueueSizeMax());
+
+				// Adapts again from the bottom up to the new maximum
+				m_queueDepthController.reset();
 			}
 			break;
 
@@ -2308,13 +2456,35 @@ void CVideoProcessorDlg::OnTimer(UINT_PTR nIDEvent)
 
 	if (m_rendererState == RendererState::RENDERSTATE_RENDERING)
 	{
-		cstring.Format(_T("%lu"), m_videoRenderer->GetFrameQueueSize());
+		cstring.Format(_T("%lu (%.1f MB)"),
+			m_videoRenderer->GetFrameQueueSize(),
+			m_videoRenderer->GetFrameQueueBytes() / (1024.0 * 1024.0));
 		m_rendererVideoFrameQueueSizeText.SetWindowText(cstring);
 
-		cstring.Format(_T("%.01f"), m_videoRenderer->EntryLatencyMs());
+		// Median and worst of every frame over the last few seconds
+		const RendererLatencyHistograms& latencyHistograms = m_videoRenderer->LatencyHistograms();
+		if (!m_rendererEntryLatencyWindows || &m_rendererEntryLatencyWindows->Histogram() != &latencyHistograms.entry)
+		{
+			m_rendererEntryLatencyWindows.reset(new CLatencyHistogramWindows(latencyHistograms.entry, RENDERER_LATENCY_WINDOW_SECONDS));
+			m_rendererExitLatencyWindows.reset(new CLatencyHistogramWindows(latencyHistograms.exit, RENDERER_LATENCY_WINDOW_SECONDS));
+			m_rendererQueueWaitLatencyWindows.reset(new CLatencyHistogramWindows(latencyHistograms.queueWait, RENDERER_LATENCY_WINDOW_SECONDS));
+			m_rendererDeliverLatencyWindows.reset(new CLatencyHistogramWindows(latencyHistograms.deliver, RENDERER_LATENCY_WINDOW_SECONDS));
+
+			// New renderer, which has a queue of the maximum size
+			m_queueDepthController.reset();
+		}
+
+		m_rendererEntryLatencyWindows->Update();
+		m_rendererExitLatencyWindows->Update();
+		m_rendererQueueWaitLatencyWindows->Update();
+		m_rendererDeliverLatencyWindows->Update();
+
+		const LatencyHistogramSummary entryLatency = m_rendererEntryLatencyWindows->Summary(RENDERER_LATENCY_WINDOW_SECONDS);
+		cstring.Format(_T("%.01f (%.01f)"), entryLatency.p50Ms, entryLatency.maxMs);
 		m_rendererLatencyToVPText.SetWindowText(cstring);
 
-		cstring.Format(_T("%.01f"), m_videoRenderer->ExitLatencyMs());
+		const LatencyHistogramSummary exitLatency = m_rendererExitLatencyWindows->Summary(RENDERER_LATENCY_WINDOW_SECONDS);
+		cstring.Format(_T("%.01f (%.01f)"), exitLatency.p50Ms, exitLatency.maxMs);
 		m_rendererLatencyToDSText.SetWindowText(cstring);
 
 		const double frameMs = 1000.0 / m_captureDeviceVideoState->displayMode->RefreshRateHz();
@@ -2329,8 +2499,24 @@ void CVideoProcessorDlg::OnTimer(UINT_PTR nIDEvent)
 		//else
 		//	m_rendererLatencyToDSText.SetTextColor(CColorStatic::GREEN);
 
-		cstring.Format(_T("%lu"), m_videoRenderer->DroppedFrameCount());
+		const uint64_t droppedFrameCount = m_videoRenderer->DroppedFrameCount();
+		cstring.Format(_T("%lu"), droppedFrameCount);
 		m_rendererDroppedFrameCountText.SetWindowText(cstring);
+
+		// No room for the reasons in the dialog, log them when there are new drops
+		if (droppedFrameCount != m_rendererDroppedFrameCountLogged)
+		{
+			DbgLog((LOG_TRACE, 1,
+				TEXT("CVideoProcessorDlg::OnTimer(): Dropped frames %I64u, overflow %I64u, reorder %I64u, late %I64u, reset %I64u, failed %I64u"),
+				droppedFrameCount,
+				m_videoRenderer->DroppedFrameCount(FrameDropReason::FRAMEDROP_OVERFLOW),
+				m_videoRenderer->DroppedFrameCount(FrameDropReason::FRAMEDROP_REORDER),
+				m_videoRenderer->DroppedFrameCount(FrameDropReason::FRAMEDROP_LATE),
+				m_videoRenderer->DroppedFrameCount(FrameDropReason::FRAMEDROP_RESET),
+				m_videoRenderer->DroppedFrameCount(FrameDropReason::FRAMEDROP_FAILED)));
+
+			m_rendererDroppedFrameCountLogged = droppedFrameCount;
+		}
 	}
 	else
 	{
@@ -2348,9 +2534,67 @@ void CVideoProcessorDlg::OnTimer(UINT_PTR nIDEvent)
 		cstring.Format(_T("%lu"), m_captureDevice->VideoFrameMissedCount());
 		m_inputVideoFrameMissedText.SetWindowText(cstring);
 
+		// No room for the capture buffers in the dialog either, log when they ran out
+		const FrameBufferArenaStats captureBufferStats = m_captureDevice->CaptureBufferStats();
+		if (captureBufferStats.starved != m_captureBufferStarvedLogged)
+		{
+			DbgLog((LOG_TRACE, 1,
+				TEXT("CVideoProcessorDlg::OnTimer(): Capture buffers starved %I64u, pressured %I64u of %I64u, %zu of %zu in use, high water %zu"),
+				captureBufferStats.starved,
+				captureBufferStats.pressured,
+				captureBufferStats.acquired,
+				captureBufferStats.inUse,
+				captureBufferStats.bufferCount,
+				captureBufferStats.highWater));
+
+			m_captureBufferStarvedLogged = captureBufferStats.starved;
+		}
+
 		cstring.Format(_T("%.01f"), m_captureDevice->HardwareLatencyMs());
 		m_inputLatencyMsText.SetWindowText(cstring);
 
+		ITimingClock* timingClock = m_captureDevice->GetTimingClock();
+		CString timingClockDescription(timingClock->TimingClockDescription());
+
+		// Interpolated clocks can be off by a bit, show by how much
+		CInterpolatedTimingClock* interpolatedTimingClock = dynamic_cast<CInterpolatedTimingClock*>(timingClock);
+		if (interpolatedTimingClock)
+		{
+			cstring.Format(_T(", error %.03f ms"), interpolatedTimingClock->ErrorMs());
+			timingClockDescription += cstring;
+		}
+
+		// Drift of the capture clock against the system clock which the renderers present on
+		if (!m_clockDriftEstimator)
+			m_clockDriftEstimator.reset(new CClockDriftEstimator(timingClock->TimingClockTicksPerSecond(), m_systemTimingClock.TimingClockTicksPerSecond()));
+
+		m_clockDriftEstimator->Sample(*timingClock, m_systemTimingClock);
+
+		const ClockDriftEstimate clockDrift = m_clockDriftEstimator->Estimate();
+		if (clockDrift.valid)
+		{
+			cstring.Format(_T(", drift %+.01f ppm"), clockDrift.driftPpm);
+			timingClockDescription += cstring;
+		}
+
+		m_timingClockDescriptionText.SetWindowText(timingClockDescription);
+
+		// Worst frame to frame jitter of the timestamps over the last few seconds, before and after smoothing
+		const TimestampJitterHistograms& timestampJitter = m_captureDevice->TimestampJitter();
+		if (!m_inputTimestampJitterWindows || &m_inputTimestampJitterWindows->Histogram() != &timestampJitter.input)
+		{
+			m_inputTimestampJitterWindows.reset(new CLatencyHistogramWindows(timestampJitter.input, RENDERER_LATENCY_WINDOW_SECONDS));
+			m_outputTimestampJitterWindows.reset(new CLatencyHistogramWindows(timestampJitter.output, RENDERER_LATENCY_WINDOW_SECONDS));
+		}
+
+		m_inputTimestampJitterWindows->Update();
+		m_outputTimestampJitterWindows->Update();
+
+		cstring.Format(_T("%.02f/%.02f"),
+			m_inputTimestampJitterWindows->Summary(RENDERER_LATENCY_WINDOW_SECONDS).p99Ms,
+			m_outputTimestampJitterWindows->Summary(RENDERER_LATENCY_WINDOW_SECONDS).p99Ms);
+		m_timingClockJitterText.SetWindowText(cstring);
+
 		// TODO: Find a way to show this information again
 		//if (m_captureDevice->HardwareLatencyMs() < 10)
 		//	m_inputLatencyMsText.SetTextColor(CColorStatic::GREEN);
@@ -2364,6 +2608,9 @@ void CVideoProcessorDlg::OnTimer(UINT_PTR nIDEvent)
 		m_inputVideoFrameCountText.SetWindowText(TEXT(""));
 		m_inputVideoFrameMissedText.SetWindowText(TEXT(""));
 		m_inputLatencyMsText.SetWindowText(_T(""));
+		m_timingClockJitterText.SetWindowText(_T(""));
+
+		m_clockDriftEstimator.reset();
 	}
 
 	// Prevent screensaver, this should be called "periodically" for whatever that means
@@ -2374,8 +2621,7 @@ void CVideoProcessorDlg::OnTimer(UINT_PTR nIDEvent)
 
 
 	// Auto adjust
-	if (m_timerSeconds % 5 == 0 &&
-		m_rendererState == RendererState::RENDERSTATE_RENDERING)
+	if (m_rendererState == RendererState::RENDERSTATE_RENDERING)
 	{
 		assert(m_videoRenderer);
 		assert(m_captureDevice);
@@ -2384,7 +2630,7 @@ void CVideoProcessorDlg::OnTimer(UINT_PTR nIDEvent)
 
 		// Auto-click reset on renderer if requested
 		const bool rendererResetAuto = m_rendererResetAutoCheck.GetCheck();
-		if (rendererResetAuto)
+		if (m_timerSeconds % 5 == 0 && rendererResetAuto)
 		{
 			const bool needsReset = m_videoRenderer->GetFrameQueueSize() >= 3;
 			queueOk = !needsReset;
@@ -2393,30 +2639,73 @@ void CVideoProcessorDlg::OnTimer(UINT_PTR nIDEvent)
 			{
 				DbgLog((LOG_TRACE, 1, TEXT("CVideoProcessorDlg::OnTimer(): Resetting renderer")));
 				m_videoRenderer->Reset();
+
+				if (m_clockDriftEstimator)
+					m_clockDriftEstimator->Rebase();
 			}
 		}
 
-		// Auto update the clock frame offset to get just over zero
-		// only do this if the queue is ok as it will have a major impact on the offset(or unmanaged)
-		const bool timingClockFrameOffsetAuto = m_timingClockFrameOffsetAutoCheck.GetCheck();
-		if (queueOk && timingClockFrameOffsetAuto)
+		// Let it be known when the clocks drifted half a frame apart, which is when the renderer has to drop or repeat
+		if (m_timerSeconds % 60 == 0 && m_clockDriftEstimator)
 		{
-			const double videoFrameLead = -(m_videoRenderer->ExitLatencyMs());
-			const double frameDurationMs = 1000.0 / m_captureDeviceVideoState->displayMode->RefreshRateHz();
+			const double frameMs = 1000.0 / m_captureDeviceVideoState->displayMode->RefreshRateHz();
+			const ClockDriftSlipPrediction slip = m_clockDriftEstimator->PredictSlip(frameMs / 2);
+			if (slip.slip != ClockDriftSlip::NONE)
+			{
+				DbgLog((LOG_TRACE, 1, TEXT("CVideoProcessorDlg::OnTimer(): Clock drift will make the renderer %s a frame in %.0f seconds"),
+					slip.slip == ClockDriftSlip::DROP ? TEXT("drop") : TEXT("repeat"), slip.seconds));
+			}
+		}
 
-			const bool needsAdjusting =
-				videoFrameLead < 0 ||
-				videoFrameLead >(frameDurationMs * 2);
+		// Hold the delay by nudging the clock frame offset with every second of frames, no reset needed for that.
+		// Only do this if the queue is ok as it will have a major impact on the latencies.
+		if (queueOk && m_latencyController)
+		{
+			if (m_latencyController->Update(m_rendererExitLatencyWindows->Summary(1)))
+			{
+				DbgLog((LOG_TRACE, 1, TEXT("CVideoProcessorDlg::OnTimer(): Clock frame offset to %i, lead %.01f, jitter %.01f"),
+					m_latencyController->FrameOffsetMs(), m_latencyController->LeadMs(), m_latencyController->JitterMs()));
+
+				SetTimingClockFrameOffsetMs(m_latencyController->FrameOffsetMs());
+				m_captureDevice->SetFrameOffsetMs(m_latencyController->FrameOffsetMs());
+			}
+		}
 
-			if (needsAdjusting)
+		// Keep the queue as shallow as the arrival and delivery jitter allow, resizing it needs no reset either.
+		// Only overflows are for want of depth, the count starts over with a new renderer.
+		if (m_rendererVideoFrameQueueSizeAutoCheck.GetCheck() && GetRendererVideoFrameUseQueue())
+		{
+			const uint64_t droppedFrameCount = m_videoRenderer->DroppedFrameCount(FrameDropReason::FRAMEDROP_OVERFLOW);
+			const uint64_t droppedFrames = (droppedFrameCount >= m_rendererDroppedFrameCount) ?
+				droppedFrameCount - m_rendererDroppedFrameCount : droppedFrameCount;
+			m_rendererDroppedFrameCount = droppedFrameCount;
+
+			if (!m_queueDepthController)
 			{
-				DbgLog((LOG_TRACE, 1, TEXT("CVideoProcessorDlg::OnTimer(): Adjusting clock frame offset + reset")));
+				const int i = m_rendererDirectShowStartStopTimeMethodCombo.GetCurSel();
+				assert(i >= 0);
+				const DirectShowStartStopTimeMethod directShowStartStopTimeMethod =
+					(DirectShowStartStopTimeMethod)m_rendererDirectShowStartStopTimeMethodCombo.GetItemData(i);
+
+				QueueDepthControllerConfig queueDepthControllerConfig;
+				queueDepthControllerConfig.maximumDepth = std::max(GetRendererVideoFrameQueueSizeMax(), (size_t)1);
+				queueDepthControllerConfig.minimumDepth = std::min(
+					(directShowStartStopTimeMethod == DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK) ? (size_t)2 : (size_t)1,
+					queueDepthControllerConfig.maximumDepth);
 
-				const int delta = (int)round(-videoFrameLead);
-				const int newOffset = GetTimingClockFrameOffsetMs() + delta;
+				const double frameMs = 1000.0 / m_captureDeviceVideoState->displayMode->RefreshRateHz();
+
+				m_queueDepthController.reset(new CQueueDepthController(queueDepthControllerConfig, frameMs));
+				m_videoRenderer->SetFrameQueueMaxSize(m_queueDepthController->Depth());
+			}
+			else if (queueOk && m_queueDepthController->Update(
+				m_rendererEntryLatencyWindows->Summary(1), m_rendererDeliverLatencyWindows->Summary(1),
+				m_rendererQueueWaitLatencyWindows->Summary(1), droppedFrames))
+			{
+				DbgLog((LOG_TRACE, 1, TEXT("CVideoProcessorDlg::OnTimer(): Frame queue size to %zu, deliver %.01f, arrival jitter %.01f"),
+					m_queueDepthController->Depth(), m_queueDepthController->DeliverMs(), m_queueDepthController->ArrivalJitterMs()));
 
-				SetTimingClockFrameOffsetMs(newOffset);
-				UpdateTimingClockFrameOffset();
+				m_videoRenderer->SetFrameQueueMaxSize(m_queueDepthController->Depth());
 			}
 		}
 	}
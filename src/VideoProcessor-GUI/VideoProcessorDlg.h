@@ -11,11 +11,18 @@
 
 #include <set>
 #include <atomic>
+#include <memory>
+#include <mutex>
 
 #include <blackmagic_decklink/BlackMagicDeckLinkCaptureDeviceDiscoverer.h>
 #include <PixelValueRange.h>
 #include <CCie1931Control.h>
+#include <ClockDriftEstimator.h>
 #include <IRenderer.h>
+#include <LatencyController.h>
+#include <LatencyHistogram.h>
+#include <PerformanceCounterTimingClock.h>
+#include <QueueDepthController.h>
 #include <VideoFrame.h>
 #include <FullscreenVideoWindow.h>
 #include <VideoConversionOverride.h>
@@ -87,6 +94,10 @@ public:
 	void DefaultRendererTransferFunction(DXVA_VideoTransferFunction);
 	void DefaultRendererTransferMatrix(DXVA_VideoTransferMatrix);
 	void DefaultRendererPrimaries(DXVA_VideoPrimaries);
+	void DefaultRendererFormatterThreads(unsigned int);
+	void DefaultRendererFrameQueueDropPolicy(const FrameQueueDropPolicyConfig&);
+	void DefaultRendererFrameQueueMaxBytes(size_t);
+	void DefaultCaptureLargePages(bool);
 
 
 	// UI-related handlers
@@ -94,6 +105,7 @@ public:
 	afx_msg void OnCaptureInputSelected();
 	afx_msg void OnBnClickedCaptureRestart();
 	afx_msg void OnBnClickedTimingClockFrameOffsetAutoCheck();
+	afx_msg void OnBnClickedTimingClockSmoothCheck();
 	afx_msg void OnColorSpaceContainerSelected();
 	afx_msg void OnHdrColorSpaceSelected();
 	afx_msg void OnHdrLuminanceSelected();
@@ -101,6 +113,7 @@ public:
 	afx_msg void OnBnClickedRendererRestart();
 	afx_msg void OnRendererVideoConversionSelected();
 	afx_msg void OnBnClickedRendererVideoFrameUseQueueCheck();
+	afx_msg void OnBnClickedRendererVideoFrameQueueSizeAutoCheck();
 	afx_msg void OnBnClickedRendererReset();
 	afx_msg void OnBnClickedRendererResetAutoCheck();
 	afx_msg void OnRendererDirectShowStartStopTimeMethodSelected();
@@ -125,6 +138,7 @@ public:
 	void OnCommandFullScreenToggle();
 	void OnCommandFullScreenExit();
 	void OnCommandRendererReset();
+	void OnCommandPipelineTraceToggle();
 
 	// ICaptureDeviceDiscovererCallback
 	void OnCaptureDeviceFound(ACaptureDeviceComPtr& captureDevice) override;
@@ -174,6 +188,8 @@ protected:
 	CStatic m_timingClockDescriptionText;
 	CEdit m_timingClockFrameOffsetEdit;
 	CButton m_timingClockFrameOffsetAutoCheck;
+	CButton m_timingClockSmoothCheck;
+	CStatic m_timingClockJitterText;
 
 	// Colorspace group
 	CComboBox m_colorspaceContainerCombo;
@@ -206,6 +222,7 @@ protected:
 	CButton m_rendererVideoFrameUseQeueueCheck;
 	CStatic m_rendererVideoFrameQueueSizeText;
 	CEdit m_rendererVideoFrameQueueSizeMaxEdit;
+	CButton m_rendererVideoFrameQueueSizeAutoCheck;
 	CStatic m_rendererDroppedFrameCountText;
 	CButton m_rendererResetButton;
 	CButton m_rendererResetAutoCheck;
@@ -261,13 +278,52 @@ protected:
 	DXVA_VideoTransferFunction m_defaultTransferFunction = DXVA_VideoTransferFunction::DXVA_VideoTransFunc_Unknown;  // Auto
 	DXVA_VideoTransferMatrix m_defaultTransferMatrix = DXVA_VideoTransferMatrix::DXVA_VideoTransferMatrix_Unknown;  // Auto
 	DXVA_VideoPrimaries m_defaultPrimaries = DXVA_VideoPrimaries::DXVA_VideoPrimaries_Unknown;  // Auto
+	unsigned int m_defaultFormatterThreads = 1;
+	FrameQueueDropPolicyConfig m_defaultFrameQueueDropPolicy;
+	size_t m_defaultFrameQueueMaxBytes = 0;  // No limit
+	bool m_defaultCaptureLargePages = false;
 
 
 	IVideoRenderer* m_videoRenderer = nullptr;
 	RendererState m_rendererState = RendererState::RENDERSTATE_UNKNOWN;
 
+	// Rolling windows over the renderer's latency histograms, moved by the timer while rendering
+	std::unique_ptr<CLatencyHistogramWindows> m_rendererEntryLatencyWindows;
+	std::unique_ptr<CLatencyHistogramWindows> m_rendererExitLatencyWindows;
+	std::unique_ptr<CLatencyHistogramWindows> m_rendererQueueWaitLatencyWindows;
+	std::unique_ptr<CLatencyHistogramWindows> m_rendererDeliverLatencyWindows;
+
+	// Same for the capture device's timestamp jitter while capturing
+	std::unique_ptr<CLatencyHistogramWindows> m_inputTimestampJitterWindows;
+	std::unique_ptr<CLatencyHistogramWindows> m_outputTimestampJitterWindows;
+
+	// Drift of the capture clock against the system clock, sampled by the timer while capturing
+	CPerformanceCounterTimingClock m_systemTimingClock;
+	std::unique_ptr<CClockDriftEstimator> m_clockDriftEstimator;
+
+	// Steers the frame offset when it's on auto, the target is the offset at the time auto was turned on
+	std::unique_ptr<CLatencyController> m_latencyController;
+
+	// Sizes the frame queue when it's on adapt, within the maximum the renderer was built with.
+	// Built by the timer for every renderer, with the dropped frame count at the previous update.
+	std::unique_ptr<CQueueDepthController> m_queueDepthController;
+	uint64_t m_rendererDroppedFrameCount = 0;
+
+	// Dropped frame count when the drops per reason were last logged
+	uint64_t m_rendererDroppedFrameCountLogged = 0;
+
+	// Capture buffer requests which found the arena empty when last logged
+	uint64_t m_captureBufferStarvedLogged = 0;
+
 	std::atomic_bool m_deliverCaptureDataToRenderer = false;
 
+	// Capture device error handed from the capture thread to the GUI thread, in place so that posting
+	// it does not allocate. Errors which come in before the GUI took the previous one are only counted.
+	std::mutex m_captureDeviceErrorMutex;
+	TCHAR m_captureDeviceError[512] = {};
+	bool m_captureDeviceErrorPosted = false;
+	unsigned int m_captureDeviceErrorsDropped = 0;
+
 	uint32_t m_timerSeconds = 0;
 
 	// We often have to wait for devices to come back etc. Hence many functions can't complete
@@ -22,6 +22,8 @@
 #include <BitDepth.h>
 #include <HDRData.h>
 #include <CaptureInput.h>
+#include <FrameBufferArena.h>
+#include <TimestampSmoother.h>
 #include <VideoFrame.h>
 #include <VideoState.h>
 
@@ -187,6 +189,23 @@ public:
 	// Value in whole milliseconds
 	virtual void SetFrameOffsetMs(int) = 0;
 
+	// Take the jitter out of the frame timestamps with a phase-locked loop on the nominal
+	// frame duration, before the frame offset is added. Off by default, the jitter is
+	// measured either way.
+	virtual void SetTimestampSmoothing(bool) = 0;
+
+	//
+	// Capture buffers
+	//
+
+	// Devices which let the hardware capture into memory of our own keep the frames in a page aligned arena,
+	// with room for the given amount of frames held downstream on top of what the hardware holds.
+	// Large pages if asked for and allowed. Others ignore this. Takes effect on the next StartCapture().
+	virtual void SetCaptureBuffering(size_t heldFrames, bool largePages) = 0;
+
+	// Use of the capture buffer arena, all 0 if the device does not have one
+	virtual FrameBufferArenaStats CaptureBufferStats() const = 0;
+
 	//
 	// Metrics
 	//
@@ -203,6 +222,10 @@ public:
 	// Some hardware supports this, sometimes directly and sometimes it can be derived from
 	// gaps in the the hardware clock timestamps
 	virtual uint64_t VideoFrameMissedCount() const = 0;
+
+	// Frame to frame jitter of the timestamps before and after smoothing, in ms.
+	// Lives as long as the capture device, can be read from any thread.
+	virtual const TimestampJitterHistograms& TimestampJitter() const = 0;
 };
 
 
@@ -0,0 +1,190 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <math.h>
+#include <stdexcept>
+
+#include "ClockDriftEstimator.h"
+
+
+CClockDriftEstimator::CClockDriftEstimator(
+	timingclocktime_t sourceTicksPerSecond, timingclocktime_t sinkTicksPerSecond,
+	const ClockDriftEstimatorConfig& config):
+	m_config(config),
+	m_sourceTicksPerSecond(sourceTicksPerSecond),
+	m_sinkTicksPerSecond(sinkTicksPerSecond)
+{
+	if (sourceTicksPerSecond <= 0 || sinkTicksPerSecond <= 0)
+		throw std::runtime_error("Ticks per second must be > 0");
+
+	if (config.halfLifeSeconds <= 0.0)
+		throw std::runtime_error("Half life must be > 0");
+
+	if (config.minimumSpanSeconds < 0.0)
+		throw std::runtime_error("Minimum span must be >= 0");
+}
+
+
+void CClockDriftEstimator::Sample(timingclocktime_t source, timingclocktime_t sink)
+{
+	if (m_sampleCount > 0 && (source < m_sourceLast || sink <= m_sinkLast))
+	{
+		DbgLog((LOG_TRACE, 1, TEXT("CClockDriftEstimator::Sample(): Clock went back in time, starting over")));
+		Reset();
+	}
+
+	if (m_sampleCount == 0)
+	{
+		m_sourceFirst = source;
+		m_sinkFirst = sink;
+	}
+
+	const double previousX = LastX();
+
+	m_sourceLast = source;
+	m_sinkLast = sink;
+	++m_sampleCount;
+
+	const double x = LastX();
+	const double y = (double)(source - m_sourceFirst) / m_sourceTicksPerSecond - x;
+
+	// Older samples count for less the longer ago they were
+	const double decay = (m_sampleCount > 1) ? exp2(-(x - previousX) / m_config.halfLifeSeconds) : 0.0;
+
+	m_weight = decay * m_weight + 1.0;
+	m_weightSquared = decay * decay * m_weightSquared + 1.0;
+
+	const double dx = x - m_meanX;
+	const double dy = y - m_meanY;
+	m_meanX += dx / m_weight;
+	m_meanY += dy / m_weight;
+
+	m_sxx = decay * m_sxx + dx * (x - m_meanX);
+	m_sxy = decay * m_sxy + dx * (y - m_meanY);
+	m_syy = decay * m_syy + dy * (y - m_meanY);
+}
+
+
+void CClockDriftEstimator::Sample(ITimingClock& source, ITimingClock& sink)
+{
+	const timingclocktime_t sinkBefore = sink.TimingClockNow();
+	const timingclocktime_t sourceNow = source.TimingClockNow();
+	const timingclocktime_t sinkAfter = sink.TimingClockNow();
+
+	Sample(sourceNow, sinkBefore + (sinkAfter - sinkBefore) / 2);
+}
+
+
+void CClockDriftEstimator::Reset()
+{
+	m_sampleCount = 0;
+	m_sourceFirst = m_sinkFirst = 0;
+	m_sourceLast = m_sinkLast = 0;
+
+	m_weight = m_weightSquared = 0.0;
+	m_meanX = m_meanY = 0.0;
+	m_sxx = m_sxy = m_syy = 0.0;
+
+	m_anchorX = 0.0;
+	m_slippedMs = 0.0;
+}
+
+
+void CClockDriftEstimator::Rebase()
+{
+	m_anchorX = LastX();
+	m_slippedMs = 0.0;
+}
+
+
+void CClockDriftEstimator::OnSlip(ClockDriftSlip slip, double frameMs)
+{
+	// Dropping a frame makes up for the source being ahead by it
+	switch (slip)
+	{
+	case ClockDriftSlip::DROP:
+		m_slippedMs += frameMs;
+		break;
+
+	case ClockDriftSlip::REPEAT:
+		m_slippedMs -= frameMs;
+		break;
+
+	case ClockDriftSlip::NONE:
+		break;
+
+	default:
+		throw std::runtime_error("Unknown ClockDriftSlip");
+	}
+}
+
+
+ClockDriftEstimate CClockDriftEstimator::Estimate() const
+{
+	ClockDriftEstimate estimate;
+
+	const double span = LastX();
+	if (m_sampleCount < 3 || span < m_config.minimumSpanSeconds || m_sxx <= 0.0)
+		return estimate;
+
+	const double slope = m_sxy / m_sxx;
+
+	// Residual variance per sample, corrected for the weights making for less effective samples
+	const double effectiveSamples = m_weight * m_weight / m_weightSquared;
+	double slopeVariance = 0.0;
+	if (effectiveSamples > 2.0)
+	{
+		const double residualVariance = std::max(m_syy - slope * m_sxy, 0.0) / m_weight * effectiveSamples / (effectiveSamples - 2.0);
+		slopeVariance = residualVariance * (m_weightSquared / m_weight) / m_sxx;
+	}
+
+	estimate.valid = true;
+	estimate.driftPpm = slope * 1000000.0;
+	estimate.confidencePpm = 1.96 * sqrt(slopeVariance) * 1000000.0;
+	estimate.offsetMs = slope * (span - m_anchorX) * 1000.0 - m_slippedMs;
+
+	return estimate;
+}
+
+
+ClockDriftSlipPrediction CClockDriftEstimator::PredictSlip(double slackMs) const
+{
+	ClockDriftSlipPrediction prediction;
+
+	const ClockDriftEstimate estimate = Estimate();
+	if (!estimate.valid || fabs(estimate.driftPpm) <= estimate.confidencePpm)
+		return prediction;
+
+	// Ms the offset moves per second
+	const double rate = estimate.driftPpm / 1000.0;
+
+	if (rate > 0.0)
+	{
+		prediction.slip = ClockDriftSlip::DROP;
+		prediction.seconds = std::max((slackMs - estimate.offsetMs) / rate, 0.0);
+	}
+	else
+	{
+		prediction.slip = ClockDriftSlip::REPEAT;
+		prediction.seconds = std::max((-slackMs - estimate.offsetMs) / rate, 0.0);
+	}
+
+	return prediction;
+}
+
+
+double CClockDriftEstimator::LastX() const
+{
+	if (m_sampleCount == 0)
+		return 0.0;
+
+	return (double)(m_sinkLast - m_sinkFirst) / m_sinkTicksPerSecond;
+}
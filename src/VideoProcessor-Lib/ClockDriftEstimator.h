@@ -0,0 +1,136 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <ITimingClock.h>
+
+
+struct ClockDriftEstimatorConfig
+{
+	// Samples lose half their weight after this long, long enough to average out the read jitter
+	// and short enough to follow a clock which changes rate as it warms up
+	double halfLifeSeconds = 300.0;
+
+	// Time the samples need to cover before there is an estimate
+	double minimumSpanSeconds = 30.0;
+};
+
+
+// What the sink has to do to stay in step with the source
+enum class ClockDriftSlip
+{
+	NONE,
+	DROP,    // Source is ahead by a frame, drop one
+	REPEAT   // Source is behind by a frame, repeat one
+};
+
+
+struct ClockDriftEstimate
+{
+	// False until the samples cover the minimum span, everything else is 0 then
+	bool valid = false;
+
+	// Rate of the source clock against the sink clock, positive if the source runs fast
+	double driftPpm = 0.0;
+
+	// Half width of the 95% confidence interval around the drift
+	double confidencePpm = 0.0;
+
+	// Time the source got ahead of the sink since the anchor going by the drift, minus slipped frames
+	double offsetMs = 0.0;
+};
+
+
+struct ClockDriftSlipPrediction
+{
+	ClockDriftSlip slip = ClockDriftSlip::NONE;
+
+	// Time from the last sample until it happens, 0 if it's overdue, only set if there is a slip
+	double seconds = 0.0;
+};
+
+
+/**
+ * Estimates how two clock domains drift apart, like the capture hardware clock which the frames
+ * are timestamped on and the clock the renderer presents on.
+ *
+ * Sample() takes readings of both clocks made at the same moment. The offset between them is fitted
+ * against the sink clock with a least squares regression which forgets old samples exponentially,
+ * so it runs in constant time and memory over hours of playback. Its slope is the drift.
+ *
+ * The drift adds up to an offset between the clocks from an anchor on, when this gets to the slack the
+ * sink has, like half a frame or what fits in its queue, a frame has to be dropped or repeated.
+ * PredictSlip() tells which and when so it can be done at a convenient moment, rather than the queue
+ * over- or underflowing. Slipped frames are reported back through OnSlip() so the offset accounts for
+ * them, and Rebase() moves the anchor when the sink starts over by itself.
+ *
+ * Not thread safe.
+ */
+class CClockDriftEstimator
+{
+public:
+
+	CClockDriftEstimator(
+		timingclocktime_t sourceTicksPerSecond, timingclocktime_t sinkTicksPerSecond,
+		const ClockDriftEstimatorConfig& config = ClockDriftEstimatorConfig());
+
+	// Readings of both clocks at the same moment. If either goes back in time the estimator starts over.
+	void Sample(timingclocktime_t source, timingclocktime_t sink);
+
+	// Read both clocks, the source between two reads of the sink
+	void Sample(ITimingClock& source, ITimingClock& sink);
+
+	// Throw away all samples
+	void Reset();
+
+	// Anchor the offset at the last sample
+	void Rebase();
+
+	// A frame of the given duration was dropped or repeated to make up for the drift
+	void OnSlip(ClockDriftSlip slip, double frameMs);
+
+	ClockDriftEstimate Estimate() const;
+
+	// When the offset will have reached the slack, going by the drift. There is no prediction for a drift
+	// which is within its confidence interval of 0.
+	ClockDriftSlipPrediction PredictSlip(double slackMs) const;
+
+	uint64_t SampleCount() const { return m_sampleCount; }
+
+private:
+
+	const ClockDriftEstimatorConfig m_config;
+	const timingclocktime_t m_sourceTicksPerSecond;
+	const timingclocktime_t m_sinkTicksPerSecond;
+
+	// Times are in seconds since the first sample, x is the sink time and y the source time minus that
+	timingclocktime_t m_sourceFirst = 0;
+	timingclocktime_t m_sinkFirst = 0;
+	timingclocktime_t m_sourceLast = 0;
+	timingclocktime_t m_sinkLast = 0;
+	uint64_t m_sampleCount = 0;
+
+	// Exponentially weighted sums, the means and the co-moments around them
+	double m_weight = 0.0;
+	double m_weightSquared = 0.0;
+	double m_meanX = 0.0;
+	double m_meanY = 0.0;
+	double m_sxx = 0.0;
+	double m_sxy = 0.0;
+	double m_syy = 0.0;
+
+	// Sink time the offset is counted from and the slipped frames since
+	double m_anchorX = 0.0;
+	double m_slippedMs = 0.0;
+
+	double LastX() const;
+};
@@ -0,0 +1,87 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <intrin.h>
+#include <immintrin.h>
+
+#include "CpuFeatures.h"
+
+
+// CPUID leaf 1 ECX
+#define CPUID_1_ECX_SSE41 (1 << 19)
+#define CPUID_1_ECX_OSXSAVE (1 << 27)
+#define CPUID_1_ECX_AVX (1 << 28)
+
+// CPUID leaf 7 EBX
+#define CPUID_7_EBX_AVX2 (1 << 5)
+
+// XCR0, OS saves XMM and YMM state on context switches
+#define XCR0_XMM_YMM 0x6
+
+
+static CpuInstructionSet CpuDetectInstructionSet()
+{
+	int regs[4];  // EAX, EBX, ECX, EDX
+
+	__cpuid(regs, 0);
+	const int maxLeaf = regs[0];
+	if (maxLeaf < 1)
+		return CpuInstructionSet::SCALAR;
+
+	__cpuid(regs, 1);
+	const int ecx1 = regs[2];
+	if (!(ecx1 & CPUID_1_ECX_SSE41))
+		return CpuInstructionSet::SCALAR;
+
+	// AVX2 needs the CPU to support it and the OS to save the YMM registers
+	if (maxLeaf >= 7 &&
+		(ecx1 & CPUID_1_ECX_OSXSAVE) &&
+		(ecx1 & CPUID_1_ECX_AVX) &&
+		(_xgetbv(0) & XCR0_XMM_YMM) == XCR0_XMM_YMM)
+	{
+		__cpuidex(regs, 7, 0);
+		if (regs[1] & CPUID_7_EBX_AVX2)
+			return CpuInstructionSet::AVX2;
+	}
+
+	return CpuInstructionSet::SSE41;
+}
+
+
+const TCHAR* ToString(const CpuInstructionSet cpuInstructionSet)
+{
+	switch (cpuInstructionSet)
+	{
+	case CpuInstructionSet::SCALAR:
+		return TEXT("Scalar");
+
+	case CpuInstructionSet::SSE41:
+		return TEXT("SSE4.1");
+
+	case CpuInstructionSet::AVX2:
+		return TEXT("AVX2");
+	}
+
+	throw std::runtime_error("CpuInstructionSet ToString() failed, value not recognized");
+}
+
+
+CpuInstructionSet CpuBestInstructionSet()
+{
+	static const CpuInstructionSet best = CpuDetectInstructionSet();
+	return best;
+}
+
+
+CpuInstructionSet CpuClampInstructionSet(const CpuInstructionSet requested)
+{
+	const CpuInstructionSet best = CpuBestInstructionSet();
+	return requested < best ? requested : best;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <atlstr.h>
+
+
+/**
+ * SIMD instruction sets which code paths can be specialized for, ordered from least to most capable
+ */
+enum class CpuInstructionSet
+{
+	SCALAR,
+	SSE41,
+	AVX2
+};
+
+
+const TCHAR* ToString(const CpuInstructionSet cpuInstructionSet);
+
+
+// Best instruction set supported by both the CPU and the OS, detected once and cached
+CpuInstructionSet CpuBestInstructionSet();
+
+
+// Returns the lesser of the requested instruction set and the best one this machine supports
+CpuInstructionSet CpuClampInstructionSet(const CpuInstructionSet requested);
@@ -49,6 +49,18 @@ double DisplayMode::RefreshRateHz() const
 }
 
 
+uint64_t DisplayMode::NanosecondsPerFrame() const
+{
+	return (uint64_t)FrameTimebase(1000000000ULL).Convert(1);
+}
+
+
+RationalTimebase DisplayMode::FrameTimebase(uint64_t unitsPerSecond) const
+{
+	return RationalTimebase((uint64_t)m_frameDuration * unitsPerSecond, m_timeScale);
+}
+
+
 CString DisplayMode::ToString() const
 {
 	CString s;
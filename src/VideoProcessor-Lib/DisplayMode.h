@@ -10,6 +10,7 @@
 
 #include <afxstr.h>
 #include <memory>
+#include <RationalTimebase.h>
 #include <WallClock.h>
 
 
@@ -57,8 +58,12 @@ public:
 	// Refresh rate in Hz as double
 	double RefreshRateHz() const;
 
-	// Nanosecond per frame
-	uint64_t NanosecondsPerFrame() const {}
+	// Nanosecond per frame, rounded down
+	uint64_t NanosecondsPerFrame() const;
+
+	// Exact conversion of frame numbers into the start time of the frame in units of the given
+	// rate, like timing clock ticks per second
+	RationalTimebase FrameTimebase(uint64_t unitsPerSecond) const;
 
 	// Return the mode as a human-understandable string
 	CString ToString() const;
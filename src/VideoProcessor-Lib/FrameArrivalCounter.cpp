@@ -0,0 +1,60 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "FrameArrivalCounter.h"
+
+
+void CFrameArrivalCounter::SetTicksPerFrame(timingclocktime_t ticksPerFrame)
+{
+	if (ticksPerFrame <= 0)
+		throw std::runtime_error("Ticks per frame must be > 0");
+
+	SetFrameTimebase(RationalTimebase(ticksPerFrame, 1));
+}
+
+
+void CFrameArrivalCounter::SetFrameTimebase(const RationalTimebase& framesToTicks)
+{
+	m_ticksToFrames = framesToTicks.Inverse();
+	m_hasFrameDuration = true;
+}
+
+
+void CFrameArrivalCounter::Reset()
+{
+	m_previousTimingTimestamp = TIMING_CLOCK_TIME_INVALID;
+	m_capturedCount = 0;
+	m_missedCount = 0;
+}
+
+
+uint64_t CFrameArrivalCounter::OnFrame(timingclocktime_t timingTimestamp)
+{
+	assert(m_hasFrameDuration);
+
+	// Figure out how many frames fit in the interval
+	if (m_previousTimingTimestamp != TIMING_CLOCK_TIME_INVALID)
+	{
+		assert(m_previousTimingTimestamp < timingTimestamp);
+
+		const int frames = (int)m_ticksToFrames.ConvertRounded(timingTimestamp - m_previousTimingTimestamp);
+		assert(frames >= 0);
+
+		m_capturedCount += frames;
+		m_missedCount += std::max((frames - 1), 0);
+	}
+
+	m_previousTimingTimestamp = timingTimestamp;
+
+	return m_capturedCount;
+}
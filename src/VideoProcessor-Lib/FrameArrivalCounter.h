@@ -0,0 +1,51 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <RationalTimebase.h>
+#include <TimingClock.h>
+
+
+/**
+ * Counts captured frames from their hardware timestamps, frames which were missed in between
+ * are counted from how many frame durations fit between two consecutive timestamps.
+ *
+ * Not thread safe, use from the capture thread. The counts can be read from anywhere as a
+ * rough indication.
+ */
+class CFrameArrivalCounter
+{
+public:
+
+	// Frame duration of the stream in timing clock ticks, keeps the counts
+	void SetTicksPerFrame(timingclocktime_t ticksPerFrame);
+
+	// Same as an exact conversion of frame numbers to timing clock ticks, see DisplayMode::FrameTimebase()
+	void SetFrameTimebase(const RationalTimebase& framesToTicks);
+
+	// Start counting from zero, the next frame is the first
+	void Reset();
+
+	// Count a frame with its hardware timestamp and return its counter
+	uint64_t OnFrame(timingclocktime_t timingTimestamp);
+
+	uint64_t CapturedCount() const { return m_capturedCount; }
+	uint64_t MissedCount() const { return m_missedCount; }
+
+private:
+
+	RationalTimebase m_ticksToFrames;
+	bool m_hasFrameDuration = false;
+	timingclocktime_t m_previousTimingTimestamp = TIMING_CLOCK_TIME_INVALID;
+	uint64_t m_capturedCount = 0;
+	uint64_t m_missedCount = 0;
+};
@@ -0,0 +1,151 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "FrameBufferAllocator.h"
+
+
+CFrameBufferAllocator::CFrameBufferAllocator(size_t bufferCount, bool largePages):
+	m_bufferCount(bufferCount),
+	m_largePages(largePages)
+{
+	if (bufferCount == 0)
+		throw std::runtime_error("Frame buffer allocator needs at least one buffer");
+}
+
+
+CFrameBufferAllocator::~CFrameBufferAllocator()
+{
+	// Buffers should all have been given back by now
+	assert(!m_arena || m_arena->InUse() == 0);
+	assert(m_retiredArenas.empty());
+}
+
+
+void CFrameBufferAllocator::Reserve(size_t frameBytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (frameBytes > 0 && (!m_arena || m_arena->BufferSize() < frameBytes))
+		ReplaceArena(frameBytes);
+}
+
+
+void* CFrameBufferAllocator::Allocate(size_t size)
+{
+	// WARNING: Called from the capture driver's thread, does not make arenas or touch the heap
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Not reserved (in time), the frame is lost
+	if (!m_arena || m_arena->BufferSize() < size)
+	{
+		++m_retiredStats.starved;
+		return nullptr;
+	}
+
+	// Counted as starved by the arena if empty
+	return m_arena->Acquire(size);
+}
+
+
+void CFrameBufferAllocator::Release(void* buffer)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_arena && m_arena->Owns(buffer))
+	{
+		m_arena->Release(buffer);
+		return;
+	}
+
+	for (auto it = m_retiredArenas.begin(); it != m_retiredArenas.end(); ++it)
+	{
+		if (!(*it)->Owns(buffer))
+			continue;
+
+		(*it)->Release(buffer);
+
+		if ((*it)->InUse() == 0)
+			m_retiredArenas.erase(it);
+
+		return;
+	}
+
+	throw std::runtime_error("Frame buffer is not from this allocator");
+}
+
+
+void CFrameBufferAllocator::Free()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	ReplaceArena(0);
+}
+
+
+FrameBufferArenaStats CFrameBufferAllocator::Stats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	FrameBufferArenaStats stats = m_retiredStats;
+
+	for (const auto& arena : m_retiredArenas)
+		stats.inUse += arena->InUse();
+
+	if (m_arena)
+	{
+		const FrameBufferArenaStats arenaStats = m_arena->Stats();
+
+		stats.bufferSize = arenaStats.bufferSize;
+		stats.bufferCount = arenaStats.bufferCount;
+		stats.largePages = arenaStats.largePages;
+		stats.inUse += arenaStats.inUse;
+		stats.highWater = std::max(stats.highWater, arenaStats.highWater);
+		stats.acquired += arenaStats.acquired;
+		stats.pressured += arenaStats.pressured;
+		stats.starved += arenaStats.starved;
+	}
+
+	return stats;
+}
+
+
+void CFrameBufferAllocator::ReplaceArena(size_t frameBytes)
+{
+	// WARNING: Call with the lock held
+
+	if (m_arena)
+	{
+		const FrameBufferArenaStats arenaStats = m_arena->Stats();
+
+		m_retiredStats.highWater = std::max(m_retiredStats.highWater, arenaStats.highWater);
+		m_retiredStats.acquired += arenaStats.acquired;
+		m_retiredStats.pressured += arenaStats.pressured;
+		m_retiredStats.starved += arenaStats.starved;
+
+		if (m_arena->InUse() > 0)
+			m_retiredArenas.push_back(std::move(m_arena));
+
+		m_arena.reset();
+	}
+
+	if (frameBytes == 0)
+		return;
+
+	FrameBufferArenaConfig config;
+	config.bufferSize = frameBytes;
+	config.bufferCount = m_bufferCount;
+	config.largePages = m_largePages;
+
+	m_arena.reset(new CFrameBufferArena(config));
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <FrameBufferArena.h>
+
+
+/**
+ * Frame buffers for capture hardware out of an arena which follows the frame size.
+ *
+ * The arena is made by Reserve() only, for the frame size given to it and with the configured amount of
+ * buffers. That can be hundreds of MB so it is meant to be called once before capture starts, off the
+ * driver's threads, for the largest frames the input can switch to. A larger size gets a new arena, the
+ * old one lives on until its last buffer is back.
+ *
+ * Allocate() is called on the driver's capture thread and never allocates itself. If there is no arena
+ * for the size or it has run dry it returns nullptr, the driver drops the frame and it counts as starved
+ * in the stats, which means the arena should be bigger or was not reserved for frames this size.
+ *
+ * This is the driver facing end of the memory, allocation and release can come from any thread.
+ */
+class CFrameBufferAllocator
+{
+public:
+
+	CFrameBufferAllocator(size_t bufferCount, bool largePages);
+	~CFrameBufferAllocator();
+
+	CFrameBufferAllocator(const CFrameBufferAllocator&) = delete;
+	CFrameBufferAllocator& operator= (const CFrameBufferAllocator&) = delete;
+
+	// Largest frames which are going to come, makes the arena if there is none or it's too small.
+	// WARNING: Allocates the arena, do not call from the driver's threads
+	void Reserve(size_t frameBytes);
+
+	// Page aligned buffer of at least size bytes out of the arena, nullptr if there is no room
+	void* Allocate(size_t size);
+
+	// Give back a buffer from Allocate()
+	void Release(void* buffer);
+
+	// Done capturing, the arena is freed once all of its buffers are back.
+	// The driver stopping and starting streams on a mode change leaves it as is.
+	void Free();
+
+	// Use of the arenas since construction
+	FrameBufferArenaStats Stats() const;
+
+private:
+
+	const size_t m_bufferCount;
+	const bool m_largePages;
+
+	mutable std::mutex m_mutex;
+	std::unique_ptr<CFrameBufferArena> m_arena;
+
+	// Arenas which were replaced but still have buffers out
+	std::vector<std::unique_ptr<CFrameBufferArena>> m_retiredArenas;
+
+	// Counts of the arenas which are gone and of the allocations without a fitting arena
+	FrameBufferArenaStats m_retiredStats;
+
+	// Replace the arena with one for frames of the given size, or with none if 0
+	void ReplaceArena(size_t frameBytes);
+};
@@ -0,0 +1,119 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "FrameBufferArena.h"
+
+
+static size_t RoundUp(size_t value, size_t multiple)
+{
+	return ((value + multiple - 1) / multiple) * multiple;
+}
+
+
+CFrameBufferArena::CFrameBufferArena(const FrameBufferArenaConfig& config):
+	m_bufferCount(config.bufferCount),
+	m_lowWaterBuffers(config.lowWaterBuffers)
+{
+	if (config.bufferSize == 0 || config.bufferCount == 0)
+		throw std::runtime_error("Frame buffer arena needs a buffer size and count > 0");
+
+	m_bufferSize = RoundUp(config.bufferSize, FrameBufferPageSize());
+
+	m_memory = FrameBufferMemoryAllocate(m_bufferSize * m_bufferCount, config.largePages, config.numaLocal);
+
+	m_free.reserve(m_bufferCount);
+	for (size_t i = m_bufferCount; i > 0; --i)
+		m_free.push_back(i - 1);
+
+	DbgLog((LOG_TRACE, 1, TEXT("CFrameBufferArena(): %zu buffers of %zu bytes, %zu bytes in total, large pages: %d"),
+		m_bufferCount, m_bufferSize, m_memory.size, m_memory.largePages));
+}
+
+
+CFrameBufferArena::~CFrameBufferArena()
+{
+	// Memory which is still in use would be pulled out from under the user
+	assert(m_inUse == 0);
+
+	FrameBufferMemoryFree(m_memory);
+}
+
+
+void* CFrameBufferArena::Acquire(size_t size)
+{
+	if (size > m_bufferSize)
+		throw std::runtime_error("Requested frame buffer is larger than the arena's buffers");
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_free.empty())
+	{
+		++m_starved;
+		return nullptr;
+	}
+
+	const size_t index = m_free.back();
+	m_free.pop_back();
+
+	++m_acquired;
+	if (m_free.size() <= m_lowWaterBuffers)
+		++m_pressured;
+
+	const size_t inUse = ++m_inUse;
+	if (inUse > m_highWater)
+		m_highWater = inUse;
+
+	return m_memory.data + index * m_bufferSize;
+}
+
+
+void CFrameBufferArena::Release(void* buffer)
+{
+	if (!Owns(buffer))
+		throw std::runtime_error("Frame buffer is not from this arena");
+
+	const size_t offset = (uint8_t*)buffer - m_memory.data;
+	assert(offset % m_bufferSize == 0);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	assert(m_free.size() < m_bufferCount);
+	assert(std::find(m_free.begin(), m_free.end(), offset / m_bufferSize) == m_free.end());
+
+	m_free.push_back(offset / m_bufferSize);
+	--m_inUse;
+}
+
+
+bool CFrameBufferArena::Owns(const void* buffer) const
+{
+	const uint8_t* p = (const uint8_t*)buffer;
+	return p >= m_memory.data && p < m_memory.data + m_bufferSize * m_bufferCount;
+}
+
+
+FrameBufferArenaStats CFrameBufferArena::Stats() const
+{
+	FrameBufferArenaStats stats;
+
+	stats.bufferSize = m_bufferSize;
+	stats.bufferCount = m_bufferCount;
+	stats.largePages = m_memory.largePages;
+	stats.inUse = m_inUse;
+	stats.highWater = m_highWater;
+	stats.acquired = m_acquired;
+	stats.pressured = m_pressured;
+	stats.starved = m_starved;
+
+	return stats;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include <FrameBufferMemory.h>
+
+
+struct FrameBufferArenaConfig
+{
+	// Bytes per buffer, rounded up to whole pages
+	size_t bufferSize = 0;
+
+	size_t bufferCount = 0;
+
+	// Back with large pages, which needs the lock pages in memory privilege.
+	// Falls back to normal pages if they can't be had.
+	bool largePages = false;
+
+	// Place it on the NUMA node of the thread which makes it
+	bool numaLocal = false;
+
+	// Taking a buffer which leaves this many or less free counts as pressure
+	size_t lowWaterBuffers = 1;
+};
+
+
+// Use of an arena, or of several added up
+struct FrameBufferArenaStats
+{
+	size_t bufferSize = 0;
+	size_t bufferCount = 0;
+	bool largePages = false;
+
+	// Buffers handed out right now and the most there ever were at once
+	size_t inUse = 0;
+	size_t highWater = 0;
+
+	// Buffers handed out, those which left the arena at its low water mark and
+	// the requests which found it empty
+	uint64_t acquired = 0;
+	uint64_t pressured = 0;
+	uint64_t starved = 0;
+};
+
+
+/**
+ * Fixed amount of equally sized frame buffers in one page aligned allocation.
+ *
+ * Made once up front so that nothing is allocated while capturing, every buffer starts on a page of its own
+ * which is what DMA and the SIMD formatters like. Buffers which were released last are handed out first as
+ * they are the most likely to still be in cache.
+ *
+ * When empty it does not grow, Acquire() returns nullptr and counts as starved so that the owner can fall back
+ * and the arena can be sized up next time. Thread safe.
+ */
+class CFrameBufferArena
+{
+public:
+
+	CFrameBufferArena(const FrameBufferArenaConfig&);
+	~CFrameBufferArena();
+
+	CFrameBufferArena(const CFrameBufferArena&) = delete;
+	CFrameBufferArena& operator= (const CFrameBufferArena&) = delete;
+
+	// Buffer of at least size bytes, nullptr if none are free. Throws if size is over the buffer size.
+	void* Acquire(size_t size);
+
+	// Give back a buffer from Acquire(), throws if it isn't from this arena
+	void Release(void* buffer);
+
+	// Buffer is from this arena
+	bool Owns(const void* buffer) const;
+
+	size_t BufferSize() const { return m_bufferSize; }
+	size_t BufferCount() const { return m_bufferCount; }
+	bool LargePages() const { return m_memory.largePages; }
+	size_t InUse() const { return m_inUse; }
+
+	FrameBufferArenaStats Stats() const;
+
+private:
+
+	const size_t m_bufferCount;
+	const size_t m_lowWaterBuffers;
+	size_t m_bufferSize;
+	FrameBufferMemory m_memory;
+
+	// Indices of the free buffers, the top is handed out next
+	std::mutex m_mutex;
+	std::vector<size_t> m_free;
+
+	std::atomic<size_t> m_inUse{ 0 };
+	std::atomic<size_t> m_highWater{ 0 };
+	std::atomic<uint64_t> m_acquired{ 0 };
+	std::atomic<uint64_t> m_pressured{ 0 };
+	std::atomic<uint64_t> m_starved{ 0 };
+};
@@ -0,0 +1,85 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <stdexcept>
+
+#include "FrameBufferMemory.h"
+
+
+static size_t RoundUp(size_t value, size_t multiple)
+{
+	return ((value + multiple - 1) / multiple) * multiple;
+}
+
+
+static void* Allocate(size_t size, DWORD allocationType, bool numaLocal)
+{
+	if (numaLocal)
+	{
+		PROCESSOR_NUMBER processor;
+		GetCurrentProcessorNumberEx(&processor);
+
+		USHORT node;
+		if (GetNumaProcessorNodeEx(&processor, &node))
+			return VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, allocationType, PAGE_READWRITE, node);
+	}
+
+	return VirtualAlloc(nullptr, size, allocationType, PAGE_READWRITE);
+}
+
+
+FrameBufferMemory FrameBufferMemoryAllocate(size_t size, bool largePages, bool numaLocal)
+{
+	if (size == 0)
+		throw std::runtime_error("Frame buffer memory size must be > 0");
+
+	FrameBufferMemory memory;
+
+	// Large pages are all or nothing for the whole allocation
+	const size_t largePageSize = largePages ? GetLargePageMinimum() : 0;
+	if (largePageSize > 0)
+	{
+		memory.size = RoundUp(size, largePageSize);
+		memory.data = (uint8_t*)Allocate(memory.size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, numaLocal);
+		memory.largePages = (memory.data != nullptr);
+
+		if (!memory.data)
+			DbgLog((LOG_TRACE, 1, TEXT("FrameBufferMemoryAllocate(): Large pages not available (%lu), using normal pages"), GetLastError()));
+	}
+
+	if (!memory.data)
+	{
+		memory.size = RoundUp(size, FrameBufferPageSize());
+		memory.data = (uint8_t*)Allocate(memory.size, MEM_RESERVE | MEM_COMMIT, numaLocal);
+	}
+
+	if (!memory.data)
+		throw std::runtime_error("Failed to allocate frame buffer memory");
+
+	return memory;
+}
+
+
+void FrameBufferMemoryFree(FrameBufferMemory& memory)
+{
+	if (memory.data)
+		VirtualFree(memory.data, 0, MEM_RELEASE);
+
+	memory = FrameBufferMemory();
+}
+
+
+size_t FrameBufferPageSize()
+{
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+
+	return systemInfo.dwPageSize;
+}
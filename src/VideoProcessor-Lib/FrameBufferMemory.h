@@ -0,0 +1,32 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+
+// Page aligned memory for frame buffers, straight from the OS
+struct FrameBufferMemory
+{
+	uint8_t* data = nullptr;
+	size_t size = 0;  // Rounded up to whole (large) pages
+	bool largePages = false;
+};
+
+
+// Large pages if asked for and allowed, else normal pages. On the NUMA node of the calling thread's
+// processor if numaLocal, else wherever the OS likes. Throws if there is no memory.
+FrameBufferMemory FrameBufferMemoryAllocate(size_t size, bool largePages, bool numaLocal);
+
+// Idempotent
+void FrameBufferMemoryFree(FrameBufferMemory&);
+
+// Bytes in a normal page
+size_t FrameBufferPageSize();
@@ -0,0 +1,358 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "FrameBufferPool.h"
+
+
+static size_t RoundUp(size_t value, size_t multiple)
+{
+	return ((value + multiple - 1) / multiple) * multiple;
+}
+
+
+// A single buffer of a layout, these don't move for as long as the pool lives
+struct FrameBufferSlot
+{
+	CFrameBufferPool* pool = nullptr;
+	const FrameBufferLayout* layout = nullptr;
+	CMpmcRingBuffer<FrameBufferSlot*>* free = nullptr;
+	uint8_t* data = nullptr;
+};
+
+
+// All buffers of a layout and the ones which are free
+struct CFrameBufferPool::Layout
+{
+	Layout(const FrameBufferLayout& layout, size_t maxBuffers):
+		layout(layout),
+		slots(new FrameBufferSlot[maxBuffers]),
+		free(maxBuffers)
+	{
+	}
+
+	~Layout()
+	{
+		for (FrameBufferMemory& slab : slabs)
+			FrameBufferMemoryFree(slab);
+	}
+
+	const FrameBufferLayout layout;
+
+	// Slots up to the count have a buffer, only grows under the pool's lock
+	std::unique_ptr<FrameBufferSlot[]> slots;
+	size_t slotCount = 0;
+	std::vector<FrameBufferMemory> slabs;
+
+	CMpmcRingBuffer<FrameBufferSlot*> free;
+};
+
+
+//
+// FrameBufferLayout
+//
+
+
+FrameBufferLayout::FrameBufferLayout(size_t size, size_t alignment):
+	alignment(alignment)
+{
+	planeSizes[0] = size;
+}
+
+
+size_t FrameBufferLayout::PlaneOffset(size_t plane) const
+{
+	assert(plane < FRAME_BUFFER_MAX_PLANES);
+
+	size_t offset = 0;
+	for (size_t i = 0; i < plane; ++i)
+	{
+		if (planeSizes[i] > 0)
+			offset = RoundUp(offset, alignment) + planeSizes[i];
+	}
+
+	return RoundUp(offset, alignment);
+}
+
+
+size_t FrameBufferLayout::Size() const
+{
+	return PlaneOffset(FRAME_BUFFER_MAX_PLANES - 1) + RoundUp(planeSizes[FRAME_BUFFER_MAX_PLANES - 1], alignment);
+}
+
+
+bool FrameBufferLayout::operator == (const FrameBufferLayout& other) const
+{
+	return
+		alignment == other.alignment &&
+		std::equal(planeSizes, planeSizes + FRAME_BUFFER_MAX_PLANES, other.planeSizes);
+}
+
+
+bool FrameBufferLayout::operator != (const FrameBufferLayout& other) const
+{
+	return !(*this == other);
+}
+
+
+//
+// CFrameBuffer
+//
+
+
+CFrameBuffer::CFrameBuffer(CFrameBuffer&& frameBuffer):
+	m_slot(frameBuffer.m_slot)
+{
+	frameBuffer.m_slot = nullptr;
+}
+
+
+CFrameBuffer& CFrameBuffer::operator= (CFrameBuffer&& frameBuffer)
+{
+	if (this != &frameBuffer)
+	{
+		Reset();
+
+		m_slot = frameBuffer.m_slot;
+		frameBuffer.m_slot = nullptr;
+	}
+
+	return *this;
+}
+
+
+uint8_t* CFrameBuffer::Data() const
+{
+	return m_slot ? m_slot->data : nullptr;
+}
+
+
+uint8_t* CFrameBuffer::Plane(size_t plane) const
+{
+	if (!m_slot || m_slot->layout->planeSizes[plane] == 0)
+		return nullptr;
+
+	return m_slot->data + m_slot->layout->PlaneOffset(plane);
+}
+
+
+const FrameBufferLayout& CFrameBuffer::Layout() const
+{
+	static const FrameBufferLayout noLayout;
+
+	return m_slot ? *m_slot->layout : noLayout;
+}
+
+
+void CFrameBuffer::Reset()
+{
+	if (m_slot)
+	{
+		m_slot->pool->Recycle(m_slot);
+		m_slot = nullptr;
+	}
+}
+
+
+void* CFrameBuffer::Detach()
+{
+	FrameBufferSlot* slot = m_slot;
+	m_slot = nullptr;
+
+	return slot;
+}
+
+
+CFrameBuffer CFrameBuffer::Attach(void* detached)
+{
+	return CFrameBuffer((FrameBufferSlot*)detached);
+}
+
+
+//
+// CFrameBufferPool
+//
+
+
+CFrameBufferPool::CFrameBufferPool(const FrameBufferPoolConfig& config):
+	m_config(config),
+	m_layouts(new std::unique_ptr<Layout>[config.maxLayouts])
+{
+	if (config.slabBuffers == 0 || config.maxBuffersPerLayout == 0 || config.maxLayouts == 0)
+		throw std::runtime_error("Frame buffer pool slab size, maximum buffers and layouts must be > 0");
+}
+
+
+CFrameBufferPool::~CFrameBufferPool()
+{
+	// Memory which is still in use would be pulled out from under the user
+	assert(m_inUse == 0);
+}
+
+
+CFrameBuffer CFrameBufferPool::Get(const FrameBufferLayout& layout)
+{
+	if (layout.alignment < 64 || layout.alignment > FrameBufferPageSize() || (layout.alignment & (layout.alignment - 1)) != 0)
+		throw std::runtime_error("Frame buffer alignment must be a power of two from 64 up to the page size");
+
+	if (layout.Size() == 0)
+		throw std::runtime_error("Frame buffer needs at least one plane");
+
+	Layout* bufferLayout = FindLayout(layout);
+	FrameBufferSlot* slot;
+
+	if (bufferLayout && bufferLayout->free.Pop(slot))
+	{
+		++m_hits;
+		return CFrameBuffer(Acquired(slot));
+	}
+
+	++m_misses;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!bufferLayout)
+	{
+		// Might have been added while waiting for the lock
+		bufferLayout = FindLayout(layout);
+		if (!bufferLayout)
+		{
+			const size_t layoutCount = m_layoutCount.load(std::memory_order_relaxed);
+			if (layoutCount >= m_config.maxLayouts)
+				return CFrameBuffer();
+
+			m_layouts[layoutCount].reset(new Layout(layout, m_config.maxBuffersPerLayout));
+			bufferLayout = m_layouts[layoutCount].get();
+			m_layoutCount.store(layoutCount + 1, std::memory_order_release);
+		}
+	}
+
+	// Might have been given back while waiting for the lock
+	if (bufferLayout->free.Pop(slot))
+		return CFrameBuffer(Acquired(slot));
+
+	try
+	{
+		slot = Grow(*bufferLayout);
+	}
+	catch (const std::runtime_error&)
+	{
+		DbgLog((LOG_TRACE, 1, TEXT("CFrameBufferPool::Get(): Failed to allocate a slab of %zu bytes buffers"), layout.Size()));
+		return CFrameBuffer();
+	}
+
+	return slot ? CFrameBuffer(Acquired(slot)) : CFrameBuffer();
+}
+
+
+FrameBufferPoolStats CFrameBufferPool::Stats() const
+{
+	FrameBufferPoolStats stats;
+
+	stats.hits = m_hits;
+	stats.misses = m_misses;
+	stats.layouts = m_layoutCount;
+	stats.buffers = m_buffers;
+	stats.bytes = m_bytes;
+	stats.inUse = m_inUse;
+	stats.highWater = m_highWater;
+
+	return stats;
+}
+
+
+CFrameBufferPool& CFrameBufferPool::Shared()
+{
+	static CFrameBufferPool pool;
+	return pool;
+}
+
+
+CFrameBufferPool::Layout* CFrameBufferPool::FindLayout(const FrameBufferLayout& layout) const
+{
+	const size_t layoutCount = m_layoutCount.load(std::memory_order_acquire);
+	for (size_t i = 0; i < layoutCount; ++i)
+	{
+		if (m_layouts[i]->layout == layout)
+			return m_layouts[i].get();
+	}
+
+	return nullptr;
+}
+
+
+FrameBufferSlot* CFrameBufferPool::Grow(Layout& layout)
+{
+	// WARNING: Call with the lock held
+
+	if (layout.slotCount >= m_config.maxBuffersPerLayout)
+		return nullptr;
+
+	const size_t stride = layout.layout.Size();
+	const size_t buffers = std::min(m_config.slabBuffers, m_config.maxBuffersPerLayout - layout.slotCount);
+
+	FrameBufferMemory slab = FrameBufferMemoryAllocate(stride * buffers, m_config.largePages, m_config.numaLocal);
+	layout.slabs.push_back(slab);
+
+	m_buffers += buffers;
+	m_bytes += slab.size;
+
+	FrameBufferSlot* first = nullptr;
+	for (size_t i = 0; i < buffers; ++i)
+	{
+		FrameBufferSlot* slot = &layout.slots[layout.slotCount++];
+		slot->pool = this;
+		slot->layout = &layout.layout;
+		slot->free = &layout.free;
+		slot->data = slab.data + i * stride;
+
+		if (!first)
+		{
+			first = slot;
+		}
+		else
+		{
+			const bool pushed = layout.free.Push(slot);
+			assert(pushed);
+		}
+	}
+
+	DbgLog((LOG_TRACE, 1, TEXT("CFrameBufferPool::Grow(): %zu buffers of %zu bytes, large pages: %d, %zu of this layout now"),
+		buffers, stride, slab.largePages, layout.slotCount));
+
+	return first;
+}
+
+
+FrameBufferSlot* CFrameBufferPool::Acquired(FrameBufferSlot* slot)
+{
+	const size_t inUse = ++m_inUse;
+
+	size_t highWater = m_highWater.load(std::memory_order_relaxed);
+	while (inUse > highWater && !m_highWater.compare_exchange_weak(highWater, inUse, std::memory_order_relaxed))
+	{
+	}
+
+	return slot;
+}
+
+
+void CFrameBufferPool::Recycle(FrameBufferSlot* slot)
+{
+	assert(slot->pool == this);
+
+	// Always room, the queue can hold all buffers of the layout
+	const bool pushed = slot->free->Push(slot);
+	assert(pushed);
+
+	--m_inUse;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <FrameBufferMemory.h>
+#include <MpmcRingBuffer.h>
+
+
+static const size_t FRAME_BUFFER_MAX_PLANES = 4;
+
+
+// Planes of a frame buffer, in one piece of memory with every plane starting at the alignment
+struct FrameBufferLayout
+{
+	FrameBufferLayout() = default;
+
+	// Single plane
+	FrameBufferLayout(size_t size, size_t alignment = 64);
+
+	// Bytes per plane, 0 for planes which aren't there
+	size_t planeSizes[FRAME_BUFFER_MAX_PLANES] = {};
+
+	// Power of two from 64 up to the page size
+	size_t alignment = 64;
+
+	// Where the plane starts in the buffer
+	size_t PlaneOffset(size_t plane) const;
+
+	// All planes, including the alignment padding
+	size_t Size() const;
+
+	bool operator == (const FrameBufferLayout& other) const;
+	bool operator != (const FrameBufferLayout& other) const;
+};
+
+
+struct FrameBufferPoolConfig
+{
+	// Buffers of a layout are made this many at a time, in one slab
+	size_t slabBuffers = 2;
+
+	// Most buffers of a single layout there can be, and the most different layouts
+	size_t maxBuffersPerLayout = 64;
+	size_t maxLayouts = 32;
+
+	// Back slabs with large pages if allowed
+	bool largePages = false;
+
+	// Place slabs on the NUMA node of the thread which asks for them
+	bool numaLocal = true;
+};
+
+
+struct FrameBufferPoolStats
+{
+	// Buffers which were recycled, and requests which needed a new slab or got nothing
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+	size_t layouts = 0;
+	size_t buffers = 0;
+	size_t bytes = 0;
+
+	// Buffers handed out right now and the most there ever were at once
+	size_t inUse = 0;
+	size_t highWater = 0;
+};
+
+
+class CFrameBufferPool;
+struct FrameBufferSlot;
+
+
+/**
+ * Buffer from a CFrameBufferPool, goes back to the pool when destroyed. Move-only.
+ */
+class CFrameBuffer
+{
+public:
+
+	// No buffer
+	CFrameBuffer() {}
+
+	CFrameBuffer(CFrameBuffer&&);
+	CFrameBuffer& operator= (CFrameBuffer&&);
+
+	CFrameBuffer(const CFrameBuffer&) = delete;
+	CFrameBuffer& operator= (const CFrameBuffer&) = delete;
+
+	~CFrameBuffer() { Reset(); }
+
+	explicit operator bool() const { return m_slot != nullptr; }
+
+	// Start of the first plane, nullptr if no buffer
+	uint8_t* Data() const;
+	uint8_t* Plane(size_t plane) const;
+
+	const FrameBufferLayout& Layout() const;
+	size_t Size() const { return Layout().Size(); }
+
+	// Give the buffer back to the pool now
+	void Reset();
+
+	// Let go of the buffer without giving it back, for handing it to code which can only hold
+	// a pointer, like the opaque of an ffmpeg buffer. Attach() it again to give it back.
+	void* Detach();
+	static CFrameBuffer Attach(void* detached);
+
+private:
+
+	friend class CFrameBufferPool;
+
+	explicit CFrameBuffer(FrameBufferSlot* slot) : m_slot(slot) {}
+
+	FrameBufferSlot* m_slot = nullptr;
+};
+
+
+/**
+ * Frame buffers for the formatters and the stages in between, kept apart per layout and recycled.
+ *
+ * A layout which is asked for the first time gets a slab of a few buffers, more slabs are added when all
+ * of them are in use, up to the maximum for a layout. That is a miss, after which the same buffers go
+ * around without any allocation, which is a hit. Buffers are given back and handed out lock-free from any
+ * thread, only a miss takes a lock. Slabs are page aligned (large pages if allowed) and stay until the pool
+ * is destroyed, so a renderer rebuild or a mode change back and forth costs no allocations either.
+ *
+ * Shared() is the pool for the whole process, all buffers need to be back before a pool is destroyed.
+ */
+class CFrameBufferPool
+{
+public:
+
+	CFrameBufferPool(const FrameBufferPoolConfig& = FrameBufferPoolConfig());
+	~CFrameBufferPool();
+
+	CFrameBufferPool(const CFrameBufferPool&) = delete;
+	CFrameBufferPool& operator= (const CFrameBufferPool&) = delete;
+
+	// Buffer with the layout, no buffer if there are already the maximum amount of layouts or
+	// buffers of this layout, or no memory. Throws if the layout is invalid.
+	CFrameBuffer Get(const FrameBufferLayout&);
+
+	// Can be called from any thread
+	FrameBufferPoolStats Stats() const;
+
+	static CFrameBufferPool& Shared();
+
+private:
+
+	friend class CFrameBuffer;
+
+	struct Layout;
+
+	const FrameBufferPoolConfig m_config;
+
+	// Layouts are only added, under the lock, and are read without it up to the count
+	std::mutex m_mutex;
+	std::unique_ptr<std::unique_ptr<Layout>[]> m_layouts;
+	std::atomic<size_t> m_layoutCount{ 0 };
+
+	std::atomic<uint64_t> m_hits{ 0 };
+	std::atomic<uint64_t> m_misses{ 0 };
+	std::atomic<size_t> m_buffers{ 0 };
+	std::atomic<size_t> m_bytes{ 0 };
+	std::atomic<size_t> m_inUse{ 0 };
+	std::atomic<size_t> m_highWater{ 0 };
+
+	Layout* FindLayout(const FrameBufferLayout&) const;
+
+	// Add a slab to the layout and take a buffer from it, call with the lock held
+	FrameBufferSlot* Grow(Layout&);
+
+	// Buffer is handed out
+	FrameBufferSlot* Acquired(FrameBufferSlot*);
+
+	void Recycle(FrameBufferSlot*);
+};
@@ -0,0 +1,58 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include "FrameDropReason.h"
+
+
+const TCHAR* ToString(const FrameDropReason frameDropReason)
+{
+	switch (frameDropReason)
+	{
+	case FrameDropReason::FRAMEDROP_OVERFLOW:
+		return TEXT("Overflow");
+
+	case FrameDropReason::FRAMEDROP_REORDER:
+		return TEXT("Reorder");
+
+	case FrameDropReason::FRAMEDROP_LATE:
+		return TEXT("Late");
+
+	case FrameDropReason::FRAMEDROP_RESET:
+		return TEXT("Reset");
+
+	case FrameDropReason::FRAMEDROP_FAILED:
+		return TEXT("Failed");
+	}
+
+	throw std::runtime_error("FrameDropReason ToString() failed, value not recognized");
+}
+
+
+CFrameDropCounter::CFrameDropCounter()
+{
+	Reset();
+}
+
+
+uint64_t CFrameDropCounter::Total() const
+{
+	uint64_t total = 0;
+	for (const std::atomic<uint64_t>& count : m_counts)
+		total += count;
+
+	return total;
+}
+
+
+void CFrameDropCounter::Reset()
+{
+	for (std::atomic<uint64_t>& count : m_counts)
+		count = 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <atlstr.h>
+#include <atomic>
+#include <stdint.h>
+
+
+/**
+ * Why a renderer did not deliver a frame it was given
+ */
+enum class FrameDropReason
+{
+	// Arrived at a full queue, either it or a queued frame had to make way
+	FRAMEDROP_OVERFLOW,
+
+	// Timestamp not later than that of the frame queued before it, which is dropped
+	FRAMEDROP_REORDER,
+
+	// Waited too long to be worth delivering while there was a newer frame queued
+	FRAMEDROP_LATE,
+
+	// Still queued when the queue was purged on a reset or a stop
+	FRAMEDROP_RESET,
+
+	// No buffer to be had or could not be formatted
+	FRAMEDROP_FAILED,
+
+	// Number of reasons, not a reason itself
+	FRAMEDROP_REASONS
+};
+
+
+const TCHAR* ToString(const FrameDropReason);
+
+
+/**
+ * Dropped frame counts per reason, can be counted and read from any thread.
+ */
+class CFrameDropCounter
+{
+public:
+
+	CFrameDropCounter();
+
+	void Add(FrameDropReason reason)
+	{
+		++m_counts[(size_t)reason];
+	}
+
+	uint64_t Count(FrameDropReason reason) const
+	{
+		return m_counts[(size_t)reason];
+	}
+
+	// All reasons together
+	uint64_t Total() const;
+
+	void Reset();
+
+private:
+
+	std::atomic<uint64_t> m_counts[(size_t)FrameDropReason::FRAMEDROP_REASONS];
+};
@@ -0,0 +1,433 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include <FrameDropReason.h>
+#include <FrameQueueBudget.h>
+#include <FrameQueueDropPolicy.h>
+#include <ITimingClock.h>
+#include <PipelineTrace.h>
+#include <SpscRingBuffer.h>
+
+
+/**
+ * Gets back the buffers of the frames a CFrameQueue drops.
+ */
+template<class Buffer>
+class IFrameQueueCallback
+{
+public:
+
+	virtual ~IFrameQueueCallback() {}
+
+	// A frame which will not be delivered, give its buffer back. Called from whichever side dropped it.
+	virtual void OnFrameQueueRelease(Buffer buffer) = 0;
+};
+
+
+/**
+ * Queue of formatted frames between the capture callback and a delivery thread, with the drop rules
+ * every renderer's frame queue follows.
+ *
+ * Frames are pushed by the capture callback (the producer) and taken by the delivery (the consumer),
+ * which sleeps until there are enough frames for the timestamp method. On the way:
+ * - A frame with a timestamp which is not after the one queued before it supersedes that one.
+ * - A frame arriving at a queue which is full, in frames or in bytes, gets the drop policy to pick what makes space.
+ * - A frame about to be delivered can be dropped by the policy if it's too late and there is a newer one.
+ * Every drop releases the buffer to the callback, is counted by reason and traced.
+ *
+ * The buffer is whatever the frame was formatted into, a media sample for the live source pin or a frame
+ * buffer for the headless renderer. There are never more frames queued than the capacity it's opened with,
+ * which is what the owner has buffers for.
+ *
+ * The lock only guards opening, closing, resizing and the producer side, the consumer never takes it other than
+ * through the ring when the producer takes back frames.
+ */
+template<class Buffer>
+class CFrameQueue
+{
+public:
+
+	// A formatted frame waiting for delivery and what's needed from the video frame to timestamp it
+	struct Frame
+	{
+		Buffer buffer;
+		uint64_t counter;
+		timingclocktime_t timingTimestamp;
+		timingclocktime_t queuedTime;
+	};
+
+	CFrameQueue(IFrameQueueCallback<Buffer>& callback, CFrameDropCounter& droppedFrames):
+		m_callback(callback),
+		m_droppedFrames(droppedFrames),
+		m_dropPolicy(CreateFrameQueueDropPolicy(FrameQueueDropPolicyConfig()))
+	{
+	}
+
+	~CFrameQueue()
+	{
+		Purge();
+	}
+
+	CFrameQueue(const CFrameQueue&) = delete;
+	CFrameQueue& operator= (const CFrameQueue&) = delete;
+
+	//
+	// Settings
+	//
+
+	// The delivery needs the frame after the one it delivers, like clock-clock timestamps do.
+	// It keeps one more frame queued and waits for the next one. Only when not open.
+	void SetNeedsNextFrame(bool needsNextFrame)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_isOpen)
+			throw std::runtime_error("Frame queue delivery can only be changed when not open");
+
+		m_needsNextFrame = needsNextFrame;
+		m_budget.SetMinimumFrames(MinimumQueued());
+	}
+
+	// Frames which need to be queued before delivering the oldest one
+	uint32_t MinimumQueued() const { return m_needsNextFrame ? 2 : 1; }
+
+	// Frames the queue may hold, must be > 0. If open the oldest frames over it are dropped.
+	void SetMaxFrames(size_t maxFrames)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_budget.SetMaxFrames(maxFrames);
+
+		if (!m_ring)
+			return;
+
+		Frame frame;
+		while (m_budget.IsFull(m_ring->Size()))
+		{
+			if (m_ring->DropFront(frame))
+				DropQueuedFrame(frame, FrameDropReason::FRAMEDROP_OVERFLOW);
+		}
+	}
+
+	// Bytes the queue may hold and the bytes every frame is counted at, see CFrameQueueBudget.
+	// Only when not open, the buffers and the queue are sized from them.
+	void SetMaxBytes(size_t maxBytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_isOpen)
+			throw std::runtime_error("Frame queue max bytes can only be set when not open");
+
+		m_budget.SetMaxBytes(maxBytes);
+	}
+
+	void SetFrameBytes(size_t frameBytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_isOpen)
+			throw std::runtime_error("Frame queue frame bytes can only be set when not open");
+
+		m_budget.SetFrameBytes(frameBytes);
+	}
+
+	// Most frames the queue may hold under both limits
+	size_t FrameLimit() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_budget.FrameLimit();
+	}
+
+	// Only when not open, the consumer uses it without the lock
+	void SetDropPolicy(const FrameQueueDropPolicyConfig& dropPolicyConfig)
+	{
+		std::unique_ptr<IFrameQueueDropPolicy> dropPolicy = CreateFrameQueueDropPolicy(dropPolicyConfig);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_isOpen)
+			throw std::runtime_error("Frame queue drop policy can only be set when not open");
+
+		m_dropPolicy = std::move(dropPolicy);
+	}
+
+	//
+	// Control
+	//
+
+	// Start taking frames, at most capacity of them. The clock is what the timing timestamps are in.
+	void Open(uint32_t capacity, ITimingClock* timingClock)
+	{
+		if (!timingClock)
+			throw std::runtime_error("Frame queue needs a timing clock");
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_isOpen)
+			throw std::runtime_error("Frame queue already open");
+
+		// Replaced only while there is no consumer
+		m_ring.reset(new CSpscRingBuffer<Frame>(capacity));
+		m_timingClock = timingClock;
+		m_isOpen = true;
+	}
+
+	// Stop taking frames and wake up the consumer, queued frames stay until Purge()
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_isOpen = false;
+
+		if (m_ring)
+			m_ring->Close();
+	}
+
+	bool IsOpen() const { return m_isOpen.load(std::memory_order_acquire); }
+
+	// Drop all queued frames
+	void Purge()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_ring)
+			return;
+
+		Frame frame;
+		while (m_ring->DropFront(frame))
+			DropQueuedFrame(frame, FrameDropReason::FRAMEDROP_RESET);
+	}
+
+	size_t Size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_ring)
+			return 0;
+
+		return m_ring->Size();
+	}
+
+	size_t Bytes() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_ring)
+			return 0;
+
+		return m_budget.Bytes(m_ring->Size());
+	}
+
+	//
+	// Producer
+	//
+
+	// Queue a formatted frame, dropping what it supersedes or what the policy picks if full.
+	// Returns false if the frame itself was not queued, its buffer has been released then.
+	bool Push(const Frame& incomingFrame)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// Might have been closed while formatting
+		if (!m_isOpen)
+		{
+			m_callback.OnFrameQueueRelease(incomingFrame.buffer);
+			return false;
+		}
+
+		CSpscRingBuffer<Frame>& ring = *m_ring;
+		Frame frame;
+
+		// If this frame's timestamp is lower or equal to the one before it,
+		// erase that earlier one
+		while (ring.PeekBack(frame))
+		{
+			// Previous one was younger, nothing to do
+			if (incomingFrame.timingTimestamp > frame.timingTimestamp)
+				break;
+
+			// Previous one was older or equal, erase. Can fail if it just got delivered.
+			if (ring.PopBack(frame))
+				DropQueuedFrame(frame, FrameDropReason::FRAMEDROP_REORDER);
+		}
+
+		// If full, in frames or in bytes, let the policy pick what makes space
+		while (ring.Size() >= std::min((size_t)ring.Capacity(), m_budget.FrameLimit()))
+		{
+			// Can fail if the last one just got delivered
+			Frame oldestFrame, newestFrame;
+			if (!ring.PeekFront(oldestFrame) || !ring.PeekBack(newestFrame))
+				continue;
+
+			switch (m_dropPolicy->OnOverflow(incomingFrame.counter, oldestFrame.counter, newestFrame.counter))
+			{
+			case FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_INCOMING:
+				m_callback.OnFrameQueueRelease(incomingFrame.buffer);
+				m_droppedFrames.Add(FrameDropReason::FRAMEDROP_OVERFLOW);
+				PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, incomingFrame.counter);
+				return false;
+
+			case FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_NEWEST:
+				if (ring.PopBack(frame))
+					DropQueuedFrame(frame, FrameDropReason::FRAMEDROP_OVERFLOW);
+				break;
+
+			case FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_OLDEST:
+				if (ring.DropFront(frame))
+					DropQueuedFrame(frame, FrameDropReason::FRAMEDROP_OVERFLOW);
+				break;
+			}
+		}
+
+		// Traced before the push as the consumer can pop it right after
+		PipelineTrace::Record(PipelineTraceStage::QUEUE, PipelineTracePhase::ASYNC_BEGIN, incomingFrame.counter);
+
+		if (!ring.PushBack(incomingFrame))
+			throw std::runtime_error("Frame queue full after making space");
+
+		return true;
+	}
+
+	// Drop the oldest queued frame and hand its buffer out to format into rather than release it,
+	// for when the owner has run out of buffers. Returns false if there is none.
+	bool TakeOldestBuffer(Buffer& buffer)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		Frame frame;
+		if (!m_isOpen || !m_ring || !m_ring->DropFront(frame))
+			return false;
+
+		m_droppedFrames.Add(FrameDropReason::FRAMEDROP_OVERFLOW);
+		PipelineTrace::Record(PipelineTraceStage::QUEUE, PipelineTracePhase::ASYNC_END, frame.counter);
+		PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, frame.counter);
+
+		buffer = frame.buffer;
+		return true;
+	}
+
+	//
+	// Consumer
+	//
+
+	// Sleep until there is a frame to deliver and take it off the queue, nextFrame is the one after it
+	// if hasNextFrame. Frames the policy drops on the way are released. Returns false once closed.
+	bool WaitForNext(Frame& frame, Frame& nextFrame, bool& hasNextFrame)
+	{
+		// Only replaced while there is no consumer
+		CSpscRingBuffer<Frame>& ring = *m_ring;
+
+		while (ring.WaitForSize(MinimumQueued()))
+		{
+			// Get the front frame (oldest), can fail if the producer dropped frames since waking up
+			if (!ring.PopFront(frame))
+				continue;
+
+			PipelineTrace::Record(PipelineTraceStage::QUEUE, PipelineTracePhase::ASYNC_END, frame.counter);
+
+			hasNextFrame = ring.PeekFront(nextFrame);
+
+			// The next one can have been superseded by a newer one since waking up, wait for that
+			if (m_needsNextFrame)
+			{
+				while (!hasNextFrame && ring.WaitForSize(1))
+					hasNextFrame = ring.PeekFront(nextFrame);
+			}
+
+			// Closed while waiting for the next frame
+			if (ring.IsClosed())
+			{
+				m_callback.OnFrameQueueRelease(frame.buffer);
+				return false;
+			}
+
+			if (!DropLate(frame, hasNextFrame))
+				return true;
+		}
+
+		return false;
+	}
+
+	// Same as WaitForNext() minus the waiting, for driving the delivery from a simulated clock.
+	// Returns false if there are not enough frames queued for one to be delivered.
+	bool TakeNext(Frame& frame, Frame& nextFrame, bool& hasNextFrame)
+	{
+		if (!m_ring)
+			return false;
+
+		CSpscRingBuffer<Frame>& ring = *m_ring;
+
+		while (ring.Size() >= MinimumQueued())
+		{
+			if (!ring.PopFront(frame))
+				return false;
+
+			PipelineTrace::Record(PipelineTraceStage::QUEUE, PipelineTracePhase::ASYNC_END, frame.counter);
+
+			hasNextFrame = ring.PeekFront(nextFrame);
+
+			if (!DropLate(frame, hasNextFrame))
+				return true;
+		}
+
+		return false;
+	}
+
+private:
+
+	IFrameQueueCallback<Buffer>& m_callback;
+	CFrameDropCounter& m_droppedFrames;
+
+	CFrameQueueBudget m_budget;
+	std::unique_ptr<IFrameQueueDropPolicy> m_dropPolicy;
+	bool m_needsNextFrame = false;
+	ITimingClock* m_timingClock = nullptr;
+
+	// Created on open, the capture callback is the producer and the delivery the consumer
+	std::unique_ptr<CSpscRingBuffer<Frame>> m_ring;
+	std::atomic<bool> m_isOpen{ false };
+
+	// Guards opening, closing, resizing and the producer side of the ring
+	mutable std::mutex m_mutex;
+
+	// Release a queued frame which will not be delivered
+	void DropQueuedFrame(const Frame& frame, FrameDropReason reason)
+	{
+		m_callback.OnFrameQueueRelease(frame.buffer);
+		m_droppedFrames.Add(reason);
+
+		PipelineTrace::Record(PipelineTraceStage::QUEUE, PipelineTracePhase::ASYNC_END, frame.counter);
+		PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, frame.counter);
+	}
+
+	// Might not be worth delivering anymore if there is a newer one, returns true if released
+	bool DropLate(const Frame& frame, bool hasNextFrame)
+	{
+		const double ageMs = TimingClockDiffMs(
+			frame.timingTimestamp, m_timingClock->TimingClockNow(), m_timingClock->TimingClockTicksPerSecond());
+
+		if (!m_dropPolicy->OnDequeue(ageMs, hasNextFrame))
+			return false;
+
+		m_callback.OnFrameQueueRelease(frame.buffer);
+		m_droppedFrames.Add(FrameDropReason::FRAMEDROP_LATE);
+		PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, frame.counter);
+
+		return true;
+	}
+};
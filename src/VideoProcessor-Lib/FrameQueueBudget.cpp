@@ -0,0 +1,60 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+
+#include "FrameQueueBudget.h"
+
+
+void CFrameQueueBudget::SetMaxFrames(size_t maxFrames)
+{
+	if (maxFrames == 0)
+		throw std::runtime_error("Frame queue size must be > 0");
+
+	m_maxFrames = maxFrames;
+	UpdateFrameLimit();
+}
+
+
+void CFrameQueueBudget::SetMaxBytes(size_t maxBytes)
+{
+	m_maxBytes = maxBytes;
+	UpdateFrameLimit();
+}
+
+
+void CFrameQueueBudget::SetFrameBytes(size_t frameBytes)
+{
+	m_frameBytes = frameBytes;
+	UpdateFrameLimit();
+}
+
+
+void CFrameQueueBudget::SetMinimumFrames(size_t minimumFrames)
+{
+	if (minimumFrames == 0)
+		throw std::runtime_error("Minimum frames must be > 0");
+
+	m_minimumFrames = minimumFrames;
+	UpdateFrameLimit();
+}
+
+
+void CFrameQueueBudget::UpdateFrameLimit()
+{
+	m_frameLimit = m_maxFrames;
+
+	// Without knowing the frame size there is nothing to count bytes with
+	if (m_maxBytes > 0 && m_frameBytes > 0)
+		m_frameLimit = std::min(m_frameLimit, m_maxBytes / m_frameBytes);
+
+	// A queue which can't hold what delivery waits for would never deliver
+	m_frameLimit = std::max(m_frameLimit, std::min(m_minimumFrames, m_maxFrames));
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stddef.h>
+
+
+/**
+ * How much a frame queue may hold, in frames and in bytes.
+ *
+ * The same amount of frames takes very different amounts of memory depending on the input, a 2160p R12B frame
+ * is about 9 times a 1080p UYVY one. The queue is full as soon as either limit is reached. Queued frames are
+ * counted at the out frame size of the formatter which made them, which is the same for every frame of
+ * a renderer but not the captured size, R12B to RGB48 for example grows every frame by a third.
+ *
+ * Not thread safe, guard it like the queue it is for.
+ */
+class CFrameQueueBudget
+{
+public:
+
+	// Frames the queue may hold, must be > 0
+	void SetMaxFrames(size_t maxFrames);
+	size_t MaxFrames() const { return m_maxFrames; }
+
+	// Bytes the queue may hold, 0 (default) is no byte limit
+	void SetMaxBytes(size_t maxBytes);
+	size_t MaxBytes() const { return m_maxBytes; }
+
+	// Bytes every queued frame is counted at, IVideoFrameFormatter::GetOutFrameSize()
+	void SetFrameBytes(size_t frameBytes);
+	size_t FrameBytes() const { return m_frameBytes; }
+
+	// Frames which are allowed regardless of the byte limit, the frames the delivery needs queued
+	// before it delivers one. Defaults to 1.
+	void SetMinimumFrames(size_t minimumFrames);
+
+	// Most frames the queue may hold under both limits
+	size_t FrameLimit() const { return m_frameLimit; }
+
+	// True if the queue with this many frames has no room for another one
+	bool IsFull(size_t queuedFrames) const { return queuedFrames >= m_frameLimit; }
+
+	// Bytes taken by this many queued frames
+	size_t Bytes(size_t queuedFrames) const { return queuedFrames * m_frameBytes; }
+
+	// True if it's the byte limit which keeps the frame limit below the max frames
+	bool IsByteBound() const { return m_frameLimit < m_maxFrames; }
+
+private:
+
+	size_t m_maxFrames = 1;
+	size_t m_maxBytes = 0;
+	size_t m_frameBytes = 0;
+	size_t m_minimumFrames = 1;
+
+	size_t m_frameLimit = 1;
+
+	void UpdateFrameLimit();
+};
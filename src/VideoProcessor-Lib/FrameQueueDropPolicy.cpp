@@ -0,0 +1,167 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <stdexcept>
+
+#include "FrameQueueDropPolicy.h"
+
+
+const TCHAR* ToString(const FrameQueueDropPolicyType frameQueueDropPolicyType)
+{
+	switch (frameQueueDropPolicyType)
+	{
+	case FrameQueueDropPolicyType::FRAMEQUEUEDROP_OLDEST:
+		return TEXT("Drop oldest");
+
+	case FrameQueueDropPolicyType::FRAMEQUEUEDROP_NEWEST:
+		return TEXT("Drop newest");
+
+	case FrameQueueDropPolicyType::FRAMEQUEUEDROP_LATENCY_BOUNDED:
+		return TEXT("Latency bounded");
+
+	case FrameQueueDropPolicyType::FRAMEQUEUEDROP_CADENCE:
+		return TEXT("Cadence preserving");
+	}
+
+	throw std::runtime_error("FrameQueueDropPolicyType ToString() failed, value not recognized");
+}
+
+
+std::unique_ptr<IFrameQueueDropPolicy> CreateFrameQueueDropPolicy(const FrameQueueDropPolicyConfig& config)
+{
+	switch (config.type)
+	{
+	case FrameQueueDropPolicyType::FRAMEQUEUEDROP_OLDEST:
+		return std::unique_ptr<IFrameQueueDropPolicy>(new CDropOldestFrameQueueDropPolicy());
+
+	case FrameQueueDropPolicyType::FRAMEQUEUEDROP_NEWEST:
+		return std::unique_ptr<IFrameQueueDropPolicy>(new CDropNewestFrameQueueDropPolicy());
+
+	case FrameQueueDropPolicyType::FRAMEQUEUEDROP_LATENCY_BOUNDED:
+		return std::unique_ptr<IFrameQueueDropPolicy>(new CLatencyBoundedFrameQueueDropPolicy(config.latencyBoundMs));
+
+	case FrameQueueDropPolicyType::FRAMEQUEUEDROP_CADENCE:
+		return std::unique_ptr<IFrameQueueDropPolicy>(new CCadenceFrameQueueDropPolicy(config.cadence, config.cadencePhase));
+	}
+
+	throw std::runtime_error("Unknown frame queue drop policy");
+}
+
+
+//
+// Drop oldest
+//
+
+
+FrameQueueOverflowAction CDropOldestFrameQueueDropPolicy::OnOverflow(uint64_t, uint64_t, uint64_t) const
+{
+	return FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_OLDEST;
+}
+
+
+bool CDropOldestFrameQueueDropPolicy::OnDequeue(double, bool) const
+{
+	return false;
+}
+
+
+//
+// Drop newest
+//
+
+
+FrameQueueOverflowAction CDropNewestFrameQueueDropPolicy::OnOverflow(uint64_t, uint64_t, uint64_t) const
+{
+	return FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_INCOMING;
+}
+
+
+bool CDropNewestFrameQueueDropPolicy::OnDequeue(double, bool) const
+{
+	return false;
+}
+
+
+//
+// Latency bounded
+//
+
+
+CLatencyBoundedFrameQueueDropPolicy::CLatencyBoundedFrameQueueDropPolicy(double latencyBoundMs):
+	m_latencyBoundMs(latencyBoundMs)
+{
+	if (!(latencyBoundMs > 0.0))
+		throw std::runtime_error("Latency bound must be > 0");
+}
+
+
+FrameQueueOverflowAction CLatencyBoundedFrameQueueDropPolicy::OnOverflow(uint64_t, uint64_t, uint64_t) const
+{
+	return FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_OLDEST;
+}
+
+
+bool CLatencyBoundedFrameQueueDropPolicy::OnDequeue(double ageMs, bool hasNewerFrame) const
+{
+	return hasNewerFrame && ageMs > m_latencyBoundMs;
+}
+
+
+//
+// Cadence
+//
+
+
+CCadenceFrameQueueDropPolicy::CCadenceFrameQueueDropPolicy(const std::vector<unsigned int>& cadence, uint64_t cadencePhase)
+{
+	for (const unsigned int frames : cadence)
+	{
+		if (frames == 0)
+			throw std::runtime_error("Every source frame in the cadence needs at least one frame");
+
+		// First is the source frame itself, the rest repeat it
+		m_repeats.push_back(false);
+		m_repeats.insert(m_repeats.end(), frames - 1, true);
+	}
+
+	if (m_repeats.empty())
+		throw std::runtime_error("Cadence cannot be empty");
+
+	m_cadencePhase = cadencePhase % m_repeats.size();
+}
+
+
+FrameQueueOverflowAction CCadenceFrameQueueDropPolicy::OnOverflow(uint64_t incomingCounter, uint64_t oldestCounter, uint64_t newestCounter) const
+{
+	if (IsRepeat(incomingCounter))
+		return FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_INCOMING;
+
+	if (IsRepeat(oldestCounter))
+		return FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_OLDEST;
+
+	if (IsRepeat(newestCounter))
+		return FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_NEWEST;
+
+	// No repeat to spare, the cadence breaks either way so keep latency low
+	return FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_OLDEST;
+}
+
+
+bool CCadenceFrameQueueDropPolicy::OnDequeue(double, bool) const
+{
+	return false;
+}
+
+
+bool CCadenceFrameQueueDropPolicy::IsRepeat(uint64_t counter) const
+{
+	const uint64_t cycle = m_repeats.size();
+	return m_repeats[(size_t)((counter % cycle + cycle - m_cadencePhase) % cycle)];
+}
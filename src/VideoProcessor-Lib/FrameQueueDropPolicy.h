@@ -0,0 +1,166 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <atlstr.h>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+
+enum class FrameQueueDropPolicyType
+{
+	// Make way for a new frame by dropping the oldest queued one, keeps latency lowest (default)
+	FRAMEQUEUEDROP_OLDEST,
+
+	// Drop the new frame and keep what is queued, delivery never skips ahead
+	FRAMEQUEUEDROP_NEWEST,
+
+	// Drop the oldest when full and on delivery drop frames older than the bound if there is a newer one
+	FRAMEQUEUEDROP_LATENCY_BOUNDED,
+
+	// Drop the repeated frames of a pulldown cadence before any other
+	FRAMEQUEUEDROP_CADENCE
+};
+
+
+const TCHAR* ToString(const FrameQueueDropPolicyType);
+
+
+struct FrameQueueDropPolicyConfig
+{
+	FrameQueueDropPolicyType type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_OLDEST;
+
+	// Latency bounded: time since capture after which a frame is not worth delivering
+	double latencyBoundMs = 50.0;
+
+	// Cadence: frames per source frame in a cycle, { 3, 2 } is 3:2 pulldown of 24p in 60p,
+	// and the counter of a frame which starts a cycle.
+	std::vector<unsigned int> cadence = { 3, 2 };
+	uint64_t cadencePhase = 0;
+};
+
+
+// What to drop when a frame arrives at a full queue
+enum class FrameQueueOverflowAction
+{
+	// The frame at the front of the queue, which would be delivered next
+	FRAMEQUEUEOVERFLOW_DROP_OLDEST,
+
+	// The frame at the back of the queue, which was queued last
+	FRAMEQUEUEOVERFLOW_DROP_NEWEST,
+
+	// The arriving frame
+	FRAMEQUEUEOVERFLOW_DROP_INCOMING
+};
+
+
+/**
+ * Decides which frames a renderer's frame queue drops.
+ *
+ * The queue asks when a frame arrives while it is full and right before it delivers a frame. Frames with a timestamp
+ * which is not after the one queued before them are always dropped, that is not up to the policy.
+ * Policies hold no state, they are called from both the capture and the delivery thread.
+ */
+class IFrameQueueDropPolicy
+{
+public:
+
+	virtual ~IFrameQueueDropPolicy() {}
+
+	// The frame with the incoming counter arrived at a full queue which has the oldest and newest at its ends
+	virtual FrameQueueOverflowAction OnOverflow(uint64_t incomingCounter, uint64_t oldestCounter, uint64_t newestCounter) const = 0;
+
+	// The frame about to be delivered was captured ageMs ago, return true to drop it instead.
+	// hasNewerFrame is true if there is another frame queued behind it.
+	virtual bool OnDequeue(double ageMs, bool hasNewerFrame) const = 0;
+};
+
+
+// Build the policy of the config, throws if the config is not valid
+std::unique_ptr<IFrameQueueDropPolicy> CreateFrameQueueDropPolicy(const FrameQueueDropPolicyConfig&);
+
+
+/**
+ * Drops the oldest queued frame, the queue always holds the latest frames.
+ */
+class CDropOldestFrameQueueDropPolicy:
+	public IFrameQueueDropPolicy
+{
+public:
+
+	FrameQueueOverflowAction OnOverflow(uint64_t incomingCounter, uint64_t oldestCounter, uint64_t newestCounter) const override;
+	bool OnDequeue(double ageMs, bool hasNewerFrame) const override;
+};
+
+
+/**
+ * Drops the arriving frame, every queued frame gets delivered at the cost of skipping what comes next.
+ */
+class CDropNewestFrameQueueDropPolicy:
+	public IFrameQueueDropPolicy
+{
+public:
+
+	FrameQueueOverflowAction OnOverflow(uint64_t incomingCounter, uint64_t oldestCounter, uint64_t newestCounter) const override;
+	bool OnDequeue(double ageMs, bool hasNewerFrame) const override;
+};
+
+
+/**
+ * Drops the oldest queued frame, and on delivery skips frames which are older than the bound.
+ *
+ * A late frame is only dropped if there is a newer one to deliver instead, so a renderer which is slower than
+ * the bound still gets the latest frame there is rather than nothing at all.
+ */
+class CLatencyBoundedFrameQueueDropPolicy:
+	public IFrameQueueDropPolicy
+{
+public:
+
+	CLatencyBoundedFrameQueueDropPolicy(double latencyBoundMs);
+
+	FrameQueueOverflowAction OnOverflow(uint64_t incomingCounter, uint64_t oldestCounter, uint64_t newestCounter) const override;
+	bool OnDequeue(double ageMs, bool hasNewerFrame) const override;
+
+private:
+
+	const double m_latencyBoundMs;
+};
+
+
+/**
+ * Keeps a pulldown cadence like 3:2 intact by dropping a repeat of a source frame before anything else.
+ *
+ * With the frames timestamped from their capture times the renderer shows the frame before a dropped repeat
+ * for as long as the repeat would have been, which is the same picture, so a dropped repeat is not seen.
+ * The repeats are found by their position in the cadence, counted from the frame counter which includes
+ * missed frames. The first frame of a source frame is only dropped if neither the arriving frame nor
+ * the ones at the ends of the queue are repeats.
+ */
+class CCadenceFrameQueueDropPolicy:
+	public IFrameQueueDropPolicy
+{
+public:
+
+	CCadenceFrameQueueDropPolicy(const std::vector<unsigned int>& cadence, uint64_t cadencePhase);
+
+	FrameQueueOverflowAction OnOverflow(uint64_t incomingCounter, uint64_t oldestCounter, uint64_t newestCounter) const override;
+	bool OnDequeue(double ageMs, bool hasNewerFrame) const override;
+
+	// True if the frame shows the same source frame as the one before it
+	bool IsRepeat(uint64_t counter) const;
+
+private:
+
+	// Per position in the cycle
+	std::vector<bool> m_repeats;
+	uint64_t m_cadencePhase;
+};
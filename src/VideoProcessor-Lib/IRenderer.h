@@ -9,6 +9,9 @@
 #pragma once
 
 
+#include <FrameDropReason.h>
+#include <FrameQueueDropPolicy.h>
+#include <LatencyHistogram.h>
 #include <VideoFrame.h>
 #include <VideoState.h>
 
@@ -97,6 +100,15 @@ public:
 	// Window needs repainting
 	virtual void OnPaint() = 0;
 
+	//
+	// Formatting
+	//
+
+	// Set the amount of threads a video frame is formatted with, 1 (default) formats on the delivery thread only.
+	// More threads split the frame in stripes which are formatted by a pool of threads pinned to their own core.
+	// Must be called before Build()
+	virtual void SetFormatterThreads(unsigned int) = 0;
+
 	//
 	// Queues
 	//
@@ -106,11 +118,27 @@ public:
 	// Queues might not be implemented by all renderers, this will throw if it cannot be set
 	virtual void SetFrameQueueMaxSize(size_t) = 0;
 
+	// Set which frames the video frame queue drops when it's full and which it drops rather than deliver,
+	// drop oldest by default. Renderers without a queue ignore it.
+	// Must be called before Build()
+	virtual void SetFrameQueueDropPolicy(const FrameQueueDropPolicyConfig&) = 0;
+
+	// Set the most bytes the video frame queue may hold, frames are counted at their size after formatting.
+	// The drop policy is applied when either this or the max size is reached, 0 (default) is no byte limit.
+	// Renderers without a queue ignore it.
+	// Must be called before Build()
+	virtual void SetFrameQueueMaxBytes(size_t) = 0;
+
 	// Get the current frame queue size, negative means no queue
 	// Only valid te be called if the RendererState called back RENDERSTATE_RENDERING
 	// Queues might not be implemented by all renderers, this will return 0 if there is no queueing possible.
 	virtual size_t GetFrameQueueSize() = 0;
 
+	// Get the bytes the frames in the queue take right now
+	// Only valid te be called if the RendererState called back RENDERSTATE_RENDERING
+	// Queues might not be implemented by all renderers, this will return 0 if there is no queueing possible.
+	virtual size_t GetFrameQueueBytes() = 0;
+
 	//
 	// Metrics
 	//
@@ -127,6 +155,12 @@ public:
 	// Only valid te be called if the RendererState called back RENDERSTATE_RENDERING
 	virtual double ExitLatencyMs() const = 0;
 
-	// Get the amount of dropped frames due to queue actions
+	// Get the histograms of the latencies of every frame through the renderer, these live as long as
+	// the renderer and can be read from any thread at any time.
+	virtual const RendererLatencyHistograms& LatencyHistograms() const = 0;
+
+	// Get the amount of dropped frames due to queue actions, in total or for one reason.
+	// Counted for as long as the renderer lives, frames dropped by Reset() included.
 	virtual uint64_t DroppedFrameCount() const = 0;
+	virtual uint64_t DroppedFrameCount(FrameDropReason) const = 0;
 };
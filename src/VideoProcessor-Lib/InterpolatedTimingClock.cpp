@@ -0,0 +1,304 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <math.h>
+#include <stdexcept>
+
+#include "InterpolatedTimingClock.h"
+
+
+CInterpolatedTimingClock::CInterpolatedTimingClock(ITimingClock& referenceClock, ITimingClock& localClock, unsigned int sampleIntervalMs):
+	m_referenceClock(referenceClock),
+	m_localClock(localClock),
+	m_sampleIntervalMs(sampleIntervalMs),
+	m_description(CString(referenceClock.TimingClockDescription()) + TEXT(" (interpolated)")),
+	m_nominalSlope((double)referenceClock.TimingClockTicksPerSecond() / localClock.TimingClockTicksPerSecond())
+{
+	if (sampleIntervalMs < 1)
+		throw std::runtime_error("Sample interval needs to be at least a millisecond");
+}
+
+
+CInterpolatedTimingClock::~CInterpolatedTimingClock()
+{
+	Stop();
+}
+
+
+void CInterpolatedTimingClock::Start()
+{
+	if (m_samplingThread.joinable())
+		throw std::runtime_error("Already started");
+
+	Reset();
+	Sample();
+
+	m_samplingStop = false;
+	m_samplingThread = std::thread(&CInterpolatedTimingClock::SamplingThreadProc, this);
+}
+
+
+void CInterpolatedTimingClock::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_samplingMutex);
+		m_samplingStop = true;
+	}
+
+	m_samplingCondition.notify_all();
+
+	if (m_samplingThread.joinable())
+		m_samplingThread.join();
+
+	Reset();
+}
+
+
+bool CInterpolatedTimingClock::Sample()
+{
+	// The reference read is somewhere in between the local reads
+	const timingclocktime_t localBefore = m_localClock.TimingClockNow();
+	const timingclocktime_t reference = m_referenceClock.TimingClockNow();
+	const timingclocktime_t localAfter = m_localClock.TimingClockNow();
+
+	ClockSample sample;
+	sample.local = localBefore + (localAfter - localBefore) / 2;
+	sample.reference = reference;
+	sample.readTicks = localAfter - localBefore;
+	sample.errorTicks = 0;
+
+	// How far off was the current fit
+	timingclocktime_t localBase, referenceBase;
+	double slope;
+	const bool hasFit = ReadFit(localBase, referenceBase, slope);
+	if (hasFit)
+		sample.errorTicks = std::abs(referenceBase + (timingclocktime_t)llround(slope * (sample.local - localBase)) - reference);
+
+	// Reads which got interrupted say little about when the reference was read,
+	// what's fast is going by the recent reads so that an odd fast one doesn't hold forever.
+	m_readTicks.push_back(std::max(sample.readTicks, (timingclocktime_t)1));
+	while (m_readTicks.size() > SAMPLE_WINDOW)
+		m_readTicks.pop_front();
+
+	const timingclocktime_t fastestReadTicks = *std::min_element(m_readTicks.begin(), m_readTicks.end());
+
+	if (sample.readTicks > 4 * fastestReadTicks)
+	{
+		++m_rejectedSampleCount;
+
+		// Not checked for a while, a slow read is better than nothing to tell how far off the fit is
+		if (++m_rejectedInRow >= STALE_SAMPLES && hasFit)
+		{
+			const double errorMs =
+				TimingClockDiffMs(0, sample.errorTicks, m_referenceClock.TimingClockTicksPerSecond()) +
+				TimingClockDiffMs(0, sample.readTicks / 2, m_localClock.TimingClockTicksPerSecond());
+
+			if (errorMs > m_errorMs.load(std::memory_order_relaxed))
+				m_errorMs.store(errorMs, std::memory_order_relaxed);
+		}
+
+		return false;
+	}
+
+	++m_sampleCount;
+	m_rejectedInRow = 0;
+
+	if (hasFit && sample.errorTicks > RESET_MS * m_referenceClock.TimingClockTicksPerSecond() / 1000)
+	{
+		DbgLog((LOG_TRACE, 1, TEXT("CInterpolatedTimingClock::Sample(): Reference clock jumped %I64d ticks, starting over"), sample.errorTicks));
+
+		Reset();
+		m_readTicks.push_back(std::max(sample.readTicks, (timingclocktime_t)1));
+		sample.errorTicks = 0;
+	}
+
+	m_samples.push_back(sample);
+	while (m_samples.size() > SAMPLE_WINDOW)
+		m_samples.pop_front();
+
+	//
+	// Least squares fit relative to the newest sample, keeps the numbers small
+	//
+
+	const ClockSample& newest = m_samples.back();
+
+	double meanX = 0.0, meanY = 0.0;
+	for (const ClockSample& s : m_samples)
+	{
+		meanX += (double)(s.local - newest.local);
+		meanY += (double)(s.reference - newest.reference);
+	}
+	meanX /= m_samples.size();
+	meanY /= m_samples.size();
+
+	double sxx = 0.0, sxy = 0.0;
+	for (const ClockSample& s : m_samples)
+	{
+		const double dx = (s.local - newest.local) - meanX;
+		const double dy = (s.reference - newest.reference) - meanY;
+		sxx += dx * dx;
+		sxy += dx * dy;
+	}
+
+	// A single sample, or all at the same local time, has nothing to go by but the tick rates
+	const double newSlope = (sxx > 0.0) ? sxy / sxx : m_nominalSlope;
+
+	// Base the new fit at now, not behind where the previous fit is now
+	const timingclocktime_t now = m_localClock.TimingClockNow();
+	timingclocktime_t newReferenceBase = newest.reference + (timingclocktime_t)llround(meanY + newSlope * ((now - newest.local) - meanX));
+	if (ReadFit(localBase, referenceBase, slope))
+		newReferenceBase = std::max(newReferenceBase, referenceBase + (timingclocktime_t)llround(slope * (now - localBase)));
+
+	PublishFit(now, newReferenceBase, newSlope);
+
+	//
+	// Error
+	//
+
+	timingclocktime_t errorTicks = 0;
+	timingclocktime_t readTicks = 0;
+	for (const ClockSample& s : m_samples)
+	{
+		errorTicks = std::max(errorTicks, s.errorTicks);
+		readTicks = std::max(readTicks, s.readTicks);
+	}
+
+	const double errorMs =
+		TimingClockDiffMs(0, errorTicks, m_referenceClock.TimingClockTicksPerSecond()) +
+		TimingClockDiffMs(0, readTicks / 2, m_localClock.TimingClockTicksPerSecond());
+	m_errorMs.store(errorMs, std::memory_order_relaxed);
+
+	return true;
+}
+
+
+void CInterpolatedTimingClock::Reset()
+{
+	m_samples.clear();
+	m_readTicks.clear();
+	m_rejectedInRow = 0;
+	m_errorMs.store(0.0, std::memory_order_relaxed);
+
+	// Readers in the middle of a read will see the sequence change and try again
+	m_fitSequence.store(0, std::memory_order_release);
+}
+
+
+double CInterpolatedTimingClock::ErrorMs() const
+{
+	return m_errorMs.load(std::memory_order_relaxed);
+}
+
+
+double CInterpolatedTimingClock::RateOffsetPpm() const
+{
+	timingclocktime_t localBase, referenceBase;
+	double slope;
+	if (!ReadFit(localBase, referenceBase, slope))
+		return 0.0;
+
+	return (slope / m_nominalSlope - 1.0) * 1000000.0;
+}
+
+
+//
+// ITimingClock
+//
+
+
+timingclocktime_t CInterpolatedTimingClock::TimingClockNow()
+{
+	timingclocktime_t localBase, referenceBase;
+	double slope;
+	if (!ReadFit(localBase, referenceBase, slope))
+		return m_referenceClock.TimingClockNow();
+
+	const timingclocktime_t local = m_localClock.TimingClockNow();
+
+	return referenceBase + (timingclocktime_t)llround(slope * (local - localBase));
+}
+
+
+timingclocktime_t CInterpolatedTimingClock::TimingClockTicksPerSecond() const
+{
+	return m_referenceClock.TimingClockTicksPerSecond();
+}
+
+
+const TCHAR* CInterpolatedTimingClock::TimingClockDescription()
+{
+	return m_description;
+}
+
+
+//
+// Private
+//
+
+
+void CInterpolatedTimingClock::SamplingThreadProc()
+{
+	DbgLog((LOG_TRACE, 1, TEXT("CInterpolatedTimingClock sampling thread starting")));
+
+	std::unique_lock<std::mutex> lock(m_samplingMutex);
+
+	while (!m_samplingCondition.wait_for(lock, std::chrono::milliseconds(m_sampleIntervalMs), [this] { return m_samplingStop; }))
+	{
+		lock.unlock();
+		Sample();
+		lock.lock();
+	}
+
+	DbgLog((LOG_TRACE, 1, TEXT("CInterpolatedTimingClock sampling thread exiting")));
+}
+
+
+bool CInterpolatedTimingClock::ReadFit(timingclocktime_t& localBase, timingclocktime_t& referenceBase, double& slope) const
+{
+	while (true)
+	{
+		const uint32_t sequence = m_fitSequence.load(std::memory_order_acquire);
+		if (sequence == 0)
+			return false;
+
+		// Being written
+		if (sequence & 1)
+			continue;
+
+		localBase = m_fitLocalBase.load(std::memory_order_relaxed);
+		referenceBase = m_fitReferenceBase.load(std::memory_order_relaxed);
+		slope = m_fitSlope.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_fitSequence.load(std::memory_order_relaxed) == sequence)
+			return true;
+	}
+}
+
+
+void CInterpolatedTimingClock::PublishFit(timingclocktime_t localBase, timingclocktime_t referenceBase, double slope)
+{
+	// Only one writer, a published fit has an even sequence which is never 0
+	uint32_t sequence = m_fitSequence.load(std::memory_order_relaxed);
+	if (sequence == 0)
+		sequence = 2;
+
+	m_fitSequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	m_fitLocalBase.store(localBase, std::memory_order_relaxed);
+	m_fitReferenceBase.store(referenceBase, std::memory_order_relaxed);
+	m_fitSlope.store(slope, std::memory_order_relaxed);
+
+	// Skip 0 on wrap
+	m_fitSequence.store((sequence + 2 == 0) ? 2 : sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <ITimingClock.h>
+
+
+/**
+ * Timing clock which reads a cheap local clock and maps that onto an expensive reference clock,
+ * like a capture card's hardware clock which has to go through the driver for every read.
+ *
+ * Sample() reads both clocks together, the last SAMPLE_WINDOW samples are fitted to a line which
+ * TimingClockNow() extrapolates along from the local clock. Once started a thread samples at the
+ * given interval, without a fit yet the reference clock is read directly.
+ *
+ * A new fit never puts the time back from where the previous one was at that moment, unless
+ * the reference clock jumped by more than RESET_MS in which case it starts over.
+ *
+ * Reads of the reference which took much longer than the fastest of the last SAMPLE_WINDOW reads are
+ * rejected, so a single fast read only holds for a window. ErrorMs() is how far the fit was off from the
+ * reference clock at the worst of the samples in the window, before they went into the fit, plus the
+ * uncertainty of reading the reference. Once STALE_SAMPLES reads in a row were rejected the fit has not
+ * been checked for that long, and how far off it was at those reads counts as well.
+ */
+class CInterpolatedTimingClock:
+	public ITimingClock
+{
+public:
+
+	// Samples the fit is made from
+	static const size_t SAMPLE_WINDOW = 16;
+
+	// A reference clock this far off from the fit has jumped, start over
+	static const int RESET_MS = 2;
+
+	// Rejected reads in a row after which the error is taken from them
+	static const size_t STALE_SAMPLES = 4;
+
+	CInterpolatedTimingClock(ITimingClock& referenceClock, ITimingClock& localClock, unsigned int sampleIntervalMs = 50);
+	virtual ~CInterpolatedTimingClock();
+
+	// Start and stop the sampling thread, starting takes a first sample on the calling thread
+	void Start();
+	void Stop();
+
+	// Read both clocks and update the fit. Once started the sampling thread calls this, don't call it yourself then.
+	// Returns false if the sample was rejected because the reference read took too long.
+	bool Sample();
+
+	// Throw away the fit and samples, TimingClockNow() reads the reference clock until the next sample.
+	// Not while started, Start() and Stop() do this already.
+	void Reset();
+
+	// Worst error of the fit against the reference clock in the current samples
+	double ErrorMs() const;
+
+	// Rate of the reference clock against what the tick rates say, in ppm
+	double RateOffsetPpm() const;
+
+	uint64_t SampleCount() const { return m_sampleCount.load(std::memory_order_relaxed); }
+	uint64_t RejectedSampleCount() const { return m_rejectedSampleCount.load(std::memory_order_relaxed); }
+
+	// ITimingClock
+	timingclocktime_t TimingClockNow() override;
+	timingclocktime_t TimingClockTicksPerSecond() const override;
+	const TCHAR* TimingClockDescription() override;
+
+private:
+
+	ITimingClock& m_referenceClock;
+	ITimingClock& m_localClock;
+	const unsigned int m_sampleIntervalMs;
+	const CString m_description;
+
+	// Reference ticks per local tick going by the tick rates
+	const double m_nominalSlope;
+
+	struct ClockSample
+	{
+		timingclocktime_t local;      // Middle of the reference read
+		timingclocktime_t reference;
+		timingclocktime_t readTicks;  // Local ticks the reference read took
+		timingclocktime_t errorTicks; // Reference ticks the fit was off before this sample
+	};
+
+	// Fit published to TimingClockNow() under a sequence lock, odd while being written and 0 if there is none.
+	// reference = referenceBase + slope * (local - localBase)
+	std::atomic<uint32_t> m_fitSequence = { 0 };
+	std::atomic<timingclocktime_t> m_fitLocalBase = { 0 };
+	std::atomic<timingclocktime_t> m_fitReferenceBase = { 0 };
+	std::atomic<double> m_fitSlope = { 0.0 };
+
+	std::atomic<double> m_errorMs = { 0.0 };
+	std::atomic<uint64_t> m_sampleCount = { 0 };
+	std::atomic<uint64_t> m_rejectedSampleCount = { 0 };
+
+	// Sampling state, only touched by whoever calls Sample()
+	std::deque<ClockSample> m_samples;
+	std::deque<timingclocktime_t> m_readTicks;  // Last SAMPLE_WINDOW reads, rejected ones included
+	size_t m_rejectedInRow = 0;
+
+	// Sampling thread
+	std::thread m_samplingThread;
+	std::mutex m_samplingMutex;
+	std::condition_variable m_samplingCondition;
+	bool m_samplingStop = false;
+
+	void SamplingThreadProc();
+
+	// Read the published fit, returns false if there is none
+	bool ReadFit(timingclocktime_t& localBase, timingclocktime_t& referenceBase, double& slope) const;
+	void PublishFit(timingclocktime_t localBase, timingclocktime_t referenceBase, double slope);
+};
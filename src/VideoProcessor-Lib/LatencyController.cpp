@@ -0,0 +1,64 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <math.h>
+#include <stdexcept>
+
+#include "LatencyController.h"
+
+
+CLatencyController::CLatencyController(const LatencyControllerConfig& config, int frameOffsetMs):
+	m_config(config),
+	m_frameOffsetMs(frameOffsetMs)
+{
+	if (config.maxStepUpMs <= 0 || config.maxStepDownMs <= 0)
+		throw std::runtime_error("Latency controller steps must be > 0");
+
+	if (!(config.smoothing > 0.0 && config.smoothing <= 1.0))
+		throw std::runtime_error("Latency controller smoothing must be in (0, 1]");
+}
+
+
+bool CLatencyController::Update(const LatencyHistogramSummary& exitLatency)
+{
+	if (exitLatency.count < std::max(m_config.minimumFrames, (uint64_t)1))
+		return false;
+
+	// The exit latency is measured against the offset timestamps, without the offset
+	// it's the time the frames took to get to the renderer.
+	const double pipelineLatencyMs = exitLatency.p50Ms + m_frameOffsetMs;
+	const double jitterMs = exitLatency.p99Ms - exitLatency.p50Ms;
+
+	if (m_hasEstimate)
+	{
+		m_pipelineLatencyMs += m_config.smoothing * (pipelineLatencyMs - m_pipelineLatencyMs);
+		m_jitterMs += m_config.smoothing * (jitterMs - m_jitterMs);
+	}
+	else
+	{
+		m_pipelineLatencyMs = pipelineLatencyMs;
+		m_jitterMs = jitterMs;
+		m_hasEstimate = true;
+	}
+
+	const int wantedFrameOffsetMs = std::max(m_config.targetDelayMs, MinimumFrameOffsetMs());
+	const int stepMs = std::min(std::max(wantedFrameOffsetMs - m_frameOffsetMs, -m_config.maxStepDownMs), m_config.maxStepUpMs);
+
+	m_frameOffsetMs += stepMs;
+
+	return stepMs != 0;
+}
+
+
+int CLatencyController::MinimumFrameOffsetMs() const
+{
+	return (int)ceil(m_pipelineLatencyMs + m_jitterMs + m_config.minimumLeadMs);
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <LatencyHistogram.h>
+
+
+struct LatencyControllerConfig
+{
+	// Delay from capture to display to hold, which is the frame offset as long as the frames make it in time
+	int targetDelayMs = 90;
+
+	// Lead over the renderer the slow (p99) frames need to keep
+	double minimumLeadMs = 1.0;
+
+	// Most the offset moves in a single update. Going up only holds frames a bit longer,
+	// going down makes them late if overdone so that is slower.
+	int maxStepUpMs = 4;
+	int maxStepDownMs = 1;
+
+	// Weight of a new update in the pipeline latency and jitter estimates, 1 is no smoothing
+	double smoothing = 0.25;
+
+	// Updates with less frames than this are ignored
+	uint64_t minimumFrames = 10;
+};
+
+
+/**
+ * Holds the delay from capture to display at a configured target by steering the frame offset.
+ *
+ * The frame offset moves the frame timestamps into the future so that frames reach the renderer
+ * before they are due, the delay from capture to display then is the offset. Every update takes the
+ * exit latencies of the frames since the last update, estimates how long the pipeline takes up to the
+ * renderer and how much that jitters, and moves the offset towards the target without going below what
+ * the pipeline needs. The offset moves in small steps so that the renderer can keep going without
+ * a reset.
+ *
+ * Has no clock of its own, call Update() at a steady interval like once a second.
+ */
+class CLatencyController
+{
+public:
+
+	CLatencyController(const LatencyControllerConfig&, int frameOffsetMs);
+
+	// Feed the exit latencies of the frames since the previous update, these have to be measured
+	// against timestamps with the offset of the previous update. Returns true if the offset changed.
+	bool Update(const LatencyHistogramSummary& exitLatency);
+
+	// Offset to apply to the frame timestamps
+	int FrameOffsetMs() const { return m_frameOffsetMs; }
+
+	// Estimated time from capture to the renderer for the median frame and the spread up to the p99 frame,
+	// both 0 until the first update with enough frames
+	double PipelineLatencyMs() const { return m_pipelineLatencyMs; }
+	double JitterMs() const { return m_jitterMs; }
+
+	// Estimated lead of the median frame over the renderer with the current offset
+	double LeadMs() const { return m_frameOffsetMs - m_pipelineLatencyMs; }
+
+	// Lowest offset the pipeline can keep up with
+	int MinimumFrameOffsetMs() const;
+
+	const LatencyControllerConfig& Config() const { return m_config; }
+
+private:
+
+	const LatencyControllerConfig m_config;
+
+	int m_frameOffsetMs;
+
+	bool m_hasEstimate = false;
+	double m_pipelineLatencyMs = 0.0;
+	double m_jitterMs = 0.0;
+};
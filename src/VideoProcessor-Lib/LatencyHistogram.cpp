@@ -0,0 +1,174 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <intrin.h>
+#include <math.h>
+#include <stdexcept>
+
+#include "LatencyHistogram.h"
+
+
+//
+// CLatencyHistogram
+//
+
+
+CLatencyHistogram::CLatencyHistogram():
+	m_counts(2 * BUCKET_COUNT)
+{
+}
+
+
+void CLatencyHistogram::Snapshot(LatencyHistogramCounts& counts) const
+{
+	counts.resize(m_counts.size());
+
+	for (size_t i = 0; i < m_counts.size(); i++)
+		counts[i] = m_counts[i].load(std::memory_order_relaxed);
+}
+
+
+LatencyHistogramSummary CLatencyHistogram::Summarize(const LatencyHistogramCounts& from, const LatencyHistogramCounts& to)
+{
+	if (to.size() != 2 * BUCKET_COUNT || (!from.empty() && from.size() != to.size()))
+		throw std::runtime_error("Invalid latency histogram snapshot");
+
+	// Counts can wrap, the difference is still right
+	auto count = [&](size_t i) -> uint32_t { return from.empty() ? to[i] : to[i] - from[i]; };
+
+	LatencyHistogramSummary summary;
+	for (size_t i = 0; i < to.size(); i++)
+		summary.count += count(i);
+
+	if (summary.count == 0)
+		return summary;
+
+	const double percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	double* const percentileMs[] = { &summary.p50Ms, &summary.p90Ms, &summary.p99Ms, &summary.p999Ms };
+
+	bool hasMin = false;
+	size_t percentile = 0;
+	uint64_t seen = 0;
+
+	for (uint32_t i = 0; i < to.size(); i++)
+	{
+		const uint32_t c = count(i);
+		if (c == 0)
+			continue;
+
+		if (!hasMin)
+		{
+			summary.minMs = BucketMs(i);
+			hasMin = true;
+		}
+
+		seen += c;
+
+		// The percentile is in the first bucket which has at least that many of the latencies in it or before it
+		while (percentile < _countof(percentiles) &&
+			   seen >= (uint64_t)ceil(percentiles[percentile] * summary.count))
+		{
+			*percentileMs[percentile] = BucketMs(i);
+			++percentile;
+		}
+
+		summary.maxMs = BucketMs(i);
+	}
+
+	return summary;
+}
+
+
+uint32_t CLatencyHistogram::BucketIndex(double ms)
+{
+	const bool negative = ms < 0.0;
+	const double us = (negative ? -ms : ms) * 1000.0;
+
+	// Written as !(us < max) so that NaN ends up in the last bucket as well
+	const uint32_t maxUs = (1u << MAX_US_BITS) - 1;
+	const uint32_t value = !(us < maxUs) ? maxUs : (uint32_t)us;
+
+	// Up to SUB_BUCKET_COUNT buckets are 1us wide, after that the top SUB_BUCKET_BITS + 1
+	// bits of the value pick the bucket within the power of two.
+	uint32_t magnitudeIndex = value;
+	if (value >= SUB_BUCKET_COUNT)
+	{
+		unsigned long msb;
+		_BitScanReverse(&msb, value);
+
+		const uint32_t shift = msb - SUB_BUCKET_BITS;
+		magnitudeIndex = shift * SUB_BUCKET_COUNT + (value >> shift);
+	}
+
+	return negative ?
+		BUCKET_COUNT - 1 - magnitudeIndex :
+		BUCKET_COUNT + magnitudeIndex;
+}
+
+
+double CLatencyHistogram::BucketMs(uint32_t index)
+{
+	if (index >= 2 * BUCKET_COUNT)
+		throw std::runtime_error("Latency histogram bucket out of range");
+
+	const bool negative = index < BUCKET_COUNT;
+	const uint32_t magnitudeIndex = negative ? (BUCKET_COUNT - 1 - index) : (index - BUCKET_COUNT);
+
+	// Inverse of BucketIndex()
+	uint32_t shift = 0;
+	uint32_t lowestUs = magnitudeIndex;
+	if (magnitudeIndex >= SUB_BUCKET_COUNT)
+	{
+		shift = magnitudeIndex / SUB_BUCKET_COUNT - 1;
+		lowestUs = (magnitudeIndex % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT) << shift;
+	}
+
+	const double middleUs = lowestUs + (1u << shift) / 2.0;
+
+	return (negative ? -middleUs : middleUs) / 1000.0;
+}
+
+
+//
+// CLatencyHistogramWindows
+//
+
+
+CLatencyHistogramWindows::CLatencyHistogramWindows(const CLatencyHistogram& histogram, size_t maxWindowUpdates):
+	m_histogram(histogram),
+	m_snapshots(maxWindowUpdates + 1)
+{
+	if (maxWindowUpdates == 0)
+		throw std::runtime_error("Latency histogram windows need to be at least one update long");
+
+	m_histogram.Snapshot(m_snapshots[m_latest]);
+}
+
+
+void CLatencyHistogramWindows::Update()
+{
+	m_latest = (m_latest + 1) % m_snapshots.size();
+	m_histogram.Snapshot(m_snapshots[m_latest]);
+
+	++m_updates;
+}
+
+
+LatencyHistogramSummary CLatencyHistogramWindows::Summary(size_t windowUpdates) const
+{
+	if (windowUpdates == 0 || windowUpdates >= m_snapshots.size())
+		throw std::runtime_error("Latency histogram window out of range");
+
+	const size_t updates = std::min(windowUpdates, m_updates);
+	const size_t from = (m_latest + m_snapshots.size() - updates) % m_snapshots.size();
+
+	return CLatencyHistogram::Summarize(m_snapshots[from], m_snapshots[m_latest]);
+}
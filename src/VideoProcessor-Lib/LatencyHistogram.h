@@ -0,0 +1,146 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+
+// Bucket counts of a latency histogram, see CLatencyHistogram
+typedef std::vector<uint32_t> LatencyHistogramCounts;
+
+
+// Distribution of the latencies in a histogram or a window of it, all in ms
+struct LatencyHistogramSummary
+{
+	uint64_t count = 0;
+	double minMs = 0.0;
+	double p50Ms = 0.0;
+	double p90Ms = 0.0;
+	double p99Ms = 0.0;
+	double p999Ms = 0.0;
+	double maxMs = 0.0;
+};
+
+
+/**
+ * Log-linear histogram of latencies, for recording every frame without locks or allocations.
+ *
+ * Latencies are kept in microseconds, every power of two range is split into 32 linear buckets
+ * so values are accurate to within about 1.6%. Below 32us buckets are 1us wide and anything over
+ * 16 seconds ends up in the last bucket. Negative latencies, which happen when the frame timestamps
+ * are offset into the future, have buckets of their own.
+ *
+ * Recording is a couple of relaxed loads and stores, there can only be one thread recording
+ * into a histogram at a time. Reading can be done from any thread while recording, counts
+ * only ever go up so the readers work with the difference between two snapshots.
+ */
+class CLatencyHistogram
+{
+public:
+
+	CLatencyHistogram();
+
+	// Record a latency, only to be called from one thread at a time
+	void Record(double ms)
+	{
+		std::atomic<uint32_t>& bucket = m_counts[BucketIndex(ms)];
+		bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+		m_lastMs.store(ms, std::memory_order_relaxed);
+	}
+
+	// Last recorded latency, 0 if there is none
+	double LastMs() const { return m_lastMs.load(std::memory_order_relaxed); }
+
+	// Copy the current counts, the total is lost and an exact set of counts is not guaranteed
+	// while recording, but every count is at least what it was at a previous snapshot.
+	void Snapshot(LatencyHistogramCounts&) const;
+
+	// Get the distribution of the difference between two snapshots, "from" can be empty to
+	// get everything recorded until "to".
+	static LatencyHistogramSummary Summarize(const LatencyHistogramCounts& from, const LatencyHistogramCounts& to);
+
+	// Buckets per power of two, the range of the buckets in microseconds and the amount of buckets per sign
+	static const uint32_t SUB_BUCKET_BITS = 5;
+	static const uint32_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+	static const uint32_t MAX_US_BITS = 24;
+	static const uint32_t BUCKET_COUNT = SUB_BUCKET_COUNT * (MAX_US_BITS - SUB_BUCKET_BITS + 1);
+
+	// Bucket of a latency, buckets are in order of latency with the negative ones
+	// in [0, BUCKET_COUNT) and the others in [BUCKET_COUNT, 2 * BUCKET_COUNT)
+	static uint32_t BucketIndex(double ms);
+
+	// The latency a bucket stands for, which is the middle of its range
+	static double BucketMs(uint32_t index);
+
+private:
+
+	std::vector<std::atomic<uint32_t>> m_counts;
+	std::atomic<double> m_lastMs{ 0.0 };
+};
+
+
+/**
+ * Per frame latencies of a renderer, all in ms and measured against the timing clock.
+ * Stages a renderer does not have stay empty.
+ */
+struct RendererLatencyHistograms
+{
+	// From the capture timestamp to the entry of the renderer
+	CLatencyHistogram entry;
+
+	// Time spent formatting the frame
+	CLatencyHistogram format;
+
+	// Time a formatted frame spent in the queue waiting for delivery
+	CLatencyHistogram queueWait;
+
+	// Time handing the frame over took, which is how long the renderer held up delivery
+	CLatencyHistogram deliver;
+
+	// From the capture timestamp to handing the frame to whatever puts it on the wire
+	CLatencyHistogram exit;
+};
+
+
+/**
+ * Rolling windows over a latency histogram for the reading side.
+ *
+ * Update() takes a snapshot of the histogram, call it at a steady interval (like once a second)
+ * and a window of N updates is the difference between the latest snapshot and the one N updates
+ * before it. Not thread safe, use from the reading thread only.
+ */
+class CLatencyHistogramWindows
+{
+public:
+
+	// Keeps enough snapshots for windows up to maxWindowUpdates long
+	CLatencyHistogramWindows(const CLatencyHistogram&, size_t maxWindowUpdates);
+
+	const CLatencyHistogram& Histogram() const { return m_histogram; }
+
+	// Take a snapshot, this is what moves the windows
+	void Update();
+
+	// Summary of what was recorded over the last windowUpdates updates, or since
+	// construction if there haven't been that many. Throws if longer than the maximum.
+	LatencyHistogramSummary Summary(size_t windowUpdates) const;
+
+private:
+
+	const CLatencyHistogram& m_histogram;
+
+	// Ring of snapshots, the one at m_latest is the newest and the first one is taken on construction
+	std::vector<LatencyHistogramCounts> m_snapshots;
+	size_t m_latest = 0;
+	size_t m_updates = 0;
+};
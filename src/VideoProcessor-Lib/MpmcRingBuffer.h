@@ -0,0 +1,133 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+
+/**
+ * Bounded lock-free ring buffer for any amount of producers and consumers, it never blocks.
+ *
+ * Every slot carries a sequence number which says whether it's ready to be written or read for the
+ * current lap around the ring, a producer or consumer claims a position with a compare-exchange and
+ * then owns the slot until it moves the sequence on. (Dmitry Vyukov's bounded MPMC queue.)
+ *
+ * No allocation after construction, items must be trivially copyable.
+ */
+template<class T>
+class CMpmcRingBuffer
+{
+	static_assert(std::is_trivially_copyable<T>::value, "CMpmcRingBuffer items must be trivially copyable");
+
+public:
+
+	CMpmcRingBuffer(size_t capacity)
+	{
+		if (capacity == 0 || capacity > ((size_t)1 << 30))
+			throw std::runtime_error("Ring buffer capacity must be > 0 and <= 2^30");
+
+		// Power of two amount of slots so that indexing stays right when the positions wrap
+		size_t slots = 1;
+		while (slots < capacity)
+			slots <<= 1;
+
+		m_slots.reset(new Slot[slots]);
+		m_slotMask = slots - 1;
+
+		for (size_t i = 0; i < slots; ++i)
+			m_slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	// Slots, which can be a bit more than the capacity asked for
+	size_t Capacity() const { return m_slotMask + 1; }
+
+	// Add an item, returns false if full
+	bool Push(const T& item)
+	{
+		size_t position = m_pushPosition.load(std::memory_order_relaxed);
+
+		for (;;)
+		{
+			Slot& slot = m_slots[position & m_slotMask];
+			const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+			const intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+
+			if (diff == 0)
+			{
+				if (m_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					slot.item = item;
+					slot.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				// Still holds an item from the previous lap
+				return false;
+			}
+			else
+			{
+				position = m_pushPosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Take the oldest item, returns false if empty
+	bool Pop(T& item)
+	{
+		size_t position = m_popPosition.load(std::memory_order_relaxed);
+
+		for (;;)
+		{
+			Slot& slot = m_slots[position & m_slotMask];
+			const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+			const intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+
+			if (diff == 0)
+			{
+				if (m_popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					item = slot.item;
+					slot.sequence.store(position + m_slotMask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				// Not written yet this lap
+				return false;
+			}
+			else
+			{
+				position = m_popPosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		T item;
+	};
+
+	std::unique_ptr<Slot[]> m_slots;
+	size_t m_slotMask;
+
+	// Apart so that producers and consumers don't share a cache line
+	alignas(64) std::atomic<size_t> m_pushPosition{ 0 };
+	alignas(64) std::atomic<size_t> m_popPosition{ 0 };
+};
@@ -0,0 +1,39 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <stdexcept>
+
+#include "PerformanceCounterTimingClock.h"
+
+
+CPerformanceCounterTimingClock::CPerformanceCounterTimingClock()
+{
+	// Fixed at boot, never fails on XP and later
+	LARGE_INTEGER frequency;
+	if (!QueryPerformanceFrequency(&frequency) || frequency.QuadPart < 1000LL)
+		throw std::runtime_error("No usable performance counter");
+
+	m_ticksPerSecond = frequency.QuadPart;
+}
+
+
+timingclocktime_t CPerformanceCounterTimingClock::TimingClockNow()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	return counter.QuadPart;
+}
+
+
+const TCHAR* CPerformanceCounterTimingClock::TimingClockDescription()
+{
+	return TEXT("Performance counter");
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <ITimingClock.h>
+
+
+/**
+ * Timing clock on the Windows performance counter. On CPUs with an invariant TSC, which is
+ * everything recent, this is a TSC read with no trip to the kernel.
+ */
+class CPerformanceCounterTimingClock:
+	public ITimingClock
+{
+public:
+
+	CPerformanceCounterTimingClock();
+
+	// ITimingClock
+	timingclocktime_t TimingClockNow() override;
+	timingclocktime_t TimingClockTicksPerSecond() const override { return m_ticksPerSecond; }
+	const TCHAR* TimingClockDescription() override;
+
+private:
+
+	timingclocktime_t m_ticksPerSecond;
+};
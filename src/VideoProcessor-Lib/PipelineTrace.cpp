@@ -0,0 +1,292 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "PipelineTrace.h"
+
+
+static_assert((PipelineTrace::EVENTS_PER_THREAD & (PipelineTrace::EVENTS_PER_THREAD - 1)) == 0, "Events per thread must be a power of two");
+
+
+struct PipelineTraceEvent
+{
+	std::chrono::steady_clock::rep time;
+	uint64_t frameCounter;
+	PipelineTraceStage stage;
+	PipelineTracePhase phase;
+};
+
+
+// Ring of events of a single thread, only that thread writes to it
+struct PipelineTraceThreadBuffer
+{
+	PipelineTraceThreadBuffer(uint32_t threadId):
+		events(PipelineTrace::EVENTS_PER_THREAD),
+		threadId(threadId)
+	{
+	}
+
+	std::vector<PipelineTraceEvent> events;
+	std::atomic<uint64_t> written{ 0 };
+	std::atomic<uint32_t> epoch{ 0 };  // Recording the events are of
+	std::atomic<const char*> name{ nullptr };
+	const uint32_t threadId;
+};
+
+
+std::atomic<bool> PipelineTrace::s_enabled{ false };
+
+
+// Recording, bumped by every Start(). A thread buffer of an older recording is stale, the thread
+// which owns it clears it on its next event, so only that thread ever touches its written index.
+static std::atomic<uint32_t> s_epoch{ 0 };
+
+
+// All thread buffers, a buffer only referenced from here belongs to a thread which has exited
+static std::mutex s_threadBuffersMutex;
+static std::vector<std::shared_ptr<PipelineTraceThreadBuffer>> s_threadBuffers;
+static uint32_t s_nextThreadId = 1;
+
+static thread_local std::shared_ptr<PipelineTraceThreadBuffer> t_threadBuffer;
+
+
+static PipelineTraceThreadBuffer& ThreadBuffer()
+{
+	if (!t_threadBuffer)
+	{
+		std::lock_guard<std::mutex> lock(s_threadBuffersMutex);
+
+		t_threadBuffer = std::make_shared<PipelineTraceThreadBuffer>(s_nextThreadId++);
+		s_threadBuffers.push_back(t_threadBuffer);
+	}
+
+	return *t_threadBuffer;
+}
+
+
+static const char* StageName(PipelineTraceStage stage)
+{
+	switch (stage)
+	{
+	case PipelineTraceStage::CAPTURE_CALLBACK:
+		return "capture_callback";
+
+	case PipelineTraceStage::CAPTURE_METADATA:
+		return "capture_metadata";
+
+	case PipelineTraceStage::GET_DELIVERY_BUFFER:
+		return "get_delivery_buffer";
+
+	case PipelineTraceStage::FORMAT:
+		return "format";
+
+	case PipelineTraceStage::QUEUE:
+		return "queue";
+
+	case PipelineTraceStage::TIMESTAMP:
+		return "timestamp";
+
+	case PipelineTraceStage::DELIVER:
+		return "deliver";
+
+	case PipelineTraceStage::DROP:
+		return "drop";
+	}
+
+	throw std::runtime_error("PipelineTraceStage name lookup failed");
+}
+
+
+static const char* PhaseType(PipelineTracePhase phase)
+{
+	switch (phase)
+	{
+	case PipelineTracePhase::BEGIN:
+		return "B";
+
+	case PipelineTracePhase::END:
+		return "E";
+
+	case PipelineTracePhase::ASYNC_BEGIN:
+		return "b";
+
+	case PipelineTracePhase::ASYNC_END:
+		return "e";
+
+	case PipelineTracePhase::INSTANT:
+		return "i";
+	}
+
+	throw std::runtime_error("PipelineTracePhase type lookup failed");
+}
+
+
+void PipelineTrace::Start()
+{
+	std::lock_guard<std::mutex> lock(s_threadBuffersMutex);
+
+	s_enabled.store(false, std::memory_order_relaxed);
+
+	// Forget about threads which are gone, clear the rest
+	s_threadBuffers.erase(
+		std::remove_if(
+			s_threadBuffers.begin(), s_threadBuffers.end(),
+			[](const std::shared_ptr<PipelineTraceThreadBuffer>& threadBuffer) { return threadBuffer.use_count() == 1; }),
+		s_threadBuffers.end());
+
+	s_epoch.fetch_add(1, std::memory_order_release);
+
+	s_enabled.store(true, std::memory_order_release);
+}
+
+
+void PipelineTrace::Stop()
+{
+	s_enabled.store(false, std::memory_order_release);
+}
+
+
+void PipelineTrace::SetThreadName(const char* name)
+{
+	if (IsEnabled())
+		ThreadBuffer().name.store(name, std::memory_order_relaxed);
+}
+
+
+void PipelineTrace::WriteChromeTrace(std::ostream& os)
+{
+	std::lock_guard<std::mutex> lock(s_threadBuffersMutex);
+
+	// Range of events in each of the rings
+	struct ThreadEvents
+	{
+		const PipelineTraceThreadBuffer* threadBuffer;
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	std::vector<ThreadEvents> threadEvents;
+	std::chrono::steady_clock::rep firstTime = std::numeric_limits<std::chrono::steady_clock::rep>::max();
+	const uint32_t epoch = s_epoch.load(std::memory_order_acquire);
+
+	for (const auto& threadBuffer : s_threadBuffers)
+	{
+		// Nothing recorded by this thread since the last start
+		if (threadBuffer->epoch.load(std::memory_order_acquire) != epoch)
+			continue;
+
+		const uint64_t written = threadBuffer->written.load(std::memory_order_acquire);
+		if (written == 0)
+			continue;
+
+		const uint64_t begin = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+		threadEvents.push_back({ threadBuffer.get(), begin, written });
+
+		firstTime = std::min(firstTime, threadBuffer->events[begin & (EVENTS_PER_THREAD - 1)].time);
+	}
+
+	// Timestamps are in us relative to the first event
+	const double usPerTick = 1000000.0 * std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den;
+
+	os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool first = true;
+	for (const ThreadEvents& thread : threadEvents)
+	{
+		const uint32_t tid = thread.threadBuffer->threadId;
+
+		const char* name = thread.threadBuffer->name.load(std::memory_order_relaxed);
+		if (name)
+		{
+			os << (first ? "" : ",\n")
+			   << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+			   << ",\"args\":{\"name\":\"" << name << "\"}}";
+			first = false;
+		}
+
+		// The ring can have overwritten the begin of a stage of which the end is still there
+		int depth = 0;
+
+		for (uint64_t i = thread.begin; i < thread.end; i++)
+		{
+			const PipelineTraceEvent& event = thread.threadBuffer->events[i & (EVENTS_PER_THREAD - 1)];
+
+			if (event.phase == PipelineTracePhase::BEGIN)
+			{
+				++depth;
+			}
+			else if (event.phase == PipelineTracePhase::END)
+			{
+				if (depth == 0)
+					continue;
+
+				--depth;
+			}
+
+			os << (first ? "" : ",\n")
+			   << "{\"name\":\"" << StageName(event.stage) << "\",\"cat\":\"frame\",\"ph\":\"" << PhaseType(event.phase) << "\""
+			   << ",\"ts\":" << std::fixed << ((event.time - firstTime) * usPerTick)
+			   << ",\"pid\":1,\"tid\":" << tid;
+
+			switch (event.phase)
+			{
+			case PipelineTracePhase::ASYNC_BEGIN:
+			case PipelineTracePhase::ASYNC_END:
+				os << ",\"id\":" << event.frameCounter;
+				break;
+
+			case PipelineTracePhase::INSTANT:
+				os << ",\"s\":\"t\"";
+				break;
+			}
+
+			os << ",\"args\":{\"frame\":" << event.frameCounter << "}}";
+			first = false;
+		}
+	}
+
+	os << "\n]}\n";
+}
+
+
+void PipelineTrace::RecordEnabled(PipelineTraceStage stage, PipelineTracePhase phase, uint64_t frameCounter)
+{
+	PipelineTraceThreadBuffer& threadBuffer = ThreadBuffer();
+
+	// First event since a Start(), throw away the previous recording. The buffer is only taken as
+	// part of the new recording once it's empty.
+	const uint32_t epoch = s_epoch.load(std::memory_order_acquire);
+	if (threadBuffer.epoch.load(std::memory_order_relaxed) != epoch)
+	{
+		threadBuffer.written.store(0, std::memory_order_relaxed);
+		threadBuffer.epoch.store(epoch, std::memory_order_release);
+	}
+
+	// Only this thread writes, the store publishes the event to WriteChromeTrace()
+	const uint64_t written = threadBuffer.written.load(std::memory_order_relaxed);
+
+	threadBuffer.events[written & (EVENTS_PER_THREAD - 1)] = {
+		std::chrono::steady_clock::now().time_since_epoch().count(),
+		frameCounter,
+		stage,
+		phase };
+
+	// Started again while writing, the event belongs to the recording which got thrown away
+	if (s_epoch.load(std::memory_order_acquire) != epoch)
+		return;
+
+	threadBuffer.written.store(written + 1, std::memory_order_release);
+}
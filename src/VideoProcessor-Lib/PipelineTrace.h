@@ -0,0 +1,126 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+
+
+// Stages a frame goes through, in pipeline order
+enum class PipelineTraceStage : uint8_t
+{
+	CAPTURE_CALLBACK,     // Capture device frame callback, everything up to the renderer is nested in it
+	CAPTURE_METADATA,     // Capture device checking the frame's metadata and sending state changes
+	GET_DELIVERY_BUFFER,  // Getting a buffer to format into
+	FORMAT,               // Formatting the frame into that buffer
+	QUEUE,                // Formatted frame waiting for delivery, starts and ends on different threads
+	TIMESTAMP,            // Setting the start and stop times
+	DELIVER,              // Handing the frame to the DirectShow renderer or sink
+	DROP                  // Frame dropped, a single instant
+};
+
+
+enum class PipelineTracePhase : uint8_t
+{
+	BEGIN,
+	END,
+	ASYNC_BEGIN,  // Can end on a different thread
+	ASYNC_END,
+	INSTANT
+};
+
+
+/**
+ * Tracing of frames through the pipeline stages for finding out where the time of a late frame went.
+ *
+ * Every thread records begin and end events keyed by the frame counter into a ring buffer of its
+ * own, which is allocated on the first event and kept when the thread goes away so it can still be
+ * written out. When tracing is off recording is a single relaxed atomic load.
+ *
+ * The buffers are written out as Chrome trace event JSON which can be opened in chrome://tracing
+ * and in the Perfetto UI (ui.perfetto.dev), giving a frame by frame timeline over all threads.
+ */
+class PipelineTrace
+{
+public:
+
+	// Events kept per thread, older ones get overwritten
+	static const uint32_t EVENTS_PER_THREAD = 1 << 15;
+
+	// Throw away everything recorded so far and start recording.
+	// Can be called while threads are recording, each thread clears its own buffer on its first event
+	// after this and an event which was being written while starting is dropped.
+	static void Start();
+
+	// Stop recording, stop before writing to get a consistent trace
+	static void Stop();
+
+	static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+	// Record an event for the calling thread, does nothing when not enabled
+	static void Record(PipelineTraceStage stage, PipelineTracePhase phase, uint64_t frameCounter)
+	{
+		if (IsEnabled())
+			RecordEnabled(stage, phase, frameCounter);
+	}
+
+	// Name the calling thread in the trace, the name has to be a string literal or otherwise outlive
+	// the trace. Does nothing when not enabled so call it from within the thread's loop.
+	static void SetThreadName(const char* name);
+
+	// Write all recorded events as Chrome trace event JSON
+	static void WriteChromeTrace(std::ostream&);
+
+private:
+
+	static std::atomic<bool> s_enabled;
+
+	static void RecordEnabled(PipelineTraceStage stage, PipelineTracePhase phase, uint64_t frameCounter);
+};
+
+
+/**
+ * Records the begin of a stage on construction and the end on destruction or End(),
+ * whichever is first. Does nothing if tracing was not enabled on construction.
+ */
+class CPipelineTraceScope
+{
+public:
+
+	CPipelineTraceScope(PipelineTraceStage stage, uint64_t frameCounter):
+		m_stage(stage),
+		m_frameCounter(frameCounter),
+		m_active(PipelineTrace::IsEnabled())
+	{
+		if (m_active)
+			PipelineTrace::Record(m_stage, PipelineTracePhase::BEGIN, m_frameCounter);
+	}
+
+	~CPipelineTraceScope()
+	{
+		End();
+	}
+
+	void End()
+	{
+		if (m_active)
+		{
+			PipelineTrace::Record(m_stage, PipelineTracePhase::END, m_frameCounter);
+			m_active = false;
+		}
+	}
+
+private:
+
+	const PipelineTraceStage m_stage;
+	const uint64_t m_frameCounter;
+	bool m_active;
+};
@@ -0,0 +1,130 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <math.h>
+#include <stdexcept>
+
+#include "QueueDepthController.h"
+
+
+CQueueDepthController::CQueueDepthController(const QueueDepthControllerConfig& config, double frameMs):
+	m_config(config),
+	m_frameMs(frameMs),
+	m_depth(config.minimumDepth)
+{
+	if (config.minimumDepth == 0 || config.maximumDepth < config.minimumDepth)
+		throw std::runtime_error("Queue depth range must be > 0 and not empty");
+
+	if (!(config.targetDropProbability > 0.0 && config.targetDropProbability < 1.0))
+		throw std::runtime_error("Queue depth drop target must be in (0, 1)");
+
+	if (!(config.smoothing > 0.0 && config.smoothing <= 1.0))
+		throw std::runtime_error("Queue depth smoothing must be in (0, 1]");
+
+	if (frameMs <= 0.0)
+		throw std::runtime_error("Frame duration must be > 0");
+}
+
+
+bool CQueueDepthController::Update(
+	const LatencyHistogramSummary& entryLatency,
+	const LatencyHistogramSummary& deliver,
+	const LatencyHistogramSummary& queueWait,
+	uint64_t droppedFrames)
+{
+	const uint64_t frames = deliver.count + droppedFrames;
+	if (frames < std::max(m_config.minimumFrames, (uint64_t)1))
+		return false;
+
+	const double probability = m_config.targetDropProbability;
+
+	const double arrivalJitterMs = (entryLatency.count > 0) ?
+		std::max(TailMs(entryLatency, probability) - entryLatency.p50Ms, 0.0) : 0.0;
+	const double deliverMs = (deliver.count > 0) ?
+		std::max(TailMs(deliver, probability), 0.0) : 0.0;
+
+	if (m_hasEstimate)
+	{
+		m_arrivalJitterMs += m_config.smoothing * (arrivalJitterMs - m_arrivalJitterMs);
+		m_deliverMs += m_config.smoothing * (deliverMs - m_deliverMs);
+	}
+	else
+	{
+		m_arrivalJitterMs = arrivalJitterMs;
+		m_deliverMs = deliverMs;
+		m_hasEstimate = true;
+	}
+
+	size_t wantedDepth = NeededDepth();
+
+	// Most frames waiting behind a full queue is frames coming in faster than they go out, not jitter.
+	// A queue of one is full as soon as a frame waits so there it can't be told apart.
+	m_standingFull = m_depth > 1 && queueWait.count > 0 && queueWait.p50Ms >= (m_depth - 1) * m_frameMs;
+
+	// The distributions don't show everything that was dropped for lack of depth, at least one more then
+	if (!m_standingFull && droppedFrames > 0 && droppedFrames > probability * frames)
+		wantedDepth = std::max(wantedDepth, std::min(m_depth + 1, m_config.maximumDepth));
+
+	if (wantedDepth > m_depth)
+	{
+		++m_depth;
+		m_shrinkUpdates = 0;
+		return true;
+	}
+
+	if (wantedDepth < m_depth)
+	{
+		if (++m_shrinkUpdates >= m_config.shrinkHoldUpdates)
+		{
+			--m_depth;
+			m_shrinkUpdates = 0;
+			return true;
+		}
+
+		return false;
+	}
+
+	m_shrinkUpdates = 0;
+	return false;
+}
+
+
+size_t CQueueDepthController::NeededDepth() const
+{
+	// Frames that pile up while delivery is held up, plus the one it's waiting on
+	const size_t depth = (size_t)floor((m_deliverMs + m_arrivalJitterMs) / m_frameMs) + 1;
+
+	return std::min(std::max(depth, m_config.minimumDepth), m_config.maximumDepth);
+}
+
+
+double CQueueDepthController::TailMs(const LatencyHistogramSummary& summary, double probability)
+{
+	// Fraction of frames above each percentile
+	const double maxProbability = (summary.count > 0) ? std::min(1.0 / summary.count, 0.001) : 0.001;
+	const double probabilities[] = { 0.5, 0.1, 0.01, 0.001, maxProbability };
+	const double latencies[] = { summary.p50Ms, summary.p90Ms, summary.p99Ms, summary.p999Ms, summary.maxMs };
+	const size_t points = sizeof(probabilities) / sizeof(probabilities[0]);
+
+	if (probability >= probabilities[0])
+		return latencies[0];
+
+	for (size_t i = 1; i < points; ++i)
+	{
+		if (probability < probabilities[i])
+			continue;
+
+		const double t = log(probabilities[i - 1] / probability) / log(probabilities[i - 1] / probabilities[i]);
+		return latencies[i - 1] + t * (latencies[i] - latencies[i - 1]);
+	}
+
+	return latencies[points - 1];
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <LatencyHistogram.h>
+
+
+struct QueueDepthControllerConfig
+{
+	// Chance of a frame being dropped for want of queue depth which is acceptable
+	double targetDropProbability = 0.001;
+
+	// Range the depth is kept in. The renderer needs buffers for the maximum, build it with that as its queue size.
+	// Clock-clock timestamping holds a frame back so it needs at least 2.
+	size_t minimumDepth = 1;
+	size_t maximumDepth = 8;
+
+	// Updates in a row which need less depth before going down a frame, going up is right away
+	unsigned int shrinkHoldUpdates = 10;
+
+	// Weight of a new update in the jitter estimates, 1 is no smoothing
+	double smoothing = 0.25;
+
+	// Updates with less frames than this are ignored
+	uint64_t minimumFrames = 10;
+};
+
+
+/**
+ * Keeps the renderer's frame queue as shallow as the measured jitter allows.
+ *
+ * A frame is dropped when it arrives at a full queue, which happens when delivery stalls for longer
+ * than the queued frames cover or when frames arrive bunched up. Every update takes the distribution of
+ * the renderer entry latencies, whose spread is the arrival jitter, and of the time handing a frame to the
+ * renderer took, whose tail is how long delivery stalls. The depth needed is the frames that arrive during
+ * both at the quantile of the drop target, plus the one being waited on. How long frames wait in the queue
+ * is no measure for this, in a queue which runs full they wait for the whole depth however little jitter
+ * there is.
+ *
+ * Dropping more than the target allows also makes it go up, for what the distributions don't show. But not
+ * when the queue stands full, going by the median queue wait, as then the capture side outruns the delivery
+ * at a steady rate: a deeper queue fills up just the same and only adds latency. Clock drift drops like
+ * that are for a frame drop or repeat to deal with, see CClockDriftEstimator.
+ *
+ * Depth goes up by a frame per update and only comes down a frame after a while of needing less,
+ * so that it does not flap. The renderer's queue can be resized while rendering, no reset needed.
+ *
+ * Has no clock of its own, call Update() at a steady interval like once a second.
+ */
+class CQueueDepthController
+{
+public:
+
+	CQueueDepthController(const QueueDepthControllerConfig&, double frameMs);
+
+	// Feed the renderer's entry latencies, deliver times, queue waits and overflow drops since the previous update.
+	// Returns true if the depth changed.
+	bool Update(
+		const LatencyHistogramSummary& entryLatency,
+		const LatencyHistogramSummary& deliver,
+		const LatencyHistogramSummary& queueWait,
+		uint64_t droppedFrames);
+
+	// Frame queue size to set on the renderer
+	size_t Depth() const { return m_depth; }
+
+	// Depth the jitter estimates call for, within the configured range
+	size_t NeededDepth() const;
+
+	// Estimated spread of the arrivals and time delivery is held up at the drop target,
+	// both 0 until the first update with enough frames
+	double ArrivalJitterMs() const { return m_arrivalJitterMs; }
+	double DeliverMs() const { return m_deliverMs; }
+
+	// True if the last update found the queue standing full and did not count its drops
+	bool StandingFull() const { return m_standingFull; }
+
+	const QueueDepthControllerConfig& Config() const { return m_config; }
+
+	// Latency which only the given fraction of the summarized frames went over, going by its percentiles
+	// and interpolated between them on a log scale. The max stands for one frame in count.
+	static double TailMs(const LatencyHistogramSummary&, double probability);
+
+private:
+
+	const QueueDepthControllerConfig m_config;
+	const double m_frameMs;
+
+	size_t m_depth;
+	unsigned int m_shrinkUpdates = 0;
+
+	bool m_hasEstimate = false;
+	double m_arrivalJitterMs = 0.0;
+	double m_deliverMs = 0.0;
+	bool m_standingFull = false;
+};
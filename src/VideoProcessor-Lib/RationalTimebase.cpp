@@ -0,0 +1,73 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <limits>
+#include <stdexcept>
+
+#include "RationalTimebase.h"
+
+
+static uint64_t GreatestCommonDivisor(uint64_t a, uint64_t b)
+{
+	while (b != 0)
+	{
+		const uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+
+RationalTimebase::RationalTimebase(uint64_t numerator, uint64_t denominator)
+{
+	if (numerator == 0 || denominator == 0)
+		throw std::runtime_error("Numerator and denominator must be > 0");
+
+	const uint64_t gcd = GreatestCommonDivisor(numerator, denominator);
+	numerator /= gcd;
+	denominator /= gcd;
+
+	// The largest intermediate is a remainder times the numerator plus half the denominator
+	const uint64_t max = (uint64_t)std::numeric_limits<int64_t>::max();
+	if (numerator > max || denominator > max ||
+		(denominator - 1) > (max - denominator / 2) / numerator)
+		throw std::runtime_error("Timebase ratio too large for exact conversion");
+
+	m_numerator = (int64_t)numerator;
+	m_denominator = (int64_t)denominator;
+}
+
+
+RationalTimebase RationalTimebase::Rescale(uint64_t fromUnitsPerSecond, uint64_t toUnitsPerSecond)
+{
+	return RationalTimebase(toUnitsPerSecond, fromUnitsPerSecond);
+}
+
+
+RationalTimebase RationalTimebase::Inverse() const
+{
+	return RationalTimebase(m_denominator, m_numerator);
+}
+
+
+bool RationalTimebase::operator == (const RationalTimebase& other) const
+{
+	return
+		m_numerator == other.m_numerator &&
+		m_denominator == other.m_denominator;
+}
+
+
+bool RationalTimebase::operator != (const RationalTimebase& other) const
+{
+	return !(*this == other);
+}
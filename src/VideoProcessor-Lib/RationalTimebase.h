@@ -0,0 +1,85 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+
+/**
+ * Exact conversion between two units of time which are a rational multiple of each other, like
+ * frame numbers and timing clock ticks, or timing clock ticks and DirectShow's 100ns units.
+ *
+ * The ratio is reduced and checked on construction so that converting is integer only, and nothing
+ * overflows unless the result itself does not fit. Every conversion is exact up to its own rounding,
+ * so frame times taken from the frame number never drift the way adding up a rounded frame duration
+ * does, not even for 1000/1001 rates over days.
+ */
+class RationalTimebase
+{
+public:
+
+	// One to one
+	RationalTimebase() = default;
+
+	// Converts value into value * numerator / denominator, throws if that could overflow
+	RationalTimebase(uint64_t numerator, uint64_t denominator);
+
+	// From units of one rate into units of another, both in units per second
+	static RationalTimebase Rescale(uint64_t fromUnitsPerSecond, uint64_t toUnitsPerSecond);
+
+	// The other way around
+	RationalTimebase Inverse() const;
+
+	// Rounded down, which keeps consecutive conversions in order
+	int64_t Convert(int64_t value) const
+	{
+		int64_t whole, remainder;
+		Split(value, whole, remainder);
+
+		return whole * m_numerator + (remainder * m_numerator) / m_denominator;
+	}
+
+	// Rounded to the nearest, halves up
+	int64_t ConvertRounded(int64_t value) const
+	{
+		int64_t whole, remainder;
+		Split(value, whole, remainder);
+
+		return whole * m_numerator + (remainder * m_numerator + m_denominator / 2) / m_denominator;
+	}
+
+	// As a double, for where precision does not matter
+	double Ratio() const { return (double)m_numerator / m_denominator; }
+
+	int64_t Numerator() const { return m_numerator; }
+	int64_t Denominator() const { return m_denominator; }
+
+	bool operator == (const RationalTimebase& other) const;
+	bool operator != (const RationalTimebase& other) const;
+
+private:
+
+	// Reduced
+	int64_t m_numerator = 1;
+	int64_t m_denominator = 1;
+
+	// value = whole * denominator + remainder, with 0 <= remainder < denominator
+	void Split(int64_t value, int64_t& whole, int64_t& remainder) const
+	{
+		whole = value / m_denominator;
+		remainder = value % m_denominator;
+
+		if (remainder < 0)
+		{
+			--whole;
+			remainder += m_denominator;
+		}
+	}
+};
@@ -0,0 +1,312 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Bounded ring buffer for a single producer and a single consumer, with a blocking wait
+ * for the consumer.
+ *
+ * Pushing and the consumer taking or looking at the oldest item are lock-free. Next to that the producer
+ * can take items back off either end, which is what a live queue needs to drop the oldest item when full
+ * or items which got superseded. Those takes are rare, they hold a lock and first wait for the consumer
+ * to be done with the front. A consumer which comes along while a take is pending waits for it on the
+ * same lock rather than touching the front.
+ *
+ * Only the producer writes slots and only the one past the tail, which the consumer can't see yet, so an
+ * item is never read while being written.
+ *
+ * Producer calls must not overlap each other, anything which isn't the producer thread (purging
+ * on stop for example) has to hold off the producer itself.
+ *
+ * Capacity is limited to 2^23 items.
+ *
+ * The consumer only takes a lock when it has to sleep or when the producer is taking items,
+ * the producer only when the consumer sleeps or when it takes items.
+ */
+template<class T>
+class CSpscRingBuffer
+{
+public:
+
+	CSpscRingBuffer(uint32_t capacity):
+		m_capacity(capacity)
+	{
+		if (capacity == 0 || capacity > (COUNTER_MASK >> 1))
+			throw std::runtime_error("Ring buffer capacity must be > 0 and < 2^23");
+
+		// Power of two amount of slots so that indexing stays right when the counters wrap
+		uint32_t slots = 1;
+		while (slots < capacity)
+			slots <<= 1;
+
+		m_slots.resize(slots);
+		m_slotMask = slots - 1;
+	}
+
+	uint32_t Capacity() const { return m_capacity; }
+
+	// Amount of items queued, by the time the caller looks at it the other side might have changed it
+	uint32_t Size() const { return Size(m_state.load(std::memory_order_acquire)); }
+
+	bool Empty() const { return Size() == 0; }
+
+	//
+	// Producer
+	//
+
+	// Add an item at the back, returns false if full
+	bool PushBack(const T& item)
+	{
+		uint64_t state = m_state.load(std::memory_order_acquire);
+		if (Size(state) >= Capacity())
+			return false;
+
+		// The slot at the tail is not visible to the consumer until the tail moves past it,
+		// and the consumer was done with it when it moved the head past it
+		Slot(Tail(state)) = item;
+
+		// Only the head can have moved in the meantime
+		while (!m_state.compare_exchange_weak(
+			state, Pack(Head(state), Tail(state) + 1),
+			std::memory_order_seq_cst, std::memory_order_acquire))
+		{
+		}
+
+		Notify();
+		return true;
+	}
+
+	// Copy the newest item, returns false if empty
+	bool PeekBack(T& item) const
+	{
+		const uint64_t state = m_state.load(std::memory_order_acquire);
+		if (Size(state) == 0)
+			return false;
+
+		// Written by us and only ever rewritten by us
+		item = Slot(Tail(state) - 1);
+		return true;
+	}
+
+	// Take the newest item, returns false if empty
+	bool PopBack(T& item)
+	{
+		return Take([&]()
+		{
+			const uint64_t state = m_state.load(std::memory_order_acquire);
+			if (Size(state) == 0)
+				return false;
+
+			item = Slot(Tail(state) - 1);
+			m_state.store(Pack(Head(state), Tail(state) - 1), std::memory_order_release);
+			return true;
+		});
+	}
+
+	// Take the oldest item instead of the consumer, returns false if empty
+	bool DropFront(T& item)
+	{
+		return Take([&]()
+		{
+			return TakeFront(item);
+		});
+	}
+
+	//
+	// Consumer
+	//
+
+	// Take the oldest item, returns false if empty
+	bool PopFront(T& item)
+	{
+		return AccessFront([&]()
+		{
+			return TakeFront(item);
+		});
+	}
+
+	// Copy the oldest item without taking it, returns false if empty.
+	// Also for the producer outside of its takes, what it gets might have been taken by the consumer since.
+	bool PeekFront(T& item) const
+	{
+		return AccessFront([&]()
+		{
+			const uint64_t state = m_state.load(std::memory_order_acquire);
+			if (Size(state) == 0)
+				return false;
+
+			item = Slot(Head(state));
+			return true;
+		});
+	}
+
+	// Block until at least count items are queued, returns false if the buffer was closed
+	bool WaitForSize(uint32_t count)
+	{
+		if (m_closed.load(std::memory_order_acquire))
+			return false;
+
+		if (Size() >= count)
+			return true;
+
+		std::unique_lock<std::mutex> lock(m_waitMutex);
+
+		m_consumerWaiting.store(true, std::memory_order_relaxed);
+
+		while (true)
+		{
+			// Pairs with the fence in Notify(), either we see the push or the producer sees us waiting
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (m_closed.load(std::memory_order_acquire))
+				break;
+
+			if (Size() >= count)
+				break;
+
+			m_wakeCondition.wait(lock);
+		}
+
+		m_consumerWaiting.store(false, std::memory_order_relaxed);
+
+		return !m_closed.load(std::memory_order_acquire);
+	}
+
+	//
+	// Control
+	//
+
+	// Release a waiting consumer and make all following waits return false
+	void Close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_waitMutex);
+			m_closed.store(true, std::memory_order_release);
+		}
+
+		m_wakeCondition.notify_all();
+	}
+
+	bool IsClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+private:
+
+	const uint32_t m_capacity;
+	std::vector<T> m_slots;
+	uint32_t m_slotMask = 0;
+
+	// Head (oldest item) in bits 0-23 and tail (one past the newest) in bits 24-47.
+	// Head and tail count up and wrap, their difference is the size.
+	std::atomic<uint64_t> m_state{ 0 };
+
+	// Producer takes hold the take mutex and have the take flag set, front accesses without
+	// the mutex are counted so that a take can wait for them
+	mutable std::mutex m_takeMutex;
+	std::atomic<bool> m_taking{ false };
+	mutable std::atomic<uint32_t> m_frontAccesses{ 0 };
+
+	std::atomic<bool> m_closed{ false };
+	std::atomic<bool> m_consumerWaiting{ false };
+	std::mutex m_waitMutex;
+	std::condition_variable m_wakeCondition;
+
+	static const uint32_t COUNTER_MASK = 0xFFFFFF;
+
+	static uint32_t Head(uint64_t state) { return (uint32_t)state & COUNTER_MASK; }
+	static uint32_t Tail(uint64_t state) { return (uint32_t)(state >> 24) & COUNTER_MASK; }
+	static uint32_t Size(uint64_t state) { return (Tail(state) - Head(state)) & COUNTER_MASK; }
+
+	static uint64_t Pack(uint32_t head, uint32_t tail)
+	{
+		return
+			((uint64_t)(tail & COUNTER_MASK) << 24) |
+			(head & COUNTER_MASK);
+	}
+
+	T& Slot(uint32_t index) { return m_slots[index & m_slotMask]; }
+	const T& Slot(uint32_t index) const { return m_slots[index & m_slotMask]; }
+
+	// Take the oldest item, with either the consumer or the producer kept away from the front
+	bool TakeFront(T& item)
+	{
+		uint64_t state = m_state.load(std::memory_order_acquire);
+		while (Size(state) > 0)
+		{
+			item = Slot(Head(state));
+
+			// Only a push can have moved the tail in the meantime
+			if (m_state.compare_exchange_weak(
+				state, Pack(Head(state) + 1, Tail(state)),
+				std::memory_order_acq_rel, std::memory_order_acquire))
+				return true;
+		}
+
+		return false;
+	}
+
+	// Run access on the front without a lock, unless the producer is taking items then wait for it
+	template<class F>
+	bool AccessFront(F access) const
+	{
+		// Either the take sees this access or this access sees the take
+		m_frontAccesses.fetch_add(1, std::memory_order_seq_cst);
+		if (!m_taking.load(std::memory_order_seq_cst))
+		{
+			const bool result = access();
+			m_frontAccesses.fetch_sub(1, std::memory_order_release);
+			return result;
+		}
+
+		m_frontAccesses.fetch_sub(1, std::memory_order_release);
+
+		std::lock_guard<std::mutex> lock(m_takeMutex);
+		return access();
+	}
+
+	// Run take with all front accesses held off, the ones already going are short so spinning is fine
+	template<class F>
+	bool Take(F take)
+	{
+		std::lock_guard<std::mutex> lock(m_takeMutex);
+
+		m_taking.store(true, std::memory_order_seq_cst);
+		while (m_frontAccesses.load(std::memory_order_seq_cst) > 0)
+			std::this_thread::yield();
+
+		const bool result = take();
+
+		m_taking.store(false, std::memory_order_seq_cst);
+		return result;
+	}
+
+	void Notify()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (!m_consumerWaiting.load(std::memory_order_relaxed))
+			return;
+
+		// Taking the lock guarantees the consumer is either in wait() or has yet to look at the size
+		{
+			std::lock_guard<std::mutex> lock(m_waitMutex);
+		}
+
+		m_wakeCondition.notify_one();
+	}
+};
@@ -0,0 +1,113 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <math.h>
+#include <stdexcept>
+
+#include "TimestampSmoother.h"
+
+
+CTimestampSmoother::CTimestampSmoother(const TimestampSmootherConfig& config):
+	m_config(config)
+{
+	if (config.phaseGain <= 0.0 || config.phaseGain > 1.0)
+		throw std::runtime_error("Phase gain must be > 0 and <= 1");
+
+	if (config.frequencyGain < 0.0 || config.frequencyGain >= config.phaseGain)
+		throw std::runtime_error("Frequency gain must be >= 0 and below the phase gain");
+
+	if (config.relockFrames <= 0.0 || config.relockFrames >= 0.5)
+		throw std::runtime_error("Relock frames must be > 0 and < 0.5");
+}
+
+
+void CTimestampSmoother::SetFrameDuration(double ticksPerFrame, timingclocktime_t ticksPerSecond)
+{
+	if (ticksPerFrame <= 0.0 || ticksPerSecond <= 0)
+		throw std::runtime_error("Frame duration and ticks per second must be > 0");
+
+	m_nominalTicksPerFrame = ticksPerFrame;
+	m_ticksPerSecond = ticksPerSecond;
+
+	Reset();
+}
+
+
+void CTimestampSmoother::Reset()
+{
+	m_locked = false;
+	m_ticksPerFrame = m_nominalTicksPerFrame;
+}
+
+
+timingclocktime_t CTimestampSmoother::Smooth(timingclocktime_t timestamp)
+{
+	assert(m_nominalTicksPerFrame > 0.0);
+
+	if (!m_locked || timestamp <= m_previousTimestamp)
+	{
+		Lock(timestamp);
+		return timestamp;
+	}
+
+	// Frames since the previous one, more than one if frames were missed
+	const double frames = std::max(round((timestamp - m_previousOutput) / m_ticksPerFrame), 1.0);
+
+	const double expected = m_previousOutput + frames * m_ticksPerFrame;
+	const double error = timestamp - expected;
+
+	if (fabs(error) > m_config.relockFrames * m_ticksPerFrame)
+	{
+		DbgLog((LOG_TRACE, 1, TEXT("CTimestampSmoother::Smooth(): Off by %.02f frames, locking again"), error / m_ticksPerFrame));
+
+		Lock(timestamp);
+		return timestamp;
+	}
+
+	const double output = expected + m_config.phaseGain * error;
+
+	// Jitter as the intervals deviate from the frame duration the loop had
+	const double msPerTick = 1000.0 / m_ticksPerSecond;
+	m_jitter.input.Record(fabs((timestamp - m_previousTimestamp) / frames - m_ticksPerFrame) * msPerTick);
+	m_jitter.output.Record(fabs((output - m_previousOutput) / frames - m_ticksPerFrame) * msPerTick);
+
+	// Follow the input's rate within reason
+	const double maxOffset = m_nominalTicksPerFrame * m_config.maxFrequencyOffsetPpm / 1000000.0;
+	m_ticksPerFrame = std::min(std::max(
+		m_ticksPerFrame + m_config.frequencyGain * error / frames,
+		m_nominalTicksPerFrame - maxOffset), m_nominalTicksPerFrame + maxOffset);
+
+	m_previousTimestamp = timestamp;
+	m_previousOutput = output;
+
+	return (timingclocktime_t)llround(output);
+}
+
+
+double CTimestampSmoother::FrequencyOffsetPpm() const
+{
+	if (m_nominalTicksPerFrame <= 0.0)
+		return 0.0;
+
+	// A longer frame is a slower clock
+	return (m_nominalTicksPerFrame / m_ticksPerFrame - 1.0) * 1000000.0;
+}
+
+
+void CTimestampSmoother::Lock(timingclocktime_t timestamp)
+{
+	// The tracked frame duration is kept, a jump in time rarely is a change in rate
+	m_locked = true;
+	++m_lockCount;
+
+	m_previousTimestamp = timestamp;
+	m_previousOutput = (double)timestamp;
+}
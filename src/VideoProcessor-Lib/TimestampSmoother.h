@@ -0,0 +1,93 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <LatencyHistogram.h>
+#include <TimingClock.h>
+
+
+struct TimestampSmootherConfig
+{
+	// Share of the phase error corrected every frame, higher follows the input closer and passes more of its jitter
+	double phaseGain = 0.05;
+
+	// Share of the phase error going into the frame duration, phaseGain^2/4 is a critically damped loop
+	double frequencyGain = 0.05 * 0.05 / 4;
+
+	// Timestamps further off than this share of a frame from where the loop expects them are a
+	// discontinuity, the loop locks onto them right away
+	double relockFrames = 0.25;
+
+	// Most the tracked frame duration can be off from the nominal one
+	double maxFrequencyOffsetPpm = 1000.0;
+};
+
+
+// Frame to frame jitter of the timestamps, as the difference of every frame interval with the tracked frame duration
+struct TimestampJitterHistograms
+{
+	CLatencyHistogram input;
+	CLatencyHistogram output;
+};
+
+
+/**
+ * Phase-locked loop on the nominal frame duration which takes the jitter out of capture timestamps.
+ *
+ * Every timestamp is compared to where the loop expected it, frames missed in between are taken
+ * into account. A share of that error corrects the output and a smaller share the tracked frame
+ * duration, so the output is evenly spaced and still follows the input if its clock drifts. Output
+ * timestamps only go up, unless the input made a jump which the loop then locks onto.
+ *
+ * Jitter is measured before and after smoothing into histograms, which can be read from any thread.
+ * Everything else is for the capture thread only.
+ */
+class CTimestampSmoother
+{
+public:
+
+	CTimestampSmoother(const TimestampSmootherConfig& config = TimestampSmootherConfig());
+
+	// Nominal frame duration of the stream in timing clock ticks, the loop starts over
+	void SetFrameDuration(double ticksPerFrame, timingclocktime_t ticksPerSecond);
+
+	// Start over, the next timestamp locks the loop
+	void Reset();
+
+	// Smoothed timestamp of a frame
+	timingclocktime_t Smooth(timingclocktime_t timestamp);
+
+	// Times the loop locked onto the input, the first frame included
+	uint64_t LockCount() const { return m_lockCount; }
+
+	// Tracked frame duration against the nominal one
+	double FrequencyOffsetPpm() const;
+
+	const TimestampJitterHistograms& Jitter() const { return m_jitter; }
+
+private:
+
+	const TimestampSmootherConfig m_config;
+
+	double m_nominalTicksPerFrame = 0.0;
+	timingclocktime_t m_ticksPerSecond = 0;
+
+	bool m_locked = false;
+	uint64_t m_lockCount = 0;
+	timingclocktime_t m_previousTimestamp = 0;
+	double m_previousOutput = 0.0;
+	double m_ticksPerFrame = 0.0;
+
+	TimestampJitterHistograms m_jitter;
+
+	void Lock(timingclocktime_t timestamp);
+};
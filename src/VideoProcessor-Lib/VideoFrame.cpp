@@ -11,6 +11,11 @@
 #include "VideoFrame.h"
 
 
+VideoFrame::VideoFrame()
+{
+}
+
+
 VideoFrame::VideoFrame(
 	const void* data, uint64_t counter,
 	timingclocktime_t timingTimestamp, IUnknown* sourceBuffer):
@@ -20,43 +25,64 @@ VideoFrame::VideoFrame(
 	m_sourceBuffer(sourceBuffer)
 {
 	assert(data);
+
+	if (m_sourceBuffer)
+		m_sourceBuffer->AddRef();
 }
 
-VideoFrame::VideoFrame(const VideoFrame& videoFrame) :
+
+VideoFrame::VideoFrame(VideoFrame&& videoFrame):
 	m_data(videoFrame.m_data),
 	m_counter(videoFrame.m_counter),
 	m_timingTimestamp(videoFrame.m_timingTimestamp),
 	m_sourceBuffer(videoFrame.m_sourceBuffer)
 {
+	videoFrame.m_data = nullptr;
+	videoFrame.m_sourceBuffer = nullptr;
 }
 
 
-VideoFrame::~VideoFrame()
+VideoFrame& VideoFrame::operator= (VideoFrame&& videoFrame)
 {
+	if (this != &videoFrame)
+	{
+		Release();
+
+		m_data = videoFrame.m_data;
+		m_counter = videoFrame.m_counter;
+		m_timingTimestamp = videoFrame.m_timingTimestamp;
+		m_sourceBuffer = videoFrame.m_sourceBuffer;
+
+		videoFrame.m_data = nullptr;
+		videoFrame.m_sourceBuffer = nullptr;
+	}
+
+	return *this;
 }
 
 
-void VideoFrame::SourceBufferAddRef()
+VideoFrame::~VideoFrame()
 {
-	m_sourceBuffer->AddRef();
+	Release();
 }
 
 
-void VideoFrame::SourceBufferRelease()
+VideoFrame VideoFrame::Share() const
 {
-	const ULONG refCount = m_sourceBuffer->Release();
-	assert(refCount == 0);
+	if (!m_data)
+		throw std::runtime_error("Cannot share a video frame without data");
+
+	return VideoFrame(m_data, m_counter, m_timingTimestamp, m_sourceBuffer);
 }
 
 
-VideoFrame& VideoFrame::operator= (const VideoFrame& videoFrame)
+void VideoFrame::Release()
 {
-	assert(this != &videoFrame);
-
-	m_data = videoFrame.m_data;
-	m_counter = videoFrame.m_counter;
-	m_timingTimestamp = videoFrame.m_timingTimestamp;
-	m_sourceBuffer = videoFrame.m_sourceBuffer;
+	if (m_sourceBuffer)
+	{
+		m_sourceBuffer->Release();
+		m_sourceBuffer = nullptr;
+	}
 
-	return *this;
+	m_data = nullptr;
 }
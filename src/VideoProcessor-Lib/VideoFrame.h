@@ -13,6 +13,14 @@
 
 /**
  * Structure which represents a single video frame
+ *
+ * The data belongs to the source buffer, which is the capture API's own refcounted frame object.
+ * A VideoFrame holds a reference on it for as long as it lives so the data can't go away underneath it,
+ * and gives it back when it's destroyed, also when an exception unwinds past it.
+ *
+ * Frames are move-only so that ownership is always clear, moving hands over the reference without
+ * touching the refcount. If a frame really needs to be held in two places, Share() makes a second
+ * handle on the same data at the cost of an AddRef(), the data itself is never copied.
  */
 class VideoFrame
 {
@@ -21,19 +29,26 @@ public:
 	/**
 	 * Constructor
 	 *
-	 * This is just a pointer to some data.
-	 * If this data in any way, shape or form might be gone by the time it's used, you can use the
-	 * sourceBuffer argument to have the VideoFrame constr/destr do ref management.
+	 * This is just a pointer to some data, sourceBuffer is what owns it and is AddRef()'d until
+	 * this frame is destroyed. Pass nullptr if the data outlives the frame anyway.
 	 */
-	VideoFrame() {}
+	VideoFrame();
 	VideoFrame(
 		const void* const data, uint64_t counter,
 		timingclocktime_t timingTimestamp, IUnknown* sourceBuffer);
-	VideoFrame(const VideoFrame&);
+
+	VideoFrame(VideoFrame&&);
+	VideoFrame& operator= (VideoFrame&&);
+
+	VideoFrame(const VideoFrame&) = delete;
+	VideoFrame& operator= (const VideoFrame&) = delete;
 
 	~VideoFrame();
 
-	// Get frame data
+	// Another frame on the same data and source buffer
+	VideoFrame Share() const;
+
+	// Get frame data, nullptr if this frame was moved from
 	// If you're wondering where the size of GetData() is, it can be found by querying
 	// VideoState::BytesPerFrame() which you should get before this gets delivered.
 	const void* const GetData() const { return m_data; }
@@ -44,15 +59,14 @@ public:
 	// Timestamp set by the timing clock.
 	timingclocktime_t GetTimingTimestamp() const { return m_timingTimestamp; }
 
-	// Memory functions to hold onto the video buffer for longer
-	void SourceBufferAddRef();
-	void SourceBufferRelease();
-
-	VideoFrame& operator= (const VideoFrame& videoFrame);
+	// Buffer which holds the data, not AddRef()'d
+	IUnknown* GetSourceBuffer() const { return m_sourceBuffer; }
 
 private:
-	const void* m_data;
-	uint64_t m_counter;
-	timingclocktime_t m_timingTimestamp;
-	IUnknown* m_sourceBuffer;
+	const void* m_data = nullptr;
+	uint64_t m_counter = 0;
+	timingclocktime_t m_timingTimestamp = 0;
+	IUnknown* m_sourceBuffer = nullptr;
+
+	void Release();
 };
@@ -83,7 +83,7 @@ uint32_t VideoState::BytesPerRow() const
 
 	case VideoFrameEncoding::ARGB_8BIT:
 	case VideoFrameEncoding::BGRA_8BIT:
-		return ((displayMode->FrameWidth() + 32) / 8);
+		return displayMode->FrameWidth() * 32 / 8;
 
 	case VideoFrameEncoding::R210:
 	case VideoFrameEncoding::R10b:
@@ -0,0 +1,203 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+
+#include "WorkerPool.h"
+
+
+// Get the n-th processor the process may run on, wrapping around the allowed ones
+static DWORD_PTR WorkerPoolProcessorMask(DWORD_PTR processMask, unsigned int n)
+{
+	unsigned int allowed = 0;
+	for (unsigned int bit = 0; bit < sizeof(DWORD_PTR) * 8; ++bit)
+		if (processMask & ((DWORD_PTR)1 << bit))
+			++allowed;
+
+	n %= allowed;
+
+	for (unsigned int bit = 0; bit < sizeof(DWORD_PTR) * 8; ++bit)
+	{
+		const DWORD_PTR mask = (DWORD_PTR)1 << bit;
+		if ((processMask & mask) && n-- == 0)
+			return mask;
+	}
+
+	return 0;
+}
+
+
+CWorkerPool::CWorkerPool(unsigned int workers)
+{
+	if (workers == 0)
+		throw std::runtime_error("Worker pool needs at least one worker");
+
+	// Only processors the process is allowed on. Both masks are zero if the process spans more than
+	// one processor group (> 64 logical processors), the workers are then left to the scheduler.
+	DWORD_PTR processMask = 0;
+	DWORD_PTR systemMask = 0;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+		processMask = 0;
+
+	// Reserved up-front so that adding a thread can't fail after it started
+	m_threads.reserve(workers - 1);
+
+	// Worker 0 is the calling thread
+	try
+	{
+		for (unsigned int worker = 1; worker < workers; ++worker)
+		{
+			m_threads.emplace_back(&CWorkerPool::ThreadProc, this, worker);
+
+			if (processMask == 0)
+				continue;
+
+			// Pin every thread to its own logical processor to keep its caches warm
+			const DWORD_PTR affinityMask = WorkerPoolProcessorMask(processMask, worker);
+			if (SetThreadAffinityMask(m_threads.back().native_handle(), affinityMask) == 0)
+				DbgLog((LOG_TRACE, 1, TEXT("CWorkerPool::CWorkerPool(): Failed to pin worker %u"), worker));
+		}
+	}
+	catch (...)
+	{
+		// The destructor doesn't run for a constructor which throws, the threads which did
+		// start would terminate the process when destroyed still joinable
+		StopThreads();
+		throw;
+	}
+}
+
+
+CWorkerPool::~CWorkerPool()
+{
+	StopThreads();
+}
+
+
+void CWorkerPool::Run(unsigned int jobCount, const Job& job)
+{
+	if (jobCount == 0)
+		return;
+
+	// Nothing to spread
+	if (m_threads.empty() || jobCount == 1)
+	{
+		for (unsigned int i = 0; i < jobCount; ++i)
+			job(i);
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		assert(m_busyThreads == 0);
+
+		m_job = &job;
+		m_jobCount = jobCount;
+		m_nextJob = 0;
+		m_busyThreads = m_threads.size();
+		m_exception = nullptr;
+		++m_generation;
+	}
+	m_wakeCondition.notify_all();
+
+	// Help out
+	RunJobs();
+
+	std::exception_ptr exception;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_doneCondition.wait(lock, [this] { return m_busyThreads == 0; });
+
+		m_job = nullptr;
+		exception = m_exception;
+	}
+
+	if (exception)
+		std::rethrow_exception(exception);
+}
+
+
+void CWorkerPool::ThreadProc(unsigned int worker)
+{
+	uint64_t generation = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeCondition.wait(lock, [&] { return m_stop || m_generation != generation; });
+
+			if (m_stop)
+				return;
+
+			generation = m_generation;
+		}
+
+		RunJobs();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_busyThreads == 0)
+				m_doneCondition.notify_one();
+		}
+	}
+}
+
+
+void CWorkerPool::RunJobs()
+{
+	while (true)
+	{
+		const unsigned int i = m_nextJob.fetch_add(1);
+		if (i >= m_jobCount)
+			break;
+
+		try
+		{
+			(*m_job)(i);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_exception)
+				m_exception = std::current_exception();
+		}
+	}
+}
+
+
+void CWorkerPool::StopThreads()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wakeCondition.notify_all();
+
+	for (std::thread& thread : m_threads)
+		thread.join();
+}
+
+
+void WorkerPoolSplit(
+	uint32_t total, uint32_t parts, uint32_t part, uint32_t alignment,
+	uint32_t& begin, uint32_t& end)
+{
+	assert(parts > 0);
+	assert(part < parts);
+	assert(alignment > 0);
+
+	const uint64_t units = (total + alignment - 1) / alignment;
+
+	begin = std::min((uint32_t)(units * part / parts) * alignment, total);
+	end = std::min((uint32_t)(units * (part + 1) / parts) * alignment, total);
+}
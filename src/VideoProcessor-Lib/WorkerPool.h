@@ -0,0 +1,103 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+/**
+ * Reference to a job for CWorkerPool::Run(), called with the job index.
+ *
+ * Unlike a std::function it never copies the callable so making one does not allocate, whatever
+ * the lambda captures. The callable has to outlive the reference, which a temporary does for Run().
+ */
+class CWorkerPoolJob
+{
+public:
+
+	template<class F, class = std::enable_if_t<!std::is_same<std::decay_t<F>, CWorkerPoolJob>::value>>
+	CWorkerPoolJob(const F& job):
+		m_job(&job),
+		m_call([](const void* job, unsigned int i) { (*(const F*)job)(i); })
+	{
+	}
+
+	void operator()(unsigned int i) const { m_call(m_job, i); }
+
+private:
+
+	const void* m_job;
+	void (*m_call)(const void* job, unsigned int i);
+};
+
+
+/**
+ * Pool of persistent worker threads which can run a batch of jobs in parallel.
+ *
+ * The threads are created once, pinned to their own logical processor out of the ones the process
+ * may use (not pinned if the process spans processor groups) and reused for every
+ * batch, so running a batch does not create threads or allocate. The thread calling Run()
+ * does work as well, a pool of N workers therefore has N-1 threads of its own.
+ *
+ * Run() is not re-entrant, only one thread at a time can use a pool.
+ */
+class CWorkerPool
+{
+public:
+
+	// Job, called with the job index [0, jobCount)
+	typedef CWorkerPoolJob Job;
+
+	CWorkerPool(unsigned int workers);
+	~CWorkerPool();
+
+	// Amount of jobs which can run at the same time, including the calling thread
+	unsigned int Workers() const { return (unsigned int)m_threads.size() + 1; }
+
+	// Run job for every index in [0, jobCount) and return when all are done.
+	// If a job throws, the first exception is re-thrown here after all jobs finished.
+	void Run(unsigned int jobCount, const Job& job);
+
+private:
+
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	std::condition_variable m_doneCondition;
+	bool m_stop = false;
+	uint64_t m_generation = 0;
+	size_t m_busyThreads = 0;
+	std::exception_ptr m_exception;
+
+	const Job* m_job = nullptr;
+	unsigned int m_jobCount = 0;
+	std::atomic<unsigned int> m_nextJob{ 0 };
+
+	void ThreadProc(unsigned int worker);
+	void RunJobs();
+
+	// Stop and join the threads, which have to be joined before they are destroyed
+	void StopThreads();
+};
+
+
+// Split total items in parts and get the range [begin, end) of the given part.
+// Part boundaries are a multiple of alignment (except the end of the last part).
+void WorkerPoolSplit(
+	uint32_t total, uint32_t parts, uint32_t part, uint32_t alignment,
+	uint32_t& begin, uint32_t& end);
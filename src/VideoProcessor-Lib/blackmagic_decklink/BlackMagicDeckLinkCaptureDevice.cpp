@@ -11,11 +11,13 @@
 
 #pragma warning(disable : 26812)  // class enum over class in BM API
 
+#include <algorithm>
 #include <set>
 #include <math.h>
 
 #include <blackmagic_decklink/BlackMagicDeckLinkTranslate.h>
 #include <cie.h>
+#include <PipelineTrace.h>
 #include <StringUtils.h>
 #include <WallClock.h>
 
@@ -24,6 +26,9 @@
 
 static const timingclocktime_t DECKLINK_CLOCK_MAX_TICKS_SECOND = 1000000LL;  // us
 
+// Input frames the driver holds on its own, capturing into and waiting to be delivered
+static const size_t DECKLINK_DRIVER_FRAME_BUFFERS = 4;
+
 
 //
 // Constructor & destructor
@@ -37,7 +42,8 @@ BlackMagicDeckLinkCaptureDevice::BlackMagicDeckLinkCaptureDevice(const IDeckLink
 	m_deckLinkProfileManager(deckLinkDevice),
 	m_deckLinkNotification(deckLinkDevice),
 	m_deckLinkStatus(deckLinkDevice),
-	m_deckLinkHDMIInputEDID(deckLinkDevice)
+	m_deckLinkHDMIInputEDID(deckLinkDevice),
+	m_timingClock(*this, m_performanceCounterClock)
 {
 	if (!deckLinkDevice)
 		throw std::runtime_error("No DeckLink device given in constructor");
@@ -186,6 +192,21 @@ void BlackMagicDeckLinkCaptureDevice::StartCapture()
 
 	m_deckLinkInput->SetCallback(this);
 
+	//
+	// Input frame memory, needs to be set before enabling the input.
+	// Not having it is no reason not to capture, the driver will allocate itself then.
+	//
+
+	m_frameAllocator = new BlackMagicDeckLinkFrameAllocator(
+		m_captureBufferHeldFrames + DECKLINK_DRIVER_FRAME_BUFFERS,
+		m_captureBufferLargePages);
+
+	IF_NOT_S_OK(m_deckLinkInput->SetVideoInputFrameMemoryAllocator(m_frameAllocator))
+	{
+		DbgLog((LOG_TRACE, 1, TEXT("BlackMagicDeckLinkCaptureDevice::StartCapture(): Failed to set frame allocator, using the driver's")));
+		m_frameAllocator.Release();
+	}
+
 	//
 	// Enable video input
 	//
@@ -220,12 +241,15 @@ void BlackMagicDeckLinkCaptureDevice::StartCapture()
 
 	displayMode.Release();
 
+	// Room for whatever the input switches to, the format changes come in on the driver's thread
+	CaptureBuffersReserve();
+
 	//
 	// Reset stats
 	//
 
-	m_capturedVideoFrameCount = 0;
-	m_missedVideoFrameCount = 0;
+	m_frameArrivalCounter.Reset();
+	m_timestampSmoother.Reset();
 
 
 	//
@@ -251,15 +275,36 @@ void BlackMagicDeckLinkCaptureDevice::StartCapture()
 		throw std::runtime_error("Failed to StartStreams");
 	}
 
+	m_timingClock.Start();
+
 	DbgLog((LOG_TRACE, 1, TEXT("BlackMagicDeckLinkCaptureDevice::StopCapture(): completed successfully")));
 }
 
 
+void BlackMagicDeckLinkCaptureDevice::SetCaptureBuffering(size_t heldFrames, bool largePages)
+{
+	m_captureBufferHeldFrames = heldFrames;
+	m_captureBufferLargePages = largePages;
+}
+
+
+FrameBufferArenaStats BlackMagicDeckLinkCaptureDevice::CaptureBufferStats() const
+{
+	if (!m_frameAllocator)
+		return FrameBufferArenaStats();
+
+	return m_frameAllocator->Stats();
+}
+
+
 void BlackMagicDeckLinkCaptureDevice::StopCapture()
 {
 	if (!m_outputCaptureData.load(std::memory_order_acquire))
 		throw std::runtime_error("StopCapture() called while not started");
 
+	// Stop sampling the hardware clock while it can still be read
+	m_timingClock.Stop();
+
 	// Stop egressing data
 	m_outputCaptureData.store(false, std::memory_order_release);
 
@@ -289,6 +334,10 @@ void BlackMagicDeckLinkCaptureDevice::StopCapture()
 	m_deckLinkInput.Release();
 	m_deckLinkInput = nullptr;
 
+	// Kept for the stats, the memory goes once the frames still out are back
+	if (m_frameAllocator)
+		m_frameAllocator->Free();
+
 	DbgLog((LOG_TRACE, 1, TEXT("BlackMagicDeckLinkCaptureDevice::StopCapture() completed successfully")));
 }
 
@@ -336,7 +385,7 @@ ITimingClock* BlackMagicDeckLinkCaptureDevice::GetTimingClock()
 	if (m_state != CaptureDeviceState::CAPTUREDEVICESTATE_CAPTURING)
 		return nullptr;
 
-	return this;
+	return &m_timingClock;
 }
 
 
@@ -346,7 +395,7 @@ void BlackMagicDeckLinkCaptureDevice::SetFrameOffsetMs(int frameOffsetMs)
 
 	static_assert(DECKLINK_CLOCK_MAX_TICKS_SECOND % 1000 == 0, "DECKLINK_CLOCK_MAX_TICKS_SECOND  must be mod 1k for optimization here");
 	const timingclocktime_t ticksPerMs = DECKLINK_CLOCK_MAX_TICKS_SECOND / 1000;
-	m_frameOffsetTicks = frameOffsetMs * ticksPerMs;
+	m_frameOffsetTicks.store(frameOffsetMs * ticksPerMs, std::memory_order_relaxed);
 }
 
 
@@ -482,7 +531,10 @@ HRESULT STDMETHODCALLTYPE BlackMagicDeckLinkCaptureDevice::VideoInputFormatChang
 		ResetVideoState();
 		m_bmdPixelFormat = bmdPixelFormat;
 		m_bmdDisplayMode = newMode->GetDisplayMode();
-		m_ticksPerFrame = (timingclocktime_t)round((1.0 / FPS(m_bmdDisplayMode)) * TimingClockTicksPerSecond());
+
+		const RationalTimebase frameTimebase = Translate(m_bmdDisplayMode)->FrameTimebase(TimingClockTicksPerSecond());
+		m_frameArrivalCounter.SetFrameTimebase(frameTimebase);
+		m_timestampSmoother.SetFrameDuration(frameTimebase.Ratio(), TimingClockTicksPerSecond());
 
 		// Inform callback handlers that stream will be invalid before re-starting
 		if (!SendVideoStateCallback())
@@ -563,31 +615,27 @@ HRESULT STDMETHODCALLTYPE BlackMagicDeckLinkCaptureDevice::VideoInputFrameArrive
 			return E_FAIL;
 		}
 
-		// Figure out how many frames fit in the interval
-		if (m_previousTimingClockFrameTime != TIMING_CLOCK_TIME_INVALID)
-		{
-			assert(m_previousTimingClockFrameTime < timingClockFrameTime);
-
-			const double frameDiffTicks = (double)(timingClockFrameTime - m_previousTimingClockFrameTime);
-			const int frames = (int)round(frameDiffTicks / m_ticksPerFrame);
-			assert(frames >= 0);
+		// Counts the frames which were missed since the previous one as well
+		const uint64_t frameCounter = m_frameArrivalCounter.OnFrame(timingClockFrameTime);
 
-			m_capturedVideoFrameCount += frames;
-			m_missedVideoFrameCount += std::max((frames - 1), 0);
-		}
-
-		m_previousTimingClockFrameTime = timingClockFrameTime;
+		PipelineTrace::SetThreadName("capture");
+		CPipelineTraceScope traceScope(PipelineTraceStage::CAPTURE_CALLBACK, frameCounter);
 
 		// Every every so often get the hardware latency.
 		// TODO: Change to framerate rather than fixed number of frames
-		if(m_capturedVideoFrameCount % 20 == 0)
+		if(frameCounter % 20 == 0)
 		{
-			timingclocktime_t timingClockNow = TimingClockNow();
+			timingclocktime_t timingClockNow = m_timingClock.TimingClockNow();
 			m_hardwareLatencyMs = TimingClockDiffMs(timingClockFrameTime, timingClockNow, TimingClockTicksPerSecond());
 		}
 
+		// Always smoothed so that the jitter is measured, only used if asked for
+		const timingclocktime_t smoothedFrameTime = m_timestampSmoother.Smooth(timingClockFrameTime);
+		if (m_smoothTimestamps)
+			timingClockFrameTime = smoothedFrameTime;
+
 		// Offset timestamp. Do this after getting the hardware latency else it'll account for this as well
-		timingClockFrameTime += m_frameOffsetTicks;
+		timingClockFrameTime += m_frameOffsetTicks.load(std::memory_order_relaxed);
 
 		// Check if vertical inverted
 		const bool videoInvertedVertical = (videoFrame->GetFlags() & bmdFrameFlagFlipVertical) != 0;
@@ -615,6 +663,8 @@ HRESULT STDMETHODCALLTYPE BlackMagicDeckLinkCaptureDevice::VideoInputFrameArrive
 		}
 #endif // _DEBUG
 
+		CPipelineTraceScope metadataTraceScope(PipelineTraceStage::CAPTURE_METADATA, frameCounter);
+
 		double doubleValue = 0.0;
 		LONGLONG intValue = 0;
 
@@ -787,12 +837,14 @@ HRESULT STDMETHODCALLTYPE BlackMagicDeckLinkCaptureDevice::VideoInputFrameArrive
 				return E_FAIL;
 		}
 
+		metadataTraceScope.End();
+
 		void* data;
 		if (FAILED(videoFrame->GetBytes(&data)))
 			throw std::runtime_error("Failed to get video frame bytes");
 
 		VideoFrame vpVideoFrame(
-			data, m_capturedVideoFrameCount,
+			data, frameCounter,
 			timingClockFrameTime, videoFrame);
 
 		m_callback->OnCaptureDeviceVideoFrame(vpVideoFrame);
@@ -920,6 +972,67 @@ void BlackMagicDeckLinkCaptureDevice::ResetVideoState()
 }
 
 
+void BlackMagicDeckLinkCaptureDevice::CaptureBuffersReserve()
+{
+	assert(m_deckLinkInput);
+
+	if (!m_frameAllocator)
+		return;
+
+	// What VideoInputFormatChanged() can pick
+	static const BMDPixelFormat bmdPixelFormats[] = {
+		bmdFormat8BitYUV,
+		bmdFormat10BitYUV,
+		bmdFormat8BitARGB,
+		bmdFormat10BitRGB,
+		bmdFormat12BitRGB
+	};
+
+	CComPtr<IDeckLinkDisplayModeIterator> displayModeIterator;
+	IF_NOT_S_OK(m_deckLinkInput->GetDisplayModeIterator(&displayModeIterator))
+	{
+		DbgLog((LOG_TRACE, 1, TEXT("BlackMagicDeckLinkCaptureDevice::CaptureBuffersReserve(): Failed to get display modes")));
+		return;
+	}
+
+	size_t frameBytes = 0;
+	CComPtr<IDeckLinkDisplayMode> displayMode;
+
+	while (displayModeIterator->Next(&displayMode) == S_OK)
+	{
+		for (const BMDPixelFormat bmdPixelFormat : bmdPixelFormats)
+		{
+			try
+			{
+				// Colorspace does not change the size
+				VideoState videoState;
+				videoState.displayMode = Translate(displayMode->GetDisplayMode());
+				videoState.videoFrameEncoding = Translate(bmdPixelFormat, ColorSpace::UNKNOWN);
+
+				frameBytes = std::max(frameBytes, videoState.BytesPerFrame());
+			}
+			catch (const std::runtime_error&)
+			{
+				// Modes we don't know are not captured either
+			}
+		}
+
+		displayMode.Release();
+	}
+
+	try
+	{
+		m_frameAllocator->Reserve(frameBytes);
+	}
+	catch (const std::runtime_error& e)
+	{
+		// Frames which do not fit the arena there is, if any, are dropped as starved
+		CString error(e.what());
+		DbgLog((LOG_TRACE, 1, TEXT("BlackMagicDeckLinkCaptureDevice::CaptureBuffersReserve(): Failed: %s"), error.GetString()));
+	}
+}
+
+
 bool BlackMagicDeckLinkCaptureDevice::SendVideoStateCallback()
 {
 	// WARNING: Called from some internal capture card thread!
@@ -938,12 +1051,36 @@ bool BlackMagicDeckLinkCaptureDevice::SendVideoStateCallback()
 		m_videoHasHdrData &&
 		m_videoHdrData.IsValid();
 
+	// What the video state is built from, the rest is left at the defaults so that it compares equal
+	SentVideoState sent;
+	sent.valid = hasValidVideoState;
+	if (hasValidVideoState)
+	{
+		sent.bmdPixelFormat = m_bmdPixelFormat;
+		sent.bmdDisplayMode = m_bmdDisplayMode;
+		sent.invertedVertical = m_videoInvertedVertical;
+		sent.eotf = m_videoEotf;
+		sent.colorSpace = m_videoColorSpace;
+		sent.hasHdrData = hasValidHdrData;
+		if (hasValidHdrData)
+			sent.hdrData = m_videoHdrData;
+	}
+
 	//
 	// Build and send reply
 	//
 
 	try
 	{
+		// Sent this one recently, send it again
+		for (const SentVideoState& sentBefore : m_sentVideoStates)
+		{
+			if (sentBefore.videoState && sentBefore.SameAs(sent))
+			{
+				m_callback->OnCaptureDeviceVideoStateChange(sentBefore.videoState);
+				return true;
+			}
+		}
 
 		VideoStateComPtr videoState = new VideoState();
 		if (!videoState)
@@ -981,6 +1118,11 @@ bool BlackMagicDeckLinkCaptureDevice::SendVideoStateCallback()
 			}
 		}
 
+		// Replaces the oldest
+		sent.videoState = videoState;
+		m_sentVideoStates[m_sentVideoStatesNext] = sent;
+		m_sentVideoStatesNext = (m_sentVideoStatesNext + 1) % SENT_VIDEO_STATES;
+
 		m_callback->OnCaptureDeviceVideoStateChange(videoState);
 	}
 	catch (const std::runtime_error& e)
@@ -996,6 +1138,20 @@ bool BlackMagicDeckLinkCaptureDevice::SendVideoStateCallback()
 }
 
 
+bool BlackMagicDeckLinkCaptureDevice::SentVideoState::SameAs(const SentVideoState& other) const
+{
+	return
+		valid == other.valid &&
+		bmdPixelFormat == other.bmdPixelFormat &&
+		bmdDisplayMode == other.bmdDisplayMode &&
+		invertedVertical == other.invertedVertical &&
+		eotf == other.eotf &&
+		colorSpace == other.colorSpace &&
+		hasHdrData == other.hasHdrData &&
+		(!hasHdrData || hdrData == other.hdrData);
+}
+
+
 void BlackMagicDeckLinkCaptureDevice::SendCardStateCallback()
 {
 	// WARNING: Called from some internal capture card thread!
@@ -16,7 +16,12 @@
 
 #include <VideoFrame.h>
 #include <ACaptureDevice.h>
+#include <blackmagic_decklink/BlackMagicDeckLinkFrameAllocator.h>
+#include <FrameArrivalCounter.h>
+#include <InterpolatedTimingClock.h>
 #include <ITimingClock.h>
+#include <PerformanceCounterTimingClock.h>
+#include <TimestampSmoother.h>
 
 
 typedef CComPtr<IDeckLink> IDeckLinkComPtr;
@@ -56,11 +61,16 @@ public:
 	void SetCaptureInput(const CaptureInputId) override;
 	ITimingClock* GetTimingClock() override;
 	void SetFrameOffsetMs(int) override;
+	void SetTimestampSmoothing(bool smooth) override { m_smoothTimestamps = smooth; }
+	void SetCaptureBuffering(size_t heldFrames, bool largePages) override;
+	FrameBufferArenaStats CaptureBufferStats() const override;
 	double HardwareLatencyMs() const override { return m_hardwareLatencyMs; }
-	uint64_t VideoFrameCapturedCount() const override { return m_capturedVideoFrameCount; }
-	uint64_t VideoFrameMissedCount() const override { return m_missedVideoFrameCount; }
+	uint64_t VideoFrameCapturedCount() const override { return m_frameArrivalCounter.CapturedCount(); }
+	uint64_t VideoFrameMissedCount() const override { return m_frameArrivalCounter.MissedCount(); }
+	const TimestampJitterHistograms& TimestampJitter() const override { return m_timestampSmoother.Jitter(); }
 
-	// ITimingClock
+	// ITimingClock, reads the hardware clock through the driver on every call.
+	// GetTimingClock() hands out an interpolation of this which is much cheaper to read.
 	timingclocktime_t TimingClockNow() override;
 	timingclocktime_t TimingClockTicksPerSecond() const override;
 	const TCHAR* TimingClockDescription() override;
@@ -93,9 +103,20 @@ private:
 	bool m_canCapture = true;
 	std::vector<CaptureInput> m_captureInputSet;
 
-	timingclocktime_t m_frameOffsetTicks = 0;
+	// Set from the GUI thread while the capture callback reads it
+	std::atomic<timingclocktime_t> m_frameOffsetTicks{ 0 };
+	std::atomic_bool m_smoothTimestamps = false;
 	double m_hardwareLatencyMs = 0;
 
+	// Hardware clock interpolated on the performance counter, sampled while capturing
+	CPerformanceCounterTimingClock m_performanceCounterClock;
+	CInterpolatedTimingClock m_timingClock;
+
+	// Input frame memory, made on StartCapture() and kept after for the stats
+	size_t m_captureBufferHeldFrames = 0;
+	bool m_captureBufferLargePages = false;
+	CComPtr<BlackMagicDeckLinkFrameAllocator> m_frameAllocator;
+
 	// If false this will not send any more frames out.
 	std::atomic_bool m_outputCaptureData = false;
 
@@ -113,16 +134,39 @@ private:
 	bool m_videoFrameSeen = false;
 	BMDPixelFormat m_bmdPixelFormat = BMD_PIXEL_FORMAT_INVALID;
 	BMDDisplayMode m_bmdDisplayMode = BMD_DISPLAY_MODE_INVALID;
-	timingclocktime_t m_ticksPerFrame = TIMING_CLOCK_TIME_INVALID;
 	bool m_videoHasInputSource = false;
 	bool m_videoInvertedVertical = false;
 	LONGLONG m_videoEotf = BMD_EOTF_INVALID;
 	LONGLONG m_videoColorSpace = BMD_COLOR_SPACE_INVALID;
 	bool m_videoHasHdrData = false;
 	HDRData m_videoHdrData;
-	uint64_t m_capturedVideoFrameCount = 0;
-	uint64_t m_missedVideoFrameCount = 0;
-	timingclocktime_t m_previousTimingClockFrameTime = TIMING_CLOCK_TIME_INVALID;
+
+	// Video states sent recently and what they were built from. Metadata which flips between a few values
+	// gets the video state it had before sent again rather than a newly allocated one every flip.
+	// WARNING: R/W from the capture thread, do not read from other thread
+	struct SentVideoState
+	{
+		bool valid = false;
+		BMDPixelFormat bmdPixelFormat = BMD_PIXEL_FORMAT_INVALID;
+		BMDDisplayMode bmdDisplayMode = BMD_DISPLAY_MODE_INVALID;
+		bool invertedVertical = false;
+		LONGLONG eotf = BMD_EOTF_INVALID;
+		LONGLONG colorSpace = BMD_COLOR_SPACE_INVALID;
+		bool hasHdrData = false;
+		HDRData hdrData;
+
+		VideoStateComPtr videoState;
+
+		// Built from the same values
+		bool SameAs(const SentVideoState& other) const;
+	};
+
+	static const size_t SENT_VIDEO_STATES = 4;
+	SentVideoState m_sentVideoStates[SENT_VIDEO_STATES];
+	size_t m_sentVideoStatesNext = 0;
+
+	CFrameArrivalCounter m_frameArrivalCounter;
+	CTimestampSmoother m_timestampSmoother;
 
 	void ResetVideoState();
 
@@ -130,6 +174,11 @@ private:
 	bool SendVideoStateCallback();
 	void SendCardStateCallback();
 
+	// Make room in the capture buffers for the largest frames of any mode and pixel format the input
+	// can switch to. The driver only gets buffers out of what is there and the mode changes come in on
+	// its thread, where the arena can't be made, so this is done once before the streams start.
+	void CaptureBuffersReserve();
+
 	// Current state, update through UpdateState()
 	// WARNING: R/W from the capture thread, do not read from other thread
 	CaptureDeviceState m_state = CaptureDeviceState::CAPTUREDEVICESTATE_UNKNOWN;
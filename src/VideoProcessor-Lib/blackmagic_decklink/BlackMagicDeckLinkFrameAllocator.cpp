@@ -0,0 +1,112 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include "BlackMagicDeckLinkFrameAllocator.h"
+
+
+BlackMagicDeckLinkFrameAllocator::BlackMagicDeckLinkFrameAllocator(size_t bufferCount, bool largePages):
+	m_allocator(bufferCount, largePages)
+{
+}
+
+
+//
+// IDeckLinkMemoryAllocator
+//
+
+
+HRESULT BlackMagicDeckLinkFrameAllocator::AllocateBuffer(unsigned int bufferSize, void** allocatedBuffer)
+{
+	// WARNING: Called from some internal capture card thread!
+
+	if (!allocatedBuffer)
+		return E_INVALIDARG;
+
+	// Out of the arena only, the driver drops the frame if there is no room
+	*allocatedBuffer = m_allocator.Allocate(bufferSize);
+	if (!*allocatedBuffer)
+		return E_OUTOFMEMORY;
+
+	return S_OK;
+}
+
+
+HRESULT BlackMagicDeckLinkFrameAllocator::ReleaseBuffer(void* buffer)
+{
+	// WARNING: Called from whichever thread released the last reference to the frame
+
+	try
+	{
+		m_allocator.Release(buffer);
+	}
+	catch (const std::runtime_error&)
+	{
+		return E_INVALIDARG;
+	}
+
+	return S_OK;
+}
+
+
+HRESULT BlackMagicDeckLinkFrameAllocator::Commit()
+{
+	// WARNING: Can be called from some internal capture card thread!
+
+	// Nothing to do, the arena was reserved before capture started
+	return S_OK;
+}
+
+
+HRESULT BlackMagicDeckLinkFrameAllocator::Decommit()
+{
+	// WARNING: Can be called from some internal capture card thread!
+
+	// Kept for the streams restarting on a mode change, Free() lets go of it
+	return S_OK;
+}
+
+
+//
+// IUnknown
+//
+
+
+HRESULT	BlackMagicDeckLinkFrameAllocator::QueryInterface(REFIID iid, LPVOID* ppv)
+{
+	if (!ppv)
+		return E_INVALIDARG;
+
+	*ppv = nullptr;
+
+	if (iid == IID_IUnknown || iid == IID_IDeckLinkMemoryAllocator)
+	{
+		*ppv = static_cast<IDeckLinkMemoryAllocator*>(this);
+		AddRef();
+		return S_OK;
+	}
+
+	return E_NOINTERFACE;
+}
+
+
+ULONG BlackMagicDeckLinkFrameAllocator::AddRef(void)
+{
+	return ++m_refCount;
+}
+
+
+ULONG BlackMagicDeckLinkFrameAllocator::Release(void)
+{
+	ULONG newRefValue = --m_refCount;
+	if (newRefValue == 0)
+		delete this;
+
+	return newRefValue;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <atomic>
+
+#include <DeckLinkAPI_h.h>
+
+#include <FrameBufferAllocator.h>
+
+
+/**
+ * Input frame memory for the DeckLink driver from a frame buffer arena of our own.
+ *
+ * The driver captures into buffers it gets from here and gives them back once the frame it handed out has
+ * been released, which is when the last VideoFrame on it is gone. Set it on the input before enabling it
+ * and Reserve() the largest frame size of the input before starting, buffers are never allocated on demand.
+ * The driver calls Commit() and Decommit() on its own threads when it restarts the streams on a mode
+ * change, so those keep the arena and Free() lets go of it once capture has stopped.
+ */
+class BlackMagicDeckLinkFrameAllocator:
+	public IDeckLinkMemoryAllocator
+{
+public:
+
+	// Buffers for the frames the driver holds plus those held downstream
+	BlackMagicDeckLinkFrameAllocator(size_t bufferCount, bool largePages);
+	virtual ~BlackMagicDeckLinkFrameAllocator() {}
+
+	// Largest frames which are going to come, makes the arena if there is none or it's too small.
+	// WARNING: Allocates the arena, do not call from the driver's threads
+	void Reserve(size_t frameBytes) { m_allocator.Reserve(frameBytes); }
+
+	// Capture stopped, frees the arena once its buffers are back
+	void Free() { m_allocator.Free(); }
+
+	// Use of the arenas since construction
+	FrameBufferArenaStats Stats() const { return m_allocator.Stats(); }
+
+	// IDeckLinkMemoryAllocator
+	HRESULT AllocateBuffer(unsigned int bufferSize, void** allocatedBuffer) override;
+	HRESULT ReleaseBuffer(void* buffer) override;
+	HRESULT Commit() override;
+	HRESULT Decommit() override;
+
+	// IUnknown
+	HRESULT	QueryInterface(REFIID iid, LPVOID* ppv) override;
+	ULONG AddRef() override;
+	ULONG Release() override;
+
+private:
+
+	CFrameBufferAllocator m_allocator;
+
+	std::atomic<ULONG> m_refCount{ 0 };
+};
@@ -310,13 +310,3 @@ DisplayModeSharedPtr Translate(BMDDisplayMode displayMode)
 		(unsigned int)it->second.timeScale,
 		(unsigned int)it->second.frameDuration);
 }
-
-
-double FPS(BMDDisplayMode displayMode)
-{
-	const auto& it = BD_DISPLAY_MODE_DATA.find(displayMode);
-	if (it == BD_DISPLAY_MODE_DATA.end())
-		throw std::runtime_error("Unknown BMDDisplayMode");
-
-	return (double)(it->second.timeScale) / (double)(it->second.frameDuration);
-}
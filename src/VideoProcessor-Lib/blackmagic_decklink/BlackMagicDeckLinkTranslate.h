@@ -30,5 +30,3 @@ EOTF TranslateEOTF(LONGLONG electroOpticalTransferFuncValue);
 ColorSpace Translate(BMDColorspace, uint32_t verticalLines);
 
 DisplayModeSharedPtr Translate(BMDDisplayMode);
-
-double FPS(BMDDisplayMode displayMode);
@@ -0,0 +1,153 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+#include "HeadlessFrameSinks.h"
+
+
+//
+// CDiscardHeadlessFrameSink
+//
+
+
+void CDiscardHeadlessFrameSink::OnSinkStart(ITimingClock*, size_t)
+{
+	m_frameCount = 0;
+}
+
+
+void CDiscardHeadlessFrameSink::OnSinkFrame(const BYTE*, size_t, const DirectShowFrameTimes&)
+{
+	++m_frameCount;
+}
+
+
+void CDiscardHeadlessFrameSink::OnSinkStop()
+{
+}
+
+
+//
+// CChecksumHeadlessFrameSink
+//
+
+
+void CChecksumHeadlessFrameSink::OnSinkStart(ITimingClock*, size_t)
+{
+	m_frameCount = 0;
+	m_lastFrameChecksum = 0;
+	m_streamChecksum = 0;
+}
+
+
+void CChecksumHeadlessFrameSink::OnSinkFrame(const BYTE* data, size_t size, const DirectShowFrameTimes&)
+{
+	const uint64_t checksum = Checksum(data, size);
+
+	m_lastFrameChecksum = checksum;
+	m_streamChecksum = (m_streamChecksum * 1099511628211ULL) ^ checksum;
+	++m_frameCount;
+}
+
+
+void CChecksumHeadlessFrameSink::OnSinkStop()
+{
+}
+
+
+uint64_t CChecksumHeadlessFrameSink::Checksum(const BYTE* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	// Word at a time, per byte is too slow to keep up with large frames
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+
+		hash ^= word;
+		hash *= 1099511628211ULL;
+	}
+
+	for (; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+
+//
+// CVsyncHeadlessFrameSink
+//
+
+
+CVsyncHeadlessFrameSink::CVsyncHeadlessFrameSink(double refreshRateHz):
+	m_refreshRateHz(refreshRateHz)
+{
+	if (refreshRateHz < 1.0)
+		throw std::runtime_error("Refresh rate needs to be at least 1Hz");
+}
+
+
+void CVsyncHeadlessFrameSink::OnSinkStart(ITimingClock* timingClock, size_t)
+{
+	if (!timingClock)
+		throw std::runtime_error("Vsync sink needs a timing clock");
+
+	m_timingClock = timingClock;
+	m_firstVsync = TIMING_CLOCK_TIME_INVALID;
+	m_previousVsync = 0;
+	m_frameCount = 0;
+	m_repeatedVsyncCount = 0;
+}
+
+
+void CVsyncHeadlessFrameSink::OnSinkFrame(const BYTE*, size_t, const DirectShowFrameTimes&)
+{
+	const double ticksPerVsync = m_timingClock->TimingClockTicksPerSecond() / m_refreshRateHz;
+	const timingclocktime_t now = m_timingClock->TimingClockNow();
+
+	// The display starts scanning out when the first frame arrives
+	if (m_firstVsync == TIMING_CLOCK_TIME_INVALID)
+	{
+		m_firstVsync = now;
+		m_previousVsync = 0;
+		++m_frameCount;
+		return;
+	}
+
+	// Frame goes out on the first vsync after the one which showed the previous frame
+	const uint64_t currentVsync = (uint64_t)((now - m_firstVsync) / ticksPerVsync);
+	const uint64_t vsync = std::max(currentVsync, m_previousVsync) + 1;
+
+	if (vsync > m_previousVsync + 1)
+		m_repeatedVsyncCount += vsync - m_previousVsync - 1;
+	m_previousVsync = vsync;
+
+	// Block until the flip, like a presenting renderer would
+	const timingclocktime_t vsyncTime = m_firstVsync + (timingclocktime_t)(vsync * ticksPerVsync);
+	const double waitMs = TimingClockDiffMs(now, vsyncTime, m_timingClock->TimingClockTicksPerSecond());
+	if (waitMs > 0.0)
+		std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(waitMs * 1000.0)));
+
+	++m_frameCount;
+}
+
+
+void CVsyncHeadlessFrameSink::OnSinkStop()
+{
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <atomic>
+
+#include "IHeadlessFrameSink.h"
+
+
+/**
+ * Sink which throws every frame away, measures the pipeline up to the renderer.
+ */
+class CDiscardHeadlessFrameSink:
+	public IHeadlessFrameSink
+{
+public:
+
+	// IHeadlessFrameSink
+	void OnSinkStart(ITimingClock* timingClock, size_t frameSize) override;
+	void OnSinkFrame(const BYTE* data, size_t size, const DirectShowFrameTimes& times) override;
+	void OnSinkStop() override;
+	uint64_t SinkFrameCount() const override { return m_frameCount; }
+
+private:
+
+	std::atomic<uint64_t> m_frameCount{ 0 };
+};
+
+
+/**
+ * Sink which reads every byte of every frame into a checksum, to verify formatter output and
+ * to make sure that the cost of touching the output is included.
+ */
+class CChecksumHeadlessFrameSink:
+	public IHeadlessFrameSink
+{
+public:
+
+	// IHeadlessFrameSink
+	void OnSinkStart(ITimingClock* timingClock, size_t frameSize) override;
+	void OnSinkFrame(const BYTE* data, size_t size, const DirectShowFrameTimes& times) override;
+	void OnSinkStop() override;
+	uint64_t SinkFrameCount() const override { return m_frameCount; }
+
+	// Checksum of the last frame
+	uint64_t LastFrameChecksum() const { return m_lastFrameChecksum; }
+
+	// All frame checksums since the start combined, equal for equal streams
+	uint64_t StreamChecksum() const { return m_streamChecksum; }
+
+	// FNV-1a 64-bit over the 64-bit words of a buffer, the tail per byte
+	static uint64_t Checksum(const BYTE* data, size_t size);
+
+private:
+
+	std::atomic<uint64_t> m_frameCount{ 0 };
+	std::atomic<uint64_t> m_lastFrameChecksum{ 0 };
+	std::atomic<uint64_t> m_streamChecksum{ 0 };
+};
+
+
+/**
+ * Sink which behaves like a renderer presenting on a display with a fixed refresh rate,
+ * every frame blocks the delivery until the next vsync.
+ */
+class CVsyncHeadlessFrameSink:
+	public IHeadlessFrameSink
+{
+public:
+
+	CVsyncHeadlessFrameSink(double refreshRateHz);
+
+	// IHeadlessFrameSink
+	void OnSinkStart(ITimingClock* timingClock, size_t frameSize) override;
+	void OnSinkFrame(const BYTE* data, size_t size, const DirectShowFrameTimes& times) override;
+	void OnSinkStop() override;
+	uint64_t SinkFrameCount() const override { return m_frameCount; }
+
+	// Vsyncs which did not get a new frame and repeated the previous one
+	uint64_t RepeatedVsyncCount() const { return m_repeatedVsyncCount; }
+
+private:
+
+	const double m_refreshRateHz;
+
+	ITimingClock* m_timingClock = nullptr;
+	timingclocktime_t m_firstVsync = TIMING_CLOCK_TIME_INVALID;
+	uint64_t m_previousVsync = 0;
+
+	std::atomic<uint64_t> m_frameCount{ 0 };
+	std::atomic<uint64_t> m_repeatedVsyncCount{ 0 };
+};
@@ -0,0 +1,545 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <PipelineTrace.h>
+#include <video_frame_formatter/CNoopVideoFrameFormatter.h>
+#include <video_frame_formatter/CV210toP010VideoFrameFormatter.h>
+#include <video_frame_formatter/CV210toP210VideoFrameFormatter.h>
+#include <video_frame_formatter/CRGBtoRGB48VideoFrameFormatter.h>
+
+#include "HeadlessVideoRenderer.h"
+
+
+HeadlessVideoRenderer::HeadlessVideoRenderer(
+	IRendererCallback& callback,
+	IHeadlessFrameSink& sink,
+	ITimingClock* timingClock,
+	DirectShowStartStopTimeMethod timestamp,
+	bool useFrameQueue,
+	size_t frameQueueMaxSize,
+	VideoConversionOverride videoConversionOverride):
+	m_callback(callback),
+	m_sink(sink),
+	m_timingClock(timingClock),
+	m_timestamp(timestamp),
+	m_useFrameQueue(useFrameQueue),
+	m_videoConversionOverride(videoConversionOverride),
+	m_frameQueue(*this, m_droppedFrames)
+{
+	if (!timingClock)
+		throw std::runtime_error("Headless renderer needs a timing clock");
+
+	if (timingClock->TimingClockTicksPerSecond() < 1000LL)
+		throw std::runtime_error("TimingClock needs resolution of at least millisecond level");
+
+	if (!useFrameQueue && timestamp == DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK)
+		throw std::runtime_error("No queue cannot be used with clock-clock, pick another mode and restart");
+
+	if (useFrameQueue && frameQueueMaxSize == 0)
+		throw std::runtime_error("Frame queue size must be > 0");
+
+	if (useFrameQueue)
+	{
+		m_frameQueue.SetMaxFrames(frameQueueMaxSize);
+		m_frameQueue.SetNeedsNextFrame(timestamp == DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK);
+	}
+}
+
+
+HeadlessVideoRenderer::~HeadlessVideoRenderer()
+{
+	DeliveryStop();
+}
+
+
+bool HeadlessVideoRenderer::OnVideoState(VideoStateComPtr& videoState)
+{
+	if (!videoState)
+		throw std::runtime_error("null video state is invalid");
+
+	if (m_videoState)
+	{
+		// Unacceptable changes to this renderer, return false and get cleaned up
+		if (videoState->valid == false ||
+			videoState->colorspace != m_videoState->colorspace ||
+			videoState->eotf != m_videoState->eotf ||
+			*(videoState->displayMode) != *(m_videoState->displayMode) ||
+			videoState->videoFrameEncoding != m_videoState->videoFrameEncoding)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		// No video state yet, initialize
+		m_videoState = videoState;
+	}
+
+	// All good, continue
+	return true;
+}
+
+
+void HeadlessVideoRenderer::OnVideoFrame(VideoFrame& videoFrame)
+{
+	// Called from some unknown thread, but with promise that Start() has completed
+
+	assert(m_state == RendererState::RENDERSTATE_RENDERING);
+	assert(m_videoState);
+	assert(videoFrame.GetTimingTimestamp() > 0);
+
+	const timingclocktime_t ticksPerSecond = m_timingClock->TimingClockTicksPerSecond();
+
+	// Delay until now
+	const timingclocktime_t entryTime = m_timingClock->TimingClockNow();
+	m_latencyHistograms.entry.Record(TimingClockDiffMs(videoFrame.GetTimingTimestamp(), entryTime, ticksPerSecond));
+
+	// Reject frames if not processing
+	if (!m_isActive)
+		return;
+
+	CPipelineTraceScope getDeliveryBufferTraceScope(PipelineTraceStage::GET_DELIVERY_BUFFER, videoFrame.GetCounter());
+
+	BYTE* buffer = GetFormatBuffer();
+	if (!buffer)
+	{
+		m_droppedFrames.Add(FrameDropReason::FRAMEDROP_FAILED);
+		PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, videoFrame.GetCounter());
+		return;
+	}
+
+	getDeliveryBufferTraceScope.End();
+
+	// Format outside of the lock so that the delivery thread can keep going,
+	// the source buffer is not needed after this.
+	CPipelineTraceScope formatTraceScope(PipelineTraceStage::FORMAT, videoFrame.GetCounter());
+
+	if (!m_videoFrameFormatter->FormatVideoFrame(videoFrame, buffer))
+	{
+		DbgLog((LOG_TRACE, 1, TEXT("HeadlessVideoRenderer::OnVideoFrame(#%I64u): Format failed"), videoFrame.GetCounter()));
+
+		ReturnFormatBuffer(buffer);
+		m_droppedFrames.Add(FrameDropReason::FRAMEDROP_FAILED);
+		formatTraceScope.End();
+		PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, videoFrame.GetCounter());
+		return;
+	}
+
+	formatTraceScope.End();
+
+	const timingclocktime_t formattedTime = m_timingClock->TimingClockNow();
+	m_latencyHistograms.format.Record(TimingClockDiffMs(entryTime, formattedTime, ticksPerSecond));
+
+	const FormattedFrame formattedFrame = { buffer, videoFrame.GetCounter(), videoFrame.GetTimingTimestamp(), formattedTime };
+
+	// No queue, deliver right here like the unbuffered pin
+	if (!m_useFrameQueue)
+	{
+		DeliverFrame(formattedFrame, REFERENCE_TIME_INVALID);
+		ReturnFormatBuffer(buffer);
+		return;
+	}
+
+	m_frameQueue.Push(formattedFrame);
+}
+
+
+HRESULT HeadlessVideoRenderer::OnWindowsEvent(LONG_PTR, LONG_PTR)
+{
+	// No graph, no events
+	return S_OK;
+}
+
+
+void HeadlessVideoRenderer::Build()
+{
+	DbgLog((LOG_TRACE, 1, TEXT("HeadlessVideoRenderer::Build(): Begin")));
+
+	if (!m_videoState)
+		throw std::runtime_error("Build() needs a video state");
+
+	FormatterBuild();
+
+	if (m_formatterThreads > 1)
+	{
+		m_formatterWorkerPool.reset(new CWorkerPool(m_formatterThreads));
+		m_videoFrameFormatter->SetWorkerPool(m_formatterWorkerPool.get());
+	}
+
+	m_frameTimestamper.Initialize(m_videoState->displayMode->FrameTimebase(UNITS), m_timingClock, m_timestamp);
+
+	// A full queue, one being formatted and one held by the sink. With a byte limit that's fewer than the max size.
+	// The queue holds what the formatter made of the frames, which can be larger or smaller than they came in.
+	const size_t frameSize = (size_t)m_videoFrameFormatter->GetOutFrameSize();
+	m_frameQueue.SetFrameBytes(frameSize);
+	const size_t bufferCount = m_useFrameQueue ? m_frameQueue.FrameLimit() + 2 : 1;
+
+	// Back to the pool first so that a rebuild with the same frame size gets them again
+	m_freeFrameBuffers.clear();
+	m_frameBuffers.clear();
+
+	for (size_t i = 0; i < bufferCount; ++i)
+	{
+		CFrameBuffer frameBuffer = CFrameBufferPool::Shared().Get(FrameBufferLayout(frameSize));
+		if (!frameBuffer)
+			throw std::runtime_error("Failed to get a frame buffer from the pool");
+
+		m_freeFrameBuffers.push_back(frameBuffer.Data());
+		m_frameBuffers.push_back(std::move(frameBuffer));
+	}
+
+	SetState(RendererState::RENDERSTATE_READY);
+
+	DbgLog((LOG_TRACE, 1, TEXT("HeadlessVideoRenderer::Build(): End")));
+}
+
+
+void HeadlessVideoRenderer::Start()
+{
+	DbgLog((LOG_TRACE, 1, TEXT("HeadlessVideoRenderer::Start()")));
+
+	if (!m_videoFrameFormatter)
+		throw std::runtime_error("Start() called before Build()");
+
+	m_sink.OnSinkStart(m_timingClock, (size_t)m_videoFrameFormatter->GetOutFrameSize());
+
+	DeliveryStart();
+
+	SetState(RendererState::RENDERSTATE_RENDERING);
+}
+
+
+void HeadlessVideoRenderer::Stop()
+{
+	DbgLog((LOG_TRACE, 1, TEXT("HeadlessVideoRenderer::Stop()")));
+
+	m_state = RendererState::RENDERSTATE_STOPPING;
+
+	DeliveryStop();
+
+	m_sink.OnSinkStop();
+
+	SetState(RendererState::RENDERSTATE_STOPPED);
+}
+
+
+void HeadlessVideoRenderer::Reset()
+{
+	DeliveryStop();
+
+	m_frameTimestamper.Reset();
+
+	DeliveryStart();
+}
+
+
+void HeadlessVideoRenderer::SetFormatterThreads(unsigned int formatterThreads)
+{
+	if (formatterThreads == 0)
+		throw std::runtime_error("Need at least one formatter thread");
+
+	if (m_videoFrameFormatter)
+		throw std::runtime_error("Formatter threads can only be set before Build()");
+
+	m_formatterThreads = formatterThreads;
+}
+
+
+void HeadlessVideoRenderer::SetFrameQueueMaxSize(size_t frameQueueMaxSize)
+{
+	if (!m_useFrameQueue)
+	{
+		if (frameQueueMaxSize != 0)
+			throw std::runtime_error("Renderer without a queue can only accept zero frame buffers");
+
+		return;
+	}
+
+	if (frameQueueMaxSize == 0)
+		throw std::runtime_error("Frame queue size must be > 0");
+
+	// Drops the oldest if there are more queued now
+	m_frameQueue.SetMaxFrames(frameQueueMaxSize);
+}
+
+
+void HeadlessVideoRenderer::SetFrameQueueDropPolicy(const FrameQueueDropPolicyConfig& frameQueueDropPolicy)
+{
+	if (m_videoFrameFormatter)
+		throw std::runtime_error("Frame queue drop policy can only be set before Build()");
+
+	m_frameQueue.SetDropPolicy(frameQueueDropPolicy);
+}
+
+
+void HeadlessVideoRenderer::SetFrameQueueMaxBytes(size_t frameQueueMaxBytes)
+{
+	if (m_videoFrameFormatter)
+		throw std::runtime_error("Frame queue max bytes can only be set before Build()");
+
+	m_frameQueue.SetMaxBytes(frameQueueMaxBytes);
+}
+
+
+size_t HeadlessVideoRenderer::GetFrameQueueSize()
+{
+	if (m_state != RendererState::RENDERSTATE_RENDERING)
+		throw std::runtime_error("Invalid state, can only be called while rendering");
+
+	return m_frameQueue.Size();
+}
+
+
+size_t HeadlessVideoRenderer::GetFrameQueueBytes()
+{
+	if (m_state != RendererState::RENDERSTATE_RENDERING)
+		throw std::runtime_error("Invalid state, can only be called while rendering");
+
+	return m_frameQueue.Bytes();
+}
+
+
+void HeadlessVideoRenderer::SetDeliveryThread(bool useDeliveryThread)
+{
+	if (m_state == RendererState::RENDERSTATE_RENDERING)
+		throw std::runtime_error("Delivery thread can only be changed when not rendering");
+
+	m_useDeliveryThread = useDeliveryThread;
+}
+
+
+bool HeadlessVideoRenderer::DeliverQueuedFrame()
+{
+	if (m_useDeliveryThread)
+		throw std::runtime_error("Queued frames are delivered by the delivery thread");
+
+	// Same as the delivery thread, minus the waiting
+	FormattedFrame formattedFrame, nextFormattedFrame;
+	bool hasNextFormattedFrame = false;
+	if (!m_frameQueue.TakeNext(formattedFrame, nextFormattedFrame, hasNextFormattedFrame))
+		return false;
+
+	DeliverQueuedFrame(formattedFrame, hasNextFormattedFrame ? &nextFormattedFrame : nullptr);
+	return true;
+}
+
+
+double HeadlessVideoRenderer::EntryLatencyMs() const
+{
+	if (m_state != RendererState::RENDERSTATE_RENDERING)
+		throw std::runtime_error("Invalid state, can only be called while rendering");
+
+	return m_latencyHistograms.entry.LastMs();
+}
+
+
+double HeadlessVideoRenderer::ExitLatencyMs() const
+{
+	if (m_state != RendererState::RENDERSTATE_RENDERING)
+		throw std::runtime_error("Invalid state, can only be called while rendering");
+
+	return m_latencyHistograms.exit.LastMs();
+}
+
+
+uint64_t HeadlessVideoRenderer::DroppedFrameCount() const
+{
+	if (m_state != RendererState::RENDERSTATE_RENDERING)
+		throw std::runtime_error("Invalid state, can only be called while rendering");
+
+	return m_droppedFrames.Total();
+}
+
+
+uint64_t HeadlessVideoRenderer::DroppedFrameCount(FrameDropReason reason) const
+{
+	if (m_state != RendererState::RENDERSTATE_RENDERING)
+		throw std::runtime_error("Invalid state, can only be called while rendering");
+
+	return m_droppedFrames.Count(reason);
+}
+
+
+void HeadlessVideoRenderer::DeliveryThreadProc()
+{
+	// ! WARNING: Runs in the delivery thread
+
+	DbgLog((LOG_TRACE, 1, TEXT("HeadlessVideoRenderer delivery thread starting")));
+
+	FormattedFrame formattedFrame, nextFormattedFrame;
+	bool hasNextFormattedFrame = false;
+
+	// Sleeps until there is a frame to deliver, returns false on stop
+	while (m_frameQueue.WaitForNext(formattedFrame, nextFormattedFrame, hasNextFormattedFrame))
+	{
+		PipelineTrace::SetThreadName("delivery");
+
+		DeliverQueuedFrame(formattedFrame, hasNextFormattedFrame ? &nextFormattedFrame : nullptr);
+	}
+
+	DbgLog((LOG_TRACE, 1, TEXT("HeadlessVideoRenderer delivery thread exiting")));
+}
+
+
+void HeadlessVideoRenderer::DeliverQueuedFrame(const FormattedFrame& formattedFrame, const FormattedFrame* nextFormattedFrame)
+{
+	REFERENCE_TIME nextFrameTimestamp = REFERENCE_TIME_INVALID;
+	switch (m_timestamp)
+	{
+	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK:
+	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_SMART:
+
+		if (nextFormattedFrame)
+			nextFrameTimestamp = m_frameTimestamper.ToReferenceTime(nextFormattedFrame->timingTimestamp);
+		break;
+	}
+
+	m_latencyHistograms.queueWait.Record(TimingClockDiffMs(
+		formattedFrame.queuedTime, m_timingClock->TimingClockNow(), m_timingClock->TimingClockTicksPerSecond()));
+
+	DeliverFrame(formattedFrame, nextFrameTimestamp);
+	ReturnFormatBuffer(formattedFrame.buffer);
+}
+
+
+void HeadlessVideoRenderer::DeliverFrame(const FormattedFrame& formattedFrame, REFERENCE_TIME nextFrameTimestamp)
+{
+	CPipelineTraceScope timestampTraceScope(PipelineTraceStage::TIMESTAMP, formattedFrame.counter);
+
+	const DirectShowFrameTimes times = m_frameTimestamper.Timestamp(
+		formattedFrame.counter, formattedFrame.timingTimestamp, nextFrameTimestamp);
+
+	timestampTraceScope.End();
+
+	// The exit latency, which is right before we hand-off to the sink
+	m_latencyHistograms.exit.Record(TimingClockDiffMs(
+		formattedFrame.timingTimestamp, m_timingClock->TimingClockNow(), m_timingClock->TimingClockTicksPerSecond()));
+
+	const timingclocktime_t deliverTime = m_timingClock->TimingClockNow();
+	{
+		CPipelineTraceScope deliverTraceScope(PipelineTraceStage::DELIVER, formattedFrame.counter);
+
+		m_sink.OnSinkFrame(formattedFrame.buffer, (size_t)m_videoFrameFormatter->GetOutFrameSize(), times);
+	}
+	m_latencyHistograms.deliver.Record(TimingClockDiffMs(
+		deliverTime, m_timingClock->TimingClockNow(), m_timingClock->TimingClockTicksPerSecond()));
+}
+
+
+void HeadlessVideoRenderer::FormatterBuild()
+{
+	// v210 (YUV422) to p010 (YUV420)
+	// This is lossy, only use to revert decklink upscaling
+	if (m_videoState->videoFrameEncoding == VideoFrameEncoding::V210 &&
+		m_videoConversionOverride == VideoConversionOverride::VIDEOCONVERSION_V210_TO_P010)
+	{
+		m_videoFrameFormatter.reset(new CV210toP010VideoFrameFormatter());
+	}
+
+	// Default conversions
+	else
+	{
+		switch (m_videoState->videoFrameEncoding)
+		{
+			// v210 to p210
+		case VideoFrameEncoding::V210:
+
+			m_videoFrameFormatter.reset(new CV210toP210VideoFrameFormatter());
+			break;
+
+			// Packed 10 and 12-bit RGB to RGB48
+		case VideoFrameEncoding::R210:
+		case VideoFrameEncoding::R10b:
+		case VideoFrameEncoding::R10l:
+		case VideoFrameEncoding::R12B:
+		case VideoFrameEncoding::R12L:
+
+			m_videoFrameFormatter.reset(new CRGBtoRGB48VideoFrameFormatter());
+			break;
+
+			// No conversion needed
+		default:
+			m_videoFrameFormatter.reset(new CNoopVideoFrameFormatter());
+		}
+	}
+
+	m_videoFrameFormatter->OnVideoState(m_videoState);
+}
+
+
+void HeadlessVideoRenderer::DeliveryStart()
+{
+	assert(!m_isActive);
+
+	// There can't be more formatted frames than there are buffers
+	if (m_useFrameQueue)
+		m_frameQueue.Open((uint32_t)m_frameBuffers.size(), m_timingClock);
+
+	m_isActive = true;
+
+	if (m_useFrameQueue && m_useDeliveryThread)
+		m_deliveryThread = std::thread(&HeadlessVideoRenderer::DeliveryThreadProc, this);
+}
+
+
+void HeadlessVideoRenderer::DeliveryStop()
+{
+	m_isActive = false;
+
+	// Wakes up the thread if it's waiting for frames
+	m_frameQueue.Close();
+
+	if (m_deliveryThread.joinable())
+		m_deliveryThread.join();
+
+	m_frameQueue.Purge();
+}
+
+
+BYTE* HeadlessVideoRenderer::GetFormatBuffer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_freeFrameBuffersMutex);
+
+		if (!m_freeFrameBuffers.empty())
+		{
+			BYTE* buffer = m_freeFrameBuffers.back();
+			m_freeFrameBuffers.pop_back();
+			return buffer;
+		}
+	}
+
+	// All buffers in use, which can happen if the queue was enlarged after building.
+	// Re-use the oldest queued frame instead, it would have been dropped on a full queue anyway.
+	BYTE* buffer = nullptr;
+	if (!m_frameQueue.TakeOldestBuffer(buffer))
+		return nullptr;
+
+	return buffer;
+}
+
+
+void HeadlessVideoRenderer::ReturnFormatBuffer(BYTE* buffer)
+{
+	std::lock_guard<std::mutex> lock(m_freeFrameBuffersMutex);
+	m_freeFrameBuffers.push_back(buffer);
+}
+
+
+void HeadlessVideoRenderer::SetState(RendererState state)
+{
+	DbgLog((LOG_TRACE, 1, TEXT("HeadlessVideoRenderer::SetState(): %s"), ToString(state)));
+
+	assert(state != RendererState::RENDERSTATE_UNKNOWN);
+	assert(m_state != state);
+
+	m_state = state;
+	m_callback.OnRendererState(state);
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <FrameBufferPool.h>
+#include <FrameDropReason.h>
+#include <FrameQueue.h>
+#include <FrameQueueDropPolicy.h>
+#include <IRenderer.h>
+#include <ITimingClock.h>
+#include <VideoConversionOverride.h>
+#include <VideoState.h>
+#include <WorkerPool.h>
+#include <video_frame_formatter/IVideoFrameFormatter.h>
+#include <microsoft_directshow/DirectShowFrameTimestamper.h>
+#include <microsoft_directshow/DirectShowRendererStartStopTimeMethod.h>
+
+#include "IHeadlessFrameSink.h"
+
+
+/**
+ * Video renderer without a DirectShow graph or a window, for measuring the pipeline on its own.
+ *
+ * Frames go through the same path as with the DirectShow renderers: formatted on arrival with the same
+ * formatters, queued in the same CFrameQueue as the buffered live source pin and timestamped by
+ * the same timestamper on a delivery thread. Instead of a DirectShow renderer the frames end up
+ * in an IHeadlessFrameSink.
+ *
+ * Without a frame queue the frame is formatted, timestamped and handed to the sink on the calling thread.
+ * Without a delivery thread the queued frames are delivered by calling DeliverQueuedFrame(), which is
+ * for driving the renderer from a simulated clock.
+ *
+ * It needs no graph, window or GPU, so it runs on any Windows machine including build agents, but it is
+ * Windows only like the rest of the library: it is built with the library's pch (DbgLog, ATL), reports through
+ * IRendererCallback (CString) and times frames with DirectShowFrameTimestamper (REFERENCE_TIME) so its
+ * timestamps are the ones a DirectShow renderer would get. The parts which do build anywhere, the
+ * formatter line unpackers and the worker pool, are benchmarked by src/VideoProcessor-Benchmark.
+ */
+class HeadlessVideoRenderer:
+	public IVideoRenderer,
+	private IFrameQueueCallback<BYTE*>
+{
+public:
+
+	HeadlessVideoRenderer(
+		IRendererCallback& callback,
+		IHeadlessFrameSink& sink,
+		ITimingClock* timingClock,
+		DirectShowStartStopTimeMethod timestamp,
+		bool useFrameQueue,
+		size_t frameQueueMaxSize,
+		VideoConversionOverride videoConversionOverride);
+	virtual ~HeadlessVideoRenderer();
+
+	// IVideoRenderer
+	bool OnVideoState(VideoStateComPtr&) override;
+	void OnVideoFrame(VideoFrame& videoFrame) override;
+	HRESULT OnWindowsEvent(LONG_PTR param1, LONG_PTR param2) override;
+	void Build() override;
+	void Start() override;
+	void Stop() override;
+	void Reset() override;
+	void OnSize() override {}
+	void OnPaint() override {}
+	void SetFormatterThreads(unsigned int) override;
+	void SetFrameQueueMaxSize(size_t) override;
+	void SetFrameQueueDropPolicy(const FrameQueueDropPolicyConfig&) override;
+	void SetFrameQueueMaxBytes(size_t) override;
+	size_t GetFrameQueueSize() override;
+	size_t GetFrameQueueBytes() override;
+	double EntryLatencyMs() const override;
+	double ExitLatencyMs() const override;
+	const RendererLatencyHistograms& LatencyHistograms() const override { return m_latencyHistograms; }
+	uint64_t DroppedFrameCount() const override;
+	uint64_t DroppedFrameCount(FrameDropReason) const override;
+
+	// Deliver queued frames from a thread of its own (default) or only on DeliverQueuedFrame(),
+	// can only be changed when not rendering.
+	void SetDeliveryThread(bool useDeliveryThread);
+
+	// Deliver the oldest queued frame if there are enough queued for the timestamp method, like the
+	// delivery thread does on waking up, skipping the frames the drop policy drops on the way.
+	// Only without a delivery thread, returns true if a frame was delivered.
+	bool DeliverQueuedFrame();
+
+private:
+
+	typedef CFrameQueue<BYTE*>::Frame FormattedFrame;
+
+	IRendererCallback& m_callback;
+	IHeadlessFrameSink& m_sink;
+	ITimingClock* m_timingClock;
+	VideoStateComPtr m_videoState;
+	DirectShowStartStopTimeMethod m_timestamp;
+	bool m_useFrameQueue;
+	bool m_useDeliveryThread = true;
+	VideoConversionOverride m_videoConversionOverride;
+
+	std::unique_ptr<IVideoFrameFormatter> m_videoFrameFormatter;
+	unsigned int m_formatterThreads = 1;
+	std::unique_ptr<CWorkerPool> m_formatterWorkerPool;
+
+	DirectShowFrameTimestamper m_frameTimestamper;
+
+	// Formatted frame buffers, the equivalent of the allocator's samples
+	std::vector<CFrameBuffer> m_frameBuffers;
+	std::vector<BYTE*> m_freeFrameBuffers;
+	std::mutex m_freeFrameBuffersMutex;
+
+	RendererLatencyHistograms m_latencyHistograms;
+	CFrameDropCounter m_droppedFrames;
+
+	// Opened on start, the capture callback is the producer and the delivery the consumer
+	CFrameQueue<BYTE*> m_frameQueue;
+	std::atomic<bool> m_isActive{ false };
+
+	std::thread m_deliveryThread;
+
+	// Delivery thread function
+	void DeliveryThreadProc();
+
+	// Deliver a frame taken off the queue, nextFormattedFrame is the frame after it if there is one
+	void DeliverQueuedFrame(const FormattedFrame& formattedFrame, const FormattedFrame* nextFormattedFrame);
+
+	// Timestamp the formatted frame, hand it to the sink and record the exit latency
+	void DeliverFrame(const FormattedFrame& formattedFrame, REFERENCE_TIME nextFrameTimestamp);
+
+	// Pick the formatter the same way as the DirectShow renderers do
+	void FormatterBuild();
+
+	// Start and stop the queue and delivery thread
+	void DeliveryStart();
+	void DeliveryStop();
+
+	// Get an empty buffer to format into without blocking the caller, if there are none
+	// left the oldest queued frame is dropped and its buffer reused.
+	// Returns nullptr if there is no buffer to be had.
+	BYTE* GetFormatBuffer();
+	void ReturnFormatBuffer(BYTE* buffer);
+
+	// IFrameQueueCallback
+	void OnFrameQueueRelease(BYTE* buffer) override { ReturnFormatBuffer(buffer); }
+
+	// Helper for state setting and callbacks
+	void SetState(RendererState state);
+
+	// Use SetState()
+	RendererState m_state = RendererState::RENDERSTATE_UNKNOWN;
+};
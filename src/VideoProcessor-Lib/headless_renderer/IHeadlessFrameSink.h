@@ -0,0 +1,42 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <ITimingClock.h>
+#include <microsoft_directshow/DirectShowFrameTimestamper.h>
+
+
+/**
+ * Receiver of the formatted frames of the headless renderer, takes the place of the
+ * DirectShow renderer at the end of the pipeline.
+ */
+class IHeadlessFrameSink
+{
+public:
+
+	virtual ~IHeadlessFrameSink() {}
+
+	// Called when the renderer starts, before any frames.
+	// frameSize is the size in bytes of every formatted frame.
+	virtual void OnSinkStart(ITimingClock* timingClock, size_t frameSize) = 0;
+
+	// A formatted frame with the times a DirectShow renderer would have gotten.
+	// Blocking in here holds up the delivery like a renderer would.
+	// WARNING: Called from the renderer's delivery thread, or the capture thread if there is no queue
+	virtual void OnSinkFrame(const BYTE* data, size_t size, const DirectShowFrameTimes& times) = 0;
+
+	// Called when the renderer stops, no more frames will follow
+	virtual void OnSinkStop() = 0;
+
+	// Frames received since the last start
+	virtual uint64_t SinkFrameCount() const = 0;
+};
@@ -0,0 +1,191 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include "DirectShowFrameTimestamper.h"
+
+
+void DirectShowFrameTimestamper::Initialize(
+	const RationalTimebase& frameTimebase,
+	ITimingClock* const timingClock,
+	DirectShowStartStopTimeMethod timestamp)
+{
+	if (!timingClock)
+		throw std::runtime_error("Cannot set null ITimingClock");
+
+	m_frameTimebase = frameTimebase;
+	m_frameDuration = frameTimebase.Convert(1);
+	if (m_frameDuration <= 0)
+		throw std::runtime_error("Duration must be > 0");
+
+	m_timingClock = timingClock;
+	m_timingClockTimebase = RationalTimebase::Rescale(timingClock->TimingClockTicksPerSecond(), UNITS);
+	m_timestamp = timestamp;
+
+	Reset();
+}
+
+
+void DirectShowFrameTimestamper::Reset()
+{
+	m_frameCounter = 0;
+	m_previousFrameCounter = 0;
+	m_startTimeOffset = 0;
+	m_frameCounterOffset = 0;
+	m_previousTimeStop = 0;
+}
+
+
+DirectShowFrameTimes DirectShowFrameTimestamper::Timestamp(
+	uint64_t frameCounter,
+	timingclocktime_t timingTimestamp,
+	REFERENCE_TIME nextFrameTimestamp)
+{
+	assert(timingTimestamp > 0);
+	assert(m_frameDuration > 0);
+	assert(m_timingClock->TimingClockTicksPerSecond() > 0);
+
+	++m_frameCounter;
+
+	DirectShowFrameTimes times;
+
+	//
+	// Media time
+	//
+
+	// Guarantee first frame to start counting at zero
+	uint64_t streamFrameCounter = frameCounter;
+	if (m_frameCounterOffset == 0)
+		m_frameCounterOffset = streamFrameCounter;
+	streamFrameCounter -= m_frameCounterOffset;
+
+	// Set frame counter
+	times.streamFrameCounter = streamFrameCounter;
+	times.mediaTimeStart = streamFrameCounter;
+	times.mediaTimeStop = times.mediaTimeStart + 1;
+
+	// Discontinuity check
+	times.discontinuity =
+		frameCounter != (m_previousFrameCounter + 1) ||
+		m_frameCounter == 1;
+	if (times.discontinuity)
+	{
+		DbgLog((LOG_TRACE, 1, TEXT("::FillBuffer(#%I64u): Frame counter jumped from %I64u (stream frame %I64u), discontinuity detected"),
+			frameCounter, m_previousFrameCounter, streamFrameCounter));
+	}
+
+	m_previousFrameCounter = frameCounter;
+
+	//
+	// Setting the time
+	//
+
+	REFERENCE_TIME timeStart = REFERENCE_TIME_INVALID;
+	REFERENCE_TIME timeStop = REFERENCE_TIME_INVALID;
+
+	// Determine start time
+	switch (m_timestamp)
+	{
+	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_SMART:
+	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_THEO:
+	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK:
+	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_NONE:
+
+		// Get frame timestamp as reference time
+		timeStart = ToReferenceTime(timingTimestamp);
+
+		// Guarantee first frame to start counting at time zero
+		// Note that this is against the recommendations of microsoft for directshow but otherwise
+		// renderers don't start as they're often designed for file based video which starts at 0
+		if (m_startTimeOffset == 0)
+		{
+			m_startTimeOffset = timeStart;
+
+			DbgLog((LOG_TRACE, 1, TEXT("::FillBuffer(#%I64u): Setting start time offset to %I64u"),
+				frameCounter, m_startTimeOffset));
+		}
+
+		timeStart -= m_startTimeOffset;
+		break;
+
+	case DirectShowStartStopTimeMethod::DS_SSTM_THEO_THEO:
+	case DirectShowStartStopTimeMethod::DS_SSTM_THEO_NONE:
+
+		assert(m_startTimeOffset == 0);
+		timeStart = m_frameTimebase.Convert(streamFrameCounter);
+		break;
+
+	}
+
+	// Determine stop time
+	switch (m_timestamp)
+	{
+	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_SMART:
+
+		timeStop = nextFrameTimestamp;
+		if (timeStop == REFERENCE_TIME_INVALID)
+		{
+			timeStop = timeStart + m_frameDuration;
+		}
+		else
+		{
+			assert(m_startTimeOffset > 0);
+			timeStop -= m_startTimeOffset;
+		}
+
+		assert(timeStop > timeStart);
+		break;
+
+	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_THEO:
+
+		timeStop = timeStart + m_frameDuration;
+		break;
+
+	case DirectShowStartStopTimeMethod::DS_SSTM_THEO_THEO:
+
+		// Exactly where the next frame starts
+		timeStop = m_frameTimebase.Convert(streamFrameCounter + 1);
+		break;
+
+	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK:
+
+		timeStop = nextFrameTimestamp;
+		assert(timeStop != REFERENCE_TIME_INVALID);
+		assert(timeStop > timeStart);
+
+		assert(m_startTimeOffset > 0);
+		timeStop -= m_startTimeOffset;
+		break;
+	}
+
+#ifdef _DEBUG
+	// Every n frames output a bunch of consecutive frames to check start/stop for all applicable formats
+	if (timeStop != REFERENCE_TIME_INVALID && m_frameCounter % 200 < 5)
+	{
+		const double durationMs = (timeStop - timeStart) / 10000.0;
+		const double diffStopMs = (timeStart - m_previousTimeStop) / 10000.0;
+
+		DbgLog((LOG_TRACE, 1, TEXT("::FillBuffer(#%I64u): StartTS: %I64d StopTS: %I64d, duration: %.02f, diffPrevStopStartMs: %.02f"),
+			frameCounter, timeStart, timeStop, durationMs, diffStopMs));
+
+		m_previousTimeStop = timeStop;
+	}
+#endif // _DEBUG
+
+	times.timeStart = timeStart;
+	times.timeStop = timeStop;
+
+	return times;
+}
+
+
+REFERENCE_TIME DirectShowFrameTimestamper::ToReferenceTime(timingclocktime_t timingTimestamp) const
+{
+	return m_timingClockTimebase.Convert(timingTimestamp);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <ITimingClock.h>
+#include <RationalTimebase.h>
+#include <WallClock.h>
+#include <microsoft_directshow/DirectShowDefines.h>
+#include <microsoft_directshow/DirectShowRendererStartStopTimeMethod.h>
+
+
+/**
+ * The times of a single frame as they are set on a DirectShow media sample.
+ */
+struct DirectShowFrameTimes
+{
+	// Frame number in the stream, the first frame is 0
+	uint64_t streamFrameCounter = 0;
+
+	// Media time, start and stop frame number
+	LONGLONG mediaTimeStart = 0;
+	LONGLONG mediaTimeStop = 0;
+
+	// Frame counter did not follow up on the previous one
+	bool discontinuity = false;
+
+	// Start and stop time in 100ns, REFERENCE_TIME_INVALID if the method does not set one
+	REFERENCE_TIME timeStart = REFERENCE_TIME_INVALID;
+	REFERENCE_TIME timeStop = REFERENCE_TIME_INVALID;
+};
+
+
+/**
+ * Calculates the media time, start and stop time of consecutive frames following a
+ * DirectShowStartStopTimeMethod. This holds the stream state, frames need to be timestamped in order.
+ *
+ * This has no dependency on the DirectShow filter graph so that it can be used by anything
+ * which needs to time frames the same way as the live source does.
+ */
+class DirectShowFrameTimestamper
+{
+public:
+
+	// frameTimebase converts stream frame numbers into their start time in 100ns units,
+	// see DisplayMode::FrameTimebase()
+	void Initialize(
+		const RationalTimebase& frameTimebase,
+		ITimingClock* const timingClock,
+		DirectShowStartStopTimeMethod timestamp);
+
+	// Start a new stream, the next frame will be at time and media time zero
+	void Reset();
+
+	// Get the times for the next frame.
+	// nextFrameTimestamp is the start time of the frame after this one in 100ns units of the timing clock,
+	// REFERENCE_TIME_INVALID if unknown. Required for DS_SSTM_CLOCK_CLOCK.
+	DirectShowFrameTimes Timestamp(
+		uint64_t frameCounter,
+		timingclocktime_t timingTimestamp,
+		REFERENCE_TIME nextFrameTimestamp);
+
+	// Amount of frames timestamped since the last reset
+	uint64_t FrameCount() const { return m_frameCounter; }
+
+	// Convert a timing clock timestamp into 100ns units
+	REFERENCE_TIME ToReferenceTime(timingclocktime_t timingTimestamp) const;
+
+private:
+
+	RationalTimebase m_frameTimebase;
+	timestamp_t m_frameDuration = 0;
+	ITimingClock* m_timingClock = nullptr;
+	RationalTimebase m_timingClockTimebase;  // Timing clock ticks to 100ns
+	DirectShowStartStopTimeMethod m_timestamp = DirectShowStartStopTimeMethod::DS_SSTM_NONE;
+
+	REFERENCE_TIME m_previousTimeStop = 0;
+	timestamp_t m_startTimeOffset = 0;
+	uint64_t m_frameCounterOffset = 0;
+	uint64_t m_frameCounter = 0;
+	uint64_t m_previousFrameCounter = 0;
+};
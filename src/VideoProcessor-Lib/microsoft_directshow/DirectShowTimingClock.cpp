@@ -15,11 +15,9 @@
 DirectShowTimingClock::DirectShowTimingClock(ITimingClock& timingClock):
 	CBaseReferenceClock(DIRECTSHOW_TIMING_CLOCK_NAME, nullptr, nullptr, nullptr),
 	m_timingClock(timingClock),
-	m_ticksPer100ns(m_timingClock.TimingClockTicksPerSecond() / 10000000.0)
+	m_timingClockTimebase(RationalTimebase::Rescale(timingClock.TimingClockTicksPerSecond(), UNITS))
 {
 	DbgLog((LOG_TRACE, 1, TEXT("DirectShowTimingClock::DirectShowTimingClock()")));
-
-	assert(m_ticksPer100ns > 0);
 }
 
 
@@ -31,7 +29,7 @@ DirectShowTimingClock::~DirectShowTimingClock()
 
 REFERENCE_TIME DirectShowTimingClock::GetPrivateTime()
 {
-	const REFERENCE_TIME rt = (REFERENCE_TIME)(m_timingClock.TimingClockNow() / m_ticksPer100ns);
+	const REFERENCE_TIME rt = m_timingClockTimebase.Convert(m_timingClock.TimingClockNow());
 	assert(rt > 0);
 
 	return rt;
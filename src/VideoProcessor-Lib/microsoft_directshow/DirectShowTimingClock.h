@@ -12,6 +12,7 @@
 #include <refclock.h>
 
 #include <ITimingClock.h>
+#include <RationalTimebase.h>
 
 
 #define DIRECTSHOW_TIMING_CLOCK_NAME TEXT("TimingClock")
@@ -34,5 +35,5 @@ public:
 
 private:
 	ITimingClock& m_timingClock;
-	const double m_ticksPer100ns;
+	const RationalTimebase m_timingClockTimebase;  // Timing clock ticks to 100ns
 };
@@ -10,6 +10,7 @@
 
 #include <guid.h>
 #include <IMediaSideData.h>
+#include <PipelineTrace.h>
 
 #include "ALiveSourceVideoOutputPin.h"
 
@@ -27,24 +28,25 @@ ALiveSourceVideoOutputPin::ALiveSourceVideoOutputPin(
 
 void ALiveSourceVideoOutputPin::Initialize(
 	IVideoFrameFormatter* const videoFrameFormatter,
-	timestamp_t frameDuration,
+	const RationalTimebase& frameTimebase,
 	ITimingClock* const timingClock,
 	DirectShowStartStopTimeMethod timestamp,
-	const AM_MEDIA_TYPE& mediaType)
+	const AM_MEDIA_TYPE& mediaType,
+	RendererLatencyHistograms& latencyHistograms)
 {
 	if (!videoFrameFormatter)
 		throw std::runtime_error("Cannot set null IVideoFrameFormatter");
 
-	if (frameDuration <= 0)
-		throw std::runtime_error("Duration must be > 0");
-	assert(frameDuration > 50000LL); // 5ms frame is 200Hz, probably a reasonable upper bound
-	assert(frameDuration < 10000000LL);  // 1Hz, reasonable lower bound
+	assert(frameTimebase.Convert(1) > 50000LL); // 5ms frame is 200Hz, probably a reasonable upper bound
+	assert(frameTimebase.Convert(1) < 10000000LL);  // 1Hz, reasonable lower bound
 
 	m_videoFrameFormatter = videoFrameFormatter;
-	m_frameDuration = frameDuration;
 	m_timingClock = timingClock;
 	m_timestamp = timestamp;
 	m_mediaType = mediaType;
+	m_latencyHistograms = &latencyHistograms;
+
+	m_frameTimestamper.Initialize(frameTimebase, timingClock, timestamp);
 }
 
 
@@ -136,7 +138,7 @@ HRESULT ALiveSourceVideoOutputPin::DecideBufferSize(IMemAllocator *pAlloc, ALLOC
 
 	HRESULT hr = NOERROR;
 
-	ppropInputRequest->cBuffers = 1;
+	ppropInputRequest->cBuffers = SampleBufferCount();
 	ppropInputRequest->cbBuffer = m_videoFrameFormatter->GetOutFrameSize();
 
 	ASSERT(ppropInputRequest->cbBuffer);
@@ -298,7 +300,24 @@ void ALiveSourceVideoOutputPin::OnHDRData(HDRDataSharedPtr& hdrData)
 	if (!hdrData)
 		throw std::runtime_error("Setting HDRData to null is not allowed");
 
-	m_hdrData = hdrData;
+	std::shared_ptr<HDRSideData> hdrSideData = std::make_shared<HDRSideData>();
+
+	hdrSideData->lightLevel.MaxCLL = (unsigned int)round(hdrData->maxCll);
+	hdrSideData->lightLevel.MaxFALL = (unsigned int)round(hdrData->maxFall);
+
+	hdrSideData->hdr.display_primaries_x[0] = hdrData->displayPrimaryGreenX;
+	hdrSideData->hdr.display_primaries_x[1] = hdrData->displayPrimaryBlueX;
+	hdrSideData->hdr.display_primaries_x[2] = hdrData->displayPrimaryRedX;
+	hdrSideData->hdr.display_primaries_y[0] = hdrData->displayPrimaryGreenY;
+	hdrSideData->hdr.display_primaries_y[1] = hdrData->displayPrimaryBlueY;
+	hdrSideData->hdr.display_primaries_y[2] = hdrData->displayPrimaryRedY;
+	hdrSideData->hdr.white_point_x = hdrData->whitePointX;
+	hdrSideData->hdr.white_point_y = hdrData->whitePointY;
+	hdrSideData->hdr.max_display_mastering_luminance = hdrData->masteringDisplayMaxLuminance;
+	hdrSideData->hdr.min_display_mastering_luminance = hdrData->masteringDisplayMinLuminance;
+
+	// Published whole, the delivering thread either sees the old or the new one
+	std::atomic_store(&m_hdrSideData, std::shared_ptr<const HDRSideData>(std::move(hdrSideData)));
 	m_hdrChanged = true;
 }
 
@@ -308,17 +327,12 @@ void ALiveSourceVideoOutputPin::Reset()
 	if (FAILED(DeliverBeginFlush()))
 		throw std::runtime_error("Failed to deliver beginflush");
 
-	if (m_hdrData)
+	if (std::atomic_load(&m_hdrSideData))
 		m_hdrChanged = true;
 
 	m_newSegment = true;
 
-	m_frameCounter = 0;
-	m_previousFrameCounter = 0;
-	m_startTimeOffset = 0;
-	m_frameCounterOffset = 0;
-	m_previousTimeStop = 0;
-	m_droppedFrameCount = 0;
+	m_frameTimestamper.Reset();
 
 	if (FAILED(DeliverEndFlush()))
 		throw std::runtime_error("Failed to deliver endflush");
@@ -327,162 +341,17 @@ void ALiveSourceVideoOutputPin::Reset()
 
 HRESULT ALiveSourceVideoOutputPin::RenderVideoFrameIntoSample(VideoFrame& videoFrame, IMediaSample* const pSample)
 {
-	assert(videoFrame.GetTimingTimestamp() > 0);
-	assert(m_frameDuration > 0);
-	assert(m_timingClock->TimingClockTicksPerSecond() > 0);
-
-	++m_frameCounter;
-
-	HRESULT hr;
-
-	//
-	// Media time
-	//
-
-	// Guarantee first frame to start counting at zero
-	uint64_t streamFrameCounter = videoFrame.GetCounter();
-	if (m_frameCounterOffset == 0)
-		m_frameCounterOffset = streamFrameCounter;
-	streamFrameCounter -= m_frameCounterOffset;
-
-	// Set frame counter
-	LONGLONG mediaTimeStart = streamFrameCounter;
-	LONGLONG mediaTimeStop = mediaTimeStart + 1;
-	hr = pSample->SetMediaTime(&mediaTimeStart, &mediaTimeStop);
-	if (FAILED(hr))
+	HRESULT hr = FormatVideoFrameIntoSample(videoFrame, pSample);
+	if (FAILED(hr) || hr == S_FRAME_NOT_RENDERED)
 		return hr;
 
-	// Discontinuity check
-	const bool isDiscontinuity =
-		videoFrame.GetCounter() != (m_previousFrameCounter + 1) ||
-		m_frameCounter == 1;
-	if (isDiscontinuity)
-	{
-		DbgLog((LOG_TRACE, 1, TEXT("::FillBuffer(#%I64u): Frame counter jumped from %I64u (stream frame %I64u), discontinuity detected"),
-			videoFrame.GetCounter(), m_previousFrameCounter, streamFrameCounter));
-
-		hr = pSample->SetDiscontinuity(TRUE);
-		if (FAILED(hr))
-			return hr;
-	}
-
-	m_previousFrameCounter = videoFrame.GetCounter();
-
-	//
-	// Setting the time
-	//
-
-	REFERENCE_TIME timeStart = REFERENCE_TIME_INVALID;
-	REFERENCE_TIME timeStop = REFERENCE_TIME_INVALID;
-
-	// Determine start time
-	switch (m_timestamp)
-	{
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_SMART:
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_THEO:
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK:
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_NONE:
-
-		// Get frame timestamp as reference time
-		timeStart =
-			(REFERENCE_TIME)(
-				videoFrame.GetTimingTimestamp() *
-				(10000000.0 / m_timingClock->TimingClockTicksPerSecond()));
-
-		// Guarantee first frame to start counting at time zero
-		// Note that this is against the recommendations of microsoft for directshow but otherwise
-		// renderers don't start as they're often designed for file based video which starts at 0
-		if (m_startTimeOffset == 0)
-		{
-			m_startTimeOffset = timeStart;
-
-			DbgLog((LOG_TRACE, 1, TEXT("::FillBuffer(#%I64u): Setting start time offset to %I64u"),
-				videoFrame.GetCounter(), m_startTimeOffset));
-		}
-
-		timeStart -= m_startTimeOffset;
-		break;
-
-	case DirectShowStartStopTimeMethod::DS_SSTM_THEO_THEO:
-	case DirectShowStartStopTimeMethod::DS_SSTM_THEO_NONE:
-
-		assert(m_startTimeOffset == 0);
-		timeStart = (streamFrameCounter * m_frameDuration);
-		break;
-
-	}
-
-	// Determine stop time
-	switch (m_timestamp)
-	{
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_SMART:
-
-		timeStop = NextFrameTimestamp();
-		if (timeStop == REFERENCE_TIME_INVALID)
-		{
-			timeStop = timeStart + m_frameDuration;
-		}
-		else
-		{
-			assert(m_startTimeOffset > 0);
-			timeStop -= m_startTimeOffset;
-		}
-
-		assert(timeStop > timeStart);
-		break;
-
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_THEO:
-	case DirectShowStartStopTimeMethod::DS_SSTM_THEO_THEO:
-
-		timeStop = timeStart + m_frameDuration;
-		break;
-
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK:
-
-		timeStop = NextFrameTimestamp();
-		assert(timeStop != REFERENCE_TIME_INVALID);
-		assert(timeStop > timeStart);
-
-		assert(m_startTimeOffset > 0);
-		timeStop -= m_startTimeOffset;
-		break;
-	}
-
-	// Set right amount of values
-	switch (m_timestamp)
-	{
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_SMART:
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_THEO:
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK:
-	case DirectShowStartStopTimeMethod::DS_SSTM_THEO_THEO:
-
-		hr = pSample->SetTime(&timeStart, &timeStop);
-		if (FAILED(hr))
-			return hr;
-
-#ifdef _DEBUG
-		// Every n frames output a bunch of consecutive frames to check start/stop for all applicable formats
-		if (m_frameCounter % 200 < 5)
-		{
-			const double durationMs = (timeStop - timeStart) / 10000.0;
-			const double diffStopMs = (timeStart - m_previousTimeStop) / 10000.0;
-
-			DbgLog((LOG_TRACE, 1, TEXT("::FillBuffer(#%I64u): StartTS: %I64d StopTS: %I64d, duration: %.02f, diffPrevStopStartMs: %.02f"),
-				videoFrame.GetCounter(), timeStart, timeStop, durationMs, diffStopMs));
-
-			m_previousTimeStop = timeStop;
-		}
-#endif // _DEBUG
-		break;
+	return TimestampSample(videoFrame.GetCounter(), videoFrame.GetTimingTimestamp(), pSample);
+}
 
-	case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_NONE:
-	case DirectShowStartStopTimeMethod::DS_SSTM_THEO_NONE:
 
-		hr = pSample->SetTime(&timeStart, nullptr);
-		if (FAILED(hr))
-			return hr;
-		break;
-	}
+HRESULT ALiveSourceVideoOutputPin::FormatVideoFrameIntoSample(const VideoFrame& videoFrame, IMediaSample* const pSample)
+{
+	HRESULT hr;
 
 	//
 	// Data copy/formatting
@@ -499,13 +368,18 @@ HRESULT ALiveSourceVideoOutputPin::RenderVideoFrameIntoSample(VideoFrame& videoF
 	// Format (which can just be a copy or a full decode) the video frame to the
 	// DirectShow buffer
 	// A simple memcpy runs in the 2-4ms range for a decent frame size
-#ifdef _DEBUG
-	timestamp_t startTime = ::GetWallClockTime();
-#endif
+	const timingclocktime_t formatStart = m_timingClock->TimingClockNow();
+
+	CPipelineTraceScope traceScope(PipelineTraceStage::FORMAT, videoFrame.GetCounter());
 
 	const bool formatSuccess =
 		m_videoFrameFormatter->FormatVideoFrame(videoFrame, pData);
 
+	traceScope.End();
+
+	const double formatMs = TimingClockDiffMs(
+		formatStart, m_timingClock->TimingClockNow(), m_timingClock->TimingClockTicksPerSecond());
+
 	if (!formatSuccess)
 	{
 		DbgLog((LOG_TRACE, 1,
@@ -515,13 +389,15 @@ HRESULT ALiveSourceVideoOutputPin::RenderVideoFrameIntoSample(VideoFrame& videoF
 		return S_FRAME_NOT_RENDERED;
 	}
 
+	m_latencyHistograms->format.Record(formatMs);
+
 #ifdef _DEBUG
-	if (streamFrameCounter % 100 == 0)
+	if (videoFrame.GetCounter() % 100 == 0)
 	{
 		DbgLog((LOG_TRACE, 1,
 			TEXT("::FillBuffer(#%I64u): Formatter took %.1f us"),
 			videoFrame.GetCounter(),
-			((::GetWallClockTime() - startTime) / 10.0)));
+			formatMs * 1000.0));
 	}
 #endif
 
@@ -534,62 +410,80 @@ HRESULT ALiveSourceVideoOutputPin::RenderVideoFrameIntoSample(VideoFrame& videoF
 	//
 
 	// All frames are complete images and hence sync points by definition
-	hr = pSample->SetSyncPoint(TRUE);
+	return pSample->SetSyncPoint(TRUE);
+}
+
+
+HRESULT ALiveSourceVideoOutputPin::TimestampSample(uint64_t frameCounter, timingclocktime_t timingTimestamp, IMediaSample* const pSample)
+{
+	HRESULT hr;
+
+	CPipelineTraceScope traceScope(PipelineTraceStage::TIMESTAMP, frameCounter);
+
+	const DirectShowFrameTimes times = m_frameTimestamper.Timestamp(
+		frameCounter, timingTimestamp, NextFrameTimestamp());
+	const uint64_t streamFrameCounter = times.streamFrameCounter;
+
+	//
+	// Media time
+	//
+
+	LONGLONG mediaTimeStart = times.mediaTimeStart;
+	LONGLONG mediaTimeStop = times.mediaTimeStop;
+	hr = pSample->SetMediaTime(&mediaTimeStart, &mediaTimeStop);
 	if (FAILED(hr))
 		return hr;
 
+	if (times.discontinuity)
+	{
+		hr = pSample->SetDiscontinuity(TRUE);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	//
+	// Setting the time
+	//
+
+	// Start and stop, start only or none at all depending on the method
+	REFERENCE_TIME timeStart = times.timeStart;
+	REFERENCE_TIME timeStop = times.timeStop;
+	if (timeStart != REFERENCE_TIME_INVALID)
+	{
+		hr = pSample->SetTime(&timeStart, (timeStop != REFERENCE_TIME_INVALID) ? &timeStop : nullptr);
+		if (FAILED(hr))
+			return hr;
+	}
+
 	//
 	// HDR metadata
 	//
 
-	// Note: This can be updatedcalled from a different thread, can go wrong but never saw
-	//       it happen so leaving this as-is.
-	if (m_hdrData)
+	// OnHDRData() can be called from a different thread while this runs. The changed flag is taken
+	// before the side data so that a change landing in between is set again on the next sample.
+	const bool hdrChanged = m_hdrChanged.exchange(false);
+	const std::shared_ptr<const HDRSideData> hdrSideData = std::atomic_load(&m_hdrSideData);
+	if (hdrSideData)
 	{
-		if ((streamFrameCounter % 100) == 1 || m_hdrChanged)
+		if ((streamFrameCounter % 100) == 1 || hdrChanged)
 		{
 			IMediaSideData* pMediaSideData = nullptr;
 			if (FAILED(pSample->QueryInterface(&pMediaSideData)))
 				throw std::runtime_error("Failed to get IMediaSideData");
 
-			MediaSideDataHDRContentLightLevel hdrLightLevel;
-			ZeroMemory(&hdrLightLevel, sizeof(hdrLightLevel));
-			hdrLightLevel.MaxCLL = (unsigned int)round(m_hdrData->maxCll);
-			hdrLightLevel.MaxFALL = (unsigned int)round(m_hdrData->maxFall);
-			pMediaSideData->SetSideData(IID_MediaSideDataHDRContentLightLevel, (const BYTE*)&hdrLightLevel, sizeof(hdrLightLevel));
-
-			MediaSideDataHDR hdr;
-			ZeroMemory(&hdr, sizeof(hdr));
-			hdr.display_primaries_x[0] = m_hdrData->displayPrimaryGreenX;
-			hdr.display_primaries_x[1] = m_hdrData->displayPrimaryBlueX;
-			hdr.display_primaries_x[2] = m_hdrData->displayPrimaryRedX;
-			hdr.display_primaries_y[0] = m_hdrData->displayPrimaryGreenY;
-			hdr.display_primaries_y[1] = m_hdrData->displayPrimaryBlueY;
-			hdr.display_primaries_y[2] = m_hdrData->displayPrimaryRedY;
-			hdr.white_point_x = m_hdrData->whitePointX;
-			hdr.white_point_y = m_hdrData->whitePointY;
-			hdr.max_display_mastering_luminance = m_hdrData->masteringDisplayMaxLuminance;
-			hdr.min_display_mastering_luminance = m_hdrData->masteringDisplayMinLuminance;
-			pMediaSideData->SetSideData(IID_MediaSideDataHDR, (const BYTE*)&hdr, sizeof(hdr));
+			pMediaSideData->SetSideData(IID_MediaSideDataHDRContentLightLevel, (const BYTE*)&hdrSideData->lightLevel, sizeof(hdrSideData->lightLevel));
+			pMediaSideData->SetSideData(IID_MediaSideDataHDR, (const BYTE*)&hdrSideData->hdr, sizeof(hdrSideData->hdr));
 
 			pMediaSideData->Release();
-
-			m_hdrChanged = false;
 		}
 	}
 
-	if (m_frameCounter % 20 == 0)
-	{
-		//
-		// Calculate the exit latency, which is right before we hand-off to the DirectShow
-		// renderer.
-		//
-
-		const timingclocktime_t now = m_timingClock->TimingClockNow();
+	//
+	// Exit latency, which is right before we hand-off to the DirectShow renderer.
+	//
 
-		m_exitLatencyMs = TimingClockDiffMs(
-			videoFrame.GetTimingTimestamp(), now, m_timingClock->TimingClockTicksPerSecond());
-	}
+	m_latencyHistograms->exit.Record(TimingClockDiffMs(
+		timingTimestamp, m_timingClock->TimingClockNow(), m_timingClock->TimingClockTicksPerSecond()));
 
 	return hr;
 }
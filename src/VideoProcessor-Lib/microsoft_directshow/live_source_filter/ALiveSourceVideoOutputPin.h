@@ -9,9 +9,18 @@
 #pragma once
 
 
+#include <atomic>
+#include <memory>
+
+#include <IMediaSideData.h>
+
+#include <FrameDropReason.h>
+#include <FrameQueueDropPolicy.h>
+#include <LatencyHistogram.h>
 #include <video_frame_formatter/IVideoFrameFormatter.h>
 #include <microsoft_directshow/DirectShowRendererStartStopTimeMethod.h>
 #include <microsoft_directshow/DirectShowDefines.h>
+#include <microsoft_directshow/DirectShowFrameTimestamper.h>
 
 #include "CLiveSource.h"
 
@@ -38,10 +47,11 @@ public:
 
 	void Initialize(
 		IVideoFrameFormatter* const videoFrameFormatter,
-		timestamp_t frameDuration,
+		const RationalTimebase& frameTimebase,
 		ITimingClock* const timingClock,
 		DirectShowStartStopTimeMethod timestamp,
-		const AM_MEDIA_TYPE& mediaType);
+		const AM_MEDIA_TYPE& mediaType,
+		RendererLatencyHistograms& latencyHistograms);
 
 	// CBaseOutputPin overrides
 	HRESULT GetMediaType(int iPosition, CMediaType* pmt);
@@ -85,6 +95,17 @@ public:
 	// Zero means no queueing going on.
 	virtual size_t GetFrameQueueSize() = 0;
 
+	// Set the most bytes the queue may hold with every frame counted at frameBytes, call before activating.
+	// Zero max bytes means no byte limit.
+	virtual void SetFrameQueueMaxBytes(size_t maxBytes, size_t frameBytes) = 0;
+
+	// Get the bytes the frames in the queue take right now.
+	virtual size_t GetFrameQueueBytes() = 0;
+
+	// Set which frames to drop from the queue, call before activating.
+	// Without a queue there is nothing to drop, might not be legal
+	virtual void SetFrameQueueDropPolicy(const FrameQueueDropPolicyConfig&) = 0;
+
 	// Reset the internal state and the video stream.
 	virtual void Reset();
 
@@ -92,42 +113,57 @@ public:
 	// Metrics
 	//
 
-	// Get the exit latency in ms, which the amount of time between the frame timestamp
-	// and when the frame is delivered to the DirectShow renderer.
-	// This is sampled.
-	double ExitLatencyMs() const { return m_exitLatencyMs;  }
-
-	// Get the amount of dropped frames due to queue actions
-	uint64_t DroppedFrameCount() const { return m_droppedFrameCount; }
+	// Get the amount of dropped frames due to queue actions, in total or for one reason.
+	// Kept over resets so that what a reset dropped shows.
+	uint64_t DroppedFrameCount() const { return m_droppedFrames.Total(); }
+	uint64_t DroppedFrameCount(FrameDropReason reason) const { return m_droppedFrames.Count(reason); }
 
 protected:
 
-	uint64_t m_droppedFrameCount = 0;
+	// Counted from both the capture and the delivery thread
+	CFrameDropCounter m_droppedFrames;
 
 	// Render function to render a videoFrame onto a IMediaSample.
 	// Will not release the sample or dec videoframe nor do the Deliver()
 	// Will return S_FRAME_NOT_RENDERED if frame could not be renderered, not an error per-se
 	HRESULT RenderVideoFrameIntoSample(VideoFrame&, IMediaSample* const);
 
+	// Format the video frame's data into the sample, the first half of RenderVideoFrameIntoSample().
+	// Does not touch any of the timing state so it can run ahead of delivery on another thread.
+	// Will return S_FRAME_NOT_RENDERED if frame could not be renderered, not an error per-se
+	HRESULT FormatVideoFrameIntoSample(const VideoFrame&, IMediaSample* const);
+
+	// Set media time, time, discontinuity and HDR data on a formatted sample and record the exit latency,
+	// the second half of RenderVideoFrameIntoSample(). Call right before Deliver() from the delivering thread.
+	HRESULT TimestampSample(uint64_t frameCounter, timingclocktime_t timingTimestamp, IMediaSample* const);
+
 	// Get the next frame timestamp. If it doesn't know it's invalid. Overridden by implementations
 	virtual REFERENCE_TIME NextFrameTimestamp() const { return REFERENCE_TIME_INVALID; }
 
+	// Amount of samples to ask of the allocator. Overridden by implementations which hold on to samples
+	virtual long SampleBufferCount() const { return 1; }
+
 	IVideoFrameFormatter* m_videoFrameFormatter;
-	timestamp_t m_frameDuration;
 	ITimingClock* m_timingClock;
 	DirectShowStartStopTimeMethod m_timestamp;
 	AM_MEDIA_TYPE m_mediaType;
 	bool m_useHDRData = false;
 
-	REFERENCE_TIME m_previousTimeStop = 0;
-	timestamp_t m_startTimeOffset = 0;
-	uint64_t m_frameCounterOffset = 0;
-	uint64_t m_frameCounter = 0;
-	uint64_t m_previousFrameCounter = 0;
+	DirectShowFrameTimestamper m_frameTimestamper;
 	bool m_newSegment = false;
 
-	HDRDataSharedPtr m_hdrData = nullptr;
-	bool m_hdrChanged = false;
+	// Side data of the HDR data, built when it changes and set on a sample every so often
+	struct HDRSideData
+	{
+		MediaSideDataHDRContentLightLevel lightLevel;
+		MediaSideDataHDR hdr;
+	};
+
+	// Set from the renderer's thread while the delivering thread reads it. Never changed once built,
+	// OnHDRData() swaps in a new one. Only accessed through std::atomic_load() and std::atomic_store().
+	std::shared_ptr<const HDRSideData> m_hdrSideData;
+	std::atomic_bool m_hdrChanged{ false };
 
-	double m_exitLatencyMs = 0.0;
+	// Format and exit are recorded here, queue wait by the implementations which queue
+	RendererLatencyHistograms* m_latencyHistograms = nullptr;
 };
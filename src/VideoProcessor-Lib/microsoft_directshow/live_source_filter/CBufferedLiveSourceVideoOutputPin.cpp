@@ -8,6 +8,8 @@
 
 #include <pch.h>
 
+#include <PipelineTrace.h>
+
 #include "CBufferedLiveSourceVideoOutputPin.h"
 
 
@@ -15,20 +17,21 @@ CBufferedLiveSourceVideoOutputPin::CBufferedLiveSourceVideoOutputPin(
 	CLiveSource* filter,
 	CCritSec* pLock,
 	HRESULT* phr):
-	ALiveSourceVideoOutputPin(filter, pLock, phr)
+	ALiveSourceVideoOutputPin(filter, pLock, phr),
+	m_frameQueue(*this, m_droppedFrames)
 {
 }
 
 
 CBufferedLiveSourceVideoOutputPin::~CBufferedLiveSourceVideoOutputPin()
 {
-	PurgeQueue();
+	m_frameQueue.Purge();
 }
 
 
 HRESULT CBufferedLiveSourceVideoOutputPin::Active()
 {
-	if (m_frameQueueMaxSize == 0)
+	if (!m_frameQueueMaxSizeSet)
 		throw std::runtime_error("Call SetFrameQueueMaxSize() before activating the graph");
 
 	{
@@ -38,7 +41,7 @@ HRESULT CBufferedLiveSourceVideoOutputPin::Active()
 			return S_FALSE;	// succeeded, but did not allocate resources (they already exist...)
 
 		assert(IsConnected());
-		assert(!m_isActive);
+		assert(!m_frameQueue.IsOpen());
 
 		HRESULT hr = ALiveSourceVideoOutputPin::Active();
 		if (FAILED(hr))
@@ -46,11 +49,12 @@ HRESULT CBufferedLiveSourceVideoOutputPin::Active()
 
 		assert(!ThreadExists());
 
-		{
-			CAutoLock lock2(&m_filterCritSec);
+		// For most timing empty is really empty, however for the clock-to-clock
+		// we need to keep one frame in.
+		m_frameQueue.SetNeedsNextFrame(m_timestamp == DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK);
 
-			m_isActive = true;
-		}
+		// There can't be more formatted frames than the allocator has samples
+		m_frameQueue.Open((uint32_t)SampleBufferCount(), m_timingClock);
 
 		// start the thread
 		if (!Create())
@@ -74,18 +78,15 @@ HRESULT CBufferedLiveSourceVideoOutputPin::Inactive()
 		if (FAILED(hr))
 			return hr;
 
-		{
-			CAutoLock lock2(&m_filterCritSec);
-
-			m_isActive = false;
-
-			PurgeQueue();
-		}
+		// Wakes up the thread if it's waiting for frames
+		m_frameQueue.Close();
 
 		if (ThreadExists())
 		{
 			Close();
 		}
+
+		m_frameQueue.Purge();
 	}
 
 	return S_OK;
@@ -94,42 +95,36 @@ HRESULT CBufferedLiveSourceVideoOutputPin::Inactive()
 
 HRESULT CBufferedLiveSourceVideoOutputPin::OnVideoFrame(VideoFrame& videoFrame)
 {
-	{
-		CAutoLock lock(&m_filterCritSec);
-
-		// Reject frames if not processing
-		if (!m_isActive)
-			return S_OK;
-
-		// If this frame's timestamp is lower or equal to the one before it,
-		// erase that earlier one
-		while (!m_videoFrameQueue.empty())
-		{
-			VideoFrame lastFrame = m_videoFrameQueue.back();
+	// Reject frames if not processing
+	if (!m_frameQueue.IsOpen())
+		return S_OK;
 
-			// Previous one was younger, nothing to do
-			if (videoFrame.GetTimingTimestamp() > lastFrame.GetTimingTimestamp())
-				break;
+	CPipelineTraceScope getDeliveryBufferTraceScope(PipelineTraceStage::GET_DELIVERY_BUFFER, videoFrame.GetCounter());
 
-			// Previous one was older or equal, erase
-			lastFrame.SourceBufferRelease();
-			m_videoFrameQueue.pop_back();
-			++m_droppedFrameCount;
-		}
+	IMediaSample* pSample = GetFormatBuffer();
+	if (!pSample)
+	{
+		m_droppedFrames.Add(FrameDropReason::FRAMEDROP_FAILED);
+		PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, videoFrame.GetCounter());
+		return S_OK;
+	}
 
-		// If full throw away oldest to make space
-		if (m_videoFrameQueue.size() >= m_frameQueueMaxSize)
-		{
-			m_videoFrameQueue.front().SourceBufferRelease();
-			m_videoFrameQueue.pop_front();
-			++m_droppedFrameCount;
-		}
+	getDeliveryBufferTraceScope.End();
 
-		// Prevent from getting cleaned up and add to queue
-		videoFrame.SourceBufferAddRef();
-		m_videoFrameQueue.push_back(videoFrame);
+	// Format outside of the queue's lock so that the delivery thread can keep going,
+	// the source buffer is not needed after this.
+	HRESULT hr = FormatVideoFrameIntoSample(videoFrame, pSample);
+	if (FAILED(hr) || hr == S_FRAME_NOT_RENDERED)
+	{
+		pSample->Release();
+		m_droppedFrames.Add(FrameDropReason::FRAMEDROP_FAILED);
+		PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, videoFrame.GetCounter());
+		return S_OK;
 	}
 
+	// Releases the sample itself if it's not queued
+	m_frameQueue.Push({ pSample, videoFrame.GetCounter(), videoFrame.GetTimingTimestamp(), m_timingClock->TimingClockNow() });
+
 	return S_OK;
 }
 
@@ -139,35 +134,48 @@ void CBufferedLiveSourceVideoOutputPin::SetFrameQueueMaxSize(size_t frameQueueMa
 	if (frameQueueMaxSize <= 0)
 		throw std::runtime_error("Frame queue size must be > 0");
 
-	{
-		CAutoLock lock(&m_filterCritSec);
+	m_frameQueue.SetMaxFrames(frameQueueMaxSize);
+	m_frameQueueMaxSizeSet = true;
+}
 
-		m_frameQueueMaxSize = frameQueueMaxSize;
 
-		// If full throw away oldest to make space if needed
-		while (m_videoFrameQueue.size() >= m_frameQueueMaxSize)
-		{
-			m_videoFrameQueue.front().SourceBufferRelease();
-			m_videoFrameQueue.pop_front();
-			++m_droppedFrameCount;
-		}
-	}
+void CBufferedLiveSourceVideoOutputPin::SetFrameQueueDropPolicy(const FrameQueueDropPolicyConfig& frameQueueDropPolicyConfig)
+{
+	m_frameQueue.SetDropPolicy(frameQueueDropPolicyConfig);
+}
+
+
+void CBufferedLiveSourceVideoOutputPin::SetFrameQueueMaxBytes(size_t maxBytes, size_t frameBytes)
+{
+	// The allocator and the queue are sized from it, which includes the frame clock-clock keeps in
+	m_frameQueue.SetMaxBytes(maxBytes);
+	m_frameQueue.SetFrameBytes(frameBytes);
+	m_frameQueue.SetNeedsNextFrame(m_timestamp == DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK);
 }
 
 
 size_t CBufferedLiveSourceVideoOutputPin::GetFrameQueueSize()
 {
-	{
-		CAutoLock lock(&m_filterCritSec);
+	return m_frameQueue.Size();
+}
 
-		return m_videoFrameQueue.size();
-	}
+
+size_t CBufferedLiveSourceVideoOutputPin::GetFrameQueueBytes()
+{
+	return m_frameQueue.Bytes();
+}
+
+
+long CBufferedLiveSourceVideoOutputPin::SampleBufferCount() const
+{
+	// A full queue, one being formatted and one held by the renderer. With a byte limit that's fewer than the max size.
+	return (long)m_frameQueue.FrameLimit() + 2;
 }
 
 
 void CBufferedLiveSourceVideoOutputPin::Reset()
 {
-	PurgeQueue();
+	m_frameQueue.Purge();
 	ALiveSourceVideoOutputPin::Reset();
 }
 
@@ -178,101 +186,60 @@ DWORD CBufferedLiveSourceVideoOutputPin::ThreadProc()
 
 	DbgLog((LOG_TRACE, 1, TEXT("CBufferedLiveSourceVideoOutputPin worker thread starting")));
 
-	while (true)
-	{
-		// TODO: Sleep thread on empty queue and wake if frames arrive
-		Sleep(1);
+	FormattedFrame formattedFrame, nextFormattedFrame;
+	bool hasNextFormattedFrame;
 
-		VideoFrame videoFrame;
+	// Sleeps until there is a frame to deliver, returns false on stop
+	while (m_frameQueue.WaitForNext(formattedFrame, nextFormattedFrame, hasNextFormattedFrame))
+	{
+		PipelineTrace::SetThreadName("delivery");
 
+		switch (m_timestamp)
 		{
-			CAutoLock lock(&m_filterCritSec);
-
-			// Stop thread
-			if (!m_isActive)
-				break;
+		case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK:
+		case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_SMART:
 
-			// For most timing empty is really empty, however for the clock-to-clock
-			// we need to keep one frame in.
-			if (m_timestamp == DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK)
+			if (hasNextFormattedFrame)
 			{
-				if (m_videoFrameQueue.size() <= 1)
-					continue;
+				m_nextVideoFrameStartTime = m_frameTimestamper.ToReferenceTime(nextFormattedFrame.timingTimestamp);
 			}
 			else
 			{
-				if (m_videoFrameQueue.empty())
-					continue;
-			}
-
-			// Get the front frame (oldest)
-			videoFrame = m_videoFrameQueue.front();
-			m_videoFrameQueue.pop_front();
-
-			// Get the current front's start time
-			switch (m_timestamp)
-			{
-			case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK:
-				assert(!m_videoFrameQueue.empty());
-				// break;  not here intentionally
-
-			case DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_SMART:
-
-				if (!m_videoFrameQueue.empty())
-				{
-					m_nextVideoFrameStartTime =
-						(REFERENCE_TIME)(
-						m_videoFrameQueue.front().GetTimingTimestamp() *
-						(10000000.0 / m_timingClock->TimingClockTicksPerSecond()));
-				}
-				else
-				{
-					m_nextVideoFrameStartTime = REFERENCE_TIME_INVALID;
-				}
-				break;
+				m_nextVideoFrameStartTime = REFERENCE_TIME_INVALID;
 			}
+			break;
 		}
 
-		// Get buffer for sample
-		// Note you can fill in start and stop time, but following the code shows that they are unused.
-		IMediaSample* pSample = nullptr;
-		HRESULT hr = this->GetDeliveryBuffer(&pSample, nullptr, nullptr, 0);
-		if (FAILED(hr))
-		{
-			videoFrame.SourceBufferRelease();
-			return -1;
-		}
+		m_latencyHistograms->queueWait.Record(TimingClockDiffMs(
+			formattedFrame.queuedTime, m_timingClock->TimingClockNow(), m_timingClock->TimingClockTicksPerSecond()));
 
-		// Convert
-		hr = RenderVideoFrameIntoSample(videoFrame, pSample);
+		// Sample is already formatted, only the timing is left
+		HRESULT hr = TimestampSample(formattedFrame.counter, formattedFrame.timingTimestamp, formattedFrame.buffer);
 		if (FAILED(hr))
 		{
-			videoFrame.SourceBufferRelease();
-			pSample->Release();
+			formattedFrame.buffer->Release();
 			return -2;
 		}
-		if (hr == S_FRAME_NOT_RENDERED)
-		{
-			videoFrame.SourceBufferRelease();
-			pSample->Release();
-			continue;
-		}
 
 		// Deliver frame to renderer
-		hr = this->Deliver(pSample);
+		const timingclocktime_t deliverTime = m_timingClock->TimingClockNow();
+		{
+			CPipelineTraceScope traceScope(PipelineTraceStage::DELIVER, formattedFrame.counter);
+			hr = this->Deliver(formattedFrame.buffer);
+		}
+		m_latencyHistograms->deliver.Record(TimingClockDiffMs(
+			deliverTime, m_timingClock->TimingClockNow(), m_timingClock->TimingClockTicksPerSecond()));
 		if (FAILED(hr))
 		{
 			DbgLog((LOG_TRACE, 1,
 				TEXT("::FillBuffer(#%I64u): Failed to deliver sample, error: %i"),
-				videoFrame.GetCounter(), hr));
+				formattedFrame.counter, hr));
 
-			videoFrame.SourceBufferRelease();
-			pSample->Release();
+			formattedFrame.buffer->Release();
 			return -3;
 		}
 
-		videoFrame.SourceBufferRelease();
-		pSample->Release();
+		formattedFrame.buffer->Release();
 	}
 
 	DbgLog((LOG_TRACE, 1, TEXT("CBufferedLiveSourceVideoOutputPin worker thread exiting")));
@@ -281,17 +248,18 @@ DWORD CBufferedLiveSourceVideoOutputPin::ThreadProc()
 }
 
 
-void CBufferedLiveSourceVideoOutputPin::PurgeQueue()
+IMediaSample* CBufferedLiveSourceVideoOutputPin::GetFormatBuffer()
 {
-	{
-		CAutoLock lock(&m_filterCritSec);
-
-		while (!m_videoFrameQueue.empty())
-		{
-			VideoFrame popFrame = m_videoFrameQueue.front();
-			popFrame.SourceBufferRelease();
-			m_videoFrameQueue.pop_front();
-			++m_droppedFrameCount;
-		}
-	}
+	// Note you can fill in start and stop time, but following the code shows that they are unused.
+	IMediaSample* pSample = nullptr;
+	if (SUCCEEDED(this->GetDeliveryBuffer(&pSample, nullptr, nullptr, AM_GBF_NOWAIT)))
+		return pSample;
+
+	// Allocator is out of samples, which can happen if the renderer's allocator did not
+	// give us the amount we asked for or if the queue was enlarged after connecting.
+	// Re-use the oldest queued sample instead, it would have been dropped on a full queue anyway.
+	if (m_frameQueue.TakeOldestBuffer(pSample))
+		return pSample;
+
+	return nullptr;
 }
@@ -9,8 +9,7 @@
 #pragma once
 
 
-#include <deque>
-
+#include <FrameQueue.h>
 #include <microsoft_directshow/DirectShowDefines.h>
 #include "ALiveSourceVideoOutputPin.h"
 
@@ -18,14 +17,20 @@
 
 
 /**
- * This is an buffered output pin, any presented frame will be buffered first
- * and then a separate thread will deliver the buffers to the renderer.
+ * This is an buffered output pin, any presented frame will be formatted into a media sample
+ * right away and queued, a separate thread will timestamp and deliver the samples to the renderer.
+ * The queue and its drop rules are CFrameQueue, which the headless renderer uses as well.
+ *
+ * The queued samples come from the allocator which is sized to hold a full queue, which means
+ * the source's buffer is released as soon as the frame is formatted and that the delivery thread
+ * does not pay for formatting.
  *
  * This class borrows heavily from DirectShow CSourceStream.
  */
 class CBufferedLiveSourceVideoOutputPin:
 	public ALiveSourceVideoOutputPin,
-	public CAMThread
+	public CAMThread,
+	private IFrameQueueCallback<IMediaSample*>
 {
 public:
 
@@ -43,17 +48,22 @@ public:
 	HRESULT OnVideoFrame(VideoFrame&) override;
 	void SetFrameQueueMaxSize(size_t) override;
 	size_t GetFrameQueueSize() override;
+	void SetFrameQueueMaxBytes(size_t maxBytes, size_t frameBytes) override;
+	size_t GetFrameQueueBytes() override;
+	void SetFrameQueueDropPolicy(const FrameQueueDropPolicyConfig&) override;
 	void Reset() override;
 	REFERENCE_TIME NextFrameTimestamp() const override { return m_nextVideoFrameStartTime; }
+	long SampleBufferCount() const override;
 
 private:
 
-	size_t m_frameQueueMaxSize = 0;
+	typedef CFrameQueue<IMediaSample*>::Frame FormattedFrame;
 
-	std::deque<VideoFrame> m_videoFrameQueue;
-	std::atomic_bool m_isActive = false;
+	// Unset until SetFrameQueueMaxSize() is called, the pin can't be activated without
+	bool m_frameQueueMaxSizeSet = false;
 
-	CCritSec m_filterCritSec;
+	// Opened on activation, the capture callback is the producer and the thread the consumer
+	CFrameQueue<IMediaSample*> m_frameQueue;
 
 	REFERENCE_TIME m_nextVideoFrameStartTime = REFERENCE_TIME_INVALID;
 
@@ -61,6 +71,11 @@ private:
 	// Return codes > 0 indicate an error occured
 	DWORD ThreadProc();
 
-	// Remove all items from the videoFrameQueue
-	void PurgeQueue();
+	// Get an empty sample to format into without blocking the caller, if the allocator
+	// has none left the oldest queued sample is dropped and reused.
+	// Returns nullptr if there is no sample to be had.
+	IMediaSample* GetFormatBuffer();
+
+	// IFrameQueueCallback
+	void OnFrameQueueRelease(IMediaSample* sample) override { sample->Release(); }
 };
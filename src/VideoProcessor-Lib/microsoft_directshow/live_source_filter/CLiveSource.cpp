@@ -48,16 +48,18 @@ CUnknown* WINAPI CLiveSource::CreateInstance(LPUNKNOWN pUnk, HRESULT* phr)
 STDMETHODIMP CLiveSource::Initialize(
 	IVideoFrameFormatter* videoFrameFormatter,
 	const AM_MEDIA_TYPE& mediaType,
-	timestamp_t frameDuration,
+	const RationalTimebase& frameTimebase,
 	ITimingClock* timingClock,
 	DirectShowStartStopTimeMethod timestamp,
 	bool useFrameQueue,
-	size_t frameQueueMaxSize)
+	size_t frameQueueMaxSize,
+	size_t frameQueueMaxBytes,
+	const FrameQueueDropPolicyConfig& frameQueueDropPolicy,
+	RendererLatencyHistograms& latencyHistograms)
 {
 	assert(!m_videoOutputPin);
 	assert(videoFrameFormatter);
 	assert(mediaType.majortype.Data1 > 0);
-	assert(frameDuration > 0);
 
 	HRESULT hr = S_OK;
 
@@ -84,13 +86,18 @@ STDMETHODIMP CLiveSource::Initialize(
 
 	m_videoOutputPin->Initialize(
 		videoFrameFormatter,
-		frameDuration,
+		frameTimebase,
 		timingClock,
 		timestamp,
-		mediaType);
+		mediaType,
+		latencyHistograms);
 
 	if (useFrameQueue)
+	{
 		m_videoOutputPin->SetFrameQueueMaxSize(frameQueueMaxSize);
+		m_videoOutputPin->SetFrameQueueMaxBytes(frameQueueMaxBytes, (size_t)videoFrameFormatter->GetOutFrameSize());
+		m_videoOutputPin->SetFrameQueueDropPolicy(frameQueueDropPolicy);
+	}
 
 	return S_OK;
 }
@@ -181,9 +188,9 @@ int CLiveSource::GetFrameQueueSize()
 }
 
 
-double CLiveSource::ExitLatencyMs() const
+size_t CLiveSource::GetFrameQueueBytes()
 {
-	return m_videoOutputPin->ExitLatencyMs();
+	return m_videoOutputPin->GetFrameQueueBytes();
 }
 
 
@@ -191,3 +198,9 @@ uint64_t CLiveSource::DroppedFrameCount() const
 {
 	return m_videoOutputPin->DroppedFrameCount();
 }
+
+
+uint64_t CLiveSource::DroppedFrameCount(FrameDropReason reason) const
+{
+	return m_videoOutputPin->DroppedFrameCount(reason);
+}
@@ -11,6 +11,7 @@
 
 #include <streams.h>
 
+#include <FrameDropReason.h>
 #include <VideoState.h>
 #include <video_frame_formatter/IVideoFrameFormatter.h>
 #include <microsoft_directshow/DirectShowRendererStartStopTimeMethod.h>
@@ -48,11 +49,14 @@ public:
 	STDMETHODIMP Initialize(
 		IVideoFrameFormatter* videoFrameFormatter,
 		const AM_MEDIA_TYPE& mediaType,
-		timestamp_t frameDuration,
+		const RationalTimebase& frameTimebase,
 		ITimingClock* timingClock,
 		DirectShowStartStopTimeMethod timestamp,
 		bool useFrameQueue,
-		size_t frameQueueMaxSize) override;
+		size_t frameQueueMaxSize,
+		size_t frameQueueMaxBytes,
+		const FrameQueueDropPolicyConfig& frameQueueDropPolicy,
+		RendererLatencyHistograms& latencyHistograms) override;
 	STDMETHODIMP Destroy() override;
 	STDMETHODIMP OnHDRData(HDRDataSharedPtr&) override;
 	STDMETHODIMP OnVideoFrame(VideoFrame&) override;
@@ -79,18 +83,17 @@ public:
 	// Can only be called after Initialize()
 	int GetFrameQueueSize();
 
+	// Get the bytes the frames in the queue take right now
+	// Can only be called after Initialize()
+	size_t GetFrameQueueBytes();
+
 	//
 	// Metrics
 	//
 
-	// Get the exit latency in ms, which the amount of time between the frame timestamp
-	// and when the frame is delivered to the DirectShow renderer.
-	// This is sampled.
-	double ExitLatencyMs() const;
-
-
-	// Get the amount of dropped frames due to queue actions
+	// Get the amount of dropped frames due to queue actions, in total or for one reason
 	uint64_t DroppedFrameCount() const;
+	uint64_t DroppedFrameCount(FrameDropReason) const;
 
 private:
 	ALiveSourceVideoOutputPin* m_videoOutputPin = nullptr;
@@ -8,6 +8,8 @@
 
 #include <pch.h>
 
+#include <PipelineTrace.h>
+
 #include "CUnbufferedLiveSourceVideoOutputPin.h"
 
 
@@ -34,10 +36,14 @@ HRESULT CUnbufferedLiveSourceVideoOutputPin::OnVideoFrame(VideoFrame& videoFrame
 	// Get buffer for sample
 	// Note you can fill in start and stop time, but following the code shows that they are unused.
 	IMediaSample* pSample = nullptr;
-	hr = this->GetDeliveryBuffer(&pSample, nullptr, nullptr, 0);
-	if (FAILED(hr))
 	{
-		return hr;
+		CPipelineTraceScope traceScope(PipelineTraceStage::GET_DELIVERY_BUFFER, videoFrame.GetCounter());
+
+		hr = this->GetDeliveryBuffer(&pSample, nullptr, nullptr, 0);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
 	}
 
 	// Render
@@ -49,7 +55,13 @@ HRESULT CUnbufferedLiveSourceVideoOutputPin::OnVideoFrame(VideoFrame& videoFrame
 	}
 
 	// Deliver to downstream renderer (this will block)
-	hr = this->Deliver(pSample);
+	const timingclocktime_t deliverTime = m_timingClock->TimingClockNow();
+	{
+		CPipelineTraceScope traceScope(PipelineTraceStage::DELIVER, videoFrame.GetCounter());
+		hr = this->Deliver(pSample);
+	}
+	m_latencyHistograms->deliver.Record(TimingClockDiffMs(
+		deliverTime, m_timingClock->TimingClockNow(), m_timingClock->TimingClockTicksPerSecond()));
 	pSample->Release();
 
 	return hr;
@@ -34,4 +34,7 @@ public:
 	HRESULT OnVideoFrame(VideoFrame&) override;
 	void SetFrameQueueMaxSize(size_t) override;
 	size_t GetFrameQueueSize() override { return 0; }
+	void SetFrameQueueMaxBytes(size_t, size_t) override {}
+	size_t GetFrameQueueBytes() override { return 0; }
+	void SetFrameQueueDropPolicy(const FrameQueueDropPolicyConfig&) override {}
 };
@@ -9,6 +9,9 @@
 #pragma once
 
 
+#include <FrameQueueDropPolicy.h>
+#include <LatencyHistogram.h>
+#include <RationalTimebase.h>
 #include <VideoFrame.h>
 #include <VideoState.h>
 #include <guiddef.h>
@@ -26,14 +29,21 @@ static const GUID CLSID_CLiveSource =
 DECLARE_INTERFACE_(ILiveSource, IUnknown)
 {
 	// Initialize, can only be called once
+	// The format, queue wait and exit latencies of every frame are recorded into latencyHistograms
+	// which need to outlive the filter.
+	// The queue holds at most frameQueueMaxBytes, 0 is no byte limit, counting every frame at the formatter's
+	// out frame size. The formatter must have had its video state.
 	STDMETHOD(Initialize)(
 		IVideoFrameFormatter* videoFrameFormatter,
 		const AM_MEDIA_TYPE& mediaSubType,
-		timestamp_t frameDuration,
+		const RationalTimebase& frameTimebase,
 		ITimingClock * timingClock,
 		DirectShowStartStopTimeMethod timestamp,
 		bool useFrameQueue,
-		size_t frameQueueMaxSize) PURE;
+		size_t frameQueueMaxSize,
+		size_t frameQueueMaxBytes,
+		const FrameQueueDropPolicyConfig& frameQueueDropPolicy,
+		RendererLatencyHistograms& latencyHistograms) PURE;
 
 	// Destroy, can only be called once
 	STDMETHOD(Destroy)(void) PURE;
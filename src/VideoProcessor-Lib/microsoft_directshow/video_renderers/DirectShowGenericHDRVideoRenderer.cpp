@@ -13,7 +13,7 @@
 #include <guid.h>
 #include <video_frame_formatter/CNoopVideoFrameFormatter.h>
 #include <video_frame_formatter/CV210toP010VideoFrameFormatter.h>
-#include <video_frame_formatter/CFFMpegDecoderVideoFrameFormatter.h>
+#include <video_frame_formatter/CRGBtoRGB48VideoFrameFormatter.h>
 #include <microsoft_directshow/DirectShowTranslations.h>
 
 #include "DirectShowGenericHDRVideoRenderer.h"
@@ -124,28 +124,18 @@ void DirectShowGenericHDRVideoRenderer::MediaTypeGenerate()
 	{
 		switch (m_videoState->videoFrameEncoding)
 		{
-			// r210 to RGB48
+			// Packed 10 and 12-bit RGB to RGB48
 		case VideoFrameEncoding::R210:
-
-			mediaSubType = MEDIASUBTYPE_RGB0;
-			bitCount = 48;
-			heightMultiplier = -1;
-
-			m_videoFramFormatter = new CFFMpegDecoderVideoFrameFormatter(
-				AV_CODEC_ID_R210,
-				AV_PIX_FMT_RGB48LE);
-			break;
-
-			// RGB 12-bit to RGB48
+		case VideoFrameEncoding::R10b:
+		case VideoFrameEncoding::R10l:
 		case VideoFrameEncoding::R12B:
+		case VideoFrameEncoding::R12L:
 
 			mediaSubType = MEDIASUBTYPE_RGB0;
 			bitCount = 48;
 			heightMultiplier = -1;
 
-			m_videoFramFormatter = new CFFMpegDecoderVideoFrameFormatter(
-				AV_CODEC_ID_R12B,
-				AV_PIX_FMT_RGB48LE);
+			m_videoFramFormatter = new CRGBtoRGB48VideoFrameFormatter();
 			break;
 
 			// No conversion needed
@@ -191,7 +181,7 @@ void DirectShowGenericHDRVideoRenderer::MediaTypeGenerate()
 	pvi2->bmiHeader.biClrImportant = 0;
 	pvi2->bmiHeader.biClrUsed = 0;
 
-	pvi2->AvgTimePerFrame = (REFERENCE_TIME)(UNITS / m_videoState->displayMode->RefreshRateHz());
+	pvi2->AvgTimePerFrame = m_videoState->displayMode->FrameTimebase(UNITS).Convert(1);
 
 	DXVA_ExtendedFormat* colorimetry = (DXVA_ExtendedFormat*)&(pvi2->dwControlFlags);
 
@@ -117,7 +117,7 @@ void DirectShowGenericVideoRenderer::MediaTypeGenerate()
 	pvi->bmiHeader.biPlanes = 1;
 	pvi->bmiHeader.biClrImportant = 0;
 	pvi->bmiHeader.biClrUsed = 0;
-	pvi->AvgTimePerFrame = (REFERENCE_TIME)(UNITS / m_videoState->displayMode->RefreshRateHz());
+	pvi->AvgTimePerFrame = m_videoState->displayMode->FrameTimebase(UNITS).Convert(1);
 
 	m_pmt.lSampleSize = DIBSIZE(pvi->bmiHeader);
 }
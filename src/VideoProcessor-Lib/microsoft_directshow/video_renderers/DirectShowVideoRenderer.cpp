@@ -79,8 +79,9 @@ bool DirectShowVideoRenderer::OnVideoState(VideoStateComPtr& videoState)
 	}
 	else
 	{
-		// No video state yet, initialize
-		m_videoState = videoState;
+		// No video state yet, initialize. Our own copy as the HDR data gets updated in it and
+		// capture devices can send the same video state again.
+		m_videoState = new VideoState(*videoState);
 	}
 
 	// All good, continue
@@ -96,14 +97,9 @@ void DirectShowVideoRenderer::OnVideoFrame(VideoFrame& videoFrame)
 	assert(m_videoState);
 	assert(videoFrame.GetTimingTimestamp() > 0);
 
-	// Get delay until now once in a while
-	if (m_frameCounter % 20 == 0)
-	{
-		const timingclocktime_t frameTime = videoFrame.GetTimingTimestamp();
-		const timingclocktime_t clockTime = m_timingClock->TimingClockNow();
-
-		m_frameLatencyEntry = TimingClockDiffMs(frameTime, clockTime, m_timingClock->TimingClockTicksPerSecond());
-	}
+	// Delay until now
+	m_latencyHistograms.entry.Record(TimingClockDiffMs(
+		videoFrame.GetTimingTimestamp(), m_timingClock->TimingClockNow(), m_timingClock->TimingClockTicksPerSecond()));
 
 	if (FAILED(m_liveSource->OnVideoFrame(videoFrame)))
 	{
@@ -197,12 +193,42 @@ void DirectShowVideoRenderer::OnSize()
 }
 
 
+void DirectShowVideoRenderer::SetFormatterThreads(unsigned int formatterThreads)
+{
+	if (formatterThreads == 0)
+		throw std::runtime_error("Need at least one formatter thread");
+
+	if (m_pGraph)
+		throw std::runtime_error("Formatter threads can only be set before Build()");
+
+	m_formatterThreads = formatterThreads;
+}
+
+
 void DirectShowVideoRenderer::SetFrameQueueMaxSize(size_t frameMaxQueueSize)
 {
 	m_liveSource->SetFrameQueueMaxSize(frameMaxQueueSize);
 }
 
 
+void DirectShowVideoRenderer::SetFrameQueueDropPolicy(const FrameQueueDropPolicyConfig& frameQueueDropPolicy)
+{
+	if (m_pGraph)
+		throw std::runtime_error("Frame queue drop policy can only be set before Build()");
+
+	m_frameQueueDropPolicy = frameQueueDropPolicy;
+}
+
+
+void DirectShowVideoRenderer::SetFrameQueueMaxBytes(size_t frameQueueMaxBytes)
+{
+	if (m_pGraph)
+		throw std::runtime_error("Frame queue max bytes can only be set before Build()");
+
+	m_frameQueueMaxBytes = frameQueueMaxBytes;
+}
+
+
 size_t DirectShowVideoRenderer::GetFrameQueueSize()
 {
 	if (m_state != RendererState::RENDERSTATE_RENDERING)
@@ -212,12 +238,21 @@ size_t DirectShowVideoRenderer::GetFrameQueueSize()
 }
 
 
+size_t DirectShowVideoRenderer::GetFrameQueueBytes()
+{
+	if (m_state != RendererState::RENDERSTATE_RENDERING)
+		throw std::runtime_error("Invalid state, can only be called while rendering");
+
+	return m_liveSource->GetFrameQueueBytes();
+}
+
+
 double DirectShowVideoRenderer::EntryLatencyMs() const
 {
 	if (m_state != RendererState::RENDERSTATE_RENDERING)
 		throw std::runtime_error("Invalid state, can only be called while rendering");
 
-	return m_frameLatencyEntry;
+	return m_latencyHistograms.entry.LastMs();
 }
 
 
@@ -226,7 +261,7 @@ double DirectShowVideoRenderer::ExitLatencyMs() const
 	if (m_state != RendererState::RENDERSTATE_RENDERING)
 		throw std::runtime_error("Invalid state, can only be called while rendering");
 
-	return m_liveSource->ExitLatencyMs();
+	return m_latencyHistograms.exit.LastMs();
 }
 
 
@@ -239,6 +274,15 @@ uint64_t DirectShowVideoRenderer::DroppedFrameCount() const
 }
 
 
+uint64_t DirectShowVideoRenderer::DroppedFrameCount(FrameDropReason reason) const
+{
+	if (m_state != RendererState::RENDERSTATE_RENDERING)
+		throw std::runtime_error("Invalid state, can only be called while rendering");
+
+	return m_liveSource->DroppedFrameCount(reason);
+}
+
+
 void DirectShowVideoRenderer::OnGraphEvent(long evCode, LONG_PTR param1, LONG_PTR param2)
 {
 	// ! Do not tear down graph here
@@ -316,6 +360,12 @@ void DirectShowVideoRenderer::GraphBuild()
 
 	MediaTypeGenerate();
 
+	if (m_formatterThreads > 1)
+	{
+		m_formatterWorkerPool = new CWorkerPool(m_formatterThreads);
+		m_videoFramFormatter->SetWorkerPool(m_formatterWorkerPool);
+	}
+
 	//
 	// Live source filter
 	//
@@ -403,6 +453,12 @@ void DirectShowVideoRenderer::GraphTeardown()
 		m_videoFramFormatter = nullptr;
 	}
 
+	if (m_formatterWorkerPool)
+	{
+		delete m_formatterWorkerPool;
+		m_formatterWorkerPool = nullptr;
+	}
+
 	if (m_pmt.pbFormat)
 	{
 		CoTaskMemFree(m_pmt.pbFormat);
@@ -585,17 +641,17 @@ void DirectShowVideoRenderer::LiveSourceBuildAndConnect()
 
 	m_liveSource->AddRef();
 
-	const timestamp_t frameDuration100ns =
-		(timestamp_t)round((1.0 / m_videoState->displayMode->RefreshRateHz()) * UNITS);
-
 	m_liveSource->Initialize(
 		m_videoFramFormatter,
 		m_pmt,
-		frameDuration100ns,
+		m_videoState->displayMode->FrameTimebase(UNITS),
 		m_timingClock,
 		m_timestamp,
 		m_useFrameQueue,
-		m_frameQueueMaxSize);
+		m_frameQueueMaxSize,
+		m_frameQueueMaxBytes,
+		m_frameQueueDropPolicy,
+		m_latencyHistograms);
 
 	if (m_pGraph->AddFilter(m_liveSource, L"LiveSource") != S_OK)
 	{
@@ -16,6 +16,7 @@
 #include <PixelValueRange.h>
 #include <VideoState.h>
 #include <video_frame_formatter/IVideoFrameFormatter.h>
+#include <WorkerPool.h>
 #include <ITimingClock.h>
 #include <VideoConversionOverride.h>
 #include <microsoft_directshow/live_source_filter/CLiveSource.h>
@@ -51,11 +52,17 @@ public:
 	void Stop() override;
 	void Reset() override;
 	void OnSize() override;
+	void SetFormatterThreads(unsigned int) override;
 	void SetFrameQueueMaxSize(size_t) override;
+	void SetFrameQueueDropPolicy(const FrameQueueDropPolicyConfig&) override;
+	void SetFrameQueueMaxBytes(size_t) override;
 	size_t GetFrameQueueSize() override;
+	size_t GetFrameQueueBytes() override;
 	double EntryLatencyMs() const override;
 	double ExitLatencyMs() const override;
+	const RendererLatencyHistograms& LatencyHistograms() const override { return m_latencyHistograms; }
 	uint64_t DroppedFrameCount() const override;
+	uint64_t DroppedFrameCount(FrameDropReason) const override;
 
 protected:
 
@@ -68,6 +75,8 @@ protected:
 	DirectShowStartStopTimeMethod m_timestamp;
 	bool m_useFrameQueue;
 	size_t m_frameQueueMaxSize;
+	FrameQueueDropPolicyConfig m_frameQueueDropPolicy;
+	size_t m_frameQueueMaxBytes = 0;
 	VideoConversionOverride m_videoConversionOverride;
 	DXVA_NominalRange m_forceNominalRange = DXVA_NominalRange::DXVA_NominalRange_Unknown;
 	DXVA_VideoTransferFunction m_forceVideoTransferFunction = DXVA_VideoTransferFunction::DXVA_VideoTransFunc_Unknown;
@@ -86,6 +95,8 @@ protected:
 	IAMGraphStreams* m_amGraphStreams = nullptr;
 	IReferenceClock* m_referenceClock = nullptr;
 	IVideoFrameFormatter* m_videoFramFormatter = nullptr;
+	unsigned int m_formatterThreads = 1;
+	CWorkerPool* m_formatterWorkerPool = nullptr;
 	AM_MEDIA_TYPE m_pmt;
 	CLiveSource* m_liveSource = nullptr;
 	IBaseFilter* m_pLav = nullptr;
@@ -93,7 +104,7 @@ protected:
 
 	uint64_t m_frameCounter = 0;
 	uint64_t m_missingFrameCounter = 0;
-	double m_frameLatencyEntry = 0.0;
+	RendererLatencyHistograms m_latencyHistograms;
 
 	// Handle Directshow graph events
 	void OnGraphEvent(long evCode, LONG_PTR param1, LONG_PTR param2);
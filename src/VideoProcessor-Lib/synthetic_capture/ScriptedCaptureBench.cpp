@@ -0,0 +1,278 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <algorithm>
+#include <math.h>
+#include <stdexcept>
+
+#include <FrameArrivalCounter.h>
+#include <VideoFrame.h>
+#include <VideoState.h>
+#include <headless_renderer/HeadlessVideoRenderer.h>
+#include <synthetic_capture/SimulatedTimingClock.h>
+
+#include "ScriptedCaptureBench.h"
+
+
+//
+// ScriptedCaptureTimeline
+//
+
+
+ScriptedCaptureTimeline::ScriptedCaptureTimeline(
+	const DisplayMode& displayMode,
+	timingclocktime_t ticksPerSecond,
+	double captureLatencyMs,
+	uint32_t seed):
+	m_ticksPerSecond(ticksPerSecond),
+	m_ticksPerFrame((double)ticksPerSecond * displayMode.FrameDuration() / displayMode.TimeScale()),
+	m_captureLatencyTicks((timingclocktime_t)round(captureLatencyMs * ticksPerSecond / 1000.0)),
+	m_random(seed),
+	m_nextTimingTimestamp((double)ticksPerSecond)  // Start a second in, timestamps need to be > 0
+{
+	if (captureLatencyMs < 0.0)
+		throw std::runtime_error("Capture latency cannot be negative");
+}
+
+
+ScriptedCaptureTimeline& ScriptedCaptureTimeline::Steady(unsigned int frames)
+{
+	for (unsigned int i = 0; i < frames; i++)
+	{
+		const timingclocktime_t timingTimestamp = NextTimingTimestamp();
+		AddArrival(timingTimestamp, timingTimestamp + m_captureLatencyTicks);
+	}
+
+	return *this;
+}
+
+
+ScriptedCaptureTimeline& ScriptedCaptureTimeline::Jitter(unsigned int frames, double maxJitterMs)
+{
+	const double maxJitterTicks = maxJitterMs * m_ticksPerSecond / 1000.0;
+	std::uniform_real_distribution<double> jitter(-maxJitterTicks, maxJitterTicks);
+
+	for (unsigned int i = 0; i < frames; i++)
+	{
+		const timingclocktime_t timingTimestamp = NextTimingTimestamp();
+
+		// Can't arrive before it was captured
+		const timingclocktime_t arrivalTime = timingTimestamp + std::max(
+			m_captureLatencyTicks + (timingclocktime_t)round(jitter(m_random)),
+			(timingclocktime_t)0);
+
+		AddArrival(timingTimestamp, arrivalTime);
+	}
+
+	return *this;
+}
+
+
+ScriptedCaptureTimeline& ScriptedCaptureTimeline::Burst(unsigned int frames)
+{
+	std::vector<timingclocktime_t> timingTimestamps(frames);
+	for (timingclocktime_t& timingTimestamp : timingTimestamps)
+		timingTimestamp = NextTimingTimestamp();
+
+	for (const timingclocktime_t timingTimestamp : timingTimestamps)
+		AddArrival(timingTimestamp, timingTimestamps.back() + m_captureLatencyTicks);
+
+	return *this;
+}
+
+
+ScriptedCaptureTimeline& ScriptedCaptureTimeline::Gap(unsigned int frames)
+{
+	for (unsigned int i = 0; i < frames; i++)
+		NextTimingTimestamp();
+
+	return *this;
+}
+
+
+ScriptedCaptureTimeline& ScriptedCaptureTimeline::Drift(double ppm)
+{
+	if (ppm <= -1000000.0)
+		throw std::runtime_error("Drift would stop the frames");
+
+	m_driftPpm = ppm;
+
+	return *this;
+}
+
+
+timingclocktime_t ScriptedCaptureTimeline::NextTimingTimestamp()
+{
+	// Kept in double so that the frame durations don't add up rounding errors
+	const timingclocktime_t timingTimestamp = (timingclocktime_t)round(m_nextTimingTimestamp);
+
+	m_nextTimingTimestamp += m_ticksPerFrame / (1.0 + m_driftPpm / 1000000.0);
+	++m_frameCount;
+
+	return timingTimestamp;
+}
+
+
+void ScriptedCaptureTimeline::AddArrival(timingclocktime_t timingTimestamp, timingclocktime_t arrivalTime)
+{
+	if (!m_arrivals.empty())
+		arrivalTime = std::max(arrivalTime, m_arrivals.back().arrivalTime);
+
+	m_arrivals.push_back({ timingTimestamp, arrivalTime });
+}
+
+
+//
+// ScriptedCaptureBench
+//
+
+
+// Keeps what the renderer delivers with the time it was delivered
+class ScriptedCaptureBenchSink:
+	public IHeadlessFrameSink
+{
+public:
+
+	ScriptedCaptureBenchSink(std::vector<ScriptedCaptureBenchDelivery>& deliveries):
+		m_deliveries(deliveries)
+	{
+	}
+
+	void OnSinkStart(ITimingClock* timingClock, size_t) override { m_timingClock = timingClock; }
+	void OnSinkFrame(const BYTE*, size_t, const DirectShowFrameTimes& times) override { m_deliveries.push_back({ m_timingClock->TimingClockNow(), times }); }
+	void OnSinkStop() override {}
+	uint64_t SinkFrameCount() const override { return m_deliveries.size(); }
+
+private:
+
+	std::vector<ScriptedCaptureBenchDelivery>& m_deliveries;
+	ITimingClock* m_timingClock = nullptr;
+};
+
+
+class ScriptedCaptureBenchRendererCallback:
+	public IRendererCallback
+{
+public:
+
+	void OnRendererState(RendererState) override {}
+	void OnRendererDetailString(const CString&) override {}
+};
+
+
+static LatencyHistogramSummary SummarizeAll(const CLatencyHistogram& histogram)
+{
+	LatencyHistogramCounts counts;
+	histogram.Snapshot(counts);
+
+	return CLatencyHistogram::Summarize(LatencyHistogramCounts(), counts);
+}
+
+
+ScriptedCaptureBench::ScriptedCaptureBench(const ScriptedCaptureBenchConfig& config):
+	m_config(config)
+{
+	if (!config.displayMode)
+		throw std::runtime_error("Scripted capture bench needs a display mode");
+}
+
+
+ScriptedCaptureBenchResult ScriptedCaptureBench::Run(const ScriptedCaptureTimeline& timeline)
+{
+	const std::vector<ScriptedFrameArrival>& arrivals = timeline.Arrivals();
+	if (arrivals.empty())
+		throw std::runtime_error("Nothing to run in the timeline");
+
+	const timingclocktime_t ticksPerSecond = timeline.TicksPerSecond();
+	SimulatedTimingClock timingClock(ticksPerSecond, arrivals.front().arrivalTime);
+
+	ScriptedCaptureBenchResult result;
+
+	ScriptedCaptureBenchRendererCallback rendererCallback;
+	ScriptedCaptureBenchSink sink(result.deliveries);
+	HeadlessVideoRenderer renderer(
+		rendererCallback, sink, &timingClock,
+		m_config.timestamp,
+		m_config.useFrameQueue, m_config.useFrameQueue ? m_config.frameQueueMaxSize : 0,
+		VideoConversionOverride::VIDEOCONVERSION_NONE);
+	renderer.SetDeliveryThread(false);
+	renderer.SetFrameQueueDropPolicy(m_config.frameQueueDropPolicy);
+	renderer.SetFrameQueueMaxBytes(m_config.frameQueueMaxBytes);
+
+	VideoStateComPtr videoState = new VideoState();
+	videoState->valid = true;
+	videoState->displayMode = m_config.displayMode;
+	videoState->videoFrameEncoding = m_config.videoFrameEncoding;
+
+	if (!renderer.OnVideoState(videoState))
+		throw std::runtime_error("Renderer did not accept the video state");
+
+	renderer.Build();
+	renderer.Start();
+
+	// Contents don't matter, only the timing
+	const std::vector<uint8_t> frameData(videoState->BytesPerFrame());
+
+	CFrameArrivalCounter frameArrivalCounter;
+	frameArrivalCounter.SetFrameTimebase(m_config.displayMode->FrameTimebase(ticksPerSecond));
+
+	const timingclocktime_t frameOffsetTicks = (timingclocktime_t)m_config.frameOffsetMs * ticksPerSecond / 1000;
+
+	// Refreshes start with the first arrival
+	const double refreshRateHz = (m_config.refreshRateHz > 0.0) ? m_config.refreshRateHz : m_config.displayMode->RefreshRateHz();
+	const double ticksPerRefresh = ticksPerSecond / refreshRateHz;
+	const timingclocktime_t firstRefresh = arrivals.front().arrivalTime;
+	uint64_t refresh = 1;
+
+	auto Refresh = [&]()
+	{
+		timingClock.SetNow(firstRefresh + (timingclocktime_t)round(refresh * ticksPerRefresh));
+		renderer.DeliverQueuedFrame();
+		++refresh;
+	};
+
+	for (const ScriptedFrameArrival& arrival : arrivals)
+	{
+		while (firstRefresh + (timingclocktime_t)round(refresh * ticksPerRefresh) <= arrival.arrivalTime)
+			Refresh();
+
+		timingClock.SetNow(arrival.arrivalTime);
+
+		VideoFrame videoFrame(
+			frameData.data(), frameArrivalCounter.OnFrame(arrival.timingTimestamp),
+			arrival.timingTimestamp + frameOffsetTicks, nullptr);
+
+		renderer.OnVideoFrame(videoFrame);
+
+		const size_t queueSize = renderer.GetFrameQueueSize();
+		result.queueSizes.push_back(queueSize);
+		result.maxQueueSize = std::max(result.maxQueueSize, queueSize);
+		result.maxQueueBytes = std::max(result.maxQueueBytes, renderer.GetFrameQueueBytes());
+	}
+
+	// Let the renderer take what it can of what's left
+	for (size_t i = 0; i < m_config.frameQueueMaxSize + 2; i++)
+		Refresh();
+
+	result.arrivedFrames = arrivals.size();
+	result.missedFrames = frameArrivalCounter.MissedCount();
+	result.deliveredFrames = result.deliveries.size();
+	result.droppedFrames = renderer.DroppedFrameCount();
+	for (size_t reason = 0; reason < (size_t)FrameDropReason::FRAMEDROP_REASONS; reason++)
+		result.droppedFramesPerReason[reason] = renderer.DroppedFrameCount((FrameDropReason)reason);
+
+	result.entryLatency = SummarizeAll(renderer.LatencyHistograms().entry);
+	result.queueWait = SummarizeAll(renderer.LatencyHistograms().queueWait);
+	result.exitLatency = SummarizeAll(renderer.LatencyHistograms().exit);
+
+	renderer.Stop();
+
+	return result;
+}
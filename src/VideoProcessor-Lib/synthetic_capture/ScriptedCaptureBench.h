@@ -0,0 +1,174 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+#include <DisplayMode.h>
+#include <FrameDropReason.h>
+#include <FrameQueueDropPolicy.h>
+#include <LatencyHistogram.h>
+#include <TimingClock.h>
+#include <VideoFrameEncoding.h>
+#include <microsoft_directshow/DirectShowFrameTimestamper.h>
+#include <microsoft_directshow/DirectShowRendererStartStopTimeMethod.h>
+
+
+// A frame as the capture callback gets it
+struct ScriptedFrameArrival
+{
+	// Hardware timestamp of the frame
+	timingclocktime_t timingTimestamp;
+
+	// Time of the capture callback
+	timingclocktime_t arrivalTime;
+};
+
+
+/**
+ * Script of frame arrivals built up from segments of steady, jittery, bursty and missing frames.
+ *
+ * Frames are timestamped at the rate of the display mode, or off by the drift, and arrive
+ * the capture latency after their timestamp unless the segment says otherwise. Random jitter
+ * comes from a seeded generator so a script is the same every time.
+ */
+class ScriptedCaptureTimeline
+{
+public:
+
+	ScriptedCaptureTimeline(
+		const DisplayMode& displayMode,
+		timingclocktime_t ticksPerSecond,
+		double captureLatencyMs,
+		uint32_t seed = 1);
+
+	// Frames arriving on time
+	ScriptedCaptureTimeline& Steady(unsigned int frames);
+
+	// Frames arriving up to maxJitterMs early or late, their timestamps are exact
+	ScriptedCaptureTimeline& Jitter(unsigned int frames, double maxJitterMs);
+
+	// Frames held up and arriving all at once with the last of them
+	ScriptedCaptureTimeline& Burst(unsigned int frames);
+
+	// Frames which never arrive, like a card missing them
+	ScriptedCaptureTimeline& Gap(unsigned int frames);
+
+	// Frames are this many ppm faster (or slower if negative) than the display mode from here on
+	ScriptedCaptureTimeline& Drift(double ppm);
+
+	const std::vector<ScriptedFrameArrival>& Arrivals() const { return m_arrivals; }
+
+	// All frames in the script, including the ones in gaps
+	uint64_t FrameCount() const { return m_frameCount; }
+
+	timingclocktime_t TicksPerSecond() const { return m_ticksPerSecond; }
+
+	// Nominal frame duration in ticks
+	double TicksPerFrame() const { return m_ticksPerFrame; }
+
+private:
+
+	const timingclocktime_t m_ticksPerSecond;
+	const double m_ticksPerFrame;
+	const timingclocktime_t m_captureLatencyTicks;
+
+	std::mt19937 m_random;
+
+	double m_driftPpm = 0.0;
+	double m_nextTimingTimestamp;
+	uint64_t m_frameCount = 0;
+
+	std::vector<ScriptedFrameArrival> m_arrivals;
+
+	// Timestamp of the next frame in the script
+	timingclocktime_t NextTimingTimestamp();
+
+	// Arrivals can't overtake each other
+	void AddArrival(timingclocktime_t timingTimestamp, timingclocktime_t arrivalTime);
+};
+
+
+struct ScriptedCaptureBenchConfig
+{
+	DisplayModeSharedPtr displayMode = nullptr;
+	VideoFrameEncoding videoFrameEncoding = VideoFrameEncoding::BGRA_8BIT;
+
+	DirectShowStartStopTimeMethod timestamp = DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_SMART;
+	bool useFrameQueue = true;
+	size_t frameQueueMaxSize = 4;
+	FrameQueueDropPolicyConfig frameQueueDropPolicy;
+	size_t frameQueueMaxBytes = 0;
+
+	// Rate at which the renderer takes frames from the queue, 0 for the rate of the display mode
+	double refreshRateHz = 0.0;
+
+	int frameOffsetMs = 0;
+};
+
+
+// A frame as the renderer delivered it
+struct ScriptedCaptureBenchDelivery
+{
+	timingclocktime_t deliveryTime;
+	DirectShowFrameTimes times;
+};
+
+
+struct ScriptedCaptureBenchResult
+{
+	// Frames which arrived, were missed before arriving, delivered and dropped by the renderer
+	uint64_t arrivedFrames = 0;
+	uint64_t missedFrames = 0;
+	uint64_t deliveredFrames = 0;
+	uint64_t droppedFrames = 0;
+
+	// Dropped frames split up, indexed by FrameDropReason
+	uint64_t droppedFramesPerReason[(size_t)FrameDropReason::FRAMEDROP_REASONS] = {};
+
+	// Queue size after every arrival
+	std::vector<size_t> queueSizes;
+	size_t maxQueueSize = 0;
+	size_t maxQueueBytes = 0;
+
+	std::vector<ScriptedCaptureBenchDelivery> deliveries;
+
+	// Renderer latencies over the whole run
+	LatencyHistogramSummary entryLatency;
+	LatencyHistogramSummary queueWait;
+	LatencyHistogramSummary exitLatency;
+};
+
+
+/**
+ * Plays a scripted timeline through the headless renderer on a simulated clock.
+ *
+ * Everything runs on the calling thread: the clock is moved to every frame arrival and every
+ * refresh of the renderer in turn, the arrival is counted and handed to the renderer and on
+ * a refresh the renderer delivers a queued frame. Nothing waits for real time so it runs as fast
+ * as the formatter can go and has the same result every run.
+ *
+ * Windows only like the headless renderer it drives, so it runs from VideoProcessor-Test and not from
+ * the portable CMake benchmark.
+ */
+class ScriptedCaptureBench
+{
+public:
+
+	ScriptedCaptureBench(const ScriptedCaptureBenchConfig& config);
+
+	ScriptedCaptureBenchResult Run(const ScriptedCaptureTimeline& timeline);
+
+private:
+
+	const ScriptedCaptureBenchConfig m_config;
+};
@@ -0,0 +1,43 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <stdexcept>
+
+#include "SimulatedTimingClock.h"
+
+
+SimulatedTimingClock::SimulatedTimingClock(timingclocktime_t ticksPerSecond, timingclocktime_t now):
+	m_ticksPerSecond(ticksPerSecond),
+	m_now(now)
+{
+	if (ticksPerSecond < 1000LL)
+		throw std::runtime_error("TimingClock needs resolution of at least millisecond level");
+}
+
+
+void SimulatedTimingClock::SetNow(timingclocktime_t now)
+{
+	if (now < m_now.load(std::memory_order_relaxed))
+		throw std::runtime_error("Simulated clock cannot go back in time");
+
+	m_now.store(now, std::memory_order_release);
+}
+
+
+void SimulatedTimingClock::Advance(timingclocktime_t ticks)
+{
+	SetNow(m_now.load(std::memory_order_relaxed) + ticks);
+}
+
+
+const TCHAR* SimulatedTimingClock::TimingClockDescription()
+{
+	return TEXT("Simulated clock");
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <atomic>
+
+#include <ITimingClock.h>
+
+
+/**
+ * Timing clock which only moves when told to, for running timing logic against a scripted timeline
+ * as fast as it can go and with the same outcome every time.
+ *
+ * Time can be read from any thread, it should be moved from one thread only.
+ */
+class SimulatedTimingClock:
+	public ITimingClock
+{
+public:
+
+	SimulatedTimingClock(timingclocktime_t ticksPerSecond, timingclocktime_t now = 0);
+
+	// Move the clock to the given time, throws if that's in the past
+	void SetNow(timingclocktime_t now);
+
+	// Move the clock forward
+	void Advance(timingclocktime_t ticks);
+
+	// ITimingClock
+	timingclocktime_t TimingClockNow() override { return m_now.load(std::memory_order_acquire); }
+	timingclocktime_t TimingClockTicksPerSecond() const override { return m_ticksPerSecond; }
+	const TCHAR* TimingClockDescription() override;
+
+private:
+
+	const timingclocktime_t m_ticksPerSecond;
+	std::atomic<timingclocktime_t> m_now;
+};
@@ -0,0 +1,590 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <chrono>
+#include <string.h>
+
+#include <PipelineTrace.h>
+#include <synthetic_capture/SyntheticFrameEncode.h>
+
+#include "SyntheticCaptureDevice.h"
+
+
+static const timingclocktime_t SYNTHETIC_CLOCK_TICKS_SECOND = 10000000LL;  // 100ns, same as DirectShow
+
+
+const TCHAR* ToString(const SyntheticFramePattern pattern)
+{
+	switch (pattern)
+	{
+	case SyntheticFramePattern::COLOR_BARS:
+		return TEXT("Color bars");
+
+	case SyntheticFramePattern::MOVING_GRADIENT:
+		return TEXT("Moving gradient");
+
+	case SyntheticFramePattern::BUFFER:
+		return TEXT("Buffer");
+	}
+
+	throw std::runtime_error("SyntheticFramePattern ToString() failed, value not recognized");
+}
+
+
+//
+// Constructor & destructor
+//
+
+
+SyntheticCaptureDevice::SyntheticCaptureDevice(const SyntheticCaptureSignal& signal)
+{
+	SetSignal(signal);
+}
+
+
+SyntheticCaptureDevice::~SyntheticCaptureDevice()
+{
+	if (m_outputCaptureData.load(std::memory_order_acquire))
+		StopCapture();
+}
+
+
+void SyntheticCaptureDevice::SetSignal(const SyntheticCaptureSignal& signal)
+{
+	if (!signal.displayMode)
+		throw std::runtime_error("Synthetic signal needs a display mode");
+
+	if (signal.pattern == SyntheticFramePattern::BUFFER)
+	{
+		if (!signal.buffer || signal.buffer->empty())
+			throw std::runtime_error("Synthetic signal with a buffer pattern needs a buffer");
+	}
+	else if (!SyntheticFrameEncodeCanHandle(signal.videoFrameEncoding))
+	{
+		throw std::runtime_error("Synthetic frames cannot be generated in this encoding, use a buffer");
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_signalMutex);
+
+		m_signal = signal;
+		m_signalChanged = true;
+	}
+
+	DbgLog((LOG_TRACE, 1, TEXT("SyntheticCaptureDevice::SetSignal(): signal changed")));
+}
+
+
+//
+// ACaptureDevice
+//
+
+
+void SyntheticCaptureDevice::SetCallbackHandler(ICaptureDeviceCallback* callback)
+{
+	if (m_outputCaptureData.load(std::memory_order_acquire))
+		throw std::runtime_error("Cannot change the callback handler while capturing");
+
+	m_callback = callback;
+
+	// Update client if subscribing, there is no video state until capturing
+	if (m_callback)
+	{
+		m_callback->OnCaptureDeviceState(m_state);
+		m_callback->OnCaptureDeviceVideoStateChange(new VideoState());
+	}
+
+	DbgLog((LOG_TRACE, 1, TEXT("SyntheticCaptureDevice::SetCallbackHandler(): updated callback")));
+}
+
+
+CString SyntheticCaptureDevice::GetName()
+{
+	return CString(TEXT("Synthetic"));
+}
+
+
+void SyntheticCaptureDevice::StartCapture()
+{
+	if (m_outputCaptureData.load(std::memory_order_acquire))
+		throw std::runtime_error("StartCapture() called but already started");
+
+	if (!m_callback)
+		throw std::runtime_error("Set a callback handler before calling StartCapture()");
+
+	m_capturedVideoFrameCount = 0;
+	m_missedVideoFrameCount = 0;
+
+	// Always start with sending the full state
+	{
+		std::lock_guard<std::mutex> lock(m_signalMutex);
+		m_signalChanged = true;
+	}
+
+	// From here on out data can egress
+	m_outputCaptureData.store(true, std::memory_order_release);
+
+	m_frameThread = std::thread(&SyntheticCaptureDevice::FrameThreadProc, this);
+
+	DbgLog((LOG_TRACE, 1, TEXT("SyntheticCaptureDevice::StartCapture(): completed successfully")));
+}
+
+
+void SyntheticCaptureDevice::StopCapture()
+{
+	if (!m_outputCaptureData.load(std::memory_order_acquire))
+		throw std::runtime_error("StopCapture() called while not started");
+
+	// Stop egressing data
+	m_outputCaptureData.store(false, std::memory_order_release);
+
+	if (m_frameThread.joinable())
+		m_frameThread.join();
+
+	if (m_state == CaptureDeviceState::CAPTUREDEVICESTATE_CAPTURING)
+		UpdateState(CaptureDeviceState::CAPTUREDEVICESTATE_READY);
+
+	DbgLog((LOG_TRACE, 1, TEXT("SyntheticCaptureDevice::StopCapture() completed successfully")));
+}
+
+
+CaptureInputs SyntheticCaptureDevice::SupportedCaptureInputs()
+{
+	CaptureInputs captureInputs;
+	captureInputs.push_back(CaptureInput(0, CaptureInputType::HDMI, CString(TEXT("Synthetic"))));
+
+	return captureInputs;
+}
+
+
+void SyntheticCaptureDevice::SetCaptureInput(const CaptureInputId captureInputId)
+{
+	if (captureInputId != 0)
+		throw std::runtime_error("Synthetic capture device only has input 0");
+
+	m_captureInputId = captureInputId;
+}
+
+
+ITimingClock* SyntheticCaptureDevice::GetTimingClock()
+{
+	if (m_state != CaptureDeviceState::CAPTUREDEVICESTATE_CAPTURING)
+		return nullptr;
+
+	return this;
+}
+
+
+void SyntheticCaptureDevice::SetFrameOffsetMs(int frameOffsetMs)
+{
+	DbgLog((LOG_TRACE, 1, TEXT("SyntheticCaptureDevice::SetFrameOffsetMs() to %i"), frameOffsetMs));
+
+	static_assert(SYNTHETIC_CLOCK_TICKS_SECOND % 1000 == 0, "SYNTHETIC_CLOCK_TICKS_SECOND must be mod 1k for optimization here");
+	const timingclocktime_t ticksPerMs = SYNTHETIC_CLOCK_TICKS_SECOND / 1000;
+	m_frameOffsetTicks = frameOffsetMs * ticksPerMs;
+}
+
+
+//
+// ITimingClock
+//
+
+
+timingclocktime_t SyntheticCaptureDevice::TimingClockNow()
+{
+	return std::chrono::duration_cast<std::chrono::duration<timingclocktime_t, std::ratio<1, SYNTHETIC_CLOCK_TICKS_SECOND>>>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+timingclocktime_t SyntheticCaptureDevice::TimingClockTicksPerSecond() const
+{
+	return SYNTHETIC_CLOCK_TICKS_SECOND;
+}
+
+
+const TCHAR* SyntheticCaptureDevice::TimingClockDescription()
+{
+	return TEXT("Synthetic steady clock");
+}
+
+
+//
+// IUnknown
+//
+
+
+HRESULT	SyntheticCaptureDevice::QueryInterface(REFIID iid, LPVOID* ppv)
+{
+	if (!ppv)
+		return E_INVALIDARG;
+
+	// Initialise the return result
+	*ppv = nullptr;
+
+	// Obtain the IUnknown interface and compare it the provided REFIID
+	if (iid == IID_IUnknown)
+	{
+		*ppv = this;
+		AddRef();
+		return S_OK;
+	}
+
+	return E_NOINTERFACE;
+}
+
+
+ULONG SyntheticCaptureDevice::AddRef(void)
+{
+	return ++m_refCount;
+}
+
+
+ULONG SyntheticCaptureDevice::Release(void)
+{
+	ULONG newRefValue = --m_refCount;
+	if (newRefValue == 0)
+		delete this;
+
+	return newRefValue;
+}
+
+
+//
+// Frame thread
+//
+
+
+void SyntheticCaptureDevice::FrameThreadProc()
+{
+	// WARNING: Runs in the frame thread
+
+	DbgLog((LOG_TRACE, 1, TEXT("SyntheticCaptureDevice frame thread starting")));
+
+	assert(m_callback);
+
+	UpdateState(CaptureDeviceState::CAPTUREDEVICESTATE_CAPTURING);
+
+	// Frames are counted and timed from the start of the current signal
+	timingclocktime_t streamStart = TIMING_CLOCK_TIME_INVALID;
+	uint64_t streamFrame = 0;
+	RationalTimebase frameTimebase;
+	uint64_t counter = 0;
+
+	while (m_outputCaptureData.load(std::memory_order_acquire))
+	{
+		//
+		// Signal changes
+		//
+
+		SyntheticCaptureSignal signal;
+		bool signalChanged = false;
+		{
+			std::lock_guard<std::mutex> lock(m_signalMutex);
+
+			if (m_signalChanged)
+			{
+				signal = m_signal;
+				signalChanged = true;
+				m_signalChanged = false;
+			}
+		}
+
+		if (signalChanged)
+		{
+			const bool firstSignal = (streamStart == TIMING_CLOCK_TIME_INVALID);
+			const bool relock =
+				firstSignal ||
+				*m_activeSignal.displayMode != *signal.displayMode ||
+				m_activeSignal.videoFrameEncoding != signal.videoFrameEncoding;
+
+			// Like a card locking onto a new signal, the video state is invalid until the first frame
+			if (relock && !firstSignal)
+				m_callback->OnCaptureDeviceVideoStateChange(new VideoState());
+
+			if (!ApplySignal(signal))
+				break;
+
+			SendCardStateCallback();
+
+			// Fresh (deep) copy for every receiver
+			VideoStateComPtr videoState = new VideoState(*m_videoState);
+			m_callback->OnCaptureDeviceVideoStateChange(videoState);
+
+			if (relock)
+			{
+				streamStart = TimingClockNow();
+				streamFrame = 0;
+
+				frameTimebase = m_activeSignal.displayMode->FrameTimebase(SYNTHETIC_CLOCK_TICKS_SECOND);
+				m_timestampSmoother.SetFrameDuration(frameTimebase.Ratio(), SYNTHETIC_CLOCK_TICKS_SECOND);
+			}
+		}
+
+		//
+		// Timing
+		//
+
+		timingclocktime_t frameTime = streamStart + frameTimebase.Convert(streamFrame);
+
+		std::this_thread::sleep_until(
+			std::chrono::steady_clock::time_point(
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<timingclocktime_t, std::ratio<1, SYNTHETIC_CLOCK_TICKS_SECOND>>(frameTime))));
+
+		// Skip the frames we were too late for, a card would have dropped those
+		const timingclocktime_t now = TimingClockNow();
+		uint64_t missed = 0;
+		while (now >= streamStart + frameTimebase.Convert(streamFrame + missed + 1))
+			++missed;
+
+		if (missed > 0)
+		{
+			streamFrame += missed;
+			counter += missed;
+			m_missedVideoFrameCount += missed;
+			frameTime = streamStart + frameTimebase.Convert(streamFrame);
+		}
+
+		m_capturedVideoFrameCount += missed + 1;
+
+		// Every every so often sample the latency, which here is the wake-up delay
+		if (counter % 20 == 0)
+			m_hardwareLatencyMs = TimingClockDiffMs(frameTime, now, SYNTHETIC_CLOCK_TICKS_SECOND);
+
+		//
+		// Send
+		//
+
+		PipelineTrace::SetThreadName("capture");
+		CPipelineTraceScope traceScope(PipelineTraceStage::CAPTURE_CALLBACK, counter);
+
+		// Always smoothed so that the jitter is measured, only used if asked for
+		const timingclocktime_t smoothedFrameTime = m_timestampSmoother.Smooth(frameTime);
+		if (m_smoothTimestamps)
+			frameTime = smoothedFrameTime;
+
+		VideoFrame videoFrame(
+			FrameData(streamFrame), counter,
+			frameTime + m_frameOffsetTicks, this);
+
+		m_callback->OnCaptureDeviceVideoFrame(videoFrame);
+
+		traceScope.End();
+
+		++streamFrame;
+		++counter;
+	}
+
+	DbgLog((LOG_TRACE, 1, TEXT("SyntheticCaptureDevice frame thread exiting")));
+}
+
+
+bool SyntheticCaptureDevice::ApplySignal(const SyntheticCaptureSignal& signal)
+{
+	// WARNING: Called from the frame thread
+
+	VideoStateComPtr videoState = new VideoState();
+	videoState->valid = true;
+	videoState->displayMode = signal.displayMode;
+	videoState->videoFrameEncoding = signal.videoFrameEncoding;
+	videoState->eotf = signal.eotf;
+	videoState->colorspace = signal.colorspace;
+	videoState->invertedVertical = false;
+
+	if (signal.hdrData && signal.hdrData->IsValid())
+		videoState->hdrData = std::make_shared<HDRData>(*signal.hdrData);
+
+	const uint32_t width = signal.displayMode->FrameWidth();
+	const uint32_t height = signal.displayMode->FrameHeight();
+
+	try
+	{
+		const uint32_t rowBytes = videoState->BytesPerRow();
+		const uint32_t frameBytes = videoState->BytesPerFrame();
+
+		// Only re-generate if the data changes
+		const bool dataChanged =
+			!m_videoState ||
+			*m_activeSignal.displayMode != *signal.displayMode ||
+			m_activeSignal.videoFrameEncoding != signal.videoFrameEncoding ||
+			m_activeSignal.colorspace != signal.colorspace ||
+			m_activeSignal.pattern != signal.pattern ||
+			m_activeSignal.buffer != signal.buffer;
+
+		if (dataChanged)
+		{
+			std::vector<uint16_t> rgb(width * 3);
+
+			switch (signal.pattern)
+			{
+			case SyntheticFramePattern::COLOR_BARS:
+			{
+				static const uint16_t bars[8][3] = {
+					{ 49151, 49151, 49151 },  // White
+					{ 49151, 49151, 0 },      // Yellow
+					{ 0, 49151, 49151 },      // Cyan
+					{ 0, 49151, 0 },          // Green
+					{ 49151, 0, 49151 },      // Magenta
+					{ 49151, 0, 0 },          // Red
+					{ 0, 0, 49151 },          // Blue
+					{ 0, 0, 0 }               // Black
+				};
+
+				for (uint32_t x = 0; x < width; x++)
+					memcpy(&rgb[x * 3], bars[x * 8 / width], sizeof(bars[0]));
+
+				m_frameData.resize(frameBytes);
+				SyntheticFrameEncodeRow(signal.videoFrameEncoding, signal.colorspace, rgb.data(), width, m_frameData.data(), rowBytes);
+				for (uint32_t y = 1; y < height; y++)
+					memcpy(&m_frameData[y * rowBytes], m_frameData.data(), rowBytes);
+
+				m_framesInData = 1;
+				m_frameStride = 0;
+				break;
+			}
+
+			case SyntheticFramePattern::MOVING_GRADIENT:
+
+				// Twice the height minus one line, any consecutive run of height lines is a frame
+				m_frameData.resize((2 * height - 1) * rowBytes);
+				for (uint32_t y = 0; y < height; y++)
+				{
+					const uint16_t red = (uint16_t)(y * 65535 / (height - 1));
+					for (uint32_t x = 0; x < width; x++)
+					{
+						rgb[x * 3 + 0] = red;
+						rgb[x * 3 + 1] = 65535 - red;
+						rgb[x * 3 + 2] = (uint16_t)(x * 65535 / (width - 1));
+					}
+
+					SyntheticFrameEncodeRow(signal.videoFrameEncoding, signal.colorspace, rgb.data(), width, &m_frameData[y * rowBytes], rowBytes);
+				}
+				memcpy(&m_frameData[height * rowBytes], m_frameData.data(), (height - 1) * rowBytes);
+
+				m_framesInData = height;
+				m_frameStride = rowBytes;
+				break;
+
+			case SyntheticFramePattern::BUFFER:
+
+				if (signal.buffer->size() % frameBytes != 0)
+					throw std::runtime_error("Synthetic buffer is not a whole number of frames");
+
+				m_frameData.clear();
+				m_frameData.shrink_to_fit();
+
+				m_framesInData = (uint32_t)(signal.buffer->size() / frameBytes);
+				m_frameStride = frameBytes;
+				break;
+			}
+		}
+	}
+	catch (const std::runtime_error& e)
+	{
+		CString error(e.what());
+		Error(error);
+
+		return false;
+	}
+
+	m_activeSignal = signal;
+	m_videoState = videoState;
+
+	return true;
+}
+
+
+const uint8_t* SyntheticCaptureDevice::FrameData(uint64_t frame) const
+{
+	// WARNING: Called from the frame thread
+
+	switch (m_activeSignal.pattern)
+	{
+	case SyntheticFramePattern::MOVING_GRADIENT:
+		return m_frameData.data() + ((frame * m_activeSignal.gradientLinesPerFrame) % m_framesInData) * m_frameStride;
+
+	case SyntheticFramePattern::BUFFER:
+		return m_activeSignal.buffer->data() + (frame % m_framesInData) * m_frameStride;
+	}
+
+	return m_frameData.data();
+}
+
+
+void SyntheticCaptureDevice::SendCardStateCallback()
+{
+	// WARNING: Called from the frame thread
+
+	assert(m_callback);
+
+	CaptureDeviceCardStateComPtr cardState = new CaptureDeviceCardState();
+
+	cardState->inputLocked = InputLocked::YES;
+	cardState->inputDisplayMode = m_activeSignal.displayMode;
+
+	switch (m_activeSignal.videoFrameEncoding)
+	{
+	case VideoFrameEncoding::UYVY:
+	case VideoFrameEncoding::HDYC:
+		cardState->inputEncoding = ColorFormat::YCbCr422;
+		cardState->inputBitDepth = BitDepth::BITDEPTH_8BIT;
+		break;
+
+	case VideoFrameEncoding::V210:
+		cardState->inputEncoding = ColorFormat::YCbCr422;
+		cardState->inputBitDepth = BitDepth::BITDEPTH_10BIT;
+		break;
+
+	case VideoFrameEncoding::ARGB_8BIT:
+	case VideoFrameEncoding::BGRA_8BIT:
+		cardState->inputEncoding = ColorFormat::RGB444;
+		cardState->inputBitDepth = BitDepth::BITDEPTH_8BIT;
+		break;
+
+	case VideoFrameEncoding::R210:
+	case VideoFrameEncoding::R10b:
+	case VideoFrameEncoding::R10l:
+		cardState->inputEncoding = ColorFormat::RGB444;
+		cardState->inputBitDepth = BitDepth::BITDEPTH_10BIT;
+		break;
+
+	case VideoFrameEncoding::R12B:
+	case VideoFrameEncoding::R12L:
+		cardState->inputEncoding = ColorFormat::RGB444;
+		cardState->inputBitDepth = BitDepth::BITDEPTH_12BIT;
+		break;
+	}
+
+	CString s;
+	s.Format(_T("Synthetic pattern: %s"), ToString(m_activeSignal.pattern));
+	cardState->other.push_back(s);
+
+	m_callback->OnCaptureDeviceCardStateChange(cardState);
+}
+
+
+void SyntheticCaptureDevice::UpdateState(CaptureDeviceState state)
+{
+	assert(state != m_state);  // Double state is not allowed
+	m_state = state;
+
+	if (m_callback)
+		m_callback->OnCaptureDeviceState(state);
+}
+
+
+void SyntheticCaptureDevice::Error(const CString& error)
+{
+	// WARNING: Can be called from any thread.
+
+	if (m_callback)
+		m_callback->OnCaptureDeviceError(error);
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ACaptureDevice.h>
+#include <ITimingClock.h>
+
+
+// What the synthetic capture device puts in its frames
+enum class SyntheticFramePattern
+{
+	// 75% color bars, white, yellow, cyan, green, magenta, red, blue, black
+	COLOR_BARS,
+
+	// Red-green gradient over the height and blue over the width, moving up every frame
+	MOVING_GRADIENT,
+
+	// Frames from a caller supplied buffer, played in a loop
+	BUFFER
+};
+
+
+const TCHAR* ToString(const SyntheticFramePattern);
+
+
+/**
+ * What the synthetic capture device sends, the equivalent of the signal on the input of a real card.
+ */
+struct SyntheticCaptureSignal
+{
+	DisplayModeSharedPtr displayMode = nullptr;
+	VideoFrameEncoding videoFrameEncoding = VideoFrameEncoding::V210;
+	EOTF eotf = EOTF::SDR;
+	ColorSpace colorspace = ColorSpace::REC_709;
+
+	// HDR metadata sent along, nullptr for none
+	HDRDataSharedPtr hdrData = nullptr;
+
+	SyntheticFramePattern pattern = SyntheticFramePattern::COLOR_BARS;
+
+	// MOVING_GRADIENT: lines the gradient moves up every frame
+	unsigned int gradientLinesPerFrame = 4;
+
+	// BUFFER: one or more frames of VideoState::BytesPerFrame() back to back
+	std::shared_ptr<const std::vector<uint8_t>> buffer = nullptr;
+};
+
+
+/**
+ * Capture device which generates its own frames, for testing and benchmarking the pipeline without
+ * capture hardware.
+ *
+ * Frames are sent from an internal thread at the rate of the display mode and stamped with the
+ * device's own timing clock, the callbacks follow the same order and rules as the DeckLink capture
+ * device. The frame data is generated up-front so sending a frame costs next to nothing.
+ *
+ * If the frame thread falls behind whole frames are skipped and counted as missed, like a card would.
+ */
+class SyntheticCaptureDevice:
+	public ACaptureDevice,
+	public ITimingClock
+{
+public:
+
+	SyntheticCaptureDevice(const SyntheticCaptureSignal& signal);
+	virtual ~SyntheticCaptureDevice();
+
+	// Change the signal, can be called at any time. Takes effect at the next frame.
+	// A change in the display mode or encoding is handled like a card re-locking on a new signal.
+	void SetSignal(const SyntheticCaptureSignal& signal);
+
+	// ACaptureDevice
+	void SetCallbackHandler(ICaptureDeviceCallback*) override;
+	CString GetName() override;
+	bool CanCapture() override { return true; }
+	void StartCapture() override;
+	void StopCapture() override;
+	CaptureInputId CurrentCaptureInputId() override { return m_captureInputId; }
+	CaptureInputs SupportedCaptureInputs() override;
+	void SetCaptureInput(const CaptureInputId) override;
+	ITimingClock* GetTimingClock() override;
+	void SetFrameOffsetMs(int) override;
+	void SetTimestampSmoothing(bool smooth) override { m_smoothTimestamps = smooth; }
+	void SetCaptureBuffering(size_t heldFrames, bool largePages) override {}
+	FrameBufferArenaStats CaptureBufferStats() const override { return FrameBufferArenaStats(); }
+	double HardwareLatencyMs() const override { return m_hardwareLatencyMs; }
+	uint64_t VideoFrameCapturedCount() const override { return m_capturedVideoFrameCount; }
+	uint64_t VideoFrameMissedCount() const override { return m_missedVideoFrameCount; }
+	const TimestampJitterHistograms& TimestampJitter() const override { return m_timestampSmoother.Jitter(); }
+
+	// ITimingClock
+	timingclocktime_t TimingClockNow() override;
+	timingclocktime_t TimingClockTicksPerSecond() const override;
+	const TCHAR* TimingClockDescription() override;
+
+	// IUnknown
+	HRESULT	QueryInterface(REFIID iid, LPVOID* ppv) override;
+	ULONG AddRef() override;
+	ULONG Release() override;
+
+private:
+
+	CaptureInputId m_captureInputId = 0;
+	ICaptureDeviceCallback* m_callback = nullptr;
+
+	std::atomic<timingclocktime_t> m_frameOffsetTicks{ 0 };
+	std::atomic_bool m_smoothTimestamps{ false };
+	std::atomic<double> m_hardwareLatencyMs{ 0.0 };
+	std::atomic<uint64_t> m_capturedVideoFrameCount{ 0 };
+	std::atomic<uint64_t> m_missedVideoFrameCount{ 0 };
+
+	// Signal as last set, guarded by the mutex as it can be changed from any thread
+	std::mutex m_signalMutex;
+	SyntheticCaptureSignal m_signal;
+	bool m_signalChanged = false;
+
+	// Frame thread
+	std::thread m_frameThread;
+	std::atomic<bool> m_outputCaptureData{ false };
+	void FrameThreadProc();
+
+	//
+	// Frame thread state
+	// WARNING: R/W from the frame thread, do not read from other threads while capturing
+	//
+
+	SyntheticCaptureSignal m_activeSignal;
+	VideoStateComPtr m_videoState;
+	std::vector<uint8_t> m_frameData;
+	uint32_t m_framesInData = 0;  // Amount of frames to cycle through in m_frameData
+	uint32_t m_frameStride = 0;  // Bytes between consecutive frames in m_frameData
+	CTimestampSmoother m_timestampSmoother;
+
+	// Take over the new signal and generate its frame data, returns false if the signal cannot be sent
+	bool ApplySignal(const SyntheticCaptureSignal& signal);
+
+	// Pointer to the data of the given frame
+	const uint8_t* FrameData(uint64_t frame) const;
+
+	void SendCardStateCallback();
+
+	// Current state, update through UpdateState()
+	std::atomic<CaptureDeviceState> m_state{ CaptureDeviceState::CAPTUREDEVICESTATE_READY };
+	void UpdateState(CaptureDeviceState state);
+
+	// An error occurred and capture will not proceed
+	void Error(const CString& error);
+
+	std::atomic<ULONG> m_refCount{ 0 };
+};
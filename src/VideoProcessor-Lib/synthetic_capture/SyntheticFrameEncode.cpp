@@ -0,0 +1,310 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <string.h>
+#include <math.h>
+
+#include "SyntheticFrameEncode.h"
+
+
+// Reduce a 16-bit full range value to the given amount of bits, with rounding
+static inline uint32_t ReduceBits(uint32_t value16, int bits)
+{
+	const uint32_t max = (1u << bits) - 1;
+	return (value16 * max + 32767) / 65535;
+}
+
+
+static inline void WriteWordLE(uint8_t* dst, uint32_t word)
+{
+	dst[0] = (uint8_t)word;
+	dst[1] = (uint8_t)(word >> 8);
+	dst[2] = (uint8_t)(word >> 16);
+	dst[3] = (uint8_t)(word >> 24);
+}
+
+
+static inline void WriteWordBE(uint8_t* dst, uint32_t word)
+{
+	dst[0] = (uint8_t)(word >> 24);
+	dst[1] = (uint8_t)(word >> 16);
+	dst[2] = (uint8_t)(word >> 8);
+	dst[3] = (uint8_t)word;
+}
+
+
+//
+// YCbCr
+//
+
+
+// Luma coefficients of the color space matrix
+static void LumaCoefficients(ColorSpace colorSpace, double& kr, double& kb)
+{
+	switch (colorSpace)
+	{
+	case ColorSpace::REC_601_525:
+	case ColorSpace::REC_601_576:
+	case ColorSpace::REC_601_625:
+		kr = 0.299;
+		kb = 0.114;
+		return;
+
+	case ColorSpace::BT_2020:
+		kr = 0.2627;
+		kb = 0.0593;
+		return;
+	}
+
+	// Rec 709 and everything which does not have a YCbCr matrix of its own
+	kr = 0.2126;
+	kb = 0.0722;
+}
+
+
+// Limited range YCbCr of the given bit depth for a 16-bit full range RGB pixel
+static void RGBToYCbCr(
+	const uint16_t* rgb, double kr, double kb, int bits,
+	uint32_t& y, uint32_t& cb, uint32_t& cr)
+{
+	const double r = rgb[0] / 65535.0;
+	const double g = rgb[1] / 65535.0;
+	const double b = rgb[2] / 65535.0;
+
+	const double luma = kr * r + (1.0 - kr - kb) * g + kb * b;
+	const double pb = (b - luma) / (2.0 * (1.0 - kb));
+	const double pr = (r - luma) / (2.0 * (1.0 - kr));
+
+	const double scale = (double)(1 << (bits - 8));
+
+	y = (uint32_t)lround((16.0 + 219.0 * luma) * scale);
+	cb = (uint32_t)lround((128.0 + 224.0 * pb) * scale);
+	cr = (uint32_t)lround((128.0 + 224.0 * pr) * scale);
+}
+
+
+// UYVY/HDYC, U0 Y0 V0 Y1 per pixel pair
+static void EncodeRow8BitYUV(ColorSpace colorSpace, const uint16_t* rgb, uint32_t width, uint8_t* row)
+{
+	double kr, kb;
+	LumaCoefficients(colorSpace, kr, kb);
+
+	for (uint32_t x = 0; x < width; x += 2)
+	{
+		uint32_t y0, y1, cb, cr, unused;
+		RGBToYCbCr(rgb + x * 3, kr, kb, 8, y0, cb, cr);
+		RGBToYCbCr(rgb + std::min(x + 1, width - 1) * 3, kr, kb, 8, y1, unused, unused);
+
+		*row++ = (uint8_t)cb;
+		*row++ = (uint8_t)y0;
+		*row++ = (uint8_t)cr;
+		*row++ = (uint8_t)y1;
+	}
+}
+
+
+// v210, 6 pixels in 4 little endian words:
+//   Cb0 Y0 Cr0 | Y1 Cb2 Y2 | Cr2 Y3 Cb4 | Y4 Cr4 Y5
+static void EncodeRowV210(ColorSpace colorSpace, const uint16_t* rgb, uint32_t width, uint8_t* row)
+{
+	double kr, kb;
+	LumaCoefficients(colorSpace, kr, kb);
+
+	for (uint32_t x = 0; x < width; x += 6)
+	{
+		uint32_t y[6], cb[3], cr[3], unused;
+		for (uint32_t i = 0; i < 6; i++)
+		{
+			// Repeat the last pixel in the padding of the group
+			const uint16_t* pixel = rgb + std::min(x + i, width - 1) * 3;
+
+			if (i % 2 == 0)
+				RGBToYCbCr(pixel, kr, kb, 10, y[i], cb[i / 2], cr[i / 2]);
+			else
+				RGBToYCbCr(pixel, kr, kb, 10, y[i], unused, unused);
+		}
+
+		WriteWordLE(row + 0, cb[0] | (y[0] << 10) | (cr[0] << 20));
+		WriteWordLE(row + 4, y[1] | (cb[1] << 10) | (y[2] << 20));
+		WriteWordLE(row + 8, cr[1] | (y[3] << 10) | (cb[2] << 20));
+		WriteWordLE(row + 12, y[4] | (cr[2] << 10) | (y[5] << 20));
+		row += 16;
+	}
+}
+
+
+//
+// RGB
+//
+
+
+// ARGB in memory as A R G B, BGRA as B G R A
+static void EncodeRow8BitRGB(bool bgra, const uint16_t* rgb, uint32_t width, uint8_t* row)
+{
+	for (uint32_t x = 0; x < width; x++)
+	{
+		const uint8_t r = (uint8_t)ReduceBits(*rgb++, 8);
+		const uint8_t g = (uint8_t)ReduceBits(*rgb++, 8);
+		const uint8_t b = (uint8_t)ReduceBits(*rgb++, 8);
+
+		if (bgra)
+		{
+			*row++ = b;
+			*row++ = g;
+			*row++ = r;
+			*row++ = 0xFF;
+		}
+		else
+		{
+			*row++ = 0xFF;
+			*row++ = r;
+			*row++ = g;
+			*row++ = b;
+		}
+	}
+}
+
+
+// One 32-bit word per pixel with the components at the given bit offsets
+static void EncodeRow10BitRGB(
+	int rBit, int gBit, int bBit, bool bigEndian,
+	const uint16_t* rgb, uint32_t width, uint8_t* row)
+{
+	for (uint32_t x = 0; x < width; x++)
+	{
+		const uint32_t word =
+			(ReduceBits(rgb[0], 10) << rBit) |
+			(ReduceBits(rgb[1], 10) << gBit) |
+			(ReduceBits(rgb[2], 10) << bBit);
+		rgb += 3;
+
+		if (bigEndian)
+			WriteWordBE(row, word);
+		else
+			WriteWordLE(row, word);
+		row += 4;
+	}
+}
+
+
+// 12-bit components R0 G0 B0 R1 .. packed lsb first into a little endian bit stream, 8 pixels
+// in 9 words. The big endian variant byte swaps every word.
+static void EncodeRow12BitRGB(bool bigEndian, const uint16_t* rgb, uint32_t width, uint8_t* row)
+{
+	for (uint32_t x = 0; x < width; x += 8)
+	{
+		uint32_t words[9] = {};
+		uint32_t bit = 0;
+
+		for (uint32_t i = 0; i < 8 * 3; i++)
+		{
+			// Repeat the last pixel in the padding of the group
+			const uint32_t pixel = std::min(x + i / 3, width - 1);
+			const uint32_t value = ReduceBits(rgb[pixel * 3 + i % 3], 12);
+
+			words[bit / 32] |= value << (bit % 32);
+			if (bit % 32 > 20)
+				words[bit / 32 + 1] |= value >> (32 - bit % 32);
+
+			bit += 12;
+		}
+
+		for (int i = 0; i < 9; i++)
+		{
+			if (bigEndian)
+				WriteWordBE(row, words[i]);
+			else
+				WriteWordLE(row, words[i]);
+			row += 4;
+		}
+	}
+}
+
+
+//
+// Public
+//
+
+
+bool SyntheticFrameEncodeCanHandle(VideoFrameEncoding videoFrameEncoding)
+{
+	switch (videoFrameEncoding)
+	{
+	case VideoFrameEncoding::UYVY:
+	case VideoFrameEncoding::HDYC:
+	case VideoFrameEncoding::V210:
+	case VideoFrameEncoding::ARGB_8BIT:
+	case VideoFrameEncoding::BGRA_8BIT:
+	case VideoFrameEncoding::R210:
+	case VideoFrameEncoding::R10b:
+	case VideoFrameEncoding::R10l:
+	case VideoFrameEncoding::R12B:
+	case VideoFrameEncoding::R12L:
+		return true;
+	}
+
+	return false;
+}
+
+
+void SyntheticFrameEncodeRow(
+	VideoFrameEncoding videoFrameEncoding, ColorSpace colorSpace,
+	const uint16_t* rgb, uint32_t width,
+	uint8_t* row, uint32_t rowBytes)
+{
+	assert(rgb);
+	assert(row);
+	assert(width > 0);
+
+	memset(row, 0, rowBytes);
+
+	switch (videoFrameEncoding)
+	{
+	case VideoFrameEncoding::UYVY:
+	case VideoFrameEncoding::HDYC:
+		assert(rowBytes >= (width + 1) / 2 * 4);
+		EncodeRow8BitYUV(colorSpace, rgb, width, row);
+		return;
+
+	case VideoFrameEncoding::V210:
+		assert(rowBytes >= (width + 5) / 6 * 16);
+		EncodeRowV210(colorSpace, rgb, width, row);
+		return;
+
+	case VideoFrameEncoding::ARGB_8BIT:
+	case VideoFrameEncoding::BGRA_8BIT:
+		assert(rowBytes >= width * 4);
+		EncodeRow8BitRGB(videoFrameEncoding == VideoFrameEncoding::BGRA_8BIT, rgb, width, row);
+		return;
+
+	case VideoFrameEncoding::R210:
+		assert(rowBytes >= width * 4);
+		EncodeRow10BitRGB(20, 10, 0, true, rgb, width, row);
+		return;
+
+	case VideoFrameEncoding::R10b:
+		assert(rowBytes >= width * 4);
+		EncodeRow10BitRGB(22, 12, 2, true, rgb, width, row);
+		return;
+
+	case VideoFrameEncoding::R10l:
+		assert(rowBytes >= width * 4);
+		EncodeRow10BitRGB(22, 12, 2, false, rgb, width, row);
+		return;
+
+	case VideoFrameEncoding::R12B:
+	case VideoFrameEncoding::R12L:
+		assert(rowBytes >= (width + 7) / 8 * 36);
+		EncodeRow12BitRGB(videoFrameEncoding == VideoFrameEncoding::R12B, rgb, width, row);
+		return;
+	}
+
+	throw std::runtime_error("Synthetic frames cannot be generated in this encoding");
+}
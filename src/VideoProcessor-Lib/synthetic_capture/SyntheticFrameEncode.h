@@ -0,0 +1,36 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <ColorSpace.h>
+#include <VideoFrameEncoding.h>
+
+
+/**
+ * Encodes a row of full range RGB48 pixels (three 16-bit values R, G, B per pixel) into a row of the
+ * given capture encoding as a DeckLink card would deliver it. This is the inverse of the unpackers
+ * used by the formatters and is used to generate synthetic frames.
+ *
+ * YCbCr encodings are limited range with the matrix of the color space, chroma is taken from the
+ * first pixel of every pair. RGB encodings are full range.
+ *
+ * rowBytes must be VideoState::BytesPerRow() for the encoding and width, padding is zeroed.
+ * Throws if the encoding cannot be generated.
+ */
+void SyntheticFrameEncodeRow(
+	VideoFrameEncoding videoFrameEncoding, ColorSpace colorSpace,
+	const uint16_t* rgb, uint32_t width,
+	uint8_t* row, uint32_t rowBytes);
+
+
+// True if SyntheticFrameEncodeRow() can generate the encoding
+bool SyntheticFrameEncodeCanHandle(VideoFrameEncoding videoFrameEncoding);
@@ -10,11 +10,108 @@
 
 #include <libavutil/error.h>
 
+#include <FrameBufferPool.h>
+
 #include "CFFMpegDecoderVideoFrameFormatter.h"
 
 
 static const int OUTPUT_LINESIZE_ALIGNMENT = 1;
 
+// Line and plane alignment of decoder frames from the frame buffer pool, enough for any SIMD the decoders use
+static const int POOLED_ALIGNMENT = 64;
+
+
+// Pixel format of raw input codecs which swscale might be able to read without decoding, AV_PIX_FMT_NONE if none
+static AVPixelFormat RawCodecPixelFormat(AVCodecID codecId)
+{
+	switch (codecId)
+	{
+	case AV_CODEC_ID_R210:
+		return AV_PIX_FMT_X2RGB10BE;  // 2 padding bits, 10-bit R, G and B in a big-endian word
+
+	default:
+		return AV_PIX_FMT_NONE;
+	}
+}
+
+
+// Free for buffers which wrap memory owned by someone else
+static void BufferFreeNoop(void* opaque, uint8_t* data)
+{
+}
+
+
+// Free for buffers which wrap a detached frame buffer pool buffer, gives it back
+static void BufferFreePooled(void* opaque, uint8_t* data)
+{
+	CFrameBuffer::Attach(opaque);
+}
+
+
+// Frame for a decoder from the frame buffer pool, the way avcodec_default_get_buffer2() would lay it out.
+// Falls back to that if the pool has nothing.
+static int GetBufferPooled(AVCodecContext* codecContext, AVFrame* frame, int flags)
+{
+	const AVPixelFormat pixelFormat = (AVPixelFormat)frame->format;
+
+	int alignedWidth = frame->width;
+	int alignedHeight = frame->height;
+	int linesizeAlign[AV_NUM_DATA_POINTERS];
+	avcodec_align_dimensions2(codecContext, &alignedWidth, &alignedHeight, linesizeAlign);
+
+	int linesizes[4];
+	int ret = av_image_fill_linesizes(linesizes, pixelFormat, alignedWidth);
+	if (ret < 0)
+		return ret;
+
+	ptrdiff_t planeLinesizes[4];
+	for (int plane = 0; plane < 4; ++plane)
+	{
+		linesizes[plane] = FFALIGN(linesizes[plane], POOLED_ALIGNMENT);
+		planeLinesizes[plane] = linesizes[plane];
+	}
+
+	size_t planeSizes[4];
+	ret = av_image_fill_plane_sizes(planeSizes, pixelFormat, alignedHeight, planeLinesizes);
+	if (ret < 0)
+		return ret;
+
+	// Decoders may read a little past the end of a plane
+	FrameBufferLayout layout;
+	layout.alignment = POOLED_ALIGNMENT;
+	for (int plane = 0; plane < 4; ++plane)
+	{
+		if (planeSizes[plane] > 0)
+			layout.planeSizes[plane] = planeSizes[plane] + POOLED_ALIGNMENT;
+	}
+
+	CFrameBuffer buffer = CFrameBufferPool::Shared().Get(layout);
+	if (!buffer)
+		return avcodec_default_get_buffer2(codecContext, frame, flags);
+
+	for (int plane = 0; plane < 4; ++plane)
+	{
+		frame->data[plane] = buffer.Plane(plane);
+		frame->linesize[plane] = frame->data[plane] ? linesizes[plane] : 0;
+	}
+
+	frame->extended_data = frame->data;
+
+	// Back to the pool once ffmpeg lets go of the last reference
+	uint8_t* data = buffer.Data();
+	const int size = (int)buffer.Size();
+	void* detached = buffer.Detach();
+
+	frame->buf[0] = av_buffer_create(data, size, BufferFreePooled, detached, 0);
+	if (!frame->buf[0])
+	{
+		CFrameBuffer::Attach(detached);
+		return AVERROR(ENOMEM);
+	}
+
+	return 0;
+}
+
 
 CFFMpegDecoderVideoFrameFormatter::CFFMpegDecoderVideoFrameFormatter(
 	AVCodecID inputCodecId,
@@ -32,59 +129,45 @@ CFFMpegDecoderVideoFrameFormatter::CFFMpegDecoderVideoFrameFormatter(
 	if(!sws_isSupportedOutput(mTargetPixelFormat))
 		throw std::runtime_error("Target pixel format not supported by swscale");
 
-	// Build decoder and context
+	// Raw input which swscale can read as-is does not need to be decoded
+
+	const AVPixelFormat rawPixelFormat = RawCodecPixelFormat(inputCodecId);
+	if (rawPixelFormat != AV_PIX_FMT_NONE && sws_isSupportedInput(rawPixelFormat))
+	{
+		mSourcePixelFormat = rawPixelFormat;
+		return;
+	}
+
+	// Find decoder and the pixel format it will output, the actual decoders are built per stripe
 
-	const AVCodec* avCodecDecoder = avcodec_find_decoder(inputCodecId);
-	if (!avCodecDecoder)
+	mAVCodecDecoder = avcodec_find_decoder(inputCodecId);
+	if (!mAVCodecDecoder)
 		throw std::runtime_error("Codec not found");
 
-	mAVCodecContext = avcodec_alloc_context3(avCodecDecoder);
-	if (!mAVCodecContext)
+	AVCodecContext* avCodecContext = avcodec_alloc_context3(mAVCodecDecoder);
+	if (!avCodecContext)
 		throw std::runtime_error("Could not allocate video codec context");
 
 	// This is a non-standard ffmpeg extension signalling no use of other threads
-	mAVCodecContext->thread_count = -1;
+	avCodecContext->thread_count = -1;
 
-	if (avcodec_open2(mAVCodecContext, avCodecDecoder, nullptr) < 0)
+	if (avcodec_open2(avCodecContext, mAVCodecDecoder, nullptr) < 0)
+	{
+		avcodec_free_context(&avCodecContext);
 		throw std::runtime_error("Could not open codec");
+	}
 
-	if(!sws_isSupportedInput(mAVCodecContext->pix_fmt))
-		throw std::runtime_error("Source decoder pixel format not supported");
-
-	// Alloc used buffers
-
-	mInputFrame = av_frame_alloc();
-	if (!mInputFrame)
-		throw std::runtime_error("Failed to alloc input frame");
-
-	mOutputFrame = av_frame_alloc();
-	if (!mOutputFrame)
-		throw std::runtime_error("Failed to alloc output frame");
+	mSourcePixelFormat = avCodecContext->pix_fmt;
+	avcodec_free_context(&avCodecContext);
 
-	mPkt = av_packet_alloc();
-	if (!mPkt)
-		throw std::runtime_error("Failed to alloc mPkt");
+	if(mSourcePixelFormat != mTargetPixelFormat && !sws_isSupportedInput(mSourcePixelFormat))
+		throw std::runtime_error("Source decoder pixel format not supported");
 }
 
 
 CFFMpegDecoderVideoFrameFormatter::~CFFMpegDecoderVideoFrameFormatter()
 {
-	Cleanup();
-
-	if (mAVCodecContext)
-	{
-		avcodec_close(mAVCodecContext);
-		avcodec_free_context(&mAVCodecContext);
-	}
-
-	if(mInputFrame)
-		av_frame_free(&mInputFrame);
-
-	if (mOutputFrame)
-		av_frame_free(&mOutputFrame);
-
-	if (mPkt)
-		av_packet_free(&mPkt);
+	StripesDestroy();
 }
 
 
@@ -93,10 +176,11 @@ void CFFMpegDecoderVideoFrameFormatter::OnVideoState(VideoStateComPtr& videoStat
 	if (!videoState)
 		throw std::runtime_error("Null video state is not allowed");
 
-	Cleanup();
+	StripesDestroy();
+	mOutFrameSize = 0;
 
-	mInputBytesPerVideoFrame = videoState->BytesPerFrame();
-	assert(mInputBytesPerVideoFrame > 0);
+	mInputBytesPerRow = videoState->BytesPerRow();
+	assert(mInputBytesPerRow > 0);
 
 	mHeight = videoState->displayMode->FrameHeight();
 	assert(mHeight > 0);
@@ -104,31 +188,6 @@ void CFFMpegDecoderVideoFrameFormatter::OnVideoState(VideoStateComPtr& videoStat
 	mWidth = videoState->displayMode->FrameWidth();
 	assert(mWidth > 0);
 
-	// Update codec context with width and height
-	mAVCodecContext->height = mHeight;
-	mAVCodecContext->width = mWidth;
-
-	// Build context
-	mSws = sws_getContext(
-		mWidth, mHeight,
-		mAVCodecContext->pix_fmt,
-		mWidth, mHeight,
-		mTargetPixelFormat,
-		SWS_FAST_BILINEAR,
-		nullptr,
-		nullptr,
-		nullptr);
-
-	if (!mSws)
-		throw std::runtime_error("Failed to get context");
-
-	if(!av_image_alloc(
-		mOutputFrame->data, mOutputFrame->linesize,
-		mWidth, mHeight,
-		mTargetPixelFormat,
-		OUTPUT_LINESIZE_ALIGNMENT))
-		throw std::runtime_error("Failed to allocate mOutputFrame image");
-
 	mOutFrameSize = av_image_get_buffer_size(
 		mTargetPixelFormat,
 		mWidth, mHeight,
@@ -136,6 +195,8 @@ void CFFMpegDecoderVideoFrameFormatter::OnVideoState(VideoStateComPtr& videoStat
 
 	if(mOutFrameSize <= 0)
 		throw std::runtime_error("Failed to get output frame size");
+
+	StripesBuild();
 }
 
 
@@ -145,46 +206,24 @@ bool CFFMpegDecoderVideoFrameFormatter::FormatVideoFrame(
 {
 	assert(mOutFrameSize > 0);  // Means it's set up
 
-	if (mWidth == 0 || mHeight == 0 || mInputBytesPerVideoFrame == 0)
+	if (mWidth == 0 || mHeight == 0 || mInputBytesPerRow == 0)
 		throw std::runtime_error("Width, height or bytes per frame not known, call OnVideoState() first");
 
-	mPkt->data = (uint8_t*)inFrame.GetData();
-	mPkt->size = mInputBytesPerVideoFrame;
-
-	// Decode
-	int ret = avcodec_send_packet(mAVCodecContext, mPkt);
-	if (ret < 0)
-		throw std::runtime_error("Failed to send packet for decoding");
+	const BYTE* in = (const BYTE*)inFrame.GetData();
 
-	ret = avcodec_receive_frame(mAVCodecContext, mInputFrame);
-	if (ret == AVERROR(EAGAIN))
-		return false;
-	if (ret == AVERROR_EOF)
-		throw std::runtime_error("Unexpected return for avcodec_receive_frame");
-	if (ret < 0)
-		throw std::runtime_error("avcodec_receive_frame errored");
+	if (mStripes.size() == 1)
+		return FormatStripe(mStripes[0], in, outBuffer);
 
-	// Convert
-	int scaled_lines = sws_scale(
-		mSws,
-		mInputFrame->data, mInputFrame->linesize,
-		0, mHeight,
-		mOutputFrame->data, mOutputFrame->linesize);
-	if (scaled_lines != mHeight)
-		throw std::runtime_error("Failed to sws_scale all lines");
-
-	int copiedSize = av_image_copy_to_buffer(
-		(uint8_t*)outBuffer,
-		mOutFrameSize,
-		mOutputFrame->data, mOutputFrame->linesize,
-		mTargetPixelFormat,
-		mWidth, mHeight,
-		OUTPUT_LINESIZE_ALIGNMENT);
+	assert(mWorkerPool);
 
-	if (copiedSize != mOutFrameSize)
-		throw std::runtime_error("Failed to av_image_copy_to_buffer");
+	std::atomic<bool> formatted{ true };
+	mWorkerPool->Run((unsigned int)mStripes.size(), [&](unsigned int stripe)
+	{
+		if (!FormatStripe(mStripes[stripe], in, outBuffer))
+			formatted = false;
+	});
 
-	return true;
+	return formatted;
 }
 
 
@@ -195,12 +234,224 @@ LONG CFFMpegDecoderVideoFrameFormatter::GetOutFrameSize() const
 }
 
 
-void CFFMpegDecoderVideoFrameFormatter::Cleanup()
+void CFFMpegDecoderVideoFrameFormatter::SetWorkerPool(CWorkerPool* workerPool)
 {
+	mWorkerPool = workerPool;
+
+	// Rebuild the stripes if we've been set up already
 	if (mOutFrameSize > 0)
+		StripesBuild();
+}
+
+
+void CFFMpegDecoderVideoFrameFormatter::StripesBuild()
+{
+	StripesDestroy();
+
+	unsigned int stripeCount = 1;
+	if (mWorkerPool && av_pix_fmt_count_planes(mTargetPixelFormat) == 1)
+		stripeCount = mWorkerPool->Workers();
+
+	// Not resized after this, the decoders keep a pointer to their stripe
+	mStripes.resize(stripeCount);
+
+	for (unsigned int i = 0; i < stripeCount; ++i)
 	{
-		sws_freeContext(mSws);
+		Stripe& stripe = mStripes[i];
+
+		uint32_t firstLine, endLine;
+		WorkerPoolSplit(mHeight, stripeCount, i, 1, firstLine, endLine);
+
+		stripe.firstLine = firstLine;
+		stripe.lines = endLine - firstLine;
+		assert(stripe.lines > 0);
+
+		if (mAVCodecDecoder)
+		{
+			// Decoder, sees the stripe as a full frame
+			stripe.codecContext = avcodec_alloc_context3(mAVCodecDecoder);
+			if (!stripe.codecContext)
+				throw std::runtime_error("Could not allocate video codec context");
+
+			// This is a non-standard ffmpeg extension signalling no use of other threads
+			stripe.codecContext->thread_count = -1;
+			stripe.codecContext->width = mWidth;
+			stripe.codecContext->height = stripe.lines;
+
+			// Decoder output goes straight into the output buffer if it needs no conversion, else into
+			// a recycled buffer from the pool
+			if (mAVCodecDecoder->capabilities & AV_CODEC_CAP_DR1)
+			{
+				stripe.codecContext->opaque = &stripe;
+				stripe.codecContext->get_buffer2 = GetBuffer2;
+			}
+
+			if (avcodec_open2(stripe.codecContext, mAVCodecDecoder, nullptr) < 0)
+				throw std::runtime_error("Could not open codec");
+
+			// Alloc used buffers
+
+			stripe.inputFrame = av_frame_alloc();
+			if (!stripe.inputFrame)
+				throw std::runtime_error("Failed to alloc input frame");
+
+			stripe.pkt = av_packet_alloc();
+			if (!stripe.pkt)
+				throw std::runtime_error("Failed to alloc mPkt");
+		}
+
+		// Build context
+		if (mSourcePixelFormat != mTargetPixelFormat)
+		{
+			stripe.sws = sws_getContext(
+				mWidth, stripe.lines,
+				mSourcePixelFormat,
+				mWidth, stripe.lines,
+				mTargetPixelFormat,
+				SWS_FAST_BILINEAR,
+				nullptr,
+				nullptr,
+				nullptr);
+
+			if (!stripe.sws)
+				throw std::runtime_error("Failed to get context");
+		}
+	}
+}
 
-		av_freep(&mOutputFrame->data[0]);
+
+void CFFMpegDecoderVideoFrameFormatter::StripesDestroy()
+{
+	for (Stripe& stripe : mStripes)
+	{
+		sws_freeContext(stripe.sws);
+		av_frame_free(&stripe.inputFrame);
+		av_packet_free(&stripe.pkt);
+		avcodec_free_context(&stripe.codecContext);
 	}
+
+	mStripes.clear();
+}
+
+
+bool CFFMpegDecoderVideoFrameFormatter::FormatStripe(Stripe& stripe, const BYTE* in, BYTE* outBuffer)
+{
+	// Output planes, only single plane formats get striped
+	if (av_image_fill_arrays(
+			stripe.outData, stripe.outLinesize,
+			outBuffer,
+			mTargetPixelFormat,
+			mWidth, mHeight,
+			OUTPUT_LINESIZE_ALIGNMENT) != mOutFrameSize)
+		throw std::runtime_error("Failed to av_image_fill_arrays");
+
+	stripe.outData[0] += (ptrdiff_t)stripe.firstLine * stripe.outLinesize[0];
+
+	// Source, either the raw input or the decoded frame
+	const uint8_t* srcData[4] = { (const uint8_t*)in + (ptrdiff_t)stripe.firstLine * mInputBytesPerRow };
+	int srcLinesize[4] = { mInputBytesPerRow };
+
+	if (stripe.codecContext)
+	{
+		stripe.pkt->data = (uint8_t*)srcData[0];
+		stripe.pkt->size = stripe.lines * mInputBytesPerRow;
+
+		// Decode
+		int ret = avcodec_send_packet(stripe.codecContext, stripe.pkt);
+		if (ret < 0)
+			throw std::runtime_error("Failed to send packet for decoding");
+
+		ret = avcodec_receive_frame(stripe.codecContext, stripe.inputFrame);
+		if (ret == AVERROR(EAGAIN))
+			return false;
+		if (ret == AVERROR_EOF)
+			throw std::runtime_error("Unexpected return for avcodec_receive_frame");
+		if (ret < 0)
+			throw std::runtime_error("avcodec_receive_frame errored");
+
+		for (int plane = 0; plane < 4; ++plane)
+		{
+			srcData[plane] = stripe.inputFrame->data[plane];
+			srcLinesize[plane] = stripe.inputFrame->linesize[plane];
+		}
+	}
+
+	// Convert
+	if (stripe.sws)
+	{
+		int scaled_lines = sws_scale(
+			stripe.sws,
+			srcData, srcLinesize,
+			0, stripe.lines,
+			stripe.outData, stripe.outLinesize);
+		if (scaled_lines != stripe.lines)
+			throw std::runtime_error("Failed to sws_scale all lines");
+	}
+
+	// Decoder could not write into the output buffer itself
+	else if (srcData[0] != stripe.outData[0])
+	{
+		av_image_copy(
+			stripe.outData, stripe.outLinesize,
+			srcData, srcLinesize,
+			mTargetPixelFormat,
+			mWidth, stripe.lines);
+	}
+
+	// Don't hold on to a frame which might point into the output buffer
+	if (stripe.inputFrame)
+		av_frame_unref(stripe.inputFrame);
+
+	return true;
+}
+
+
+int CFFMpegDecoderVideoFrameFormatter::GetBuffer2(AVCodecContext* codecContext, AVFrame* frame, int flags)
+{
+	const Stripe& stripe = *(const Stripe*)codecContext->opaque;
+
+	// Only hand out the output buffer if the decoder outputs the target format, does not keep the frame
+	// around, won't write past the edges and its alignment needs are met, else it gets a pooled buffer
+	// which is converted or copied from
+	bool fits = !stripe.sws && !(flags & AV_GET_BUFFER_FLAG_REF) && stripe.outData[0];
+
+	int alignedWidth = frame->width;
+	int alignedHeight = frame->height;
+	int linesizeAlign[AV_NUM_DATA_POINTERS];
+	avcodec_align_dimensions2(codecContext, &alignedWidth, &alignedHeight, linesizeAlign);
+
+	fits = fits && alignedWidth == frame->width && alignedHeight == frame->height && frame->height == stripe.lines;
+
+	for (int plane = 0; fits && plane < 4 && stripe.outData[plane]; ++plane)
+	{
+		if (linesizeAlign[plane] > 0)
+			fits =
+				((uintptr_t)stripe.outData[plane] % linesizeAlign[plane]) == 0 &&
+				(stripe.outLinesize[plane] % linesizeAlign[plane]) == 0;
+	}
+
+	if (!fits)
+		return GetBufferPooled(codecContext, frame, flags);
+
+	const int size = av_image_get_buffer_size(
+		(AVPixelFormat)frame->format,
+		frame->width, frame->height,
+		OUTPUT_LINESIZE_ALIGNMENT);
+	if (size < 0)
+		return size;
+
+	// The output buffer is not ours to free, the reference only tells ffmpeg the frame is valid
+	frame->buf[0] = av_buffer_create(stripe.outData[0], size, BufferFreeNoop, nullptr, 0);
+	if (!frame->buf[0])
+		return AVERROR(ENOMEM);
+
+	for (int plane = 0; plane < 4; ++plane)
+	{
+		frame->data[plane] = stripe.outData[plane];
+		frame->linesize[plane] = stripe.outLinesize[plane];
+	}
+
+	frame->extended_data = frame->data;
+
+	return 0;
 }
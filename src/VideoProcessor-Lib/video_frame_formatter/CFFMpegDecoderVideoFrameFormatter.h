@@ -14,15 +14,28 @@ extern "C"
 	#include <libswscale/swscale.h>
 	#include <libavutil/imgutils.h>
 	#include <libavutil/frame.h>
+	#include <libavutil/pixdesc.h>
 	#include <libavcodec/codec.h>
 	#include <libavcodec/avcodec.h>
 }
 
+#include <vector>
+
 #include <video_frame_formatter/IVideoFrameFormatter.h>
 
 
  /**
   * This formatter can convert using an ffmpeg decoder and scaler for a target pixel format
+  *
+  * Output is written straight into the output buffer's planes, by swscale or, if the decoder already
+  * outputs the target format, by the decoder itself. Decoders which need their own frame to convert
+  * from get recycled buffers from the shared CFrameBufferPool. Raw input codecs which map onto a pixel
+  * format swscale can read directly are not decoded at all.
+  *
+  * With a worker pool the frame is split in horizontal stripes which are each decoded and scaled
+  * by their own decoder and scaler (the swscale version used has no slice threading of its own).
+  * This only works for raw input codecs where every line is independent and for packed
+  * single-plane target formats, others are always done in a single stripe.
   */
 class CFFMpegDecoderVideoFrameFormatter:
 	public IVideoFrameFormatter
@@ -38,23 +51,48 @@ public:
 	void OnVideoState(VideoStateComPtr& videoState) override;
 	bool FormatVideoFrame(const VideoFrame& inFrame, BYTE* outBuffer) override;
 	LONG GetOutFrameSize() const override;
+	void SetWorkerPool(CWorkerPool* workerPool) override;
 
 private:
 
+	// Decoder and scaler for a horizontal stripe of the frame
+	struct Stripe
+	{
+		int firstLine = 0;
+		int lines = 0;
+
+		AVCodecContext* codecContext = nullptr;  // Null if the input goes to swscale as-is
+		AVPacket* pkt = nullptr;
+		AVFrame* inputFrame = nullptr;
+		struct SwsContext* sws = nullptr;  // Null if the decoder outputs the target format
+
+		// Where this stripe of the frame being formatted goes in the output buffer
+		uint8_t* outData[4] = {};
+		int outLinesize[4] = {};
+	};
+
 	const AVPixelFormat mTargetPixelFormat;
-	const AVCodec* mAVCodecDecoder;
-	AVCodecContext* mAVCodecContext;
+	const AVCodec* mAVCodecDecoder = nullptr;  // Null if no decoding is needed
 
-	int mInputBytesPerVideoFrame = 0;
+	// Format of the data handed to swscale, either the decoder output or the raw input
+	AVPixelFormat mSourcePixelFormat;
+
+	CWorkerPool* mWorkerPool = nullptr;
+
+	int mInputBytesPerRow = 0;
 	int mHeight = 0;
 	int mWidth = 0;
 	LONG mOutFrameSize = 0;
 
-	struct SwsContext* mSws = nullptr;
-	AVFrame* mInputFrame = nullptr;
-	AVFrame* mOutputFrame = nullptr;
+	std::vector<Stripe> mStripes;
+
+	void StripesBuild();
+	void StripesDestroy();
 
-	AVPacket* mPkt;
+	// Decode and scale a single stripe, returns false if the decoder did not output anything
+	bool FormatStripe(Stripe& stripe, const BYTE* in, BYTE* outBuffer);
 
-	void Cleanup();
+	// AVCodecContext::get_buffer2 which lets the decoder write into the output buffer, or into a buffer
+	// from the frame buffer pool if it can't
+	static int GetBuffer2(AVCodecContext* codecContext, AVFrame* frame, int flags);
 };
@@ -28,7 +28,22 @@ bool CNoopVideoFrameFormatter::FormatVideoFrame(
 	if (m_bytesPerVideoFrame == 0)
 		throw std::runtime_error("bytes per frame not known, call OnVideoState() first");
 
-	memcpy(outBuffer, inFrame.GetData(), m_bytesPerVideoFrame);
+	if (!m_workerPool)
+	{
+		memcpy(outBuffer, inFrame.GetData(), m_bytesPerVideoFrame);
+		return true;
+	}
+
+	// Copy in cache line aligned stripes
+	const unsigned int stripes = m_workerPool->Workers();
+	m_workerPool->Run(stripes, [&](unsigned int stripe)
+	{
+		uint32_t begin, end;
+		WorkerPoolSplit(m_bytesPerVideoFrame, stripes, stripe, 64, begin, end);
+
+		memcpy(outBuffer + begin, (const BYTE*)inFrame.GetData() + begin, end - begin);
+	});
+
 	return true;
 }
 
@@ -38,3 +53,9 @@ LONG CNoopVideoFrameFormatter::GetOutFrameSize() const
 	assert(m_bytesPerVideoFrame > 0);
 	return m_bytesPerVideoFrame;
 }
+
+
+void CNoopVideoFrameFormatter::SetWorkerPool(CWorkerPool* workerPool)
+{
+	m_workerPool = workerPool;
+}
@@ -26,7 +26,9 @@ public:
 	void OnVideoState(VideoStateComPtr& videoState) override;
 	bool FormatVideoFrame(const VideoFrame& inFrame, BYTE* outBuffer) override;
 	LONG GetOutFrameSize() const override;
+	void SetWorkerPool(CWorkerPool* workerPool) override;
 
 private:
 	int m_bytesPerVideoFrame = 0;
+	CWorkerPool* m_workerPool = nullptr;
 };
@@ -0,0 +1,97 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include "CRGBtoRGB48VideoFrameFormatter.h"
+
+
+// RGB48 is 3 16-bit values per pixel
+#define RGB48_BYTES_PER_PIXEL (3 * sizeof(uint16_t))
+
+
+CRGBtoRGB48VideoFrameFormatter::CRGBtoRGB48VideoFrameFormatter(CpuInstructionSet maxInstructionSet):
+    m_instructionSet(CpuClampInstructionSet(maxInstructionSet))
+{
+}
+
+
+void CRGBtoRGB48VideoFrameFormatter::OnVideoState(VideoStateComPtr& videoState)
+{
+	if (!videoState)
+		throw std::runtime_error("Null video state is not allowed");
+
+    if (!RGBUnpackCanHandle(videoState->videoFrameEncoding))
+        throw std::runtime_error("Can only handle r210, R10b, R10l, R12B and R12L input");
+
+    m_height = videoState->displayMode->FrameHeight();
+    m_width = videoState->displayMode->FrameWidth();
+
+    if ((videoState->videoFrameEncoding == VideoFrameEncoding::R12B ||
+         videoState->videoFrameEncoding == VideoFrameEncoding::R12L) &&
+        m_width % RGB12_PIXELS_PER_PACK != 0)
+        throw std::runtime_error("Can only handle 12-bit RGB conversions which align with the pack boundry (8 pixels)");
+
+    m_inBytesPerRow = videoState->BytesPerRow();
+    m_unpackLine = RGBUnpackLineFunctionGet(videoState->videoFrameEncoding, m_instructionSet);
+}
+
+
+bool CRGBtoRGB48VideoFrameFormatter::FormatVideoFrame(
+	const VideoFrame& inFrame,
+	BYTE* outBuffer)
+{
+    if (!m_unpackLine)
+        throw std::runtime_error("Input format not known, call OnVideoState() first");
+
+    const BYTE* in = (const BYTE*)inFrame.GetData();
+
+    if (!m_workerPool)
+    {
+        FormatLines(in, outBuffer, 0, m_height);
+        return true;
+    }
+
+    // Stripes of whole lines
+    const unsigned int stripes = m_workerPool->Workers();
+    m_workerPool->Run(stripes, [&](unsigned int stripe)
+    {
+        uint32_t firstLine, endLine;
+        WorkerPoolSplit(m_height, stripes, stripe, 1, firstLine, endLine);
+
+        FormatLines(in, outBuffer, firstLine, endLine);
+    });
+
+	return true;
+}
+
+
+void CRGBtoRGB48VideoFrameFormatter::SetWorkerPool(CWorkerPool* workerPool)
+{
+    m_workerPool = workerPool;
+}
+
+
+void CRGBtoRGB48VideoFrameFormatter::FormatLines(const BYTE* in, BYTE* outBuffer, uint32_t firstLine, uint32_t endLine) const
+{
+    const ptrdiff_t outBytesPerRow = (ptrdiff_t)m_width * RGB48_BYTES_PER_PIXEL;
+
+    for (uint32_t line = firstLine; line < endLine; line++)
+    {
+        m_unpackLine(
+            in + (ptrdiff_t)line * m_inBytesPerRow,
+            (uint16_t*)(outBuffer + (ptrdiff_t)line * outBytesPerRow),
+            m_width);
+    }
+}
+
+
+LONG CRGBtoRGB48VideoFrameFormatter::GetOutFrameSize() const
+{
+    return m_height * m_width * RGB48_BYTES_PER_PIXEL;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <CpuFeatures.h>
+#include <video_frame_formatter/IVideoFrameFormatter.h>
+#include <video_frame_formatter/RGBUnpack.h>
+
+
+ /**
+  * Video frame formatter which reads packed 10 and 12-bit RGB (r210, R10b, R10l, R12B and R12L)
+  * and writes RGB48LE in a single pass, see RGBUnpack.h
+  */
+class CRGBtoRGB48VideoFrameFormatter:
+	public IVideoFrameFormatter
+{
+public:
+
+	CRGBtoRGB48VideoFrameFormatter(CpuInstructionSet maxInstructionSet = CpuInstructionSet::AVX2);
+	virtual ~CRGBtoRGB48VideoFrameFormatter() {}
+
+	// IVideoFrameFormatter
+	void OnVideoState(VideoStateComPtr& videoState) override;
+	bool FormatVideoFrame(const VideoFrame& inFrame, BYTE* outBuffer) override;
+	LONG GetOutFrameSize() const override;
+	void SetWorkerPool(CWorkerPool* workerPool) override;
+
+	// Instruction set which is actually used for the conversion
+	CpuInstructionSet GetInstructionSet() const { return m_instructionSet; }
+
+private:
+	uint32_t m_height = 0;
+	uint32_t m_width = 0;
+	uint32_t m_inBytesPerRow = 0;
+
+	CpuInstructionSet m_instructionSet;
+	RGBUnpackLineFunction m_unpackLine = nullptr;
+	CWorkerPool* m_workerPool = nullptr;
+
+	// Format lines [firstLine, endLine)
+	void FormatLines(const BYTE* in, BYTE* outBuffer, uint32_t firstLine, uint32_t endLine) const;
+};
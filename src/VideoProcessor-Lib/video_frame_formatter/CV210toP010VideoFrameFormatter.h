@@ -9,26 +9,41 @@
 #pragma once
 
 
+#include <CpuFeatures.h>
 #include <video_frame_formatter/IVideoFrameFormatter.h>
 
 
  /**
   * Video frame formatter which reads V210 and write to P010
   * (that's YUV422 to YUV420 both in 10 bit, all assuming this is running on little endian hardware)
+  *
+  * The conversion is done with the best SIMD instruction set the CPU supports (optionally capped),
+  * see V210Unpack.h
   */
 class CV210toP010VideoFrameFormatter:
 	public IVideoFrameFormatter
 {
 public:
 
+	CV210toP010VideoFrameFormatter(CpuInstructionSet maxInstructionSet = CpuInstructionSet::AVX2);
 	virtual ~CV210toP010VideoFrameFormatter() {}
 
 	// IVideoFrameFormatter
 	void OnVideoState(VideoStateComPtr& videoState) override;
 	bool FormatVideoFrame(const VideoFrame& inFrame, BYTE* outBuffer) override;
 	LONG GetOutFrameSize() const override;
+	void SetWorkerPool(CWorkerPool* workerPool) override;
+
+	// Instruction set which is actually used for the conversion
+	CpuInstructionSet GetInstructionSet() const { return m_instructionSet; }
 
 private:
 	uint32_t m_height = 0;
 	uint32_t m_width = 0;
+
+	CpuInstructionSet m_instructionSet;
+	CWorkerPool* m_workerPool = nullptr;
+
+	// Format lines [firstLine, endLine)
+	void FormatLines(const BYTE* in, BYTE* outBuffer, uint32_t firstLine, uint32_t endLine) const;
 };
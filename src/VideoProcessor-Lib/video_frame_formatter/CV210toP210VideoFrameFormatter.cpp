@@ -8,27 +8,15 @@
 
 #include <pch.h>
 
-#include "CV210toP210VideoFrameFormatter.h"
-
-//
-// Parts of this are copied from ffmpeg v210dec.c, see /3rdparty/ffmpeg/README.txt for license and attribution
-//
-
-
-#define V210_READ_PACK_BLOCK(a, b, c) \
-    do {                              \
-        val  = *src++;                \
-        a = val & 0x3FF;              \
-        b = (val >> 10) & 0x3FF;      \
-        c = (val >> 20) & 0x3FF;      \
-    } while (0)
+#include <video_frame_formatter/V210Unpack.h>
 
-
-#define P010_WRITE_VALUE(d, v) (*d++ = (v << 6))
+#include "CV210toP210VideoFrameFormatter.h"
 
 
-#define PIXELS_PER_PACK 6
-#define BYTES_PER_PACK (4 * sizeof(uint32_t))
+CV210toP210VideoFrameFormatter::CV210toP210VideoFrameFormatter(CpuInstructionSet maxInstructionSet):
+    m_instructionSet(CpuClampInstructionSet(maxInstructionSet))
+{
+}
 
 
 void CV210toP210VideoFrameFormatter::OnVideoState(VideoStateComPtr& videoState)
@@ -50,7 +38,7 @@ void CV210toP210VideoFrameFormatter::OnVideoState(VideoStateComPtr& videoState)
     const uint32_t bytes = videoState->BytesPerFrame();
     const uint32_t expectedBytes =
         videoState->displayMode->FrameHeight() *
-        (videoState->displayMode->FrameWidth() / PIXELS_PER_PACK * BYTES_PER_PACK);
+        (videoState->displayMode->FrameWidth() / V210_PIXELS_PER_PACK * V210_BYTES_PER_PACK);
 
     if(bytes != expectedBytes)
         throw std::runtime_error("Unexpected amount of bytes for frame");
@@ -68,47 +56,55 @@ bool CV210toP210VideoFrameFormatter::FormatVideoFrame(
     // 10bpp per component, data in the high bits, zeros in the low bits (we assume little-endian native)
 	// https://docs.microsoft.com/en-us/windows/win32/medfound/10-bit-and-16-bit-yuv-video-formats
 
+    const BYTE* in = (const BYTE*)inFrame.GetData();
+
+    if (!m_workerPool)
+    {
+        FormatLines(in, outBuffer, 0, m_height);
+        return true;
+    }
+
+    // Stripes of whole lines
+    const unsigned int stripes = m_workerPool->Workers();
+    m_workerPool->Run(stripes, [&](unsigned int stripe)
+    {
+        uint32_t firstLine, endLine;
+        WorkerPoolSplit(m_height, stripes, stripe, 1, firstLine, endLine);
+
+        FormatLines(in, outBuffer, firstLine, endLine);
+    });
+
+	return true;
+}
+
+
+void CV210toP210VideoFrameFormatter::SetWorkerPool(CWorkerPool* workerPool)
+{
+    m_workerPool = workerPool;
+}
+
+
+void CV210toP210VideoFrameFormatter::FormatLines(const BYTE* in, BYTE* outBuffer, uint32_t firstLine, uint32_t endLine) const
+{
     const uint32_t pixels = m_height * m_width;
-    const uint32_t aligned_width = ((m_width + 47) / 48) * 48;
-    const uint32_t stride = aligned_width * 8 / 3;
+    const uint32_t stride = V210BytesPerLine(m_width);
 
-    uint16_t* dstY = (uint16_t *)outBuffer;
-    uint16_t* dstUV = (uint16_t*)(outBuffer + ((ptrdiff_t)pixels * sizeof(uint16_t)));
+    uint16_t* dstY = (uint16_t *)outBuffer + (ptrdiff_t)firstLine * m_width;
+    uint16_t* dstUV = (uint16_t*)(outBuffer + ((ptrdiff_t)pixels * sizeof(uint16_t))) + (ptrdiff_t)firstLine * m_width;
 
-    const uint32_t packsPerLine = m_width / PIXELS_PER_PACK;
+    const uint32_t packsPerLine = m_width / V210_PIXELS_PER_PACK;
 
-    for (uint32_t line = 0; line < m_height; line++)
+    const V210UnpackLineFunction unpackLine = V210UnpackLineFunctionGet(m_instructionSet);
+
+    for (uint32_t line = firstLine; line < endLine; line++)
     {
-        const uint32_t* src = (const uint32_t*)((const BYTE *)inFrame.GetData() + (ptrdiff_t)(line * stride));  // Lines start at 128 byte alignment
-
-        for (uint32_t pack = 0; pack < packsPerLine; pack++)
-        {
-            uint32_t val;
-            uint16_t u, y1, y2, v;
-
-            V210_READ_PACK_BLOCK(u, y1, v);
-            P010_WRITE_VALUE(dstUV, u);
-            P010_WRITE_VALUE(dstY, y1);
-            P010_WRITE_VALUE(dstUV, v);
-
-            V210_READ_PACK_BLOCK(y1, u, y2);
-            P010_WRITE_VALUE(dstY, y1);
-            P010_WRITE_VALUE(dstUV, u);
-            P010_WRITE_VALUE(dstY, y2);
-
-            V210_READ_PACK_BLOCK(v, y1, u);
-            P010_WRITE_VALUE(dstUV, v);
-            P010_WRITE_VALUE(dstY, y1);
-            P010_WRITE_VALUE(dstUV, u);
-
-            V210_READ_PACK_BLOCK(y1, v, y2);
-            P010_WRITE_VALUE(dstY, y1);
-            P010_WRITE_VALUE(dstUV, v);
-            P010_WRITE_VALUE(dstY, y2);
-        }
-    }
+        const uint32_t* src = (const uint32_t*)(in + (ptrdiff_t)line * stride);  // Lines start at 128 byte alignment
 
-	return true;
+        unpackLine(src, dstY, dstUV, packsPerLine);
+
+        dstY += packsPerLine * V210_PIXELS_PER_PACK;
+        dstUV += packsPerLine * V210_PIXELS_PER_PACK;
+    }
 }
 
 
@@ -9,26 +9,40 @@
 #pragma once
 
 
+#include <CpuFeatures.h>
 #include <video_frame_formatter/IVideoFrameFormatter.h>
 
 
  /**
   * Video frame formatter which reads V210 and write to P210
   * (packed to planar conversion)
+  *
+  * Uses the same SIMD unpack core as the P010 formatter, see V210Unpack.h
   */
 class CV210toP210VideoFrameFormatter:
 	public IVideoFrameFormatter
 {
 public:
 
+	CV210toP210VideoFrameFormatter(CpuInstructionSet maxInstructionSet = CpuInstructionSet::AVX2);
 	virtual ~CV210toP210VideoFrameFormatter() {}
 
 	// IVideoFrameFormatter
 	void OnVideoState(VideoStateComPtr& videoState) override;
 	bool FormatVideoFrame(const VideoFrame& inFrame, BYTE* outBuffer) override;
 	LONG GetOutFrameSize() const override;
+	void SetWorkerPool(CWorkerPool* workerPool) override;
+
+	// Instruction set which is actually used for the conversion
+	CpuInstructionSet GetInstructionSet() const { return m_instructionSet; }
 
 private:
 	uint32_t m_height = 0;
 	uint32_t m_width = 0;
+
+	CpuInstructionSet m_instructionSet;
+	CWorkerPool* m_workerPool = nullptr;
+
+	// Format lines [firstLine, endLine)
+	void FormatLines(const BYTE* in, BYTE* outBuffer, uint32_t firstLine, uint32_t endLine) const;
 };
@@ -11,6 +11,7 @@
 
 #include <VideoFrame.h>
 #include <VideoState.h>
+#include <WorkerPool.h>
 
 
 /**
@@ -34,4 +35,9 @@ public:
 	// Get size of frame that will be put in FormatVideoFrame()'s outBuffer, in bytes
 	// Can only be called after OnVideoState()
 	virtual LONG GetOutFrameSize() const = 0;
+
+	// Spread the formatting of every frame over the workers of the pool as horizontal stripes,
+	// nullptr formats on the calling thread. The pool must outlive its use by the formatter.
+	// Formatters which cannot split their work ignore this.
+	virtual void SetWorkerPool(CWorkerPool* workerPool) {}
 };
@@ -0,0 +1,377 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <immintrin.h>
+
+#include <video_frame_formatter/SimdStore.h>
+
+#include "RGBUnpack.h"
+
+//
+// Layouts, see "Blackmagic DeckLink SDK.pdf" section 3.4 Pixel Formats
+//
+// 10-bit formats hold one pixel in a 32-bit word, the template arguments are the lowest bit of R, G and B
+// in the word once read in the right endianness and whether the word is big endian.
+//   r210: big endian,    2 padding bits at the top, R 29-20, G 19-10, B 9-0
+//   R10b: big endian,    R 31-22, G 21-12, B 11-2, 2 padding bits at the bottom
+//   R10l: little endian, R 31-22, G 21-12, B 11-2, 2 padding bits at the bottom
+//
+// 12-bit formats hold 8 pixels in 9 32-bit words. Reading the words in the right endianness gives
+// a little endian bit stream with the 12-bit components R0 G0 B0 R1 G1 B1 .. from the lowest bit up.
+// R12B is R12L with every 32-bit word byte swapped.
+//
+
+#define R210_LAYOUT 20, 10, 0, true
+#define R10B_LAYOUT 22, 12, 2, true
+#define R10L_LAYOUT 22, 12, 2, false
+
+
+#define RGB10_EXPAND(v) ((uint16_t)(((v) << 6) | ((v) >> 4)))
+#define RGB12_EXPAND(v) ((uint16_t)(((v) << 4) | ((v) >> 8)))
+
+
+// Every 12 bytes of a 12-bit pack are 3 whole words holding 8 components
+#define RGB12_BYTES_PER_CHUNK 12
+#define RGB12_CHUNKS_PER_PACK 3
+
+
+static inline uint32_t ReadWord(const uint8_t* src, const bool bigEndian)
+{
+    if (bigEndian)
+        return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | (uint32_t)src[3];
+
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+
+//
+// Scalar, these are the reference implementations
+//
+
+template<int rBit, int gBit, int bBit, bool bigEndian>
+static void RGB10UnpackLineScalar(const uint8_t* src, uint16_t* dst, uint32_t pixels)
+{
+    for (uint32_t pixel = 0; pixel < pixels; pixel++)
+    {
+        const uint32_t val = ReadWord(src, bigEndian);
+        src += 4;
+
+        const uint32_t r = (val >> rBit) & 0x3FF;
+        const uint32_t g = (val >> gBit) & 0x3FF;
+        const uint32_t b = (val >> bBit) & 0x3FF;
+
+        *dst++ = RGB10_EXPAND(r);
+        *dst++ = RGB10_EXPAND(g);
+        *dst++ = RGB10_EXPAND(b);
+    }
+}
+
+
+template<bool bigEndian>
+static void RGB12UnpackChunksScalar(const uint8_t* src, uint16_t* dst, uint32_t chunks)
+{
+    // Byte p of the little endian stream, big endian swaps within the words
+#define RGB12_STREAM_BYTE(p) ((uint32_t)src[bigEndian ? ((p) ^ 3) : (p)])
+
+    for (uint32_t chunk = 0; chunk < chunks; chunk++)
+    {
+        // Every 3 bytes hold 2 components
+        for (int i = 0; i < RGB12_BYTES_PER_CHUNK; i += 3)
+        {
+            const uint32_t v0 = RGB12_STREAM_BYTE(i) | ((RGB12_STREAM_BYTE(i + 1) & 0x0F) << 8);
+            const uint32_t v1 = (RGB12_STREAM_BYTE(i + 1) >> 4) | (RGB12_STREAM_BYTE(i + 2) << 4);
+
+            *dst++ = RGB12_EXPAND(v0);
+            *dst++ = RGB12_EXPAND(v1);
+        }
+
+        src += RGB12_BYTES_PER_CHUNK;
+    }
+
+#undef RGB12_STREAM_BYTE
+}
+
+
+template<bool bigEndian>
+static void RGB12UnpackLineScalar(const uint8_t* src, uint16_t* dst, uint32_t pixels)
+{
+    RGB12UnpackChunksScalar<bigEndian>(src, dst, pixels / RGB12_PIXELS_PER_PACK * RGB12_CHUNKS_PER_PACK);
+}
+
+
+//
+// SIMD 10-bit
+//
+// Every 32-bit word is expanded into two registers which hold the 16-bit output values:
+//   rg: word 2n = R, word 2n+1 = G of pixel n
+//   b:  word 2n = B of pixel n
+// after which a byte shuffle picks 2 pixels (12 bytes) at a time.
+//
+
+#define RGB10_SHUFFLE_BSWAP  3,  2,  1,  0,  7,  6,  5,  4, 11, 10,  9,  8, 15, 14, 13, 12
+
+// Pixel 0 and 1
+#define RGB10_SHUFFLE_P01_RG  0,  1,  2,  3, -1, -1,  4,  5,  6,  7, -1, -1, -1, -1, -1, -1
+#define RGB10_SHUFFLE_P01_B  -1, -1, -1, -1,  0,  1, -1, -1, -1, -1,  4,  5, -1, -1, -1, -1
+
+// Pixel 2 and 3
+#define RGB10_SHUFFLE_P23_RG  8,  9, 10, 11, -1, -1, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1
+#define RGB10_SHUFFLE_P23_B  -1, -1, -1, -1,  8,  9, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1
+
+
+// Unpacks 4 pixels into pixel 0-1 and pixel 2-3 in the low 12 bytes of p01 and p23
+template<int rBit, int gBit, int bBit, bool bigEndian>
+static inline void RGB10UnpackFourPixelsSSE41(__m128i in, __m128i& p01, __m128i& p23)
+{
+    const __m128i maskLow = _mm_set1_epi32(0x0000FFC0);
+    const __m128i maskHigh = _mm_set1_epi32((int)0xFFC00000);
+
+    if (bigEndian)
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(RGB10_SHUFFLE_BSWAP));
+
+    __m128i rg = _mm_or_si128(
+        _mm_and_si128(_mm_srli_epi32(in, rBit - 6), maskLow),
+        _mm_and_si128(_mm_slli_epi32(in, 22 - gBit), maskHigh));
+    __m128i b = _mm_and_si128(_mm_slli_epi32(in, 6 - bBit), maskLow);
+
+    rg = _mm_or_si128(rg, _mm_srli_epi16(rg, 10));
+    b = _mm_or_si128(b, _mm_srli_epi16(b, 10));
+
+    p01 = _mm_or_si128(
+        _mm_shuffle_epi8(rg, _mm_setr_epi8(RGB10_SHUFFLE_P01_RG)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(RGB10_SHUFFLE_P01_B)));
+    p23 = _mm_or_si128(
+        _mm_shuffle_epi8(rg, _mm_setr_epi8(RGB10_SHUFFLE_P23_RG)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(RGB10_SHUFFLE_P23_B)));
+}
+
+
+template<int rBit, int gBit, int bBit, bool bigEndian>
+static void RGB10UnpackLineSSE41(const uint8_t* src, uint16_t* dst, uint32_t pixels)
+{
+    // 4 pixels per iteration
+    uint32_t pixel = 0;
+    for (; pixel + 4 <= pixels; pixel += 4)
+    {
+        __m128i p01, p23;
+        RGB10UnpackFourPixelsSSE41<rBit, gBit, bBit, bigEndian>(_mm_loadu_si128((const __m128i*)src), p01, p23);
+        src += 16;
+
+        StoreTwelveBytePairSSE41(dst, p01, p23);
+        dst += 12;
+    }
+
+    RGB10UnpackLineScalar<rBit, gBit, bBit, bigEndian>(src, dst, pixels - pixel);
+}
+
+
+template<int rBit, int gBit, int bBit, bool bigEndian>
+static void RGB10UnpackLineAVX2(const uint8_t* src, uint16_t* dst, uint32_t pixels)
+{
+    const __m256i maskLow = _mm256_set1_epi32(0x0000FFC0);
+    const __m256i maskHigh = _mm256_set1_epi32((int)0xFFC00000);
+
+    // 8 pixels per iteration
+    uint32_t pixel = 0;
+    for (; pixel + 8 <= pixels; pixel += 8)
+    {
+        __m256i in = _mm256_loadu_si256((const __m256i*)src);
+        src += 32;
+
+        if (bigEndian)
+            in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(RGB10_SHUFFLE_BSWAP, RGB10_SHUFFLE_BSWAP));
+
+        __m256i rg = _mm256_or_si256(
+            _mm256_and_si256(_mm256_srli_epi32(in, rBit - 6), maskLow),
+            _mm256_and_si256(_mm256_slli_epi32(in, 22 - gBit), maskHigh));
+        __m256i b = _mm256_and_si256(_mm256_slli_epi32(in, 6 - bBit), maskLow);
+
+        rg = _mm256_or_si256(rg, _mm256_srli_epi16(rg, 10));
+        b = _mm256_or_si256(b, _mm256_srli_epi16(b, 10));
+
+        // Lanes hold pixel 0-1 | 4-5 and 2-3 | 6-7
+        const __m256i p0145 = _mm256_or_si256(
+            _mm256_shuffle_epi8(rg, _mm256_setr_epi8(RGB10_SHUFFLE_P01_RG, RGB10_SHUFFLE_P01_RG)),
+            _mm256_shuffle_epi8(b, _mm256_setr_epi8(RGB10_SHUFFLE_P01_B, RGB10_SHUFFLE_P01_B)));
+        const __m256i p2367 = _mm256_or_si256(
+            _mm256_shuffle_epi8(rg, _mm256_setr_epi8(RGB10_SHUFFLE_P23_RG, RGB10_SHUFFLE_P23_RG)),
+            _mm256_shuffle_epi8(b, _mm256_setr_epi8(RGB10_SHUFFLE_P23_B, RGB10_SHUFFLE_P23_B)));
+
+        StoreTwelveByteQuadAVX2(
+            dst,
+            _mm256_permute2x128_si256(p0145, p2367, 0x20),  // 0-1 | 2-3
+            _mm256_permute2x128_si256(p0145, p2367, 0x31)); // 4-5 | 6-7
+        dst += 24;
+    }
+
+    RGB10UnpackLineSSE41<rBit, gBit, bBit, bigEndian>(src, dst, pixels - pixel);
+}
+
+
+//
+// SIMD 12-bit
+//
+// Every chunk of 12 bytes holds 8 components in stream order, which is also the output order. A byte
+// shuffle (which also does the byte swap for big endian) puts the 2 bytes holding each component in a
+// 16-bit word, even components are in the low 12 bits and odd ones in the high 12 bits. Multiplying the
+// even ones by 16 lines them all up in the high bits after which the low bits are replicated in.
+//
+
+#define RGB12_SHUFFLE_LE  0,  1,  1,  2,  3,  4,  4,  5,  6,  7,  7,  8,  9, 10, 10, 11
+#define RGB12_SHUFFLE_BE  3,  2,  2,  1,  0,  7,  7,  6,  5,  4,  4, 11, 10,  9,  9,  8
+
+
+template<bool bigEndian>
+static inline __m128i RGB12UnpackChunkSSE41(const __m128i in)
+{
+    const __m128i shuffle = bigEndian ? _mm_setr_epi8(RGB12_SHUFFLE_BE) : _mm_setr_epi8(RGB12_SHUFFLE_LE);
+    const __m128i multiply = _mm_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1);
+    const __m128i mask = _mm_set1_epi16((short)0xFFF0);
+
+    const __m128i v = _mm_and_si128(_mm_mullo_epi16(_mm_shuffle_epi8(in, shuffle), multiply), mask);
+    return _mm_or_si128(v, _mm_srli_epi16(v, 12));
+}
+
+
+template<bool bigEndian>
+static void RGB12UnpackChunksSSE41(const uint8_t* src, uint16_t* dst, uint32_t chunks)
+{
+    // 1 chunk per iteration, the 16 byte load needs at least 4 bytes of the next chunk
+    uint32_t chunk = 0;
+    for (; chunk + 2 <= chunks; chunk++)
+    {
+        _mm_storeu_si128((__m128i*)dst, RGB12UnpackChunkSSE41<bigEndian>(_mm_loadu_si128((const __m128i*)src)));
+        src += RGB12_BYTES_PER_CHUNK;
+        dst += 8;
+    }
+
+    RGB12UnpackChunksScalar<bigEndian>(src, dst, chunks - chunk);
+}
+
+
+template<bool bigEndian>
+static void RGB12UnpackLineSSE41(const uint8_t* src, uint16_t* dst, uint32_t pixels)
+{
+    RGB12UnpackChunksSSE41<bigEndian>(src, dst, pixels / RGB12_PIXELS_PER_PACK * RGB12_CHUNKS_PER_PACK);
+}
+
+
+template<bool bigEndian>
+static void RGB12UnpackLineAVX2(const uint8_t* src, uint16_t* dst, uint32_t pixels)
+{
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);  // Chunk per lane
+    const __m256i shuffle = bigEndian ?
+        _mm256_setr_epi8(RGB12_SHUFFLE_BE, RGB12_SHUFFLE_BE) :
+        _mm256_setr_epi8(RGB12_SHUFFLE_LE, RGB12_SHUFFLE_LE);
+    const __m256i multiply = _mm256_setr_epi16(16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1, 16, 1);
+    const __m256i mask = _mm256_set1_epi16((short)0xFFF0);
+
+    const uint32_t chunks = pixels / RGB12_PIXELS_PER_PACK * RGB12_CHUNKS_PER_PACK;
+
+    // 2 chunks per iteration, the 32 byte load needs at least 8 bytes of the next chunk
+    uint32_t chunk = 0;
+    for (; chunk + 3 <= chunks; chunk += 2)
+    {
+        const __m256i in = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)src), spread);
+        src += 2 * RGB12_BYTES_PER_CHUNK;
+
+        const __m256i v = _mm256_and_si256(_mm256_mullo_epi16(_mm256_shuffle_epi8(in, shuffle), multiply), mask);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_or_si256(v, _mm256_srli_epi16(v, 12)));
+        dst += 16;
+    }
+
+    RGB12UnpackChunksSSE41<bigEndian>(src, dst, chunks - chunk);
+}
+
+
+//
+// Dispatch
+//
+
+static RGBUnpackLineFunction RGBUnpackLineFunctionSelect(
+    const CpuInstructionSet instructionSet,
+    RGBUnpackLineFunction scalar,
+    RGBUnpackLineFunction sse41,
+    RGBUnpackLineFunction avx2)
+{
+    switch (instructionSet)
+    {
+    case CpuInstructionSet::AVX2:
+        return avx2;
+
+    case CpuInstructionSet::SSE41:
+        return sse41;
+
+    case CpuInstructionSet::SCALAR:
+        return scalar;
+    }
+
+    throw std::runtime_error("No RGB unpack function for instruction set");
+}
+
+
+bool RGBUnpackCanHandle(const VideoFrameEncoding videoFrameEncoding)
+{
+    switch (videoFrameEncoding)
+    {
+    case VideoFrameEncoding::R210:
+    case VideoFrameEncoding::R10b:
+    case VideoFrameEncoding::R10l:
+    case VideoFrameEncoding::R12B:
+    case VideoFrameEncoding::R12L:
+        return true;
+    }
+
+    return false;
+}
+
+
+RGBUnpackLineFunction RGBUnpackLineFunctionGet(const VideoFrameEncoding videoFrameEncoding, const CpuInstructionSet instructionSet)
+{
+    switch (videoFrameEncoding)
+    {
+    case VideoFrameEncoding::R210:
+        return RGBUnpackLineFunctionSelect(
+            instructionSet,
+            RGB10UnpackLineScalar<R210_LAYOUT>,
+            RGB10UnpackLineSSE41<R210_LAYOUT>,
+            RGB10UnpackLineAVX2<R210_LAYOUT>);
+
+    case VideoFrameEncoding::R10b:
+        return RGBUnpackLineFunctionSelect(
+            instructionSet,
+            RGB10UnpackLineScalar<R10B_LAYOUT>,
+            RGB10UnpackLineSSE41<R10B_LAYOUT>,
+            RGB10UnpackLineAVX2<R10B_LAYOUT>);
+
+    case VideoFrameEncoding::R10l:
+        return RGBUnpackLineFunctionSelect(
+            instructionSet,
+            RGB10UnpackLineScalar<R10L_LAYOUT>,
+            RGB10UnpackLineSSE41<R10L_LAYOUT>,
+            RGB10UnpackLineAVX2<R10L_LAYOUT>);
+
+    case VideoFrameEncoding::R12B:
+        return RGBUnpackLineFunctionSelect(
+            instructionSet,
+            RGB12UnpackLineScalar<true>,
+            RGB12UnpackLineSSE41<true>,
+            RGB12UnpackLineAVX2<true>);
+
+    case VideoFrameEncoding::R12L:
+        return RGBUnpackLineFunctionSelect(
+            instructionSet,
+            RGB12UnpackLineScalar<false>,
+            RGB12UnpackLineSSE41<false>,
+            RGB12UnpackLineAVX2<false>);
+    }
+
+    throw std::runtime_error("No RGB unpack function for video frame encoding");
+}
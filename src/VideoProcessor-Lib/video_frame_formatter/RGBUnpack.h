@@ -0,0 +1,41 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <CpuFeatures.h>
+#include <VideoFrameEncoding.h>
+
+
+// The 12-bit RGB formats store 8 pixels in 9 32-bit words
+#define RGB12_PIXELS_PER_PACK 8
+#define RGB12_BYTES_PER_PACK (9 * sizeof(uint32_t))
+
+
+/**
+ * Unpacks a line of packed 10 or 12-bit RGB (r210, R10b, R10l, R12B, R12L) into RGB48LE,
+ * three 16-bit little endian values R, G, B per pixel.
+ *
+ * Values are scaled to 16 bits by bit replication (v << 6 | v >> 4 for 10-bit, v << 4 | v >> 8 for 12-bit)
+ * which is what swscale does, so full scale stays full scale.
+ *
+ * For the 12-bit formats pixels must be a multiple of RGB12_PIXELS_PER_PACK.
+ * All variants produce byte-identical output and never read or write past the given pixels.
+ */
+typedef void (*RGBUnpackLineFunction)(const uint8_t* src, uint16_t* dst, uint32_t pixels);
+
+
+// True if there is an unpack function for the encoding
+bool RGBUnpackCanHandle(const VideoFrameEncoding videoFrameEncoding);
+
+
+// Get the unpack function for the given encoding and instruction set, which must be supported by the CPU
+RGBUnpackLineFunction RGBUnpackLineFunctionGet(const VideoFrameEncoding videoFrameEncoding, const CpuInstructionSet instructionSet);
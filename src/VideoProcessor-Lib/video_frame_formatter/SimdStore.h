@@ -0,0 +1,43 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+#include <immintrin.h>
+
+
+//
+// Exact stores shared by the SIMD unpackers, these never write past the bytes they are given
+//
+
+
+// Stores the low 12 bytes of a and b back to back in 24 bytes
+static inline void StoreTwelveBytePairSSE41(void* dst, const __m128i a, const __m128i b)
+{
+    _mm_storeu_si128((__m128i*)dst, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+    _mm_storel_epi64((__m128i*)((uint8_t*)dst + 16), _mm_srli_si128(b, 4));
+}
+
+
+// Stores the 4x12 bytes in the low 12 bytes of each lane of a and b back to back in 48 bytes,
+// in the order a lane 0, a lane 1, b lane 0, b lane 1
+static inline void StoreTwelveByteQuadAVX2(void* dst, const __m256i a, const __m256i b)
+{
+    // a: a0 a1 a2 a4 a5 a6 .. ..  (dwords)
+    // b: b2 b4 b5 b6 .. .. b0 b1
+    const __m256i permuteA = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    const __m256i permuteB = _mm256_setr_epi32(2, 4, 5, 6, 3, 7, 0, 1);
+
+    const __m256i pa = _mm256_permutevar8x32_epi32(a, permuteA);
+    const __m256i pb = _mm256_permutevar8x32_epi32(b, permuteB);
+
+    _mm256_storeu_si256((__m256i*)dst, _mm256_blend_epi32(pa, pb, 0xC0));
+    _mm_storeu_si128((__m128i*)((uint8_t*)dst + 32), _mm256_castsi256_si128(pb));
+}
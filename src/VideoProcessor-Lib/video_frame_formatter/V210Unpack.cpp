@@ -0,0 +1,216 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#include <pch.h>
+
+#include <immintrin.h>
+
+#include <video_frame_formatter/SimdStore.h>
+
+#include "V210Unpack.h"
+
+//
+// Parts of this are copied from ffmpeg v210dec.c, see /3rdparty/ffmpeg/README.txt for license and attribution
+//
+
+
+#define V210_READ_PACK_BLOCK(a, b, c) \
+    do {                              \
+        val  = *src++;                \
+        a = val & 0x3FF;              \
+        b = (val >> 10) & 0x3FF;      \
+        c = (val >> 20) & 0x3FF;      \
+    } while (0)
+
+
+#define P010_WRITE_VALUE(d, v) (*d++ = (v << 6))
+
+
+//
+// Scalar, this is the reference implementation
+//
+
+static void V210UnpackLineScalar(const uint32_t* src, uint16_t* dstY, uint16_t* dstUV, uint32_t packs)
+{
+    for (uint32_t pack = 0; pack < packs; pack++)
+    {
+        uint32_t val;
+        uint16_t u, y1, y2, v;
+
+        if (dstUV)
+        {
+            V210_READ_PACK_BLOCK(u, y1, v);
+            P010_WRITE_VALUE(dstUV, u);
+            P010_WRITE_VALUE(dstY, y1);
+            P010_WRITE_VALUE(dstUV, v);
+
+            V210_READ_PACK_BLOCK(y1, u, y2);
+            P010_WRITE_VALUE(dstY, y1);
+            P010_WRITE_VALUE(dstUV, u);
+            P010_WRITE_VALUE(dstY, y2);
+
+            V210_READ_PACK_BLOCK(v, y1, u);
+            P010_WRITE_VALUE(dstUV, v);
+            P010_WRITE_VALUE(dstY, y1);
+            P010_WRITE_VALUE(dstUV, u);
+
+            V210_READ_PACK_BLOCK(y1, v, y2);
+            P010_WRITE_VALUE(dstY, y1);
+            P010_WRITE_VALUE(dstUV, v);
+            P010_WRITE_VALUE(dstY, y2);
+        }
+        else
+        {
+            V210_READ_PACK_BLOCK(u, y1, v);
+            P010_WRITE_VALUE(dstY, y1);
+
+            V210_READ_PACK_BLOCK(y1, u, y2);
+            P010_WRITE_VALUE(dstY, y1);
+            P010_WRITE_VALUE(dstY, y2);
+
+            V210_READ_PACK_BLOCK(v, y1, u);
+            P010_WRITE_VALUE(dstY, y1);
+
+            V210_READ_PACK_BLOCK(y1, v, y2);
+            P010_WRITE_VALUE(dstY, y1);
+            P010_WRITE_VALUE(dstY, y2);
+        }
+    }
+}
+
+
+//
+// SIMD
+//
+// Every 32-bit word of a pack holds 3 10-bit values a (bits 0-9), b (10-19) and c (20-29). Each word
+// is expanded into two registers which hold the P010 values (<< 6) as 16-bit words:
+//   ab: word 2n = a, word 2n+1 = b of input word n
+//   c:  word 2n = c of input word n
+// after which a byte shuffle per register picks the 6 Y and 6 interleaved UV values of a pack.
+// All stores are exact so that nothing gets written past the end of a line or plane.
+//
+
+// Y: ab1, ab2, c2, ab5, ab6, c6
+#define V210_SHUFFLE_Y_AB  2,  3,  4,  5, -1, -1, 10, 11, 12, 13, -1, -1, -1, -1, -1, -1
+#define V210_SHUFFLE_Y_C  -1, -1, -1, -1,  4,  5, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1
+
+// UV: ab0, c0, ab3, ab4, c4, ab7
+#define V210_SHUFFLE_UV_AB  0,  1, -1, -1,  6,  7,  8,  9, -1, -1, 14, 15, -1, -1, -1, -1
+#define V210_SHUFFLE_UV_C  -1, -1,  0,  1, -1, -1, -1, -1,  8,  9, -1, -1, -1, -1, -1, -1
+
+
+// Unpacks one pack into 6 Y values in the low 12 bytes of y and 6 UV values in the low 12 bytes of uv
+static inline void V210UnpackPackSSE41(const __m128i in, __m128i& y, __m128i& uv)
+{
+    const __m128i maskA = _mm_set1_epi32(0x0000FFC0);
+    const __m128i maskB = _mm_set1_epi32((int)0xFFC00000);
+    const __m128i shuffleYAB = _mm_setr_epi8(V210_SHUFFLE_Y_AB);
+    const __m128i shuffleYC = _mm_setr_epi8(V210_SHUFFLE_Y_C);
+    const __m128i shuffleUVAB = _mm_setr_epi8(V210_SHUFFLE_UV_AB);
+    const __m128i shuffleUVC = _mm_setr_epi8(V210_SHUFFLE_UV_C);
+
+    const __m128i ab = _mm_or_si128(
+        _mm_and_si128(_mm_slli_epi32(in, 6), maskA),
+        _mm_and_si128(_mm_slli_epi32(in, 12), maskB));
+    const __m128i c = _mm_and_si128(_mm_srli_epi32(in, 14), maskA);
+
+    y = _mm_or_si128(_mm_shuffle_epi8(ab, shuffleYAB), _mm_shuffle_epi8(c, shuffleYC));
+    uv = _mm_or_si128(_mm_shuffle_epi8(ab, shuffleUVAB), _mm_shuffle_epi8(c, shuffleUVC));
+}
+
+
+static void V210UnpackLineSSE41(const uint32_t* src, uint16_t* dstY, uint16_t* dstUV, uint32_t packs)
+{
+    // 2 packs per iteration, 12 Y and 12 UV values
+    uint32_t pack = 0;
+    for (; pack + 2 <= packs; pack += 2)
+    {
+        __m128i y0, uv0, y1, uv1;
+        V210UnpackPackSSE41(_mm_loadu_si128((const __m128i*)src), y0, uv0);
+        V210UnpackPackSSE41(_mm_loadu_si128((const __m128i*)(src + 4)), y1, uv1);
+        src += 8;
+
+        StoreTwelveBytePairSSE41(dstY, y0, y1);
+        dstY += 12;
+
+        if (dstUV)
+        {
+            StoreTwelveBytePairSSE41(dstUV, uv0, uv1);
+            dstUV += 12;
+        }
+    }
+
+    V210UnpackLineScalar(src, dstY, dstUV, packs - pack);
+}
+
+
+// Unpacks two packs, one per 128-bit lane, into 6 Y and 6 UV values in the low 12 bytes of each lane
+static inline void V210UnpackTwoPacksAVX2(const __m256i in, __m256i& y, __m256i& uv)
+{
+    const __m256i maskA = _mm256_set1_epi32(0x0000FFC0);
+    const __m256i maskB = _mm256_set1_epi32((int)0xFFC00000);
+    const __m256i shuffleYAB = _mm256_setr_epi8(V210_SHUFFLE_Y_AB, V210_SHUFFLE_Y_AB);
+    const __m256i shuffleYC = _mm256_setr_epi8(V210_SHUFFLE_Y_C, V210_SHUFFLE_Y_C);
+    const __m256i shuffleUVAB = _mm256_setr_epi8(V210_SHUFFLE_UV_AB, V210_SHUFFLE_UV_AB);
+    const __m256i shuffleUVC = _mm256_setr_epi8(V210_SHUFFLE_UV_C, V210_SHUFFLE_UV_C);
+
+    const __m256i ab = _mm256_or_si256(
+        _mm256_and_si256(_mm256_slli_epi32(in, 6), maskA),
+        _mm256_and_si256(_mm256_slli_epi32(in, 12), maskB));
+    const __m256i c = _mm256_and_si256(_mm256_srli_epi32(in, 14), maskA);
+
+    y = _mm256_or_si256(_mm256_shuffle_epi8(ab, shuffleYAB), _mm256_shuffle_epi8(c, shuffleYC));
+    uv = _mm256_or_si256(_mm256_shuffle_epi8(ab, shuffleUVAB), _mm256_shuffle_epi8(c, shuffleUVC));
+}
+
+
+static void V210UnpackLineAVX2(const uint32_t* src, uint16_t* dstY, uint16_t* dstUV, uint32_t packs)
+{
+    // 4 packs per iteration, 24 Y and 24 UV values
+    uint32_t pack = 0;
+    for (; pack + 4 <= packs; pack += 4)
+    {
+        __m256i y0, uv0, y1, uv1;
+        V210UnpackTwoPacksAVX2(_mm256_loadu_si256((const __m256i*)src), y0, uv0);
+        V210UnpackTwoPacksAVX2(_mm256_loadu_si256((const __m256i*)(src + 8)), y1, uv1);
+        src += 16;
+
+        StoreTwelveByteQuadAVX2(dstY, y0, y1);
+        dstY += 24;
+
+        if (dstUV)
+        {
+            StoreTwelveByteQuadAVX2(dstUV, uv0, uv1);
+            dstUV += 24;
+        }
+    }
+
+    V210UnpackLineSSE41(src, dstY, dstUV, packs - pack);
+}
+
+
+//
+// Dispatch
+//
+
+V210UnpackLineFunction V210UnpackLineFunctionGet(const CpuInstructionSet instructionSet)
+{
+    switch (instructionSet)
+    {
+    case CpuInstructionSet::AVX2:
+        return V210UnpackLineAVX2;
+
+    case CpuInstructionSet::SSE41:
+        return V210UnpackLineSSE41;
+
+    case CpuInstructionSet::SCALAR:
+        return V210UnpackLineScalar;
+    }
+
+    throw std::runtime_error("No V210 unpack function for instruction set");
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <CpuFeatures.h>
+
+
+// V210 stores 6 pixels in 4 little endian 32-bit words
+#define V210_PIXELS_PER_PACK 6
+#define V210_BYTES_PER_PACK (4 * sizeof(uint32_t))
+
+
+// Bytes per V210 line, lines start at 128 byte alignment
+inline uint32_t V210BytesPerLine(const uint32_t width) { return ((width + 47) / 48) * 128; }
+
+
+/**
+ * Unpacks a line of V210 into 16-bit values with the 10-bit data in the high bits (P010/P210 layout),
+ * one Y value per pixel into dstY and interleaved UV values for every 2 pixels into dstUV.
+ * dstUV can be null when the chroma of the line is not needed.
+ *
+ * All variants produce byte-identical output and never write past the last pack.
+ */
+typedef void (*V210UnpackLineFunction)(const uint32_t* src, uint16_t* dstY, uint16_t* dstUV, uint32_t packs);
+
+
+// Get the unpack function for the given instruction set, which must be supported by the CPU
+V210UnpackLineFunction V210UnpackLineFunctionGet(const CpuInstructionSet instructionSet);
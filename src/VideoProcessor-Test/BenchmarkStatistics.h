@@ -0,0 +1,28 @@
+/*
+ * Copyright(C) 2021 Dennis Fleurbaaij <mail@dennisfleurbaaij.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, version 3.
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along with this program. If not, see < https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+namespace Tests
+{
+	// Nearest-rank percentile of sorted values
+	static double Percentile(const std::vector<double>& sorted, double percentile)
+	{
+		assert(!sorted.empty());
+
+		const size_t rank = (size_t)std::ceil(percentile / 100.0 * sorted.size());
+		return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+	}
+}
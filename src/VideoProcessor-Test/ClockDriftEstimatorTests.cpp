@@ -0,0 +1,203 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <random>
+
+#include <ClockDriftEstimator.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	static const timingclocktime_t SOURCE_TICKS_PER_SECOND = 1000000000LL;
+	static const timingclocktime_t SINK_TICKS_PER_SECOND = 10000000LL;
+
+
+	// Paired readings of a source clock drifting against the sink, read with some jitter
+	class DriftingClocks
+	{
+	public:
+
+		DriftingClocks(double ppm, double jitterMs):
+			m_ppm(ppm),
+			m_jitter(-jitterMs / 1000.0, jitterMs / 1000.0)
+		{
+		}
+
+		// Advance the sink by the given seconds and feed a reading of both
+		void Sample(CClockDriftEstimator& estimator, double seconds)
+		{
+			m_sinkSeconds += seconds;
+			m_sourceSeconds += seconds * (1.0 + m_ppm / 1000000.0);
+
+			estimator.Sample(
+				(timingclocktime_t)llround((m_sourceSeconds + m_jitter(m_random)) * SOURCE_TICKS_PER_SECOND),
+				(timingclocktime_t)llround(m_sinkSeconds * SINK_TICKS_PER_SECOND));
+		}
+
+		void SetPpm(double ppm) { m_ppm = ppm; }
+
+	private:
+
+		double m_ppm;
+		double m_sinkSeconds = 100.0;
+		double m_sourceSeconds = 5000.0;
+		std::uniform_real_distribution<double> m_jitter;
+		std::mt19937 m_random;
+	};
+
+
+	TEST_CLASS(ClockDriftEstimatorTests)
+	{
+	public:
+
+		TEST_METHOD(ClockDriftEstimatorDriftTest)
+		{
+			CClockDriftEstimator estimator(SOURCE_TICKS_PER_SECOND, SINK_TICKS_PER_SECOND);
+			DriftingClocks clocks(50.0, 0.1);
+
+			// Nothing until the minimum span is covered
+			for (int i = 0; i < 29; i++)
+				clocks.Sample(estimator, 1.0);
+
+			Assert::IsFalse(estimator.Estimate().valid);
+			Assert::AreEqual((int)ClockDriftSlip::NONE, (int)estimator.PredictSlip(8.0).slip);
+
+			// An hour of samples every second
+			for (int i = 0; i < 3600; i++)
+				clocks.Sample(estimator, 1.0);
+
+			const ClockDriftEstimate estimate = estimator.Estimate();
+			Assert::IsTrue(estimate.valid);
+			Assert::AreEqual(50.0, estimate.driftPpm, 1.0);
+			Assert::IsTrue(estimate.confidencePpm > 0.0);
+			Assert::IsTrue(estimate.confidencePpm < 1.0);
+
+			// 50ppm over an hour
+			Assert::AreEqual(0.05 * 3629, estimate.offsetMs, 5.0);
+		}
+
+
+		TEST_METHOD(ClockDriftEstimatorFollowsChangeTest)
+		{
+			CClockDriftEstimator estimator(SOURCE_TICKS_PER_SECOND, SINK_TICKS_PER_SECOND);
+			DriftingClocks clocks(50.0, 0.1);
+
+			for (int i = 0; i < 3600; i++)
+				clocks.Sample(estimator, 1.0);
+
+			Assert::AreEqual(50.0, estimator.Estimate().driftPpm, 1.0);
+
+			// Clock warmed up and changed rate, the fit takes a while to let go of the far away old samples
+			clocks.SetPpm(-20.0);
+			for (int i = 0; i < 600; i++)
+				clocks.Sample(estimator, 1.0);
+
+			Assert::IsTrue(estimator.Estimate().driftPpm < 25.0);
+
+			for (int i = 0; i < 3000; i++)
+				clocks.Sample(estimator, 1.0);
+
+			Assert::AreEqual(-20.0, estimator.Estimate().driftPpm, 1.0);
+		}
+
+
+		TEST_METHOD(ClockDriftEstimatorPredictDropTest)
+		{
+			const double frameMs = 1000.0 / 60;
+
+			CClockDriftEstimator estimator(SOURCE_TICKS_PER_SECOND, SINK_TICKS_PER_SECOND);
+			DriftingClocks clocks(100.0, 0.05);
+
+			for (int i = 0; i < 60; i++)
+				clocks.Sample(estimator, 1.0);
+
+			// Source gets ahead 0.1ms every second, half a frame slack takes 83s of which 59 are gone
+			ClockDriftSlipPrediction prediction = estimator.PredictSlip(frameMs / 2);
+			Assert::AreEqual((int)ClockDriftSlip::DROP, (int)prediction.slip);
+			Assert::AreEqual(83.3 - 59.0, prediction.seconds, 3.0);
+
+			// Dropping a frame buys another frame's worth
+			estimator.OnSlip(ClockDriftSlip::DROP, frameMs);
+			prediction = estimator.PredictSlip(frameMs / 2);
+			Assert::AreEqual((int)ClockDriftSlip::DROP, (int)prediction.slip);
+			Assert::AreEqual(83.3 - 59.0 + 166.7, prediction.seconds, 5.0);
+
+			// As does starting over from here
+			estimator.Rebase();
+			Assert::AreEqual(0.0, estimator.Estimate().offsetMs);
+			Assert::AreEqual(83.3, estimator.PredictSlip(frameMs / 2).seconds, 3.0);
+
+			// Overdue
+			for (int i = 0; i < 100; i++)
+				clocks.Sample(estimator, 1.0);
+
+			Assert::AreEqual(0.0, estimator.PredictSlip(frameMs / 2).seconds);
+		}
+
+
+		TEST_METHOD(ClockDriftEstimatorPredictRepeatTest)
+		{
+			const double frameMs = 1000.0 / 50;
+
+			CClockDriftEstimator estimator(SOURCE_TICKS_PER_SECOND, SINK_TICKS_PER_SECOND);
+			DriftingClocks clocks(-200.0, 0.05);
+
+			for (int i = 0; i < 60; i++)
+				clocks.Sample(estimator, 1.0);
+
+			// Falls behind 0.2ms every second, so half a frame was due after 50s
+			const ClockDriftSlipPrediction prediction = estimator.PredictSlip(frameMs / 2);
+			Assert::AreEqual((int)ClockDriftSlip::REPEAT, (int)prediction.slip);
+			Assert::AreEqual(0.0, prediction.seconds);
+
+			// Repeating a frame puts it ahead by the rest of the frame
+			estimator.OnSlip(ClockDriftSlip::REPEAT, frameMs);
+			Assert::AreEqual(-11.8 + frameMs, estimator.Estimate().offsetMs, 1.0);
+			Assert::AreEqual(91.0, estimator.PredictSlip(frameMs / 2).seconds, 5.0);
+		}
+
+
+		TEST_METHOD(ClockDriftEstimatorNoDriftTest)
+		{
+			CClockDriftEstimator estimator(SOURCE_TICKS_PER_SECOND, SINK_TICKS_PER_SECOND);
+			DriftingClocks clocks(0.0, 0.5);
+
+			for (int i = 0; i < 120; i++)
+				clocks.Sample(estimator, 1.0);
+
+			// Within the noise, nothing to predict
+			const ClockDriftEstimate estimate = estimator.Estimate();
+			Assert::IsTrue(estimate.valid);
+			Assert::IsTrue(std::abs(estimate.driftPpm) < estimate.confidencePpm);
+			Assert::AreEqual((int)ClockDriftSlip::NONE, (int)estimator.PredictSlip(8.0).slip);
+		}
+
+
+		TEST_METHOD(ClockDriftEstimatorResetTest)
+		{
+			CClockDriftEstimator estimator(SOURCE_TICKS_PER_SECOND, SINK_TICKS_PER_SECOND);
+
+			for (int i = 0; i < 100; i++)
+				estimator.Sample(SOURCE_TICKS_PER_SECOND * i, SINK_TICKS_PER_SECOND * i);
+
+			Assert::IsTrue(estimator.Estimate().valid);
+			Assert::AreEqual(0.0, estimator.Estimate().driftPpm, 0.001);
+
+			// Sink going back starts over
+			estimator.Sample(SOURCE_TICKS_PER_SECOND * 100, 0);
+			Assert::AreEqual((uint64_t)1, estimator.SampleCount());
+			Assert::IsFalse(estimator.Estimate().valid);
+
+			estimator.Reset();
+			Assert::AreEqual((uint64_t)0, estimator.SampleCount());
+
+			Assert::ExpectException<std::runtime_error>([]() { CClockDriftEstimator(0, SINK_TICKS_PER_SECOND); });
+
+			ClockDriftEstimatorConfig config;
+			config.halfLifeSeconds = 0.0;
+			Assert::ExpectException<std::runtime_error>([&]() { CClockDriftEstimator(SOURCE_TICKS_PER_SECOND, SINK_TICKS_PER_SECOND, config); });
+		}
+	};
+}
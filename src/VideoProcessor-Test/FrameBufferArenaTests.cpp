@@ -0,0 +1,434 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <deque>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <FrameBufferAllocator.h>
+#include <FrameBufferArena.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	static const size_t FAKE_FRAME_BYTES = 1920 * 1080 * 4;
+
+
+	/**
+	 * Uses an allocator the way capture drivers do, a few buffers being captured into
+	 * and the delivered frames held downstream until the renderer lets go of them.
+	 */
+	class FakeCaptureDriver
+	{
+	public:
+
+		FakeCaptureDriver(CFrameBufferAllocator& allocator, size_t driverBuffers, size_t frameBytes):
+			m_allocator(allocator),
+			m_driverBuffers(driverBuffers),
+			m_frameBytes(frameBytes)
+		{
+		}
+
+		~FakeCaptureDriver()
+		{
+			Stop();
+		}
+
+		void Start()
+		{
+			Refill();
+		}
+
+		// Frame done and delivered downstream, which lets go of what it no longer holds.
+		// Then as many more to capture into as there are to be had.
+		void Frame()
+		{
+			// Nothing to capture into
+			if (m_capturing.empty())
+			{
+				++m_droppedFrames;
+			}
+			else
+			{
+				m_held.push_back(m_capturing.front());
+				m_capturing.pop_front();
+			}
+
+			while (m_held.size() > m_heldFrames)
+				Downstream();
+
+			Refill();
+		}
+
+		// Downstream lets go of its oldest frame
+		void Downstream()
+		{
+			m_allocator.Release(m_held.front());
+			m_held.pop_front();
+		}
+
+		void Stop()
+		{
+			while (!m_held.empty())
+				Downstream();
+
+			for (void* buffer : m_capturing)
+				m_allocator.Release(buffer);
+
+			m_capturing.clear();
+		}
+
+		size_t m_heldFrames = 0;
+		size_t m_droppedFrames = 0;
+
+	private:
+
+		CFrameBufferAllocator& m_allocator;
+		const size_t m_driverBuffers;
+		const size_t m_frameBytes;
+
+		std::deque<void*> m_capturing;
+		std::deque<void*> m_held;
+
+		// Allocate up to the buffers the driver wants, stops at the first one the allocator doesn't have
+		void Refill()
+		{
+			while (m_capturing.size() < m_driverBuffers)
+			{
+				void* buffer = m_allocator.Allocate(m_frameBytes);
+				if (!buffer)
+					break;
+
+				Assert::AreEqual((size_t)0, (size_t)buffer % 4096);
+
+				// Every byte is ours
+				memset(buffer, 0xAB, m_frameBytes);
+				m_capturing.push_back(buffer);
+			}
+		}
+	};
+
+
+	TEST_CLASS(FrameBufferArenaTests)
+	{
+	public:
+
+		TEST_METHOD(FrameBufferArenaAcquireTest)
+		{
+			FrameBufferArenaConfig config;
+			config.bufferSize = 5000;
+			config.bufferCount = 3;
+			CFrameBufferArena arena(config);
+
+			// Whole pages
+			Assert::AreEqual((size_t)8192, arena.BufferSize());
+
+			std::set<void*> buffers;
+			for (int i = 0; i < 3; i++)
+			{
+				void* buffer = arena.Acquire(5000);
+				Assert::IsTrue(buffer != nullptr);
+				Assert::AreEqual((size_t)0, (size_t)buffer % 4096);
+				Assert::IsTrue(arena.Owns(buffer));
+				buffers.insert(buffer);
+			}
+
+			Assert::AreEqual((size_t)3, buffers.size());
+
+			// Empty
+			Assert::IsTrue(arena.Acquire(5000) == nullptr);
+
+			FrameBufferArenaStats stats = arena.Stats();
+			Assert::AreEqual((size_t)3, stats.inUse);
+			Assert::AreEqual((size_t)3, stats.highWater);
+			Assert::AreEqual((uint64_t)3, stats.acquired);
+			Assert::AreEqual((uint64_t)2, stats.pressured);
+			Assert::AreEqual((uint64_t)1, stats.starved);
+
+			// Last one back is the first one out again
+			void* buffer = *buffers.begin();
+			arena.Release(buffer);
+			Assert::IsTrue(arena.Acquire(100) == buffer);
+
+			for (void* b : buffers)
+				arena.Release(b);
+
+			stats = arena.Stats();
+			Assert::AreEqual((size_t)0, stats.inUse);
+			Assert::AreEqual((size_t)3, stats.highWater);
+		}
+
+		TEST_METHOD(FrameBufferArenaInvalidTest)
+		{
+			FrameBufferArenaConfig config;
+			Assert::ExpectException<std::runtime_error>([&]() { CFrameBufferArena arena(config); });
+
+			config.bufferSize = 4096;
+			config.bufferCount = 1;
+			CFrameBufferArena arena(config);
+
+			Assert::ExpectException<std::runtime_error>([&]() { arena.Acquire(4097); });
+
+			int notFromArena;
+			Assert::IsFalse(arena.Owns(&notFromArena));
+			Assert::ExpectException<std::runtime_error>([&]() { arena.Release(&notFromArena); });
+		}
+
+		// Large pages need a privilege which is most likely not there, either way there are buffers
+		TEST_METHOD(FrameBufferArenaLargePagesTest)
+		{
+			FrameBufferArenaConfig config;
+			config.bufferSize = FAKE_FRAME_BYTES;
+			config.bufferCount = 2;
+			config.largePages = true;
+			CFrameBufferArena arena(config);
+
+			void* buffer = arena.Acquire(FAKE_FRAME_BYTES);
+			Assert::IsTrue(buffer != nullptr);
+			memset(buffer, 0, FAKE_FRAME_BYTES);
+			arena.Release(buffer);
+		}
+
+		// With enough buffers for the driver and what's held downstream nothing is ever starved
+		TEST_METHOD(FrameBufferAllocatorSteadyTest)
+		{
+			CFrameBufferAllocator allocator(4 + 3, false);
+			allocator.Reserve(FAKE_FRAME_BYTES);
+
+			{
+				FakeCaptureDriver driver(allocator, 4, FAKE_FRAME_BYTES);
+				driver.m_heldFrames = 3;
+				driver.Start();
+
+				for (int i = 0; i < 1000; i++)
+					driver.Frame();
+
+				const FrameBufferArenaStats stats = allocator.Stats();
+				Assert::AreEqual((size_t)7, stats.bufferCount);
+				Assert::AreEqual((size_t)7, stats.inUse);
+				Assert::AreEqual((size_t)7, stats.highWater);
+				Assert::AreEqual((uint64_t)1004, stats.acquired);
+				Assert::AreEqual((uint64_t)0, stats.starved);
+				Assert::AreEqual((size_t)0, driver.m_droppedFrames);
+			}
+
+			Assert::AreEqual((size_t)0, allocator.Stats().inUse);
+		}
+
+		// Downstream holding on to more than planned runs it dry, the driver gets fewer buffers and it's counted
+		TEST_METHOD(FrameBufferAllocatorStarvedTest)
+		{
+			CFrameBufferAllocator allocator(4 + 1, false);
+			allocator.Reserve(FAKE_FRAME_BYTES);
+
+			FakeCaptureDriver driver(allocator, 4, FAKE_FRAME_BYTES);
+			driver.m_heldFrames = 1;
+			driver.Start();
+
+			Assert::AreEqual(FAKE_FRAME_BYTES, allocator.Stats().bufferSize);
+
+			for (int i = 0; i < 100; i++)
+				driver.Frame();
+
+			Assert::AreEqual((uint64_t)0, allocator.Stats().starved);
+
+			// Renderer stalls for a few frames
+			driver.m_heldFrames = 4;
+			for (int i = 0; i < 100; i++)
+				driver.Frame();
+
+			FrameBufferArenaStats stats = allocator.Stats();
+			Assert::IsTrue(stats.starved >= 3);
+			Assert::AreEqual((size_t)5, stats.inUse);
+			Assert::AreEqual((size_t)5, stats.highWater);
+			Assert::IsTrue(stats.pressured > 100);
+
+			// Holding on to every buffer there is loses frames
+			driver.m_heldFrames = 5;
+			for (int i = 0; i < 10; i++)
+				driver.Frame();
+
+			Assert::IsTrue(driver.m_droppedFrames > 0);
+
+			// Once it lets go the driver gets all of its buffers again
+			driver.m_heldFrames = 1;
+			for (int i = 0; i < 10; i++)
+				driver.Frame();
+
+			const uint64_t starved = allocator.Stats().starved;
+			for (int i = 0; i < 100; i++)
+				driver.Frame();
+
+			Assert::AreEqual(starved, allocator.Stats().starved);
+
+			driver.Stop();
+			allocator.Free();
+			stats = allocator.Stats();
+			Assert::AreEqual((size_t)0, stats.inUse);
+			Assert::AreEqual((size_t)0, stats.bufferCount);
+		}
+
+		// The driver restarting its streams on a mode change gets the same arena, only Free() lets go of it
+		TEST_METHOD(FrameBufferAllocatorRestartTest)
+		{
+			CFrameBufferAllocator allocator(4, false);
+			allocator.Reserve(FAKE_FRAME_BYTES);
+
+			FakeCaptureDriver driver(allocator, 2, FAKE_FRAME_BYTES);
+			driver.m_heldFrames = 2;
+			driver.Start();
+			for (int i = 0; i < 10; i++)
+				driver.Frame();
+
+			driver.Stop();
+			Assert::AreEqual((size_t)4, allocator.Stats().bufferCount);
+			Assert::AreEqual((size_t)0, allocator.Stats().inUse);
+
+			driver.Start();
+			for (int i = 0; i < 10; i++)
+				driver.Frame();
+
+			Assert::AreEqual((uint64_t)0, allocator.Stats().starved);
+
+			// Buffers still out keep it until they are back
+			allocator.Free();
+			Assert::AreEqual((size_t)4, allocator.Stats().inUse);
+			Assert::IsTrue(allocator.Allocate(FAKE_FRAME_BYTES) == nullptr);
+
+			driver.Stop();
+			const FrameBufferArenaStats stats = allocator.Stats();
+			Assert::AreEqual((size_t)0, stats.inUse);
+			Assert::AreEqual((size_t)0, stats.bufferCount);
+			Assert::AreEqual((uint64_t)2 + 10 + 2 + 10, stats.acquired);
+			Assert::AreEqual((uint64_t)1, stats.starved);
+		}
+
+		// Nothing is allocated on the driver's behalf, frames it wasn't reserved for get nothing
+		TEST_METHOD(FrameBufferAllocatorNotReservedTest)
+		{
+			CFrameBufferAllocator allocator(4, false);
+
+			// Without a size there's no arena
+			Assert::IsTrue(allocator.Allocate(FAKE_FRAME_BYTES) == nullptr);
+			Assert::AreEqual((size_t)0, allocator.Stats().bufferCount);
+			Assert::AreEqual((uint64_t)1, allocator.Stats().starved);
+
+			// Larger than reserved
+			allocator.Reserve(FAKE_FRAME_BYTES / 4);
+			Assert::AreEqual((size_t)4, allocator.Stats().bufferCount);
+			Assert::IsTrue(allocator.Allocate(FAKE_FRAME_BYTES) == nullptr);
+			Assert::AreEqual((uint64_t)2, allocator.Stats().starved);
+
+			void* buffer = allocator.Allocate(FAKE_FRAME_BYTES / 4);
+			Assert::IsTrue(buffer != nullptr);
+			allocator.Release(buffer);
+
+			int notFromAllocator;
+			Assert::ExpectException<std::runtime_error>([&]() { allocator.Release(&notFromAllocator); });
+
+			allocator.Free();
+		}
+
+		// Frames of a new size get a new arena, the old one is kept until its buffers are back
+		TEST_METHOD(FrameBufferAllocatorModeChangeTest)
+		{
+			CFrameBufferAllocator allocator(4, false);
+			allocator.Reserve(FAKE_FRAME_BYTES / 4);
+
+			FakeCaptureDriver small(allocator, 2, FAKE_FRAME_BYTES / 4);
+			small.m_heldFrames = 2;
+			small.Start();
+			for (int i = 0; i < 10; i++)
+				small.Frame();
+
+			allocator.Reserve(FAKE_FRAME_BYTES);
+			Assert::AreEqual(FAKE_FRAME_BYTES, allocator.Stats().bufferSize);
+			Assert::AreEqual((size_t)4, allocator.Stats().inUse);
+
+			// Small frames fit the new arena as well
+			small.Frame();
+			small.Frame();
+
+			FakeCaptureDriver large(allocator, 2, FAKE_FRAME_BYTES);
+			large.Start();
+			for (int i = 0; i < 10; i++)
+				large.Frame();
+
+			Assert::AreEqual((uint64_t)0, allocator.Stats().starved);
+
+			small.Stop();
+			large.Stop();
+
+			const FrameBufferArenaStats stats = allocator.Stats();
+			Assert::AreEqual((size_t)0, stats.inUse);
+			Assert::AreEqual((uint64_t)2 + 10 + 2 + 2 + 10, stats.acquired);
+		}
+
+		// Driver allocates on its thread while the renderer releases on another
+		TEST_METHOD(FrameBufferAllocatorThreadsTest)
+		{
+			CFrameBufferAllocator allocator(8, false);
+			allocator.Reserve(FAKE_FRAME_BYTES);
+
+			std::mutex mutex;
+			std::deque<void*> delivered;
+			const int frames = 2000;
+
+			std::thread renderer([&]()
+			{
+				for (int released = 0; released < frames;)
+				{
+					void* buffer = nullptr;
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						if (!delivered.empty())
+						{
+							buffer = delivered.front();
+							delivered.pop_front();
+						}
+					}
+
+					if (buffer)
+					{
+						allocator.Release(buffer);
+						++released;
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+			});
+
+			uint64_t dropped = 0;
+			for (int i = 0; i < frames;)
+			{
+				// Renderer behind, the driver drops the frame and tries again on the next
+				void* buffer = allocator.Allocate(FAKE_FRAME_BYTES);
+				if (!buffer)
+				{
+					++dropped;
+					std::this_thread::yield();
+					continue;
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				delivered.push_back(buffer);
+				++i;
+			}
+
+			renderer.join();
+
+			const FrameBufferArenaStats stats = allocator.Stats();
+			Assert::AreEqual((size_t)0, stats.inUse);
+			Assert::AreEqual((uint64_t)frames, stats.acquired);
+			Assert::AreEqual(dropped, stats.starved);
+			Assert::IsTrue(stats.highWater <= 8);
+
+			allocator.Free();
+		}
+	};
+}
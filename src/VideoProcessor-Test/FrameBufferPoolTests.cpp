@@ -0,0 +1,221 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <FrameBufferPool.h>
+#include <MpmcRingBuffer.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	TEST_CLASS(FrameBufferPoolTests)
+	{
+	public:
+
+		TEST_METHOD(MpmcRingBufferTest)
+		{
+			CMpmcRingBuffer<int> ring(3);
+			Assert::AreEqual((size_t)4, ring.Capacity());
+
+			int item;
+			Assert::IsFalse(ring.Pop(item));
+
+			for (int i = 0; i < 4; i++)
+				Assert::IsTrue(ring.Push(i));
+			Assert::IsFalse(ring.Push(4));
+
+			// Around the ring a few times, oldest first
+			for (int i = 4; i < 20; i++)
+			{
+				Assert::IsTrue(ring.Pop(item));
+				Assert::AreEqual(i - 4, item);
+				Assert::IsTrue(ring.Push(i));
+			}
+
+			Assert::ExpectException<std::runtime_error>([]() { CMpmcRingBuffer<int>(0); });
+		}
+
+
+		TEST_METHOD(FrameBufferLayoutTest)
+		{
+			const FrameBufferLayout single(100);
+			Assert::AreEqual((size_t)0, single.PlaneOffset(0));
+			Assert::AreEqual((size_t)128, single.Size());
+
+			// Planes start aligned, missing ones take no space
+			FrameBufferLayout planes;
+			planes.planeSizes[0] = 1000;
+			planes.planeSizes[2] = 10;
+			planes.alignment = 256;
+
+			Assert::AreEqual((size_t)1024, planes.PlaneOffset(1));
+			Assert::AreEqual((size_t)1024, planes.PlaneOffset(2));
+			Assert::AreEqual((size_t)1280, planes.PlaneOffset(3));
+			Assert::AreEqual((size_t)1280, planes.Size());
+
+			Assert::IsTrue(single == FrameBufferLayout(100));
+			Assert::IsTrue(single != FrameBufferLayout(100, 128));
+			Assert::IsTrue(single != FrameBufferLayout(101));
+		}
+
+
+		TEST_METHOD(FrameBufferPoolGetTest)
+		{
+			FrameBufferPoolConfig config;
+			config.slabBuffers = 2;
+			config.maxBuffersPerLayout = 3;
+			CFrameBufferPool pool(config);
+
+			FrameBufferLayout layout;
+			layout.planeSizes[0] = 1920 * 1080;
+			layout.planeSizes[1] = 1920 * 1080 / 2;
+			layout.alignment = 4096;
+
+			CFrameBuffer a = pool.Get(layout);
+			Assert::IsTrue((bool)a);
+			Assert::IsTrue(a.Layout() == layout);
+			Assert::AreEqual((size_t)0, (size_t)a.Data() % 4096);
+			Assert::AreEqual((size_t)0, (size_t)a.Plane(1) % 4096);
+			Assert::IsTrue(a.Plane(1) >= a.Data() + layout.planeSizes[0]);
+			Assert::IsNull(a.Plane(2));
+			memset(a.Data(), 0xAB, a.Size());
+
+			// Second one came with the first slab, the third is a new slab and then it's full
+			CFrameBuffer b = pool.Get(layout);
+			CFrameBuffer c = pool.Get(layout);
+			Assert::IsTrue(b && c);
+			Assert::IsFalse((bool)pool.Get(layout));
+
+			std::set<uint8_t*> buffers = { a.Data(), b.Data(), c.Data() };
+			Assert::AreEqual((size_t)3, buffers.size());
+
+			FrameBufferPoolStats stats = pool.Stats();
+			Assert::AreEqual((uint64_t)1, stats.hits);
+			Assert::AreEqual((uint64_t)3, stats.misses);
+			Assert::AreEqual((size_t)1, stats.layouts);
+			Assert::AreEqual((size_t)3, stats.buffers);
+			Assert::IsTrue(stats.bytes >= 3 * layout.Size());
+			Assert::AreEqual((size_t)3, stats.inUse);
+			Assert::AreEqual((size_t)3, stats.highWater);
+
+			// Given back and handed out again without new slabs
+			b.Reset();
+			c = CFrameBuffer();
+			Assert::AreEqual((size_t)1, pool.Stats().inUse);
+
+			for (int i = 0; i < 100; i++)
+			{
+				CFrameBuffer d = pool.Get(layout);
+				Assert::IsTrue(buffers.count(d.Data()) == 1);
+			}
+
+			stats = pool.Stats();
+			Assert::AreEqual((uint64_t)101, stats.hits);
+			Assert::AreEqual((size_t)3, stats.buffers);
+			Assert::AreEqual((size_t)3, stats.highWater);
+		}
+
+
+		TEST_METHOD(FrameBufferPoolLayoutsTest)
+		{
+			FrameBufferPoolConfig config;
+			config.maxLayouts = 2;
+			CFrameBufferPool pool(config);
+
+			CFrameBuffer a = pool.Get(FrameBufferLayout(1000));
+			CFrameBuffer b = pool.Get(FrameBufferLayout(1000, 128));
+			Assert::IsTrue(a && b);
+			Assert::IsTrue(a.Data() != b.Data());
+			Assert::IsFalse((bool)pool.Get(FrameBufferLayout(2000)));
+			Assert::AreEqual((size_t)2, pool.Stats().layouts);
+
+			Assert::ExpectException<std::runtime_error>([&]() { pool.Get(FrameBufferLayout(1000, 32)); });
+			Assert::ExpectException<std::runtime_error>([&]() { pool.Get(FrameBufferLayout(1000, 96)); });
+			Assert::ExpectException<std::runtime_error>([&]() { pool.Get(FrameBufferLayout(0)); });
+
+			config.slabBuffers = 0;
+			Assert::ExpectException<std::runtime_error>([&]() { CFrameBufferPool pool(config); });
+		}
+
+
+		TEST_METHOD(FrameBufferPoolDetachTest)
+		{
+			CFrameBufferPool pool;
+
+			CFrameBuffer a = pool.Get(FrameBufferLayout(1000));
+			uint8_t* data = a.Data();
+
+			void* detached = a.Detach();
+			Assert::IsFalse((bool)a);
+			Assert::IsNull(a.Data());
+			Assert::AreEqual((size_t)1, pool.Stats().inUse);
+
+			CFrameBuffer b = CFrameBuffer::Attach(detached);
+			Assert::IsTrue(data == b.Data());
+
+			CFrameBuffer c(std::move(b));
+			Assert::IsFalse((bool)b);
+			Assert::IsTrue(data == c.Data());
+
+			c.Reset();
+			Assert::AreEqual((size_t)0, pool.Stats().inUse);
+		}
+
+
+		// Decoder gets buffers on its thread while the renderer gives them back on another
+		TEST_METHOD(FrameBufferPoolThreadsTest)
+		{
+			FrameBufferPoolConfig config;
+			config.maxBuffersPerLayout = 8;
+			CFrameBufferPool pool(config);
+
+			const FrameBufferLayout layout(4096);
+			CMpmcRingBuffer<void*> rendering(8);
+			const int frames = 100000;
+
+			std::thread renderer([&]()
+			{
+				for (int i = 0; i < frames;)
+				{
+					void* detached;
+					if (rendering.Pop(detached))
+					{
+						CFrameBuffer::Attach(detached);
+						++i;
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+			});
+
+			for (int i = 0; i < frames;)
+			{
+				CFrameBuffer buffer = pool.Get(layout);
+				if (!buffer)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				while (!rendering.Push(buffer.Detach()))
+					std::this_thread::yield();
+				++i;
+			}
+
+			renderer.join();
+
+			const FrameBufferPoolStats stats = pool.Stats();
+			Assert::AreEqual((size_t)0, stats.inUse);
+			Assert::IsTrue(stats.buffers <= 8);
+			Assert::IsTrue(stats.highWater <= 8);
+			Assert::IsTrue(stats.hits >= frames - 8);
+		}
+	};
+}
@@ -0,0 +1,244 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <FrameDropReason.h>
+#include <FrameQueueBudget.h>
+#include <FrameQueueDropPolicy.h>
+#include <synthetic_capture/ScriptedCaptureBench.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	static const timingclocktime_t DROP_POLICY_TICKS_PER_SECOND = 10000000LL;
+
+
+	// Runs steady frames around a burst which overflows a queue of 4
+	static ScriptedCaptureBenchResult RunBurst(
+		const FrameQueueDropPolicyConfig& frameQueueDropPolicy,
+		size_t frameQueueMaxBytes = 0,
+		VideoFrameEncoding videoFrameEncoding = VideoFrameEncoding::BGRA_8BIT)
+	{
+		DisplayModeSharedPtr displayMode = std::make_shared<DisplayMode>(640, 360, false /* interlaced */, 24000, 1000);
+
+		ScriptedCaptureTimeline timeline(*displayMode, DROP_POLICY_TICKS_PER_SECOND, 10.0);
+		timeline.Steady(24).Burst(8).Steady(24);
+
+		ScriptedCaptureBenchConfig config;
+		config.displayMode = displayMode;
+		config.videoFrameEncoding = videoFrameEncoding;
+		config.frameQueueMaxSize = 4;
+		config.frameQueueDropPolicy = frameQueueDropPolicy;
+		config.frameQueueMaxBytes = frameQueueMaxBytes;
+
+		return ScriptedCaptureBench(config).Run(timeline);
+	}
+
+
+	static uint64_t Dropped(const ScriptedCaptureBenchResult& result, FrameDropReason reason)
+	{
+		return result.droppedFramesPerReason[(size_t)reason];
+	}
+
+
+	TEST_CLASS(FrameQueueDropPolicyTests)
+	{
+	public:
+
+		TEST_METHOD(FrameDropCounterTest)
+		{
+			CFrameDropCounter counter;
+			Assert::AreEqual((uint64_t)0, counter.Total());
+
+			counter.Add(FrameDropReason::FRAMEDROP_OVERFLOW);
+			counter.Add(FrameDropReason::FRAMEDROP_OVERFLOW);
+			counter.Add(FrameDropReason::FRAMEDROP_RESET);
+
+			Assert::AreEqual((uint64_t)2, counter.Count(FrameDropReason::FRAMEDROP_OVERFLOW));
+			Assert::AreEqual((uint64_t)1, counter.Count(FrameDropReason::FRAMEDROP_RESET));
+			Assert::AreEqual((uint64_t)0, counter.Count(FrameDropReason::FRAMEDROP_LATE));
+			Assert::AreEqual((uint64_t)3, counter.Total());
+
+			counter.Reset();
+			Assert::AreEqual((uint64_t)0, counter.Total());
+
+			Assert::ExpectException<std::runtime_error>([]() { ToString(FrameDropReason::FRAMEDROP_REASONS); });
+		}
+
+
+		TEST_METHOD(FrameQueueBudgetTest)
+		{
+			CFrameQueueBudget budget;
+			budget.SetMaxFrames(8);
+			Assert::AreEqual((size_t)8, budget.FrameLimit());
+			Assert::IsFalse(budget.IsByteBound());
+
+			// No byte limit until there is one and a frame size to count it with
+			budget.SetMaxBytes(1000);
+			Assert::AreEqual((size_t)8, budget.FrameLimit());
+
+			budget.SetFrameBytes(300);
+			Assert::AreEqual((size_t)3, budget.FrameLimit());
+			Assert::IsTrue(budget.IsByteBound());
+			Assert::IsFalse(budget.IsFull(2));
+			Assert::IsTrue(budget.IsFull(3));
+			Assert::AreEqual((size_t)900, budget.Bytes(3));
+
+			// The lower of the two
+			budget.SetMaxFrames(2);
+			Assert::AreEqual((size_t)2, budget.FrameLimit());
+			Assert::IsFalse(budget.IsByteBound());
+
+			// A frame larger than the budget still gets the frames delivery needs, but no more than the max size
+			budget.SetMaxFrames(8);
+			budget.SetFrameBytes(5000);
+			Assert::AreEqual((size_t)1, budget.FrameLimit());
+			budget.SetMinimumFrames(2);
+			Assert::AreEqual((size_t)2, budget.FrameLimit());
+			budget.SetMaxFrames(1);
+			Assert::AreEqual((size_t)1, budget.FrameLimit());
+
+			budget.SetMaxBytes(0);
+			budget.SetMaxFrames(8);
+			Assert::AreEqual((size_t)8, budget.FrameLimit());
+
+			Assert::ExpectException<std::runtime_error>([&]() { budget.SetMaxFrames(0); });
+			Assert::ExpectException<std::runtime_error>([&]() { budget.SetMinimumFrames(0); });
+		}
+
+
+		TEST_METHOD(FrameQueueDropPolicySimpleTest)
+		{
+			FrameQueueDropPolicyConfig config;
+
+			std::unique_ptr<IFrameQueueDropPolicy> policy = CreateFrameQueueDropPolicy(config);
+			Assert::IsTrue(policy->OnOverflow(10, 6, 9) == FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_OLDEST);
+			Assert::IsFalse(policy->OnDequeue(1000.0, true));
+
+			config.type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_NEWEST;
+			policy = CreateFrameQueueDropPolicy(config);
+			Assert::IsTrue(policy->OnOverflow(10, 6, 9) == FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_INCOMING);
+			Assert::IsFalse(policy->OnDequeue(1000.0, true));
+
+			// Late only if there is something newer to show instead
+			config.type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_LATENCY_BOUNDED;
+			config.latencyBoundMs = 40.0;
+			policy = CreateFrameQueueDropPolicy(config);
+			Assert::IsTrue(policy->OnOverflow(10, 6, 9) == FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_OLDEST);
+			Assert::IsFalse(policy->OnDequeue(39.0, true));
+			Assert::IsTrue(policy->OnDequeue(41.0, true));
+			Assert::IsFalse(policy->OnDequeue(41.0, false));
+
+			config.latencyBoundMs = 0.0;
+			Assert::ExpectException<std::runtime_error>([&]() { CreateFrameQueueDropPolicy(config); });
+		}
+
+
+		TEST_METHOD(FrameQueueDropPolicyCadenceTest)
+		{
+			// 3:2, counters 2, 7, 12.. start a three and 0, 5, 10.. a two
+			const CCadenceFrameQueueDropPolicy policy({ 3, 2 }, 12);
+
+			const bool repeats[] = { false, true, false, true, true, false, true };
+			for (uint64_t counter = 0; counter < 7; counter++)
+				Assert::AreEqual(repeats[counter], policy.IsRepeat(counter));
+
+			Assert::IsFalse(policy.IsRepeat(1000002));
+			Assert::IsTrue(policy.IsRepeat(1000003));
+
+			// Repeats go first, arriving before queued and oldest before newest
+			Assert::IsTrue(policy.OnOverflow(8, 2, 5) == FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_INCOMING);
+			Assert::IsTrue(policy.OnOverflow(7, 3, 6) == FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_OLDEST);
+			Assert::IsTrue(policy.OnOverflow(7, 2, 6) == FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_NEWEST);
+			Assert::IsTrue(policy.OnOverflow(7, 2, 5) == FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_OLDEST);
+			Assert::IsFalse(policy.OnDequeue(1000.0, true));
+
+			// Without repeats it's drop oldest
+			const CCadenceFrameQueueDropPolicy noRepeats({ 1 }, 0);
+			Assert::IsTrue(noRepeats.OnOverflow(7, 3, 6) == FrameQueueOverflowAction::FRAMEQUEUEOVERFLOW_DROP_OLDEST);
+
+			Assert::ExpectException<std::runtime_error>([]() { CCadenceFrameQueueDropPolicy({}, 0); });
+			Assert::ExpectException<std::runtime_error>([]() { CCadenceFrameQueueDropPolicy({ 3, 0 }, 0); });
+		}
+
+
+		TEST_METHOD(FrameQueueDropPolicyBurstTest)
+		{
+			FrameQueueDropPolicyConfig config;
+
+			// The same amount makes way at either end of the burst
+			const ScriptedCaptureBenchResult oldest = RunBurst(config);
+			Assert::IsTrue(oldest.droppedFrames > 0);
+			Assert::AreEqual(oldest.droppedFrames, Dropped(oldest, FrameDropReason::FRAMEDROP_OVERFLOW));
+			Assert::AreEqual(oldest.arrivedFrames, oldest.deliveredFrames + oldest.droppedFrames);
+
+			config.type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_NEWEST;
+			const ScriptedCaptureBenchResult newest = RunBurst(config);
+			Assert::AreEqual(oldest.droppedFrames, newest.droppedFrames);
+			Assert::AreEqual(newest.droppedFrames, Dropped(newest, FrameDropReason::FRAMEDROP_OVERFLOW));
+
+			// Drop newest delivers the first frames of the burst, which are the oldest
+			Assert::IsTrue(newest.exitLatency.maxMs > oldest.exitLatency.maxMs);
+
+			// The burst's frames are stale, the bound skips ahead to the newer ones
+			config.type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_LATENCY_BOUNDED;
+			config.latencyBoundMs = 60.0;
+			const ScriptedCaptureBenchResult bounded = RunBurst(config);
+			Assert::IsTrue(Dropped(bounded, FrameDropReason::FRAMEDROP_LATE) > 0);
+			Assert::AreEqual(bounded.droppedFrames,
+				Dropped(bounded, FrameDropReason::FRAMEDROP_OVERFLOW) + Dropped(bounded, FrameDropReason::FRAMEDROP_LATE));
+			Assert::AreEqual(bounded.arrivedFrames, bounded.deliveredFrames + bounded.droppedFrames);
+			Assert::IsTrue(bounded.exitLatency.maxMs < oldest.exitLatency.maxMs);
+		}
+
+
+		// A byte limit below the max size overflows the queue sooner, under the same policy
+		TEST_METHOD(FrameQueueByteBudgetBurstTest)
+		{
+			const FrameQueueDropPolicyConfig config;
+			const size_t frameBytes = 640 * 360 * 4;
+
+			const ScriptedCaptureBenchResult frames = RunBurst(config);
+			Assert::AreEqual((size_t)4, frames.maxQueueSize);
+			Assert::AreEqual(4 * frameBytes, frames.maxQueueBytes);
+
+			const ScriptedCaptureBenchResult bytes = RunBurst(config, frameBytes * 5 / 2);
+			Assert::AreEqual((size_t)2, bytes.maxQueueSize);
+			Assert::AreEqual(2 * frameBytes, bytes.maxQueueBytes);
+			Assert::IsTrue(bytes.droppedFrames > frames.droppedFrames);
+			Assert::AreEqual(bytes.droppedFrames, Dropped(bytes, FrameDropReason::FRAMEDROP_OVERFLOW));
+			Assert::AreEqual(bytes.arrivedFrames, bytes.deliveredFrames + bytes.droppedFrames);
+
+			// More than the max size allows changes nothing
+			const ScriptedCaptureBenchResult loose = RunBurst(config, frameBytes * 100);
+			Assert::AreEqual(frames.droppedFrames, loose.droppedFrames);
+			Assert::AreEqual((size_t)4, loose.maxQueueSize);
+		}
+
+
+		// The queue holds formatted frames, R12B comes in at 4.5 bytes a pixel and is queued as 6 byte RGB48
+		TEST_METHOD(FrameQueueByteBudgetFormattedTest)
+		{
+			const FrameQueueDropPolicyConfig config;
+			const size_t inFrameBytes = 640 * 360 * 36 / 8;
+			const size_t outFrameBytes = 640 * 360 * 6;
+
+			// Room for 3 frames as they came in but only 2 as they are queued
+			const size_t maxBytes = outFrameBytes * 5 / 2;
+			Assert::AreEqual((size_t)3, maxBytes / inFrameBytes);
+
+			const ScriptedCaptureBenchResult bytes = RunBurst(config, maxBytes, VideoFrameEncoding::R12B);
+			Assert::AreEqual((size_t)2, bytes.maxQueueSize);
+			Assert::AreEqual(2 * outFrameBytes, bytes.maxQueueBytes);
+			Assert::AreEqual(bytes.droppedFrames, Dropped(bytes, FrameDropReason::FRAMEDROP_OVERFLOW));
+			Assert::AreEqual(bytes.arrivedFrames, bytes.deliveredFrames + bytes.droppedFrames);
+
+			// Without a byte limit the bytes follow the formatted size too
+			const ScriptedCaptureBenchResult frames = RunBurst(config, 0, VideoFrameEncoding::R12B);
+			Assert::AreEqual((size_t)4, frames.maxQueueSize);
+			Assert::AreEqual(4 * outFrameBytes, frames.maxQueueBytes);
+			Assert::IsTrue(bytes.droppedFrames > frames.droppedFrames);
+		}
+	};
+}
@@ -0,0 +1,318 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <thread>
+#include <random>
+#include <vector>
+
+#include <FrameQueue.h>
+#include <SpscRingBuffer.h>
+#include <synthetic_capture/SimulatedTimingClock.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	// Item where every field holds the same value, so torn copies are easy to spot
+	struct RingItem
+	{
+		uint64_t a;
+		uint64_t b;
+		uint64_t c;
+	};
+
+
+	// Keeps the buffers a CFrameQueue gives back in the order it does
+	class RecordingFrameQueueCallback:
+		public IFrameQueueCallback<int>
+	{
+	public:
+
+		void OnFrameQueueRelease(int buffer) override { released.push_back(buffer); }
+
+		std::vector<int> released;
+	};
+
+
+	TEST_CLASS(FrameQueueTests)
+	{
+	public:
+
+		TEST_METHOD(SpscRingBufferPushPopTest)
+		{
+			CSpscRingBuffer<RingItem> ring(5);
+			RingItem item;
+
+			Assert::AreEqual(5u, ring.Capacity());
+			Assert::IsTrue(ring.Empty());
+			Assert::IsFalse(ring.PopFront(item));
+			Assert::IsFalse(ring.DropFront(item));
+			Assert::IsFalse(ring.PopBack(item));
+			Assert::IsFalse(ring.PeekFront(item));
+			Assert::IsFalse(ring.PeekBack(item));
+
+			for (uint64_t i = 0; i < 5; i++)
+				Assert::IsTrue(ring.PushBack({ i, i, i }));
+
+			// Full at the capacity, not at the internal power of two
+			Assert::IsFalse(ring.PushBack({ 5, 5, 5 }));
+			Assert::AreEqual(5u, ring.Size());
+
+			Assert::IsTrue(ring.PopBack(item));
+			Assert::AreEqual((uint64_t)4, item.a);
+
+			Assert::IsTrue(ring.PopFront(item));
+			Assert::AreEqual((uint64_t)0, item.a);
+
+			Assert::IsTrue(ring.DropFront(item));
+			Assert::AreEqual((uint64_t)1, item.a);
+
+			Assert::IsTrue(ring.PeekFront(item));
+			Assert::AreEqual((uint64_t)2, item.a);
+
+			Assert::IsTrue(ring.PeekBack(item));
+			Assert::AreEqual((uint64_t)3, item.a);
+
+			Assert::AreEqual(2u, ring.Size());
+		}
+
+		TEST_METHOD(SpscRingBufferWrapTest)
+		{
+			// Runs the 24-bit counters around twice, order must hold throughout
+			CSpscRingBuffer<RingItem> ring(3);
+			uint64_t expected = 0;
+
+			for (uint64_t i = 0; i < (2 << 24) + 1000; i++)
+			{
+				Assert::IsTrue(ring.PushBack({ i, i, i }));
+
+				if (ring.Size() == ring.Capacity() || (i % 2))
+				{
+					RingItem item;
+					Assert::IsTrue(ring.PopFront(item));
+					Assert::AreEqual(expected, item.a);
+					++expected;
+				}
+			}
+		}
+
+		TEST_METHOD(SpscRingBufferCloseTest)
+		{
+			CSpscRingBuffer<RingItem> ring(4);
+
+			std::thread consumer([&ring]() {
+				// Only returns on close
+				Assert::IsFalse(ring.WaitForSize(1));
+			});
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			ring.Close();
+			consumer.join();
+
+			Assert::IsTrue(ring.IsClosed());
+			Assert::IsFalse(ring.WaitForSize(0));
+		}
+
+		TEST_METHOD(SpscRingBufferConcurrentTest)
+		{
+			// Producer pushes and drops from both ends like the buffered pin, consumer waits, peeks and takes.
+			// Every item must end up either dropped or consumed, exactly once and in order. A capacity which
+			// is a power of two has a drop of the oldest followed by a push re-use the slot at the front.
+			CSpscRingBuffer<RingItem> ring(8);
+
+			const uint64_t items = 2000000;
+			uint64_t dropped = 0;
+			uint64_t consumed = 0;
+			bool consumerValid = true;
+
+			std::thread consumer([&]() {
+				uint64_t last = 0;
+				RingItem item;
+
+				while (ring.WaitForSize(1))
+				{
+					if (ring.PeekFront(item))
+						consumerValid &= (item.a == item.b && item.b == item.c);
+
+					if (ring.PopFront(item))
+					{
+						consumerValid &= (item.a == item.b && item.b == item.c && item.a > last);
+						last = item.a;
+						++consumed;
+					}
+				}
+
+				while (ring.PopFront(item))
+					++consumed;
+			});
+
+			std::mt19937 rng(42);
+			RingItem item;
+
+			for (uint64_t i = 1; i <= items; i++)
+			{
+				if (rng() % 7 == 0 && ring.PopBack(item))
+				{
+					Assert::IsTrue(item.a == item.b && item.b == item.c);
+					++dropped;
+				}
+
+				while (ring.Size() >= ring.Capacity())
+				{
+					if (ring.DropFront(item))
+					{
+						Assert::IsTrue(item.a == item.b && item.b == item.c);
+						++dropped;
+					}
+				}
+
+				Assert::IsTrue(ring.PushBack({ i, i, i }));
+			}
+
+			ring.Close();
+			consumer.join();
+
+			Assert::IsTrue(consumerValid);
+			Assert::AreEqual(items, dropped + consumed);
+		}
+
+		TEST_METHOD(FrameQueueReorderAndOverflowTest)
+		{
+			RecordingFrameQueueCallback callback;
+			CFrameDropCounter droppedFrames;
+			SimulatedTimingClock timingClock(1000);
+			CFrameQueue<int> queue(callback, droppedFrames);
+
+			queue.SetMaxFrames(3);
+			queue.Open(8, &timingClock);
+
+			// Buffer, counter, timing timestamp, queued time
+			Assert::IsTrue(queue.Push({ 1, 1, 10, 0 }));
+			Assert::IsTrue(queue.Push({ 2, 2, 20, 0 }));
+
+			// Not after the one before it, supersedes it
+			Assert::IsTrue(queue.Push({ 3, 3, 20, 0 }));
+			Assert::AreEqual((uint64_t)1, droppedFrames.Count(FrameDropReason::FRAMEDROP_REORDER));
+			Assert::AreEqual((size_t)2, queue.Size());
+
+			// Full at the max frames, not the capacity, the oldest makes way
+			Assert::IsTrue(queue.Push({ 4, 4, 30, 0 }));
+			Assert::IsTrue(queue.Push({ 5, 5, 40, 0 }));
+			Assert::AreEqual((uint64_t)1, droppedFrames.Count(FrameDropReason::FRAMEDROP_OVERFLOW));
+			Assert::AreEqual((size_t)3, queue.Size());
+
+			// Shrinking drops the oldest right away, down to where there is space for the next one
+			queue.SetMaxFrames(2);
+			Assert::AreEqual((uint64_t)3, droppedFrames.Count(FrameDropReason::FRAMEDROP_OVERFLOW));
+			Assert::AreEqual((size_t)1, queue.Size());
+
+			// The oldest can be taken back to format into
+			int buffer = 0;
+			Assert::IsTrue(queue.TakeOldestBuffer(buffer));
+			Assert::AreEqual(5, buffer);
+			Assert::AreEqual((uint64_t)4, droppedFrames.Count(FrameDropReason::FRAMEDROP_OVERFLOW));
+			Assert::IsFalse(queue.TakeOldestBuffer(buffer));
+
+			CFrameQueue<int>::Frame frame, nextFrame;
+			bool hasNextFrame;
+			Assert::IsTrue(queue.Push({ 6, 6, 50, 0 }));
+			Assert::IsTrue(queue.TakeNext(frame, nextFrame, hasNextFrame));
+			Assert::AreEqual(6, frame.buffer);
+			Assert::IsFalse(hasNextFrame);
+			Assert::IsFalse(queue.TakeNext(frame, nextFrame, hasNextFrame));
+
+			// Closed drops what's pushed, purge what's left
+			Assert::IsTrue(queue.Push({ 7, 7, 60, 0 }));
+			queue.Close();
+			Assert::IsFalse(queue.Push({ 8, 8, 70, 0 }));
+			queue.Purge();
+			Assert::AreEqual((uint64_t)1, droppedFrames.Count(FrameDropReason::FRAMEDROP_RESET));
+			Assert::AreEqual((size_t)0, queue.Size());
+
+			// Taken and delivered buffers are the owner's, the rest came back
+			Assert::IsTrue(std::vector<int>({ 2, 1, 3, 4, 8, 7 }) == callback.released);
+		}
+
+		TEST_METHOD(FrameQueueDropPolicyTest)
+		{
+			RecordingFrameQueueCallback callback;
+			CFrameDropCounter droppedFrames;
+			SimulatedTimingClock timingClock(1000);
+			CFrameQueue<int> queue(callback, droppedFrames);
+
+			FrameQueueDropPolicyConfig config;
+			config.type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_NEWEST;
+			queue.SetDropPolicy(config);
+			queue.SetMaxFrames(2);
+			queue.Open(4, &timingClock);
+
+			// Can't be swapped under the consumer
+			Assert::ExpectException<std::runtime_error>([&]() { queue.SetDropPolicy(config); });
+
+			Assert::IsTrue(queue.Push({ 1, 1, 10, 0 }));
+			Assert::IsTrue(queue.Push({ 2, 2, 20, 0 }));
+			Assert::IsFalse(queue.Push({ 3, 3, 30, 0 }));
+			Assert::AreEqual((uint64_t)1, droppedFrames.Count(FrameDropReason::FRAMEDROP_OVERFLOW));
+			Assert::IsTrue(std::vector<int>({ 3 }) == callback.released);
+
+			queue.Close();
+			queue.Purge();
+
+			// Late frames go on the way out, but not the last one
+			config.type = FrameQueueDropPolicyType::FRAMEQUEUEDROP_LATENCY_BOUNDED;
+			config.latencyBoundMs = 50.0;
+			queue.SetDropPolicy(config);
+			queue.Open(4, &timingClock);
+
+			Assert::IsTrue(queue.Push({ 4, 4, 100, 0 }));
+			Assert::IsTrue(queue.Push({ 5, 5, 110, 0 }));
+			timingClock.SetNow(200);
+
+			CFrameQueue<int>::Frame frame, nextFrame;
+			bool hasNextFrame;
+			Assert::IsTrue(queue.TakeNext(frame, nextFrame, hasNextFrame));
+			Assert::AreEqual(5, frame.buffer);
+			Assert::AreEqual((uint64_t)1, droppedFrames.Count(FrameDropReason::FRAMEDROP_LATE));
+		}
+
+		TEST_METHOD(FrameQueueNextFrameTest)
+		{
+			RecordingFrameQueueCallback callback;
+			CFrameDropCounter droppedFrames;
+			SimulatedTimingClock timingClock(1000);
+			CFrameQueue<int> queue(callback, droppedFrames);
+
+			queue.SetNeedsNextFrame(true);
+			queue.SetMaxFrames(4);
+			queue.Open(4, &timingClock);
+
+			Assert::ExpectException<std::runtime_error>([&]() { queue.SetNeedsNextFrame(false); });
+
+			CFrameQueue<int>::Frame frame, nextFrame;
+			bool hasNextFrame;
+
+			// A frame is only delivered once the one after it is in
+			Assert::IsTrue(queue.Push({ 1, 1, 10, 0 }));
+			Assert::IsFalse(queue.TakeNext(frame, nextFrame, hasNextFrame));
+			Assert::IsTrue(queue.Push({ 2, 2, 20, 0 }));
+
+			Assert::IsTrue(queue.WaitForNext(frame, nextFrame, hasNextFrame));
+			Assert::AreEqual(1, frame.buffer);
+			Assert::IsTrue(hasNextFrame);
+			Assert::AreEqual(2, nextFrame.buffer);
+
+			// Waits for more, until closed
+			std::thread consumer([&]() {
+				Assert::IsFalse(queue.WaitForNext(frame, nextFrame, hasNextFrame));
+			});
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			queue.Close();
+			consumer.join();
+
+			queue.Purge();
+			Assert::IsTrue(std::vector<int>({ 2 }) == callback.released);
+		}
+	};
+}
@@ -0,0 +1,233 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <headless_renderer/HeadlessVideoRenderer.h>
+#include <headless_renderer/HeadlessFrameSinks.h>
+#include <synthetic_capture/SyntheticCaptureDevice.h>
+#include <video_frame_formatter/CV210toP210VideoFrameFormatter.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	// Keeps the last renderer state
+	class HeadlessVideoRendererTestCallback:
+		public IRendererCallback
+	{
+	public:
+
+		void OnRendererState(RendererState rendererState) override { state = rendererState; }
+		void OnRendererDetailString(const CString&) override {}
+
+		RendererState state = RendererState::RENDERSTATE_UNKNOWN;
+	};
+
+
+	// Forwards what the synthetic capture device sends to a renderer, like the GUI does
+	class HeadlessVideoRendererTestCaptureCallback:
+		public ICaptureDeviceCallback
+	{
+	public:
+
+		HeadlessVideoRendererTestCaptureCallback(IVideoRenderer& renderer):
+			m_renderer(renderer)
+		{
+		}
+
+		void OnCaptureDeviceState(CaptureDeviceState) override {}
+		void OnCaptureDeviceCardStateChange(CaptureDeviceCardStateComPtr) override {}
+		void OnCaptureDeviceVideoStateChange(VideoStateComPtr) override {}
+		void OnCaptureDeviceVideoFrame(VideoFrame& videoFrame) override { m_renderer.OnVideoFrame(videoFrame); }
+		void OnCaptureDeviceError(const CString&) override {}
+
+	private:
+
+		IVideoRenderer& m_renderer;
+	};
+
+
+	TEST_CLASS(HeadlessVideoRendererTests)
+	{
+	public:
+
+		TEST_METHOD(DirectShowFrameTimestamperTest)
+		{
+			const DisplayModeSharedPtr displayMode = std::make_shared<DisplayMode>(1920, 1080, false /* interlaced */, 24000, 1000);
+			SyntheticCaptureDevice timingClock(SyntheticCaptureSignal{ displayMode });
+			const timingclocktime_t tps = timingClock.TimingClockTicksPerSecond();
+
+			// Theoretical start and stop from the stream frame counter, which starts at zero.
+			// Frames are 416666.67 100ns units long.
+			DirectShowFrameTimestamper theoTheo;
+			theoTheo.Initialize(displayMode->FrameTimebase(UNITS), &timingClock, DirectShowStartStopTimeMethod::DS_SSTM_THEO_THEO);
+
+			DirectShowFrameTimes times = theoTheo.Timestamp(100, tps, REFERENCE_TIME_INVALID);
+			Assert::IsTrue(times.discontinuity);
+			Assert::AreEqual((uint64_t)0, times.streamFrameCounter);
+			Assert::AreEqual((REFERENCE_TIME)0, times.timeStart);
+			Assert::AreEqual((REFERENCE_TIME)416666, times.timeStop);
+
+			times = theoTheo.Timestamp(101, tps * 2, REFERENCE_TIME_INVALID);
+			Assert::IsFalse(times.discontinuity);
+			Assert::AreEqual((LONGLONG)1, times.mediaTimeStart);
+			Assert::AreEqual((REFERENCE_TIME)416666, times.timeStart);
+			Assert::AreEqual((REFERENCE_TIME)833333, times.timeStop);
+
+			// Skipped a frame, exactly three frames in without adding up the rounding
+			times = theoTheo.Timestamp(103, tps * 3, REFERENCE_TIME_INVALID);
+			Assert::IsTrue(times.discontinuity);
+			Assert::AreEqual((REFERENCE_TIME)1250000, times.timeStart);
+			Assert::AreEqual((uint64_t)3, theoTheo.FrameCount());
+
+			// Clock start relative to the first frame, stop from the next frame
+			DirectShowFrameTimestamper clockClock;
+			clockClock.Initialize(displayMode->FrameTimebase(UNITS), &timingClock, DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK);
+
+			times = clockClock.Timestamp(1, tps, clockClock.ToReferenceTime(tps + tps / 24));
+			Assert::AreEqual((REFERENCE_TIME)0, times.timeStart);
+			Assert::AreEqual((REFERENCE_TIME)416666, times.timeStop);
+
+			times = clockClock.Timestamp(2, tps + tps / 24, clockClock.ToReferenceTime(tps + 2 * tps / 24));
+			Assert::AreEqual((REFERENCE_TIME)416666, times.timeStart);
+			Assert::AreEqual((REFERENCE_TIME)833333, times.timeStop);
+
+			// No stop
+			DirectShowFrameTimestamper clockNone;
+			clockNone.Initialize(displayMode->FrameTimebase(UNITS), &timingClock, DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_NONE);
+			times = clockNone.Timestamp(1, tps, REFERENCE_TIME_INVALID);
+			Assert::AreEqual((REFERENCE_TIME)0, times.timeStart);
+			Assert::AreEqual(REFERENCE_TIME_INVALID, times.timeStop);
+
+			clockNone.Reset();
+			Assert::AreEqual((uint64_t)0, clockNone.FrameCount());
+		}
+
+		// Synthetic capture through the queue into the checksum sink, the output has to be what the formatter makes of it
+		TEST_METHOD(HeadlessVideoRendererQueueTest)
+		{
+			SyntheticCaptureSignal signal;
+			signal.displayMode = std::make_shared<DisplayMode>(1920, 1080, false /* interlaced */, 24000, 1000);
+			signal.videoFrameEncoding = VideoFrameEncoding::V210;
+			signal.pattern = SyntheticFramePattern::COLOR_BARS;
+
+			CComPtr<SyntheticCaptureDevice> captureDevice = new SyntheticCaptureDevice(signal);
+
+			VideoStateComPtr videoState = new VideoState();
+			videoState->valid = true;
+			videoState->displayMode = signal.displayMode;
+			videoState->videoFrameEncoding = signal.videoFrameEncoding;
+			videoState->eotf = signal.eotf;
+			videoState->colorspace = signal.colorspace;
+
+			HeadlessVideoRendererTestCallback rendererCallback;
+			CChecksumHeadlessFrameSink sink;
+			HeadlessVideoRenderer renderer(
+				rendererCallback, sink, captureDevice,
+				DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK,
+				true, 4,
+				VideoConversionOverride::VIDEOCONVERSION_NONE);
+
+			Assert::IsTrue(renderer.OnVideoState(videoState));
+			renderer.Build();
+			Assert::IsTrue(rendererCallback.state == RendererState::RENDERSTATE_READY);
+
+			renderer.Start();
+			Assert::IsTrue(rendererCallback.state == RendererState::RENDERSTATE_RENDERING);
+
+			HeadlessVideoRendererTestCaptureCallback captureCallback(renderer);
+			captureDevice->SetCallbackHandler(&captureCallback);
+			captureDevice->StartCapture();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+			// Clock-clock holds one back
+			Assert::IsTrue(renderer.GetFrameQueueSize() >= 1);
+			Assert::AreEqual((uint64_t)0, renderer.DroppedFrameCount());
+			Assert::IsTrue(renderer.EntryLatencyMs() >= 0.0);
+			Assert::IsTrue(renderer.ExitLatencyMs() >= 0.0);
+
+			captureDevice->StopCapture();
+			captureDevice->SetCallbackHandler(nullptr);
+			renderer.Stop();
+			Assert::IsTrue(rendererCallback.state == RendererState::RENDERSTATE_STOPPED);
+
+			const uint64_t frames = sink.SinkFrameCount();
+			Assert::IsTrue(frames > 15);
+			Assert::IsTrue(frames + 1 >= captureDevice->VideoFrameCapturedCount());
+
+			// Every delivered frame has its latencies recorded
+			LatencyHistogramCounts counts;
+			renderer.LatencyHistograms().exit.Snapshot(counts);
+			Assert::AreEqual(frames, CLatencyHistogram::Summarize(LatencyHistogramCounts(), counts).count);
+			renderer.LatencyHistograms().queueWait.Snapshot(counts);
+			Assert::AreEqual(frames, CLatencyHistogram::Summarize(LatencyHistogramCounts(), counts).count);
+
+			// Color bars are the same every frame, compare to formatting one directly
+			CV210toP210VideoFrameFormatter vff;
+			vff.OnVideoState(videoState);
+			std::vector<uint8_t> out(vff.GetOutFrameSize());
+
+			// Grab a frame from the device without a renderer
+			class FrameGrab: public ICaptureDeviceCallback
+			{
+			public:
+				FrameGrab(IVideoFrameFormatter& vff, std::vector<uint8_t>& out): vff(vff), out(out) {}
+				void OnCaptureDeviceState(CaptureDeviceState) override {}
+				void OnCaptureDeviceCardStateChange(CaptureDeviceCardStateComPtr) override {}
+				void OnCaptureDeviceVideoStateChange(VideoStateComPtr) override {}
+				void OnCaptureDeviceVideoFrame(VideoFrame& videoFrame) override { vff.FormatVideoFrame(videoFrame, out.data()); }
+				void OnCaptureDeviceError(const CString&) override {}
+				IVideoFrameFormatter& vff;
+				std::vector<uint8_t>& out;
+			} frameGrab(vff, out);
+
+			captureDevice->SetCallbackHandler(&frameGrab);
+			captureDevice->StartCapture();
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			captureDevice->StopCapture();
+			captureDevice->SetCallbackHandler(nullptr);
+
+			Assert::AreEqual(CChecksumHeadlessFrameSink::Checksum(out.data(), out.size()), sink.LastFrameChecksum());
+		}
+
+		// Without a queue the frame is delivered before OnVideoFrame() returns
+		TEST_METHOD(HeadlessVideoRendererNoQueueTest)
+		{
+			SyntheticCaptureDevice timingClock(SyntheticCaptureSignal{ std::make_shared<DisplayMode>(1920, 1080, false /* interlaced */, 24000, 1000) });
+
+			VideoStateComPtr videoState = new VideoState();
+			videoState->valid = true;
+			videoState->displayMode = std::make_shared<DisplayMode>(1920, 1080, false /* interlaced */, 24000, 1000);
+			videoState->videoFrameEncoding = VideoFrameEncoding::R12B;
+
+			HeadlessVideoRendererTestCallback rendererCallback;
+			CDiscardHeadlessFrameSink sink;
+			HeadlessVideoRenderer renderer(
+				rendererCallback, sink, &timingClock,
+				DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_THEO,
+				false, 0,
+				VideoConversionOverride::VIDEOCONVERSION_NONE);
+
+			Assert::IsTrue(renderer.OnVideoState(videoState));
+			renderer.Build();
+			renderer.Start();
+
+			std::vector<uint8_t> in(videoState->BytesPerFrame(), 0);
+			for (uint64_t i = 1; i <= 10; i++)
+			{
+				VideoFrame videoFrame(in.data(), i, timingClock.TimingClockNow(), nullptr);
+				renderer.OnVideoFrame(videoFrame);
+				Assert::AreEqual(i, sink.SinkFrameCount());
+			}
+
+			Assert::AreEqual((size_t)0, renderer.GetFrameQueueSize());
+			Assert::AreEqual((uint64_t)0, renderer.DroppedFrameCount());
+
+			renderer.Stop();
+		}
+	};
+}
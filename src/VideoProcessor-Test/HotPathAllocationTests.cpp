@@ -0,0 +1,375 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <malloc.h>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <PipelineTrace.h>
+#include <headless_renderer/HeadlessVideoRenderer.h>
+#include <headless_renderer/HeadlessFrameSinks.h>
+#include <synthetic_capture/SimulatedTimingClock.h>
+#include <synthetic_capture/SyntheticCaptureDevice.h>
+
+#ifdef _DEBUG
+	#include <crtdbg.h>
+#endif
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+
+//
+// Every heap allocation in this module goes through these, from any thread
+//
+
+
+static std::atomic<bool> g_countAllocations{ false };
+static std::atomic<uint64_t> g_allocations{ 0 };
+
+
+static void* CountedAllocate(size_t size)
+{
+	if (g_countAllocations.load(std::memory_order_relaxed))
+		g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	return malloc(size ? size : 1);
+}
+
+
+void* operator new(size_t size)
+{
+	void* p = CountedAllocate(size);
+	if (!p)
+		throw std::bad_alloc();
+
+	return p;
+}
+
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAllocate(size);
+}
+
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return CountedAllocate(size);
+}
+
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+
+// Types aligned beyond the default, like the MpmcRingBuffer positions, get these from C++17 on
+#ifdef __cpp_aligned_new
+
+static void* CountedAllocateAligned(size_t size, std::align_val_t alignment)
+{
+	if (g_countAllocations.load(std::memory_order_relaxed))
+		g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	return _aligned_malloc(size ? size : 1, (size_t)alignment);
+}
+
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* p = CountedAllocateAligned(size, alignment);
+	if (!p)
+		throw std::bad_alloc();
+
+	return p;
+}
+
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return CountedAllocateAligned(size, alignment);
+}
+
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return CountedAllocateAligned(size, alignment);
+}
+
+
+void operator delete(void* p, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { _aligned_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { _aligned_free(p); }
+
+#endif
+
+
+namespace Tests
+{
+#ifdef _DEBUG
+	// The debug CRT also sees plain malloc() and friends
+	static int AllocationCounterCrtHook(int allocType, void*, size_t, int, long, const unsigned char*, int)
+	{
+		if (allocType != _HOOK_FREE && g_countAllocations.load(std::memory_order_relaxed))
+			g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+		return TRUE;
+	}
+#endif
+
+
+	/**
+	 * Counts the heap allocations of all threads while it lives.
+	 *
+	 * Every form of operator new is counted in all builds. Direct calls to malloc(), _aligned_malloc() and
+	 * the like are only seen through the debug CRT's allocation hook, so Release builds count operator new
+	 * only and it takes a Debug run to prove a path makes no allocations at all.
+	 */
+	class AllocationCounter
+	{
+	public:
+
+		AllocationCounter()
+		{
+#ifdef _DEBUG
+			m_previousCrtHook = _CrtSetAllocHook(AllocationCounterCrtHook);
+#endif
+			g_allocations = 0;
+			g_countAllocations = true;
+		}
+
+		~AllocationCounter()
+		{
+			Stop();
+
+#ifdef _DEBUG
+			_CrtSetAllocHook(m_previousCrtHook);
+#endif
+		}
+
+		uint64_t Stop()
+		{
+			g_countAllocations = false;
+			return g_allocations;
+		}
+
+	private:
+
+#ifdef _DEBUG
+		_CRT_ALLOC_HOOK m_previousCrtHook = nullptr;
+#endif
+	};
+
+
+	class HotPathRendererCallback:
+		public IRendererCallback
+	{
+	public:
+
+		void OnRendererState(RendererState) override {}
+		void OnRendererDetailString(const CString&) override {}
+	};
+
+
+	// Forwards frames to the renderer once it's rendering, like the GUI does
+	class HotPathCaptureCallback:
+		public ICaptureDeviceCallback
+	{
+	public:
+
+		HotPathCaptureCallback(IVideoRenderer& renderer):
+			m_renderer(renderer)
+		{
+		}
+
+		void OnCaptureDeviceState(CaptureDeviceState) override {}
+		void OnCaptureDeviceCardStateChange(CaptureDeviceCardStateComPtr) override {}
+		void OnCaptureDeviceVideoStateChange(VideoStateComPtr) override {}
+		void OnCaptureDeviceVideoFrame(VideoFrame& videoFrame) override { m_renderer.OnVideoFrame(videoFrame); }
+		void OnCaptureDeviceError(const CString&) override { ++m_errors; }
+
+		std::atomic<uint64_t> m_errors{ 0 };
+
+	private:
+
+		IVideoRenderer& m_renderer;
+	};
+
+
+	static VideoStateComPtr HotPathVideoState(DisplayModeSharedPtr displayMode)
+	{
+		VideoStateComPtr videoState = new VideoState();
+		videoState->valid = true;
+		videoState->displayMode = displayMode;
+		videoState->videoFrameEncoding = VideoFrameEncoding::V210;
+
+		return videoState;
+	}
+
+
+	TEST_CLASS(HotPathAllocationTests)
+	{
+	public:
+
+		// Makes sure the counter sees what it should, or the tests below prove nothing
+		TEST_METHOD(AllocationCounterTest)
+		{
+			AllocationCounter counter;
+
+			std::unique_ptr<int> p(new int(1));
+			std::thread([]() { std::vector<int> v(10); }).join();
+
+			Assert::IsTrue(counter.Stop() >= 2);
+		}
+
+#ifdef __cpp_aligned_new
+		TEST_METHOD(AllocationCounterAlignedTest)
+		{
+			struct alignas(64) Aligned { int i; };
+
+			AllocationCounter counter;
+
+			std::unique_ptr<Aligned> p(new Aligned());
+			std::unique_ptr<Aligned[]> a(new (std::nothrow) Aligned[4]);
+
+			Assert::IsTrue(counter.Stop() >= 2);
+			Assert::IsTrue(((uintptr_t)p.get() % 64) == 0);
+		}
+#endif
+
+
+		// Thousands of frames through the queue, formatter workers and sink on a simulated clock, with
+		// jitter so that frames are dropped as well. None of it may allocate after warming up.
+		TEST_METHOD(HotPathScriptedTest)
+		{
+			const DisplayModeSharedPtr displayMode = std::make_shared<DisplayMode>(1920, 1080, false /* interlaced */, 60, 1);
+			const VideoStateComPtr videoState = HotPathVideoState(displayMode);
+
+			const timingclocktime_t ticksPerSecond = 10000000;
+			const timingclocktime_t ticksPerFrame = ticksPerSecond / 60;
+			SimulatedTimingClock timingClock(ticksPerSecond, ticksPerSecond);
+
+			HotPathRendererCallback rendererCallback;
+			CChecksumHeadlessFrameSink sink;
+			HeadlessVideoRenderer renderer(
+				rendererCallback, sink, &timingClock,
+				DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_SMART,
+				true, 3,
+				VideoConversionOverride::VIDEOCONVERSION_NONE);
+			renderer.SetDeliveryThread(false);
+			renderer.SetFormatterThreads(2);
+
+			VideoStateComPtr rendererVideoState = videoState;
+			Assert::IsTrue(renderer.OnVideoState(rendererVideoState));
+			renderer.Build();
+			renderer.Start();
+
+			PipelineTrace::Start();
+
+			const std::vector<uint8_t> frameData(videoState->BytesPerFrame(), 0x40);
+			std::unique_ptr<AllocationCounter> counter;
+
+			const uint64_t warmUpFrames = 100;
+			const uint64_t frames = 5000;
+
+			for (uint64_t frame = 0; frame < warmUpFrames + frames; ++frame)
+			{
+				if (frame == warmUpFrames)
+					counter.reset(new AllocationCounter());
+
+				// Every now and then two frames at once, and two refreshes to catch up
+				const timingclocktime_t timingTimestamp = ticksPerSecond + (timingclocktime_t)frame * ticksPerFrame;
+				timingClock.SetNow(timingTimestamp + ((frame % 7 == 0) ? ticksPerFrame : ticksPerFrame / 2));
+
+				VideoFrame videoFrame(frameData.data(), frame, timingTimestamp, nullptr);
+				renderer.OnVideoFrame(videoFrame);
+
+				renderer.DeliverQueuedFrame();
+				if (frame % 7 == 1)
+					renderer.DeliverQueuedFrame();
+			}
+
+			const uint64_t allocations = counter->Stop();
+			counter.reset();
+
+			PipelineTrace::Stop();
+
+			Assert::IsTrue(sink.SinkFrameCount() > frames / 2);
+			Assert::AreEqual((uint64_t)0, allocations);
+
+			renderer.Stop();
+		}
+
+
+		// The synthetic capture device at a high rate into the renderer's delivery thread, all threads
+		// like in the application
+		TEST_METHOD(HotPathCaptureTest)
+		{
+			SyntheticCaptureSignal signal;
+			signal.displayMode = std::make_shared<DisplayMode>(720, 480, false /* interlaced */, 120, 1);
+			signal.videoFrameEncoding = VideoFrameEncoding::V210;
+			signal.pattern = SyntheticFramePattern::MOVING_GRADIENT;
+
+			CComPtr<SyntheticCaptureDevice> captureDevice = new SyntheticCaptureDevice(signal);
+
+			HotPathRendererCallback rendererCallback;
+			CChecksumHeadlessFrameSink sink;
+			HeadlessVideoRenderer renderer(
+				rendererCallback, sink, captureDevice,
+				DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_THEO,
+				true, 4,
+				VideoConversionOverride::VIDEOCONVERSION_NONE);
+
+			VideoStateComPtr videoState = HotPathVideoState(signal.displayMode);
+			Assert::IsTrue(renderer.OnVideoState(videoState));
+			renderer.Build();
+			renderer.Start();
+
+			HotPathCaptureCallback captureCallback(renderer);
+			captureDevice->SetCallbackHandler(&captureCallback);
+			captureDevice->StartCapture();
+
+			// All threads running and through their first frames
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+			const uint64_t firstFrame = sink.SinkFrameCount();
+			uint64_t allocations;
+			{
+				AllocationCounter counter;
+				std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+				allocations = counter.Stop();
+			}
+
+			const uint64_t frames = sink.SinkFrameCount() - firstFrame;
+
+			captureDevice->StopCapture();
+			captureDevice->SetCallbackHandler(nullptr);
+			renderer.Stop();
+
+			Assert::IsTrue(frames > 400);
+			Assert::AreEqual((uint64_t)0, captureCallback.m_errors.load());
+			Assert::AreEqual((uint64_t)0, allocations);
+		}
+	};
+}
@@ -0,0 +1,272 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+#include <InterpolatedTimingClock.h>
+#include <PerformanceCounterTimingClock.h>
+#include <synthetic_capture/SimulatedTimingClock.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	static const timingclocktime_t LOCAL_TICKS_PER_SECOND = 10000000LL;
+	static const timingclocktime_t REFERENCE_TICKS_PER_SECOND = 1000000000LL;
+
+
+	/**
+	 * Reference clock running off a simulated local clock at a rate offset, reading it takes time
+	 * like going through a driver does.
+	 */
+	class SlowReferenceClock:
+		public ITimingClock
+	{
+	public:
+
+		SlowReferenceClock(SimulatedTimingClock& localClock, double ppm):
+			m_localClock(localClock),
+			m_ppm(ppm)
+		{
+		}
+
+		// Reference at the given local time
+		timingclocktime_t At(timingclocktime_t local) const
+		{
+			return m_jump + (timingclocktime_t)llround(
+				local * (1.0 + m_ppm / 1000000.0) * REFERENCE_TICKS_PER_SECOND / LOCAL_TICKS_PER_SECOND);
+		}
+
+		timingclocktime_t TimingClockNow() override
+		{
+			++reads;
+
+			// Read somewhere during the call
+			std::uniform_int_distribution<timingclocktime_t> position(0, readTicks);
+			const timingclocktime_t start = m_localClock.TimingClockNow();
+			m_localClock.Advance(readTicks);
+
+			return At(start + position(m_random));
+		}
+
+		timingclocktime_t TimingClockTicksPerSecond() const override { return REFERENCE_TICKS_PER_SECOND; }
+		const TCHAR* TimingClockDescription() override { return TEXT("Slow reference"); }
+
+		void Jump(timingclocktime_t ticks) { m_jump += ticks; }
+
+		timingclocktime_t readTicks = 20;  // 2us
+		uint64_t reads = 0;
+
+	private:
+
+		SimulatedTimingClock& m_localClock;
+		const double m_ppm;
+		timingclocktime_t m_jump = 0;
+		std::mt19937 m_random;
+	};
+
+
+	TEST_CLASS(InterpolatedTimingClockTests)
+	{
+	public:
+
+		TEST_METHOD(InterpolatedTimingClockTracksReferenceTest)
+		{
+			SimulatedTimingClock localClock(LOCAL_TICKS_PER_SECOND, LOCAL_TICKS_PER_SECOND);
+			SlowReferenceClock referenceClock(localClock, 50.0);
+			CInterpolatedTimingClock timingClock(referenceClock, localClock);
+
+			Assert::AreEqual(REFERENCE_TICKS_PER_SECOND, timingClock.TimingClockTicksPerSecond());
+
+			// No fit yet, goes to the reference
+			timingClock.TimingClockNow();
+			Assert::AreEqual((uint64_t)1, referenceClock.reads);
+
+			// 50ms sampling for two seconds
+			for (int i = 0; i < 40; i++)
+			{
+				Assert::IsTrue(timingClock.Sample());
+				localClock.Advance(LOCAL_TICKS_PER_SECOND / 20);
+			}
+
+			Assert::AreEqual(50.0, timingClock.RateOffsetPpm(), 5.0);
+			Assert::IsTrue(timingClock.ErrorMs() < 0.01);
+
+			// In between samples reads stay off the reference and within the error
+			const uint64_t reads = referenceClock.reads;
+			for (int i = 0; i < 50; i++)
+			{
+				const double errorMs = TimingClockDiffMs(
+					referenceClock.At(localClock.TimingClockNow()), timingClock.TimingClockNow(), REFERENCE_TICKS_PER_SECOND);
+				Assert::IsTrue(std::abs(errorMs) <= timingClock.ErrorMs());
+
+				localClock.Advance(LOCAL_TICKS_PER_SECOND / 1000);
+			}
+
+			Assert::AreEqual(reads, referenceClock.reads);
+		}
+
+
+		TEST_METHOD(InterpolatedTimingClockMonotonicTest)
+		{
+			SimulatedTimingClock localClock(LOCAL_TICKS_PER_SECOND, LOCAL_TICKS_PER_SECOND);
+			SlowReferenceClock referenceClock(localClock, -120.0);
+			referenceClock.readTicks = 200;  // Noisy 20us reads
+
+			CInterpolatedTimingClock timingClock(referenceClock, localClock);
+
+			timingclocktime_t previous = 0;
+			for (int i = 0; i < 2000; i++)
+			{
+				if (i % 10 == 0)
+					timingClock.Sample();
+
+				const timingclocktime_t now = timingClock.TimingClockNow();
+				Assert::IsTrue(now >= previous);
+				previous = now;
+
+				localClock.Advance(LOCAL_TICKS_PER_SECOND / 200);
+			}
+
+			Assert::AreEqual(-120.0, timingClock.RateOffsetPpm(), 20.0);
+		}
+
+
+		TEST_METHOD(InterpolatedTimingClockRejectAndResetTest)
+		{
+			SimulatedTimingClock localClock(LOCAL_TICKS_PER_SECOND, LOCAL_TICKS_PER_SECOND);
+			SlowReferenceClock referenceClock(localClock, 0.0);
+			CInterpolatedTimingClock timingClock(referenceClock, localClock);
+
+			for (int i = 0; i < 5; i++)
+			{
+				Assert::IsTrue(timingClock.Sample());
+				localClock.Advance(LOCAL_TICKS_PER_SECOND / 20);
+			}
+
+			// A read which got held up is not used
+			referenceClock.readTicks = 1000;
+			Assert::IsFalse(timingClock.Sample());
+			Assert::AreEqual((uint64_t)1, timingClock.RejectedSampleCount());
+			Assert::AreEqual((uint64_t)5, timingClock.SampleCount());
+			referenceClock.readTicks = 20;
+
+			// Reference jumps back, the fit follows instead of holding on to the old time
+			referenceClock.Jump(-REFERENCE_TICKS_PER_SECOND);
+			Assert::IsTrue(timingClock.Sample());
+
+			const double errorMs = TimingClockDiffMs(
+				referenceClock.At(localClock.TimingClockNow()), timingClock.TimingClockNow(), REFERENCE_TICKS_PER_SECOND);
+			Assert::IsTrue(std::abs(errorMs) < 0.01);
+
+			// And after a reset it's back to reading the reference
+			timingClock.Reset();
+			const uint64_t reads = referenceClock.reads;
+			timingClock.TimingClockNow();
+			Assert::AreEqual(reads + 1, referenceClock.reads);
+		}
+
+
+		// A single fast read doesn't get every read after it rejected, and while they are the error doesn't go stale
+		TEST_METHOD(InterpolatedTimingClockFastOutlierTest)
+		{
+			SimulatedTimingClock localClock(LOCAL_TICKS_PER_SECOND, LOCAL_TICKS_PER_SECOND);
+			SlowReferenceClock referenceClock(localClock, 0.0);
+			CInterpolatedTimingClock timingClock(referenceClock, localClock);
+
+			for (int i = 0; i < 5; i++)
+			{
+				Assert::IsTrue(timingClock.Sample());
+				localClock.Advance(LOCAL_TICKS_PER_SECOND / 20);
+			}
+
+			referenceClock.readTicks = 1;
+			Assert::IsTrue(timingClock.Sample());
+			localClock.Advance(LOCAL_TICKS_PER_SECOND / 20);
+			referenceClock.readTicks = 20;
+
+			// Reference moves half a millisecond while the normal reads are held against the fast one
+			referenceClock.Jump(REFERENCE_TICKS_PER_SECOND / 2000);
+
+			for (size_t i = 0; i < CInterpolatedTimingClock::STALE_SAMPLES; i++)
+			{
+				Assert::IsFalse(timingClock.Sample());
+				localClock.Advance(LOCAL_TICKS_PER_SECOND / 20);
+			}
+
+			double errorMs = TimingClockDiffMs(
+				referenceClock.At(localClock.TimingClockNow()), timingClock.TimingClockNow(), REFERENCE_TICKS_PER_SECOND);
+			Assert::IsTrue(std::abs(errorMs) > 0.4);
+			Assert::IsTrue(std::abs(errorMs) <= timingClock.ErrorMs());
+
+			// Taken again once the fast one is out of the window
+			const uint64_t samples = timingClock.SampleCount();
+			for (size_t i = 0; i < 2 * CInterpolatedTimingClock::SAMPLE_WINDOW; i++)
+			{
+				timingClock.Sample();
+				localClock.Advance(LOCAL_TICKS_PER_SECOND / 20);
+			}
+
+			Assert::IsTrue(timingClock.SampleCount() - samples > CInterpolatedTimingClock::SAMPLE_WINDOW);
+			Assert::IsTrue(timingClock.Sample());
+
+			// The fit doesn't go back for the part of the jump it took ahead of time, the error says by how much
+			errorMs = TimingClockDiffMs(
+				referenceClock.At(localClock.TimingClockNow()), timingClock.TimingClockNow(), REFERENCE_TICKS_PER_SECOND);
+			Assert::IsTrue(std::abs(errorMs) <= timingClock.ErrorMs());
+		}
+
+
+		TEST_METHOD(InterpolatedTimingClockThreadTest)
+		{
+			CPerformanceCounterTimingClock referenceClock;
+			CPerformanceCounterTimingClock localClock;
+			CInterpolatedTimingClock timingClock(referenceClock, localClock, 5);
+
+			timingClock.Start();
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+			// Same clock on both sides can only be off by the read
+			const timingclocktime_t diff = timingClock.TimingClockNow() - referenceClock.TimingClockNow();
+			Assert::IsTrue(TimingClockDiffMs(0, std::abs(diff), referenceClock.TimingClockTicksPerSecond()) < 1.0);
+
+			timingClock.Stop();
+
+			Assert::IsTrue(timingClock.SampleCount() + timingClock.RejectedSampleCount() >= 5);
+			Assert::ExpectException<std::runtime_error>([&]() { CInterpolatedTimingClock(referenceClock, localClock, 0); });
+		}
+
+
+		// Cost of a read of the performance counter and the interpolation on top of it
+		TEST_METHOD(InterpolatedTimingClockReadBenchmark)
+		{
+			const int reads = 1000000;
+
+			CPerformanceCounterTimingClock referenceClock;
+			CPerformanceCounterTimingClock localClock;
+			CInterpolatedTimingClock timingClock(referenceClock, localClock);
+			timingClock.Sample();
+			timingClock.Sample();
+
+			auto benchmark = [&](ITimingClock& clock) {
+				timingclocktime_t sum = 0;
+				const auto start = std::chrono::steady_clock::now();
+				for (int i = 0; i < reads; i++)
+					sum += clock.TimingClockNow();
+				const auto duration = std::chrono::steady_clock::now() - start;
+
+				Assert::IsTrue(sum != 0);
+				return std::chrono::duration<double, std::nano>(duration).count() / reads;
+			};
+
+			CString s;
+			s.Format(_T("Performance counter read %.1f ns, interpolated read %.1f ns\n"),
+				benchmark(localClock), benchmark(timingClock));
+			Logger::WriteMessage(s);
+		}
+	};
+}
@@ -0,0 +1,159 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+
+#include <LatencyController.h>
+#include <LatencyHistogram.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	/**
+	 * Simulated pipeline which takes a jittery amount of time to get frames to the renderer,
+	 * every Second() runs a second of 60Hz frames with the controller's offset.
+	 */
+	class SimulatedPipeline
+	{
+	public:
+
+		SimulatedPipeline(CLatencyController& controller):
+			m_controller(controller),
+			m_windows(m_exitLatency, 1)
+		{
+		}
+
+		void Second()
+		{
+			std::normal_distribution<double> jitter(0.0, m_jitterMs);
+
+			for (int i = 0; i < 60; i++)
+			{
+				const double pipelineMs = m_pipelineMs + std::min(std::max(jitter(m_random), -3 * m_jitterMs), 3 * m_jitterMs);
+				const double exitLatencyMs = pipelineMs - m_controller.FrameOffsetMs();
+
+				m_exitLatency.Record(exitLatencyMs);
+				if (exitLatencyMs > 0.0)
+					++m_lateFrames;
+			}
+
+			m_windows.Update();
+
+			const int previousFrameOffsetMs = m_controller.FrameOffsetMs();
+			m_controller.Update(m_windows.Summary(1));
+			m_maxStepMs = std::max(m_maxStepMs, abs(m_controller.FrameOffsetMs() - previousFrameOffsetMs));
+		}
+
+		double m_pipelineMs = 30.0;
+		double m_jitterMs = 1.0;
+
+		uint64_t m_lateFrames = 0;
+		int m_maxStepMs = 0;
+
+	private:
+
+		CLatencyController& m_controller;
+		CLatencyHistogram m_exitLatency;
+		CLatencyHistogramWindows m_windows;
+		std::mt19937 m_random{ 42 };
+	};
+
+
+	TEST_CLASS(LatencyControllerTests)
+	{
+	public:
+
+		// A target the pipeline can make is held as is
+		TEST_METHOD(LatencyControllerHoldsTargetTest)
+		{
+			LatencyControllerConfig config;
+			config.targetDelayMs = 80;
+
+			CLatencyController controller(config, 80);
+			SimulatedPipeline pipeline(controller);
+
+			for (int s = 0; s < 120; s++)
+			{
+				pipeline.Second();
+				Assert::AreEqual(80, controller.FrameOffsetMs());
+			}
+
+			Assert::AreEqual((uint64_t)0, pipeline.m_lateFrames);
+			Assert::AreEqual(50.0, controller.LeadMs(), 1.0);
+		}
+
+		// With a target below what the pipeline needs the offset goes up to just enough, in small steps
+		TEST_METHOD(LatencyControllerMinimumTest)
+		{
+			LatencyControllerConfig config;
+			config.targetDelayMs = 0;
+
+			CLatencyController controller(config, 0);
+			SimulatedPipeline pipeline(controller);
+
+			for (int s = 0; s < 60; s++)
+				pipeline.Second();
+
+			Assert::IsTrue(pipeline.m_maxStepMs <= config.maxStepUpMs);
+			Assert::IsTrue(controller.FrameOffsetMs() >= 32 && controller.FrameOffsetMs() <= 36);
+
+			// Settled, at most the odd frame is late
+			pipeline.m_lateFrames = 0;
+			for (int s = 0; s < 60; s++)
+				pipeline.Second();
+
+			Assert::IsTrue(pipeline.m_lateFrames <= 60);
+			Assert::AreEqual(pipeline.m_pipelineMs, controller.PipelineLatencyMs(), 1.0);
+		}
+
+		// Follows the pipeline getting slower and faster again, but never below the target
+		TEST_METHOD(LatencyControllerFollowsPipelineTest)
+		{
+			LatencyControllerConfig config;
+			config.targetDelayMs = 40;
+
+			CLatencyController controller(config, 40);
+			SimulatedPipeline pipeline(controller);
+
+			for (int s = 0; s < 10; s++)
+				pipeline.Second();
+			Assert::AreEqual(40, controller.FrameOffsetMs());
+
+			pipeline.m_pipelineMs = 50.0;
+			pipeline.m_jitterMs = 2.0;
+			for (int s = 0; s < 60; s++)
+				pipeline.Second();
+
+			Assert::IsTrue(controller.FrameOffsetMs() > 50);
+			Assert::IsTrue(controller.LeadMs() > 0.0);
+
+			pipeline.m_pipelineMs = 20.0;
+			pipeline.m_jitterMs = 1.0;
+			for (int s = 0; s < 60; s++)
+				pipeline.Second();
+
+			Assert::AreEqual(40, controller.FrameOffsetMs());
+			Assert::IsTrue(pipeline.m_maxStepMs <= config.maxStepUpMs);
+		}
+
+		// Too few frames is no update
+		TEST_METHOD(LatencyControllerIgnoresEmptyTest)
+		{
+			LatencyControllerConfig config;
+			CLatencyController controller(config, 10);
+
+			LatencyHistogramSummary summary;
+			Assert::IsFalse(controller.Update(summary));
+
+			summary.count = config.minimumFrames - 1;
+			summary.p50Ms = 100.0;
+			summary.p99Ms = 100.0;
+			Assert::IsFalse(controller.Update(summary));
+			Assert::AreEqual(10, controller.FrameOffsetMs());
+		}
+	};
+}
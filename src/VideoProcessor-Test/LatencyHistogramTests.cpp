@@ -0,0 +1,145 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <LatencyHistogram.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	static LatencyHistogramSummary LatencyHistogramSummaryOf(const CLatencyHistogram& histogram)
+	{
+		LatencyHistogramCounts counts;
+		histogram.Snapshot(counts);
+
+		return CLatencyHistogram::Summarize(LatencyHistogramCounts(), counts);
+	}
+
+
+	TEST_CLASS(LatencyHistogramTests)
+	{
+	public:
+
+		// Every bucket's latency has to land in that bucket, and any latency has to be within the precision of its bucket
+		TEST_METHOD(LatencyHistogramBucketTest)
+		{
+			for (uint32_t i = 0; i < 2 * CLatencyHistogram::BUCKET_COUNT; i++)
+				Assert::AreEqual(i, CLatencyHistogram::BucketIndex(CLatencyHistogram::BucketMs(i)));
+
+			for (double ms = 0.05; ms < 16000.0; ms *= 1.001)
+			{
+				Assert::IsTrue(fabs(CLatencyHistogram::BucketMs(CLatencyHistogram::BucketIndex(ms)) - ms) <= ms * 0.016);
+				Assert::IsTrue(fabs(CLatencyHistogram::BucketMs(CLatencyHistogram::BucketIndex(-ms)) + ms) <= ms * 0.016);
+			}
+
+			// Ordered by latency through zero
+			Assert::IsTrue(CLatencyHistogram::BucketIndex(-0.5) < CLatencyHistogram::BucketIndex(0.0));
+			Assert::IsTrue(CLatencyHistogram::BucketIndex(-1.0) < CLatencyHistogram::BucketIndex(-0.5));
+
+			// Out of range and nonsense end up at the ends
+			Assert::AreEqual(2 * CLatencyHistogram::BUCKET_COUNT - 1, CLatencyHistogram::BucketIndex(1e9));
+			Assert::AreEqual(0u, CLatencyHistogram::BucketIndex(-1e9));
+			Assert::AreEqual(2 * CLatencyHistogram::BUCKET_COUNT - 1, CLatencyHistogram::BucketIndex(NAN));
+		}
+
+		TEST_METHOD(LatencyHistogramSummaryTest)
+		{
+			CLatencyHistogram histogram;
+
+			Assert::AreEqual((uint64_t)0, LatencyHistogramSummaryOf(histogram).count);
+			Assert::AreEqual(0.0, histogram.LastMs());
+
+			// 0.01 to 10ms in 0.01 steps
+			for (int i = 1; i <= 1000; i++)
+				histogram.Record(i / 100.0);
+
+			LatencyHistogramSummary summary = LatencyHistogramSummaryOf(histogram);
+			Assert::AreEqual((uint64_t)1000, summary.count);
+			Assert::AreEqual(10.0, histogram.LastMs());
+			Assert::AreEqual(0.01, summary.minMs, 0.001);
+			Assert::AreEqual(5.0, summary.p50Ms, 5.0 * 0.016);
+			Assert::AreEqual(9.0, summary.p90Ms, 9.0 * 0.016);
+			Assert::AreEqual(9.9, summary.p99Ms, 9.9 * 0.016);
+			Assert::AreEqual(9.99, summary.p999Ms, 9.99 * 0.016);
+			Assert::AreEqual(10.0, summary.maxMs, 10.0 * 0.016);
+
+			// A single spike is what shows up in the max, not in the median
+			histogram.Record(-2.5);
+			histogram.Record(250.0);
+
+			summary = LatencyHistogramSummaryOf(histogram);
+			Assert::AreEqual((uint64_t)1002, summary.count);
+			Assert::AreEqual(-2.5, summary.minMs, 2.5 * 0.016);
+			Assert::AreEqual(5.0, summary.p50Ms, 5.0 * 0.016);
+			Assert::AreEqual(250.0, summary.maxMs, 250.0 * 0.016);
+		}
+
+		TEST_METHOD(LatencyHistogramWindowsTest)
+		{
+			CLatencyHistogram histogram;
+
+			// Recorded before the windows exist is not in any window
+			histogram.Record(100.0);
+
+			CLatencyHistogramWindows windows(histogram, 3);
+			Assert::AreEqual((uint64_t)0, windows.Summary(3).count);
+
+			histogram.Record(1.0);
+			histogram.Record(1.0);
+			windows.Update();
+
+			histogram.Record(2.0);
+			windows.Update();
+
+			Assert::AreEqual((uint64_t)1, windows.Summary(1).count);
+			Assert::AreEqual(2.0, windows.Summary(1).maxMs, 0.05);
+			Assert::AreEqual((uint64_t)3, windows.Summary(3).count);
+			Assert::AreEqual(1.0, windows.Summary(3).minMs, 0.05);
+
+			// The 1ms ones roll out
+			histogram.Record(3.0);
+			windows.Update();
+			windows.Update();
+
+			Assert::AreEqual((uint64_t)0, windows.Summary(1).count);
+			Assert::AreEqual((uint64_t)2, windows.Summary(3).count);
+			Assert::AreEqual(2.0, windows.Summary(3).minMs, 0.05);
+
+			Assert::ExpectException<std::runtime_error>([&]() { windows.Summary(4); });
+			Assert::ExpectException<std::runtime_error>([&]() { windows.Summary(0); });
+		}
+
+		// Recording has to be cheap enough to do for every stage of every frame
+		TEST_METHOD(LatencyHistogramRecordBenchmark)
+		{
+			CLatencyHistogram histogram;
+
+			// Around a 60Hz frame with a bit of jitter
+			std::vector<double> latencies(4096);
+			for (size_t i = 0; i < latencies.size(); i++)
+				latencies[i] = 16.0 + (double)((i * 7919) % 2000) / 1000.0;
+
+			const int rounds = 1000;
+			const auto start = std::chrono::steady_clock::now();
+			for (int r = 0; r < rounds; r++)
+			{
+				for (double latency : latencies)
+					histogram.Record(latency);
+			}
+			const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+			const double nsPerRecord = elapsed.count() / (latencies.size() * rounds);
+
+			CString s;
+			s.Format(TEXT("Latency histogram record: %.1f ns\n"), nsPerRecord);
+			Logger::WriteMessage(s);
+
+			Assert::AreEqual((uint64_t)(latencies.size() * rounds), LatencyHistogramSummaryOf(histogram).count);
+		}
+	};
+}
@@ -0,0 +1,170 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <PipelineTrace.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	static size_t CountOccurrences(const std::string& haystack, const std::string& needle)
+	{
+		size_t count = 0;
+		for (size_t pos = haystack.find(needle); pos != std::string::npos; pos = haystack.find(needle, pos + needle.size()))
+			++count;
+
+		return count;
+	}
+
+
+	TEST_CLASS(PipelineTraceTests)
+	{
+	public:
+
+		// Frames handed from one thread to another end up as nested stages per thread and an async queue stage
+		TEST_METHOD(PipelineTraceChromeTraceTest)
+		{
+			PipelineTrace::Start();
+
+			std::thread producer([]()
+			{
+				PipelineTrace::SetThreadName("test_capture");
+
+				for (uint64_t frame = 0; frame < 3; frame++)
+				{
+					CPipelineTraceScope callbackScope(PipelineTraceStage::CAPTURE_CALLBACK, frame);
+					{
+						CPipelineTraceScope formatScope(PipelineTraceStage::FORMAT, frame);
+					}
+
+					PipelineTrace::Record(PipelineTraceStage::QUEUE, PipelineTracePhase::ASYNC_BEGIN, frame);
+				}
+			});
+			producer.join();
+
+			std::thread consumer([]()
+			{
+				PipelineTrace::SetThreadName("test_delivery");
+
+				for (uint64_t frame = 0; frame < 3; frame++)
+				{
+					PipelineTrace::Record(PipelineTraceStage::QUEUE, PipelineTracePhase::ASYNC_END, frame);
+
+					if (frame == 1)
+					{
+						PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, frame);
+						continue;
+					}
+
+					CPipelineTraceScope deliverScope(PipelineTraceStage::DELIVER, frame);
+				}
+			});
+			consumer.join();
+
+			PipelineTrace::Stop();
+
+			// Not recorded when stopped
+			PipelineTrace::Record(PipelineTraceStage::DELIVER, PipelineTracePhase::INSTANT, 99);
+			{
+				CPipelineTraceScope scope(PipelineTraceStage::DELIVER, 99);
+			}
+
+			std::ostringstream os;
+			PipelineTrace::WriteChromeTrace(os);
+			const std::string trace = os.str();
+
+			Logger::WriteMessage(trace.c_str());
+
+			Assert::AreEqual((size_t)0, trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+			Assert::IsTrue(trace.find("\"name\":\"test_capture\"") != std::string::npos);
+			Assert::IsTrue(trace.find("\"name\":\"test_delivery\"") != std::string::npos);
+
+			Assert::AreEqual((size_t)3, CountOccurrences(trace, "\"name\":\"capture_callback\",\"cat\":\"frame\",\"ph\":\"B\""));
+			Assert::AreEqual((size_t)3, CountOccurrences(trace, "\"name\":\"capture_callback\",\"cat\":\"frame\",\"ph\":\"E\""));
+			Assert::AreEqual((size_t)3, CountOccurrences(trace, "\"name\":\"queue\",\"cat\":\"frame\",\"ph\":\"b\""));
+			Assert::AreEqual((size_t)3, CountOccurrences(trace, "\"name\":\"queue\",\"cat\":\"frame\",\"ph\":\"e\""));
+			Assert::AreEqual((size_t)2, CountOccurrences(trace, "\"name\":\"deliver\",\"cat\":\"frame\",\"ph\":\"B\""));
+			Assert::AreEqual((size_t)1, CountOccurrences(trace, "\"name\":\"drop\",\"cat\":\"frame\",\"ph\":\"i\""));
+			Assert::AreEqual((size_t)0, CountOccurrences(trace, "\"frame\":99"));
+
+			// Async stages are matched on the frame
+			Assert::IsTrue(trace.find("\"id\":1,\"args\":{\"frame\":1}") != std::string::npos);
+		}
+
+		// Starting again throws away the previous trace, a ring which wrapped around drops the dangling ends
+		TEST_METHOD(PipelineTraceRestartAndWrapTest)
+		{
+			PipelineTrace::Start();
+			PipelineTrace::Record(PipelineTraceStage::FORMAT, PipelineTracePhase::INSTANT, 1234);
+			PipelineTrace::Stop();
+
+			PipelineTrace::Start();
+
+			// The begin of the outer scope gets overwritten
+			{
+				CPipelineTraceScope outerScope(PipelineTraceStage::CAPTURE_CALLBACK, 0);
+
+				for (uint32_t i = 0; i < PipelineTrace::EVENTS_PER_THREAD; i++)
+					PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, 1);
+			}
+
+			PipelineTrace::Stop();
+
+			std::ostringstream os;
+			PipelineTrace::WriteChromeTrace(os);
+			const std::string trace = os.str();
+
+			Assert::AreEqual((size_t)0, CountOccurrences(trace, "\"frame\":1234"));
+			Assert::AreEqual((size_t)0, CountOccurrences(trace, "\"name\":\"capture_callback\""));
+			Assert::AreEqual((size_t)PipelineTrace::EVENTS_PER_THREAD - 1, CountOccurrences(trace, "\"name\":\"drop\""));
+		}
+
+		// Starting while another thread records keeps none of what it recorded before the start
+		TEST_METHOD(PipelineTraceStartWhileRecordingTest)
+		{
+			std::atomic<bool> running{ true };
+			std::atomic<uint64_t> recorded{ 0 };
+
+			PipelineTrace::Start();
+
+			std::thread recorder([&]()
+			{
+				while (running)
+				{
+					PipelineTrace::Record(PipelineTraceStage::DROP, PipelineTracePhase::INSTANT, 1);
+					recorded.fetch_add(1);
+				}
+			});
+
+			for (int i = 0; i < 1000; i++)
+			{
+				PipelineTrace::Stop();
+				PipelineTrace::Start();
+			}
+
+			const uint64_t recordedBeforeLastStart = recorded.load();
+			PipelineTrace::Stop();
+			PipelineTrace::Start();
+
+			while (recorded.load() < recordedBeforeLastStart + 100)
+				std::this_thread::yield();
+
+			PipelineTrace::Stop();
+			running = false;
+			recorder.join();
+
+			std::ostringstream os;
+			PipelineTrace::WriteChromeTrace(os);
+
+			// One event can have been in flight when stopping
+			const size_t drops = CountOccurrences(os.str(), "\"name\":\"drop\"");
+			Assert::IsTrue(drops <= recorded.load() - recordedBeforeLastStart + 1);
+		}
+	};
+}
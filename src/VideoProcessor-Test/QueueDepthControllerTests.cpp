@@ -0,0 +1,312 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <math.h>
+#include <random>
+
+#include <LatencyHistogram.h>
+#include <QueueDepthController.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	/**
+	 * Simulated frame queue with the renderer's drop rules in front of a delivery which now and then stalls,
+	 * every Second() runs a second of 60Hz frames with the controller's depth. A delivery which takes longer
+	 * than a frame is a renderer running slower than the capture.
+	 */
+	class SimulatedFrameQueue
+	{
+	public:
+
+		SimulatedFrameQueue(CQueueDepthController& controller):
+			m_controller(controller),
+			m_entryWindows(m_entryLatency, 1),
+			m_deliverWindows(m_deliver, 1),
+			m_queueWaitWindows(m_queueWait, 1)
+		{
+		}
+
+		void Second()
+		{
+			std::uniform_real_distribution<double> arrivalJitter(0.0, m_arrivalJitterMs);
+			std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+			uint64_t droppedFrames = 0;
+
+			for (int i = 0; i < 60; i++, m_frame++)
+			{
+				const double jitterMs = arrivalJitter(m_random);
+				const double arrivalMs = m_frame * FRAME_MS + jitterMs;
+				m_entryLatency.Record(jitterMs);
+
+				// Deliver what could have been delivered until this frame arrived
+				while (!m_queued.empty() && m_deliveryFreeMs <= arrivalMs)
+				{
+					const double startMs = std::max(m_deliveryFreeMs, m_queued.front());
+					m_queueWait.Record(startMs - m_queued.front());
+					m_queued.pop_front();
+
+					double deliverMs = m_deliverMs;
+					if (chance(m_random) < m_stallProbability)
+						deliverMs += m_stallMs;
+
+					m_deliver.Record(deliverMs);
+					m_deliveryFreeMs = startMs + deliverMs;
+				}
+
+				// If full throw away oldest to make space
+				while (m_queued.size() >= m_controller.Depth())
+				{
+					m_queued.pop_front();
+					++droppedFrames;
+				}
+
+				m_queued.push_back(arrivalMs);
+			}
+
+			m_droppedFrames += droppedFrames;
+
+			m_entryWindows.Update();
+			m_deliverWindows.Update();
+			m_queueWaitWindows.Update();
+
+			const size_t previousDepth = m_controller.Depth();
+			m_controller.Update(m_entryWindows.Summary(1), m_deliverWindows.Summary(1), m_queueWaitWindows.Summary(1), droppedFrames);
+			m_maxStep = std::max(m_maxStep, (size_t)abs((int)m_controller.Depth() - (int)previousDepth));
+			m_maxDepth = std::max(m_maxDepth, m_controller.Depth());
+		}
+
+		static const double FRAME_MS;
+
+		double m_arrivalJitterMs = 1.0;
+		double m_deliverMs = FRAME_MS / 2;
+		double m_stallMs = 0.0;
+		double m_stallProbability = 0.0;
+
+		uint64_t m_droppedFrames = 0;
+		size_t m_maxStep = 0;
+		size_t m_maxDepth = 0;
+
+	private:
+
+		CQueueDepthController& m_controller;
+		CLatencyHistogram m_entryLatency;
+		CLatencyHistogram m_deliver;
+		CLatencyHistogram m_queueWait;
+		CLatencyHistogramWindows m_entryWindows;
+		CLatencyHistogramWindows m_deliverWindows;
+		CLatencyHistogramWindows m_queueWaitWindows;
+
+		std::deque<double> m_queued;
+		double m_deliveryFreeMs = 0.0;
+		uint64_t m_frame = 0;
+		std::mt19937 m_random{ 42 };
+	};
+
+	const double SimulatedFrameQueue::FRAME_MS = 1000.0 / 60;
+
+
+	TEST_CLASS(QueueDepthControllerTests)
+	{
+	public:
+
+		// Interpolates between the percentiles
+		TEST_METHOD(QueueDepthControllerTailTest)
+		{
+			LatencyHistogramSummary summary;
+			summary.count = 10000;
+			summary.p50Ms = 1.0;
+			summary.p90Ms = 2.0;
+			summary.p99Ms = 4.0;
+			summary.p999Ms = 8.0;
+			summary.maxMs = 16.0;
+
+			Assert::AreEqual(1.0, CQueueDepthController::TailMs(summary, 0.9));
+			Assert::AreEqual(2.0, CQueueDepthController::TailMs(summary, 0.1), 0.0001);
+			Assert::AreEqual(4.0, CQueueDepthController::TailMs(summary, 0.01), 0.0001);
+			Assert::AreEqual(8.0, CQueueDepthController::TailMs(summary, 0.001), 0.0001);
+			Assert::AreEqual(3.0, CQueueDepthController::TailMs(summary, sqrt(0.1 * 0.01)), 0.0001);
+
+			// The max is one in count frames
+			Assert::AreEqual(12.0, CQueueDepthController::TailMs(summary, sqrt(0.001 * 0.0001)), 0.0001);
+			Assert::AreEqual(16.0, CQueueDepthController::TailMs(summary, 0.00001));
+
+			summary.count = 100;
+			Assert::AreEqual(16.0, CQueueDepthController::TailMs(summary, 0.0005));
+		}
+
+		// Without stalls a single frame does
+		TEST_METHOD(QueueDepthControllerSteadyTest)
+		{
+			QueueDepthControllerConfig config;
+			CQueueDepthController controller(config, SimulatedFrameQueue::FRAME_MS);
+			SimulatedFrameQueue queue(controller);
+
+			for (int s = 0; s < 60; s++)
+			{
+				queue.Second();
+				Assert::AreEqual((size_t)1, controller.Depth());
+			}
+
+			Assert::AreEqual((uint64_t)0, queue.m_droppedFrames);
+		}
+
+		// Stalls make it go up a frame at a time to just what covers them, and back down once they stop
+		TEST_METHOD(QueueDepthControllerStallTest)
+		{
+			QueueDepthControllerConfig config;
+			CQueueDepthController controller(config, SimulatedFrameQueue::FRAME_MS);
+			SimulatedFrameQueue queue(controller);
+
+			// Two and a half frames worth of stall every couple of seconds
+			queue.m_stallMs = 42.0;
+			queue.m_stallProbability = 0.01;
+
+			for (int s = 0; s < 60; s++)
+				queue.Second();
+
+			Assert::AreEqual((size_t)1, queue.m_maxStep);
+			Assert::IsTrue(controller.Depth() >= 3 && controller.Depth() <= 4);
+
+			// Settled, the stalls don't make it drop anymore
+			queue.m_droppedFrames = 0;
+			for (int s = 0; s < 60; s++)
+				queue.Second();
+
+			Assert::IsTrue(queue.m_droppedFrames <= 4);
+
+			// Gone, goes back down slowly
+			queue.m_stallProbability = 0.0;
+
+			queue.Second();
+			Assert::IsTrue(controller.Depth() >= 3);
+
+			for (int s = 0; s < 120; s++)
+				queue.Second();
+
+			Assert::AreEqual((size_t)1, controller.Depth());
+			Assert::AreEqual((size_t)1, queue.m_maxStep);
+		}
+
+		// A queue which got filled up by stalls stays full when the renderer takes exactly a frame per frame,
+		// the frames wait for the whole depth but the delivery doesn't need it so it comes down
+		TEST_METHOD(QueueDepthControllerFullQueueTest)
+		{
+			QueueDepthControllerConfig config;
+			CQueueDepthController controller(config, SimulatedFrameQueue::FRAME_MS);
+			SimulatedFrameQueue queue(controller);
+
+			queue.m_arrivalJitterMs = 0.1;
+			queue.m_stallMs = 42.0;
+			queue.m_stallProbability = 0.01;
+
+			for (int s = 0; s < 60; s++)
+				queue.Second();
+
+			Assert::IsTrue(controller.Depth() >= 3);
+
+			// Fill it up and keep it that way
+			queue.m_deliverMs = SimulatedFrameQueue::FRAME_MS;
+			queue.m_stallProbability = 1.0;
+			queue.Second();
+			queue.m_stallProbability = 0.0;
+
+			for (int s = 0; s < 120; s++)
+				queue.Second();
+
+			// One queued behind the one being delivered
+			Assert::AreEqual((size_t)2, controller.Depth());
+			Assert::AreEqual((size_t)1, queue.m_maxStep);
+		}
+
+		// A renderer a percent slower than the capture overflows any depth at a steady rate,
+		// that only takes what the delivery time asks for
+		TEST_METHOD(QueueDepthControllerRateMismatchTest)
+		{
+			QueueDepthControllerConfig config;
+			CQueueDepthController controller(config, SimulatedFrameQueue::FRAME_MS);
+			SimulatedFrameQueue queue(controller);
+
+			queue.m_deliverMs = SimulatedFrameQueue::FRAME_MS * 1.01;
+
+			for (int s = 0; s < 120; s++)
+				queue.Second();
+
+			// About one in a hundred, way over the target
+			Assert::IsTrue(queue.m_droppedFrames > 60);
+			Assert::IsTrue(controller.StandingFull());
+			Assert::AreEqual((size_t)2, controller.NeededDepth());
+			Assert::AreEqual((size_t)2, queue.m_maxDepth);
+			Assert::AreEqual((size_t)2, controller.Depth());
+		}
+
+		// Drops going over the target grow it even if the delivery looks fine, but not past the maximum
+		TEST_METHOD(QueueDepthControllerDropTest)
+		{
+			QueueDepthControllerConfig config;
+			config.maximumDepth = 3;
+			CQueueDepthController controller(config, 10.0);
+
+			LatencyHistogramSummary entryLatency;
+			entryLatency.count = 100;
+
+			LatencyHistogramSummary deliver;
+			deliver.count = 100;
+
+			LatencyHistogramSummary queueWait;
+			queueWait.count = 100;
+
+			Assert::IsTrue(controller.Update(entryLatency, deliver, queueWait, 5));
+			Assert::AreEqual((size_t)2, controller.Depth());
+			Assert::IsTrue(controller.Update(entryLatency, deliver, queueWait, 5));
+			Assert::IsFalse(controller.Update(entryLatency, deliver, queueWait, 5));
+			Assert::AreEqual((size_t)3, controller.Depth());
+
+			// Holds a while before going down
+			for (unsigned int i = 1; i < config.shrinkHoldUpdates; i++)
+				Assert::IsFalse(controller.Update(entryLatency, deliver, queueWait, 0));
+
+			Assert::IsTrue(controller.Update(entryLatency, deliver, queueWait, 0));
+			Assert::AreEqual((size_t)2, controller.Depth());
+
+			// Drops from a queue where most frames wait for all of it don't count
+			queueWait.p50Ms = 10.0;
+			for (unsigned int i = 1; i < config.shrinkHoldUpdates; i++)
+				Assert::IsFalse(controller.Update(entryLatency, deliver, queueWait, 5));
+			Assert::IsTrue(controller.StandingFull());
+			Assert::AreEqual((size_t)2, controller.Depth());
+
+			// Too few frames is no update
+			queueWait.p50Ms = 0.0;
+			deliver.count = 1;
+			Assert::IsFalse(controller.Update(entryLatency, deliver, queueWait, 1));
+			Assert::AreEqual((size_t)2, controller.Depth());
+		}
+
+		TEST_METHOD(QueueDepthControllerConfigTest)
+		{
+			QueueDepthControllerConfig config;
+			config.minimumDepth = 2;
+			Assert::AreEqual((size_t)2, CQueueDepthController(config, 10.0).Depth());
+
+			config.minimumDepth = 0;
+			Assert::ExpectException<std::runtime_error>([&]() { CQueueDepthController(config, 10.0); });
+
+			config.minimumDepth = 4;
+			config.maximumDepth = 3;
+			Assert::ExpectException<std::runtime_error>([&]() { CQueueDepthController(config, 10.0); });
+
+			config = QueueDepthControllerConfig();
+			config.targetDropProbability = 0.0;
+			Assert::ExpectException<std::runtime_error>([&]() { CQueueDepthController(config, 10.0); });
+
+			Assert::ExpectException<std::runtime_error>([]() { CQueueDepthController(QueueDepthControllerConfig(), 0.0); });
+		}
+	};
+}
@@ -0,0 +1,97 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <DisplayMode.h>
+#include <RationalTimebase.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	TEST_CLASS(RationalTimebaseTests)
+	{
+	public:
+
+		TEST_METHOD(RationalTimebaseReduceTest)
+		{
+			const RationalTimebase timebase(10000000, 60000);
+			Assert::AreEqual((int64_t)500, timebase.Numerator());
+			Assert::AreEqual((int64_t)3, timebase.Denominator());
+
+			Assert::IsTrue(RationalTimebase::Rescale(1000, 10000000) == RationalTimebase(10000, 1));
+			Assert::IsTrue(timebase.Inverse() == RationalTimebase(3, 500));
+			Assert::IsTrue(RationalTimebase() == RationalTimebase(7, 7));
+			Assert::IsTrue(timebase != RationalTimebase());
+		}
+
+
+		TEST_METHOD(RationalTimebaseConvertTest)
+		{
+			const RationalTimebase timebase(5, 3);
+
+			Assert::AreEqual((int64_t)0, timebase.Convert(0));
+			Assert::AreEqual((int64_t)1, timebase.Convert(1));
+			Assert::AreEqual((int64_t)3, timebase.Convert(2));
+			Assert::AreEqual((int64_t)5, timebase.Convert(3));
+
+			Assert::AreEqual((int64_t)2, timebase.ConvertRounded(1));
+			Assert::AreEqual((int64_t)3, timebase.ConvertRounded(2));
+
+			// Rounded down and to the nearest for negative values as well
+			Assert::AreEqual((int64_t)-2, timebase.Convert(-1));
+			Assert::AreEqual((int64_t)-4, timebase.Convert(-2));
+			Assert::AreEqual((int64_t)-2, timebase.ConvertRounded(-1));
+			Assert::AreEqual((int64_t)-3, timebase.ConvertRounded(-2));
+
+			// Halves up
+			Assert::AreEqual((int64_t)1, RationalTimebase(1, 2).ConvertRounded(1));
+			Assert::AreEqual((int64_t)0, RationalTimebase(1, 2).ConvertRounded(-1));
+		}
+
+
+		TEST_METHOD(RationalTimebaseNoDriftTest)
+		{
+			// 59.94Hz frames into 100ns units, a day's worth of frames ends up exactly where it should
+			const RationalTimebase timebase = DisplayMode(1920, 1080, false, 60000, 1001).FrameTimebase(10000000);
+			Assert::AreEqual((int64_t)166833, timebase.Convert(1));
+
+			const int64_t frames = 60000LL * 60 * 60 * 24;
+			Assert::AreEqual(1001LL * 60 * 60 * 24 * 10000000, timebase.Convert(frames));
+
+			// And back, with large values not overflowing on the way
+			Assert::AreEqual(frames, timebase.Inverse().Convert(timebase.Convert(frames)));
+
+			// Every frame starts after the one before
+			int64_t previous = -1;
+			for (int64_t frame = frames - 1000; frame < frames; ++frame)
+			{
+				const int64_t start = timebase.Convert(frame);
+				Assert::IsTrue(start > previous);
+				previous = start;
+			}
+		}
+
+
+		TEST_METHOD(RationalTimebaseDisplayModeTest)
+		{
+			const DisplayMode displayMode(3840, 2160, false, 24000, 1001);
+			Assert::AreEqual((uint64_t)41708333, displayMode.NanosecondsPerFrame());
+
+			// Frame durations in hardware clock ticks
+			Assert::AreEqual((int64_t)1001, displayMode.FrameTimebase(24000).Convert(1));
+			Assert::AreEqual((int64_t)2, DisplayMode(1920, 1080, false, 50, 1).FrameTimebase(100).Convert(1));
+		}
+
+
+		TEST_METHOD(RationalTimebaseInvalidTest)
+		{
+			Assert::ExpectException<std::runtime_error>([]() { RationalTimebase(0, 1); });
+			Assert::ExpectException<std::runtime_error>([]() { RationalTimebase(1, 0); });
+
+			// Intermediate values would not fit
+			Assert::ExpectException<std::runtime_error>([]() { RationalTimebase(1ULL << 40, (1ULL << 40) - 1); });
+			Assert::ExpectException<std::runtime_error>([]() { RationalTimebase(1ULL << 63, 1); });
+		}
+	};
+}
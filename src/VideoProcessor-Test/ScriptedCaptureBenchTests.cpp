@@ -0,0 +1,270 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+#include <FrameArrivalCounter.h>
+#include <synthetic_capture/ScriptedCaptureBench.h>
+#include <synthetic_capture/SimulatedTimingClock.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	static const timingclocktime_t SCRIPTED_TICKS_PER_SECOND = 10000000LL;
+
+
+	static DisplayModeSharedPtr ScriptedDisplayMode()
+	{
+		// Small frames, it's the timing which is being tested
+		return std::make_shared<DisplayMode>(640, 360, false /* interlaced */, 24000, 1000);
+	}
+
+
+	static ScriptedCaptureBenchConfig ScriptedConfig()
+	{
+		ScriptedCaptureBenchConfig config;
+		config.displayMode = ScriptedDisplayMode();
+
+		return config;
+	}
+
+
+	static double AverageQueueSize(const std::vector<size_t>& queueSizes, size_t from, size_t to)
+	{
+		return std::accumulate(queueSizes.begin() + from, queueSizes.begin() + to, 0.0) / (to - from);
+	}
+
+
+	TEST_CLASS(ScriptedCaptureBenchTests)
+	{
+	public:
+
+		TEST_METHOD(SimulatedTimingClockTest)
+		{
+			SimulatedTimingClock timingClock(SCRIPTED_TICKS_PER_SECOND, 100);
+			Assert::AreEqual(100LL, timingClock.TimingClockNow());
+			Assert::AreEqual(SCRIPTED_TICKS_PER_SECOND, timingClock.TimingClockTicksPerSecond());
+
+			timingClock.Advance(50);
+			Assert::AreEqual(150LL, timingClock.TimingClockNow());
+
+			timingClock.SetNow(150);
+			timingClock.SetNow(1000);
+			Assert::AreEqual(1000LL, timingClock.TimingClockNow());
+
+			Assert::ExpectException<std::runtime_error>([&]() { timingClock.SetNow(999); });
+			Assert::ExpectException<std::runtime_error>([]() { SimulatedTimingClock(999); });
+		}
+
+
+		TEST_METHOD(FrameArrivalCounterTest)
+		{
+			CFrameArrivalCounter counter;
+			counter.SetTicksPerFrame(1000);
+
+			// First frame is only a reference
+			Assert::AreEqual((uint64_t)0, counter.OnFrame(5000));
+			Assert::AreEqual((uint64_t)1, counter.OnFrame(6000));
+
+			// A bit of jitter is still one frame
+			Assert::AreEqual((uint64_t)2, counter.OnFrame(7400));
+			Assert::AreEqual((uint64_t)3, counter.OnFrame(8000));
+			Assert::AreEqual((uint64_t)0, counter.MissedCount());
+
+			// Two missing
+			Assert::AreEqual((uint64_t)6, counter.OnFrame(11000));
+			Assert::AreEqual((uint64_t)6, counter.CapturedCount());
+			Assert::AreEqual((uint64_t)2, counter.MissedCount());
+
+			counter.Reset();
+			Assert::AreEqual((uint64_t)0, counter.OnFrame(20000));
+			Assert::AreEqual((uint64_t)0, counter.MissedCount());
+
+			Assert::ExpectException<std::runtime_error>([&]() { counter.SetTicksPerFrame(0); });
+		}
+
+
+		TEST_METHOD(ScriptedTimelineTest)
+		{
+			const DisplayModeSharedPtr displayMode = ScriptedDisplayMode();
+
+			ScriptedCaptureTimeline timeline(*displayMode, SCRIPTED_TICKS_PER_SECOND, 10.0);
+			timeline.Steady(10).Gap(3).Burst(4).Jitter(100, 20.0);
+
+			Assert::AreEqual((uint64_t)117, timeline.FrameCount());
+			Assert::AreEqual((size_t)114, timeline.Arrivals().size());
+
+			const std::vector<ScriptedFrameArrival>& arrivals = timeline.Arrivals();
+			for (size_t i = 1; i < arrivals.size(); i++)
+			{
+				Assert::IsTrue(arrivals[i].timingTimestamp > arrivals[i - 1].timingTimestamp);
+				Assert::IsTrue(arrivals[i].arrivalTime >= arrivals[i - 1].arrivalTime);
+				Assert::IsTrue(arrivals[i].arrivalTime >= arrivals[i].timingTimestamp);
+			}
+
+			// Burst arrives at once
+			Assert::AreEqual(arrivals[10].arrivalTime, arrivals[13].arrivalTime);
+
+			// Same seed, same script
+			ScriptedCaptureTimeline again(*displayMode, SCRIPTED_TICKS_PER_SECOND, 10.0);
+			again.Steady(10).Gap(3).Burst(4).Jitter(100, 20.0);
+			for (size_t i = 0; i < arrivals.size(); i++)
+				Assert::AreEqual(arrivals[i].arrivalTime, again.Arrivals()[i].arrivalTime);
+		}
+
+
+		TEST_METHOD(ScriptedSteadyTest)
+		{
+			ScriptedCaptureTimeline timeline(*ScriptedDisplayMode(), SCRIPTED_TICKS_PER_SECOND, 10.0);
+			timeline.Steady(240);
+
+			const ScriptedCaptureBenchResult result = ScriptedCaptureBench(ScriptedConfig()).Run(timeline);
+
+			Assert::AreEqual((uint64_t)240, result.arrivedFrames);
+			Assert::AreEqual((uint64_t)240, result.deliveredFrames);
+			Assert::AreEqual((uint64_t)0, result.droppedFrames);
+			Assert::AreEqual((uint64_t)0, result.missedFrames);
+			Assert::AreEqual((size_t)1, result.maxQueueSize);
+
+			// Every frame waits exactly one refresh
+			Assert::AreEqual(10.0, result.entryLatency.p50Ms, 1.0);
+			Assert::AreEqual(1000.0 / 24, result.queueWait.p50Ms, 1.0);
+			Assert::AreEqual(result.queueWait.p50Ms, result.queueWait.p99Ms, 1.0);
+
+			// Delivered in order, no discontinuities. Counters start at 0 which the timestamper
+			// takes as unset, so it counts from the second frame on.
+			for (size_t i = 2; i < result.deliveries.size(); i++)
+			{
+				Assert::AreEqual(result.deliveries[i - 1].times.streamFrameCounter + 1, result.deliveries[i].times.streamFrameCounter);
+				Assert::IsFalse(result.deliveries[i].times.discontinuity);
+			}
+		}
+
+
+		TEST_METHOD(ScriptedJitterTest)
+		{
+			ScriptedCaptureTimeline timeline(*ScriptedDisplayMode(), SCRIPTED_TICKS_PER_SECOND, 15.0);
+			timeline.Steady(24).Jitter(480, 10.0);
+
+			const ScriptedCaptureBenchResult result = ScriptedCaptureBench(ScriptedConfig()).Run(timeline);
+
+			// Jitter moves frames around refreshes but the queue absorbs it
+			Assert::AreEqual(result.arrivedFrames, result.deliveredFrames);
+			Assert::AreEqual((uint64_t)0, result.droppedFrames);
+			Assert::IsTrue(result.maxQueueSize <= 2);
+			Assert::IsTrue(result.queueWait.p99Ms > result.queueWait.p50Ms);
+		}
+
+
+		TEST_METHOD(ScriptedBurstTest)
+		{
+			ScriptedCaptureTimeline timeline(*ScriptedDisplayMode(), SCRIPTED_TICKS_PER_SECOND, 10.0);
+			timeline.Steady(24).Burst(8).Steady(24);
+
+			ScriptedCaptureBenchConfig config = ScriptedConfig();
+			config.frameQueueMaxSize = 4;
+
+			const ScriptedCaptureBenchResult result = ScriptedCaptureBench(config).Run(timeline);
+
+			// Burst overflows the queue which throws away the oldest frames
+			Assert::AreEqual((size_t)4, result.maxQueueSize);
+			Assert::IsTrue(result.droppedFrames > 0);
+			Assert::AreEqual(result.arrivedFrames, result.deliveredFrames + result.droppedFrames);
+			Assert::AreEqual((uint64_t)0, result.missedFrames);
+		}
+
+
+		TEST_METHOD(ScriptedGapTest)
+		{
+			ScriptedCaptureTimeline timeline(*ScriptedDisplayMode(), SCRIPTED_TICKS_PER_SECOND, 10.0);
+			timeline.Steady(24).Gap(5).Steady(24).Gap(1).Steady(24);
+
+			const ScriptedCaptureBenchResult result = ScriptedCaptureBench(ScriptedConfig()).Run(timeline);
+
+			Assert::AreEqual((uint64_t)72, result.arrivedFrames);
+			Assert::AreEqual((uint64_t)6, result.missedFrames);
+			Assert::AreEqual((uint64_t)72, result.deliveredFrames);
+
+			// Renderer sees the frame counter jump, past the start of the stream
+			const size_t discontinuities = std::count_if(
+				result.deliveries.begin() + 2, result.deliveries.end(),
+				[](const ScriptedCaptureBenchDelivery& delivery) { return delivery.times.discontinuity; });
+			Assert::AreEqual((size_t)2, discontinuities);
+		}
+
+
+		TEST_METHOD(ScriptedDriftTest)
+		{
+			ScriptedCaptureBenchConfig config = ScriptedConfig();
+			config.frameQueueMaxSize = 4;
+
+			// Source faster than the display fills up the queue and drops
+			{
+				ScriptedCaptureTimeline timeline(*config.displayMode, SCRIPTED_TICKS_PER_SECOND, 10.0);
+				timeline.Drift(10000.0).Steady(960);
+
+				const ScriptedCaptureBenchResult result = ScriptedCaptureBench(config).Run(timeline);
+
+				const size_t quarter = result.queueSizes.size() / 4;
+				Assert::IsTrue(AverageQueueSize(result.queueSizes, 0, quarter) < AverageQueueSize(result.queueSizes, 3 * quarter, 4 * quarter));
+				Assert::AreEqual((size_t)4, result.maxQueueSize);
+				Assert::IsTrue(result.droppedFrames > 0);
+			}
+
+			// Source slower than the display never builds a queue
+			{
+				ScriptedCaptureTimeline timeline(*config.displayMode, SCRIPTED_TICKS_PER_SECOND, 10.0);
+				timeline.Drift(-10000.0).Steady(960);
+
+				const ScriptedCaptureBenchResult result = ScriptedCaptureBench(config).Run(timeline);
+
+				Assert::AreEqual((size_t)1, result.maxQueueSize);
+				Assert::AreEqual((uint64_t)0, result.droppedFrames);
+				Assert::AreEqual(result.arrivedFrames, result.deliveredFrames);
+			}
+		}
+
+
+		TEST_METHOD(ScriptedClockClockTest)
+		{
+			ScriptedCaptureTimeline timeline(*ScriptedDisplayMode(), SCRIPTED_TICKS_PER_SECOND, 10.0);
+			timeline.Steady(48).Jitter(48, 5.0);
+
+			ScriptedCaptureBenchConfig config = ScriptedConfig();
+			config.timestamp = DirectShowStartStopTimeMethod::DS_SSTM_CLOCK_CLOCK;
+
+			const ScriptedCaptureBenchResult result = ScriptedCaptureBench(config).Run(timeline);
+
+			// Needs the next frame to know when this one stops, so the last one stays behind
+			Assert::AreEqual(result.arrivedFrames - 1, result.deliveredFrames);
+			Assert::AreEqual((uint64_t)0, result.droppedFrames);
+
+			for (size_t i = 1; i < result.deliveries.size(); i++)
+				Assert::AreEqual(result.deliveries[i - 1].times.timeStop, result.deliveries[i].times.timeStart);
+		}
+
+
+		// Ten minutes of video should take nowhere near ten minutes
+		TEST_METHOD(ScriptedFasterThanRealTimeTest)
+		{
+			ScriptedCaptureTimeline timeline(*ScriptedDisplayMode(), SCRIPTED_TICKS_PER_SECOND, 10.0);
+			timeline.Jitter(24 * 60 * 10, 5.0);
+
+			const auto start = std::chrono::steady_clock::now();
+			const ScriptedCaptureBenchResult result = ScriptedCaptureBench(ScriptedConfig()).Run(timeline);
+			const auto duration = std::chrono::steady_clock::now() - start;
+
+			Assert::AreEqual(result.arrivedFrames, result.deliveredFrames);
+			Assert::IsTrue(duration < std::chrono::seconds(60));
+
+			CString s;
+			s.Format(_T("Ran 10 minutes of video in %.3f seconds"),
+				std::chrono::duration<double>(duration).count());
+			Logger::WriteMessage(s);
+		}
+	};
+}
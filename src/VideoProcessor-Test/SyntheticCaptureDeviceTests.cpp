@@ -0,0 +1,212 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <synthetic_capture/SyntheticCaptureDevice.h>
+#include <synthetic_capture/SyntheticFrameEncode.h>
+#include <video_frame_formatter/CRGBtoRGB48VideoFrameFormatter.h>
+#include <video_frame_formatter/CV210toP210VideoFrameFormatter.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	// Records the callbacks of a capture device in the order they arrive
+	class SyntheticCaptureDeviceTestCallback:
+		public ICaptureDeviceCallback
+	{
+	public:
+
+		void OnCaptureDeviceState(CaptureDeviceState state) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			events.push_back(state == CaptureDeviceState::CAPTUREDEVICESTATE_CAPTURING ? 'C' : 's');
+		}
+
+		void OnCaptureDeviceCardStateChange(CaptureDeviceCardStateComPtr) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			events.push_back('c');
+		}
+
+		void OnCaptureDeviceVideoStateChange(VideoStateComPtr videoState) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			events.push_back(videoState->valid ? 'V' : 'v');
+			if (videoState->valid)
+				lastVideoState = videoState;
+		}
+
+		void OnCaptureDeviceVideoFrame(VideoFrame& videoFrame) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (events.empty() || events.back() != 'f')
+				events.push_back('f');
+
+			// Data has to be valid for the video state
+			Assert::IsTrue(lastVideoState != nullptr);
+			Assert::IsTrue(videoFrame.GetData() != nullptr);
+
+			timestamps.push_back(videoFrame.GetTimingTimestamp());
+			counters.push_back(videoFrame.GetCounter());
+		}
+
+		void OnCaptureDeviceError(const CString&) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			events.push_back('e');
+		}
+
+		std::mutex mutex;
+		std::string events;
+		VideoStateComPtr lastVideoState;
+		std::vector<timingclocktime_t> timestamps;
+		std::vector<uint64_t> counters;
+	};
+
+
+	// Random full range RGB48 row
+	static std::vector<uint16_t> SyntheticRandomRow(uint32_t width)
+	{
+		std::vector<uint16_t> rgb(width * 3);
+		std::mt19937 rng(42);
+		for (auto& v : rgb)
+			v = (uint16_t)rng();
+
+		return rgb;
+	}
+
+
+	TEST_CLASS(SyntheticCaptureDeviceTests)
+	{
+	public:
+
+		// Every RGB encoding has to come back out of the RGB48 formatter within the precision of the encoding
+		TEST_METHOD(SyntheticFrameEncodeRGBRoundtripTest)
+		{
+			const uint32_t width = 1920;
+			const uint32_t height = 128;
+			const std::vector<uint16_t> rgb = SyntheticRandomRow(width);
+
+			const std::pair<VideoFrameEncoding, int> encodings[] = {
+				{ VideoFrameEncoding::R210, 10 },
+				{ VideoFrameEncoding::R10b, 10 },
+				{ VideoFrameEncoding::R10l, 10 },
+				{ VideoFrameEncoding::R12B, 12 },
+				{ VideoFrameEncoding::R12L, 12 } };
+
+			for (const auto& encoding : encodings)
+			{
+				VideoStateComPtr vs = new VideoState();
+				vs->valid = true;
+				vs->displayMode = std::make_shared<DisplayMode>(width, height, false /* interlaced */, 24000, 1000);
+				vs->videoFrameEncoding = encoding.first;
+
+				std::vector<uint8_t> in(vs->BytesPerFrame());
+				for (uint32_t y = 0; y < height; y++)
+					SyntheticFrameEncodeRow(encoding.first, ColorSpace::REC_709, rgb.data(), width, &in[y * vs->BytesPerRow()], vs->BytesPerRow());
+
+				CRGBtoRGB48VideoFrameFormatter vff(CpuInstructionSet::SCALAR);
+				vff.OnVideoState(vs);
+
+				std::vector<uint16_t> out(width * height * 3);
+				Assert::IsTrue(vff.FormatVideoFrame(VideoFrame(in.data(), 0, 0, nullptr), (BYTE*)out.data()));
+
+				const int maxError = 1 << (16 - encoding.second);
+				for (uint32_t y = 0; y < height; y++)
+				{
+					for (uint32_t i = 0; i < width * 3; i++)
+						Assert::IsTrue(abs((int)out[y * width * 3 + i] - (int)rgb[i]) <= maxError);
+				}
+			}
+		}
+
+		// 75% gray is Y 721, Cb and Cr 512 in 10-bit limited range
+		TEST_METHOD(SyntheticFrameEncodeV210Test)
+		{
+			const uint32_t width = 1920;
+			const uint32_t height = 1080;
+			const std::vector<uint16_t> rgb(width * 3, 49151);
+
+			VideoStateComPtr vs = new VideoState();
+			vs->valid = true;
+			vs->displayMode = std::make_shared<DisplayMode>(width, height, false /* interlaced */, 60000, 1001);
+			vs->videoFrameEncoding = VideoFrameEncoding::V210;
+
+			std::vector<uint8_t> in(vs->BytesPerFrame(), 0xAB);
+			for (uint32_t y = 0; y < height; y++)
+				SyntheticFrameEncodeRow(VideoFrameEncoding::V210, ColorSpace::REC_709, rgb.data(), width, &in[y * vs->BytesPerRow()], vs->BytesPerRow());
+
+			CV210toP210VideoFrameFormatter vff(CpuInstructionSet::SCALAR);
+			vff.OnVideoState(vs);
+
+			std::vector<uint16_t> out(vff.GetOutFrameSize() / sizeof(uint16_t));
+			Assert::IsTrue(vff.FormatVideoFrame(VideoFrame(in.data(), 0, 0, nullptr), (BYTE*)out.data()));
+
+			for (size_t i = 0; i < width * height; i++)
+				Assert::AreEqual((uint16_t)(721 << 6), out[i]);
+			for (size_t i = width * height; i < out.size(); i++)
+				Assert::AreEqual((uint16_t)(512 << 6), out[i]);
+		}
+
+		// Callbacks in the same order as a card, frames at the rate of the display mode
+		TEST_METHOD(SyntheticCaptureDeviceCaptureTest)
+		{
+			SyntheticCaptureSignal signal;
+			signal.displayMode = std::make_shared<DisplayMode>(1920, 1080, false /* interlaced */, 60000, 1000);
+			signal.pattern = SyntheticFramePattern::MOVING_GRADIENT;
+
+			SyntheticCaptureDeviceTestCallback callback;
+
+			ACaptureDeviceComPtr captureDevice = new SyntheticCaptureDevice(signal);
+			captureDevice->SetCallbackHandler(&callback);
+			Assert::IsTrue(captureDevice->GetTimingClock() == nullptr);
+
+			captureDevice->StartCapture();
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+			ITimingClock* timingClock = captureDevice->GetTimingClock();
+			Assert::IsTrue(timingClock != nullptr);
+
+			// A mode change re-locks
+			signal.displayMode = std::make_shared<DisplayMode>(1280, 720, false /* interlaced */, 50000, 1000);
+			((SyntheticCaptureDevice*)(ACaptureDevice*)captureDevice)->SetSignal(signal);
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+			captureDevice->StopCapture();
+
+			std::lock_guard<std::mutex> lock(callback.mutex);
+
+			// ready, invalid, capturing, card state, valid, frames, invalid, card state, valid, frames, ready
+			Assert::AreEqual(std::string("svCcVfvcVfs"), callback.events);
+			Assert::AreEqual(1280u, callback.lastVideoState->displayMode->FrameWidth());
+
+			// Around 30 frames of the first mode and 10 of the second
+			Assert::IsTrue(callback.timestamps.size() > 30);
+			Assert::IsTrue(callback.timestamps.size() < 60);
+			Assert::AreEqual(
+				callback.timestamps.size(),
+				(size_t)(captureDevice->VideoFrameCapturedCount() - captureDevice->VideoFrameMissedCount()));
+
+			for (size_t i = 1; i < callback.timestamps.size(); i++)
+			{
+				Assert::IsTrue(callback.timestamps[i] > callback.timestamps[i - 1]);
+				Assert::IsTrue(callback.counters[i] > callback.counters[i - 1]);
+			}
+
+			// The first mode is exactly 60 Hz
+			Assert::AreEqual(
+				(timingclocktime_t)((callback.counters[10] - callback.counters[9]) * timingClock->TimingClockTicksPerSecond() / 60),
+				callback.timestamps[10] - callback.timestamps[9]);
+
+			captureDevice->SetCallbackHandler(nullptr);
+		}
+	};
+}
@@ -0,0 +1,198 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <cstdlib>
+#include <random>
+
+#include <TimestampSmoother.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	static const timingclocktime_t TICKS_PER_SECOND = 10000000LL;
+	static const double TICKS_PER_FRAME = TICKS_PER_SECOND / 60.0;
+
+
+	// Everything recorded into a histogram
+	static LatencyHistogramSummary Summarize(const CLatencyHistogram& histogram)
+	{
+		LatencyHistogramCounts counts;
+		histogram.Snapshot(counts);
+
+		return CLatencyHistogram::Summarize(LatencyHistogramCounts(), counts);
+	}
+
+
+	// Frame timestamps with up to the given jitter either way
+	class JitteryTimestamps
+	{
+	public:
+
+		JitteryTimestamps(double ticksPerFrame, timingclocktime_t jitterTicks):
+			m_ticksPerFrame(ticksPerFrame),
+			m_jitter(-jitterTicks, jitterTicks)
+		{
+		}
+
+		// Timestamp the frame would have without jitter
+		timingclocktime_t Exact(uint64_t frame) const
+		{
+			return TICKS_PER_SECOND + (timingclocktime_t)llround(frame * m_ticksPerFrame);
+		}
+
+		timingclocktime_t operator()(uint64_t frame)
+		{
+			return Exact(frame) + m_jitter(m_random);
+		}
+
+	private:
+
+		const double m_ticksPerFrame;
+		std::uniform_int_distribution<timingclocktime_t> m_jitter;
+		std::mt19937 m_random;
+	};
+
+
+	TEST_CLASS(TimestampSmootherTests)
+	{
+	public:
+
+		TEST_METHOD(TimestampSmootherReducesJitterTest)
+		{
+			CTimestampSmoother timestampSmoother;
+			timestampSmoother.SetFrameDuration(TICKS_PER_FRAME, TICKS_PER_SECOND);
+
+			// 0.5ms jitter either way, like a thread waking up late
+			JitteryTimestamps timestamps(TICKS_PER_FRAME, TICKS_PER_SECOND / 2000);
+
+			timingclocktime_t previous = 0;
+			for (uint64_t frame = 0; frame < 2000; frame++)
+			{
+				const timingclocktime_t smoothed = timestampSmoother.Smooth(timestamps(frame));
+				Assert::IsTrue(smoothed > previous);
+				previous = smoothed;
+
+				// Settled on the exact timestamps, closer than the input gets
+				if (frame > 200)
+					Assert::IsTrue(std::abs(smoothed - timestamps.Exact(frame)) < TICKS_PER_SECOND / 4000);
+			}
+
+			Assert::AreEqual((uint64_t)1, timestampSmoother.LockCount());
+
+			const LatencyHistogramSummary input = Summarize(timestampSmoother.Jitter().input);
+			const LatencyHistogramSummary output = Summarize(timestampSmoother.Jitter().output);
+
+			Assert::AreEqual((uint64_t)1999, input.count);
+			Assert::AreEqual((uint64_t)1999, output.count);
+			Assert::IsTrue(input.p99Ms > 0.5);
+			Assert::IsTrue(output.p99Ms < input.p99Ms / 10);
+		}
+
+
+		TEST_METHOD(TimestampSmootherFollowsDriftTest)
+		{
+			CTimestampSmoother timestampSmoother;
+			timestampSmoother.SetFrameDuration(TICKS_PER_FRAME, TICKS_PER_SECOND);
+
+			// Input clock running 200ppm fast, so there are less ticks to a frame
+			const double ticksPerFrame = TICKS_PER_FRAME / (1.0 + 200.0 / 1000000.0);
+			JitteryTimestamps timestamps(ticksPerFrame, TICKS_PER_SECOND / 10000);
+
+			for (uint64_t frame = 0; frame < 3000; frame++)
+			{
+				const timingclocktime_t smoothed = timestampSmoother.Smooth(timestamps(frame));
+
+				// Does not fall behind
+				if (frame > 500)
+					Assert::IsTrue(std::abs(smoothed - timestamps.Exact(frame)) < TICKS_PER_SECOND / 10000);
+			}
+
+			Assert::AreEqual((uint64_t)1, timestampSmoother.LockCount());
+			Assert::AreEqual(200.0, timestampSmoother.FrequencyOffsetPpm(), 20.0);
+
+			// Starting over goes back to the nominal frame duration
+			timestampSmoother.Reset();
+			Assert::AreEqual(0.0, timestampSmoother.FrequencyOffsetPpm());
+		}
+
+
+		TEST_METHOD(TimestampSmootherMissedFramesTest)
+		{
+			CTimestampSmoother timestampSmoother;
+			timestampSmoother.SetFrameDuration(TICKS_PER_FRAME, TICKS_PER_SECOND);
+
+			JitteryTimestamps timestamps(TICKS_PER_FRAME, TICKS_PER_SECOND / 2000);
+
+			for (uint64_t frame = 0; frame < 1000; frame++)
+			{
+				// Every so often a few go missing
+				if (frame % 100 > 96)
+					continue;
+
+				const timingclocktime_t smoothed = timestampSmoother.Smooth(timestamps(frame));
+				if (frame > 200)
+					Assert::IsTrue(std::abs(smoothed - timestamps.Exact(frame)) < TICKS_PER_SECOND / 4000);
+			}
+
+			Assert::AreEqual((uint64_t)1, timestampSmoother.LockCount());
+
+			// Gaps don't count as jitter
+			Assert::IsTrue(Summarize(timestampSmoother.Jitter().input).maxMs < 1.1);
+		}
+
+
+		TEST_METHOD(TimestampSmootherRelockTest)
+		{
+			CTimestampSmoother timestampSmoother;
+			timestampSmoother.SetFrameDuration(TICKS_PER_FRAME, TICKS_PER_SECOND);
+
+			JitteryTimestamps timestamps(TICKS_PER_FRAME, TICKS_PER_SECOND / 2000);
+
+			for (uint64_t frame = 0; frame < 500; frame++)
+				timestampSmoother.Smooth(timestamps(frame));
+
+			// Jump forward by half a frame goes straight to the new timestamp
+			timingclocktime_t timestamp = timestamps.Exact(500) + (timingclocktime_t)(TICKS_PER_FRAME / 2);
+			Assert::AreEqual(timestamp, timestampSmoother.Smooth(timestamp));
+			Assert::AreEqual((uint64_t)2, timestampSmoother.LockCount());
+
+			// As does going back in time
+			timestamp = timestamps.Exact(100);
+			Assert::AreEqual(timestamp, timestampSmoother.Smooth(timestamp));
+			Assert::AreEqual((uint64_t)3, timestampSmoother.LockCount());
+
+			// And from there it's smooth again
+			for (uint64_t frame = 101; frame < 300; frame++)
+				timestampSmoother.Smooth(timestamps(frame));
+
+			Assert::AreEqual((uint64_t)3, timestampSmoother.LockCount());
+
+			// Reset locks onto the next one
+			timestampSmoother.Reset();
+			timestamp = timestamps(300);
+			Assert::AreEqual(timestamp, timestampSmoother.Smooth(timestamp));
+			Assert::AreEqual((uint64_t)4, timestampSmoother.LockCount());
+		}
+
+
+		TEST_METHOD(TimestampSmootherConfigTest)
+		{
+			TimestampSmootherConfig config;
+			config.phaseGain = 0.0;
+			Assert::ExpectException<std::runtime_error>([&]() { CTimestampSmoother timestampSmoother(config); });
+
+			config = TimestampSmootherConfig();
+			config.frequencyGain = config.phaseGain;
+			Assert::ExpectException<std::runtime_error>([&]() { CTimestampSmoother timestampSmoother(config); });
+
+			config = TimestampSmootherConfig();
+			config.relockFrames = 0.5;
+			Assert::ExpectException<std::runtime_error>([&]() { CTimestampSmoother timestampSmoother(config); });
+
+			CTimestampSmoother timestampSmoother;
+			Assert::ExpectException<std::runtime_error>([&]() { timestampSmoother.SetFrameDuration(0.0, TICKS_PER_SECOND); });
+		}
+	};
+}
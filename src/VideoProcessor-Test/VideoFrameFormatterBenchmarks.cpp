@@ -0,0 +1,325 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <CpuFeatures.h>
+#include <WorkerPool.h>
+#include <video_frame_formatter/CNoopVideoFrameFormatter.h>
+#include <video_frame_formatter/CFFMpegDecoderVideoFrameFormatter.h>
+#include <video_frame_formatter/CV210toP010VideoFrameFormatter.h>
+#include <video_frame_formatter/CV210toP210VideoFrameFormatter.h>
+#include <video_frame_formatter/CRGBtoRGB48VideoFrameFormatter.h>
+
+#include "BenchmarkStatistics.h"
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	// Runs the formatter for a number of frames and returns input bytes/second
+	static double BenchmarkFormatter(IVideoFrameFormatter& vff, VideoStateComPtr& vs, int frames)
+	{
+		vff.OnVideoState(vs);
+
+		std::vector<uint8_t> in(vs->BytesPerFrame(), 0x55);
+		std::vector<uint8_t> out(vff.GetOutFrameSize());
+		const VideoFrame videoFrame(in.data(), 0, 0, nullptr);
+
+		// Warm up caches and page in the buffers
+		vff.FormatVideoFrame(videoFrame, out.data());
+
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++)
+			vff.FormatVideoFrame(videoFrame, out.data());
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		return ((double)in.size() * frames) / elapsed.count();
+	}
+
+
+	// Formats frames until both the minimum iterations and time are reached (or the maximum iterations)
+	// and returns the duration of every frame in nanoseconds, sorted
+	static std::vector<double> BenchmarkFormatterFrameTimes(IVideoFrameFormatter& vff, VideoStateComPtr& vs)
+	{
+		const size_t minIterations = 100;
+		const size_t maxIterations = 5000;
+		const std::chrono::milliseconds minDuration(1000);
+
+		vff.OnVideoState(vs);
+
+		// Random input so that no branch or decoder shortcut gets an easy ride
+		std::vector<uint8_t> in(vs->BytesPerFrame());
+		std::mt19937 rng(42);
+		for (auto& b : in)
+			b = (uint8_t)rng();
+
+		std::vector<uint8_t> out(vff.GetOutFrameSize());
+		const VideoFrame videoFrame(in.data(), 0, 0, nullptr);
+
+		// Warm up caches and page in the buffers
+		vff.FormatVideoFrame(videoFrame, out.data());
+
+		std::vector<double> frameTimes;
+		frameTimes.reserve(maxIterations);
+
+		const auto start = std::chrono::steady_clock::now();
+		while (frameTimes.size() < maxIterations &&
+			(frameTimes.size() < minIterations || std::chrono::steady_clock::now() - start < minDuration))
+		{
+			const auto frameStart = std::chrono::steady_clock::now();
+			vff.FormatVideoFrame(videoFrame, out.data());
+			const std::chrono::duration<double, std::nano> frameTime = std::chrono::steady_clock::now() - frameStart;
+
+			frameTimes.push_back(frameTime.count());
+		}
+
+		std::sort(frameTimes.begin(), frameTimes.end());
+		return frameTimes;
+	}
+
+
+	TEST_CLASS(VideoFrameFormatterBenchmarks)
+	{
+	public:
+
+		// Runs every formatter over every encoding it handles at the common DeckLink modes and logs the results
+		// as CSV lines (prefixed with "csv,") so they can be collected and compared between runs
+		TEST_METHOD(FormatterSuiteBenchmark)
+		{
+			struct Mode
+			{
+				const TCHAR* name;
+				unsigned int width;
+				unsigned int height;
+				unsigned int timeScale;
+			};
+
+			const Mode modes[] = {
+				{ TEXT("1080p24"), 1920, 1080, 24000 },
+				{ TEXT("1080p30"), 1920, 1080, 30000 },
+				{ TEXT("1080p60"), 1920, 1080, 60000 },
+				{ TEXT("2160p24"), 3840, 2160, 24000 },
+				{ TEXT("2160p30"), 3840, 2160, 30000 },
+				{ TEXT("2160p60"), 3840, 2160, 60000 }
+			};
+
+			struct Encoding
+			{
+				const TCHAR* name;
+				VideoFrameEncoding videoFrameEncoding;
+			};
+
+			const Encoding v210[] = { { TEXT("v210"), VideoFrameEncoding::V210 } };
+			const Encoding rgb[] = {
+				{ TEXT("r210"), VideoFrameEncoding::R210 },
+				{ TEXT("R10b"), VideoFrameEncoding::R10b },
+				{ TEXT("R10l"), VideoFrameEncoding::R10l },
+				{ TEXT("R12B"), VideoFrameEncoding::R12B },
+				{ TEXT("R12L"), VideoFrameEncoding::R12L }
+			};
+			const Encoding all[] = {
+				{ TEXT("UYVY"), VideoFrameEncoding::UYVY },
+				{ TEXT("HDYC"), VideoFrameEncoding::HDYC },
+				{ TEXT("v210"), VideoFrameEncoding::V210 },
+				{ TEXT("ARGB"), VideoFrameEncoding::ARGB_8BIT },
+				{ TEXT("BGRA"), VideoFrameEncoding::BGRA_8BIT },
+				{ TEXT("r210"), VideoFrameEncoding::R210 },
+				{ TEXT("R10b"), VideoFrameEncoding::R10b },
+				{ TEXT("R10l"), VideoFrameEncoding::R10l },
+				{ TEXT("R12B"), VideoFrameEncoding::R12B },
+				{ TEXT("R12L"), VideoFrameEncoding::R12L }
+			};
+			const Encoding r210[] = { { TEXT("r210"), VideoFrameEncoding::R210 } };
+			const Encoding r12b[] = { { TEXT("R12B"), VideoFrameEncoding::R12B } };
+
+			struct Formatter
+			{
+				const TCHAR* name;
+				CpuInstructionSet instructionSet;  // Skipped if not supported by the CPU
+				const Encoding* encodings;
+				size_t encodingCount;
+				std::function<IVideoFrameFormatter*(CpuInstructionSet)> build;
+			};
+
+#define BENCHMARK_ENCODINGS(e) e, sizeof(e) / sizeof(e[0])
+
+			std::vector<Formatter> formatters;
+			for (const CpuInstructionSet instructionSet : { CpuInstructionSet::SCALAR, CpuInstructionSet::SSE41, CpuInstructionSet::AVX2 })
+			{
+				formatters.push_back({ TEXT("V210toP010"), instructionSet, BENCHMARK_ENCODINGS(v210), [](CpuInstructionSet i) { return new CV210toP010VideoFrameFormatter(i); } });
+				formatters.push_back({ TEXT("V210toP210"), instructionSet, BENCHMARK_ENCODINGS(v210), [](CpuInstructionSet i) { return new CV210toP210VideoFrameFormatter(i); } });
+				formatters.push_back({ TEXT("RGBtoRGB48"), instructionSet, BENCHMARK_ENCODINGS(rgb), [](CpuInstructionSet i) { return new CRGBtoRGB48VideoFrameFormatter(i); } });
+			}
+
+			formatters.push_back({ TEXT("Noop"), CpuInstructionSet::SCALAR, BENCHMARK_ENCODINGS(all), [](CpuInstructionSet) { return new CNoopVideoFrameFormatter(); } });
+			formatters.push_back({ TEXT("FFMpegR210toRGB48LE"), CpuInstructionSet::SCALAR, BENCHMARK_ENCODINGS(r210), [](CpuInstructionSet) { return new CFFMpegDecoderVideoFrameFormatter(AV_CODEC_ID_R210, AV_PIX_FMT_RGB48LE); } });
+			formatters.push_back({ TEXT("FFMpegR12BtoRGB48LE"), CpuInstructionSet::SCALAR, BENCHMARK_ENCODINGS(r12b), [](CpuInstructionSet) { return new CFFMpegDecoderVideoFrameFormatter(AV_CODEC_ID_R12B, AV_PIX_FMT_RGB48LE); } });
+
+#undef BENCHMARK_ENCODINGS
+
+			Logger::WriteMessage(TEXT("csv,formatter,instruction_set,encoding,mode,iterations,ns_per_frame,gb_per_s,p50_ns,p99_ns,max_ns,frame_budget_pct\n"));
+
+			for (const Formatter& formatter : formatters)
+			{
+				if (CpuClampInstructionSet(formatter.instructionSet) != formatter.instructionSet)
+					continue;
+
+				for (size_t e = 0; e < formatter.encodingCount; e++)
+				{
+					const Encoding& encoding = formatter.encodings[e];
+
+					for (const Mode& mode : modes)
+					{
+						VideoStateComPtr vs = new VideoState();
+						vs->valid = true;
+						vs->displayMode = std::make_shared<DisplayMode>(mode.width, mode.height, false /* interlaced */, mode.timeScale, 1000);
+						vs->videoFrameEncoding = encoding.videoFrameEncoding;
+
+						std::unique_ptr<IVideoFrameFormatter> vff(formatter.build(formatter.instructionSet));
+						const std::vector<double> frameTimes = BenchmarkFormatterFrameTimes(*vff, vs);
+
+						double totalNs = 0.0;
+						for (const double frameTime : frameTimes)
+							totalNs += frameTime;
+
+						const double meanNs = totalNs / frameTimes.size();
+						const double frameBudgetNs = 1e9 * 1000.0 / mode.timeScale;
+
+						CString s;
+						s.Format(
+							TEXT("csv,%s,%s,%s,%s,%zu,%.0f,%.3f,%.0f,%.0f,%.0f,%.1f\n"),
+							formatter.name, ToString(formatter.instructionSet), encoding.name, mode.name,
+							frameTimes.size(),
+							meanNs,
+							vs->BytesPerFrame() / meanNs,  // Bytes per ns is GB/s
+							Percentile(frameTimes, 50.0),
+							Percentile(frameTimes, 99.0),
+							frameTimes.back(),
+							meanNs / frameBudgetNs * 100.0);
+						Logger::WriteMessage(s);
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(RGBUnpackBenchmark)
+		{
+			const int frames = 30;
+
+			for (const VideoFrameEncoding videoFrameEncoding : {
+				VideoFrameEncoding::R210, VideoFrameEncoding::R10b, VideoFrameEncoding::R10l,
+				VideoFrameEncoding::R12B, VideoFrameEncoding::R12L })
+			{
+				VideoStateComPtr vs = new VideoState();
+				vs->valid = true;
+				vs->displayMode = std::make_shared<DisplayMode>(3840, 2160, false /* interlaced */, 60000, 1000);
+				vs->videoFrameEncoding = videoFrameEncoding;
+
+				for (const CpuInstructionSet instructionSet : { CpuInstructionSet::SCALAR, CpuInstructionSet::SSE41, CpuInstructionSet::AVX2 })
+				{
+					if (CpuClampInstructionSet(instructionSet) != instructionSet)
+						continue;  // Not supported by this CPU
+
+					CRGBtoRGB48VideoFrameFormatter rgb48(instructionSet);
+
+					CString s;
+					s.Format(
+						TEXT("2160p %-32s %-6s RGB48 %8.1f MB/s\n"),
+						ToString(videoFrameEncoding), ToString(instructionSet),
+						BenchmarkFormatter(rgb48, vs, frames) / 1e6);
+					Logger::WriteMessage(s);
+				}
+			}
+
+			// The ffmpeg decode + swscale path this replaced, for reference
+			for (const VideoFrameEncoding videoFrameEncoding : { VideoFrameEncoding::R210, VideoFrameEncoding::R12B })
+			{
+				VideoStateComPtr vs = new VideoState();
+				vs->valid = true;
+				vs->displayMode = std::make_shared<DisplayMode>(3840, 2160, false /* interlaced */, 60000, 1000);
+				vs->videoFrameEncoding = videoFrameEncoding;
+
+				CFFMpegDecoderVideoFrameFormatter ffmpeg(
+					videoFrameEncoding == VideoFrameEncoding::R210 ? AV_CODEC_ID_R210 : AV_CODEC_ID_R12B,
+					AV_PIX_FMT_RGB48LE);
+
+				CString s;
+				s.Format(
+					TEXT("2160p %-32s ffmpeg RGB48 %8.1f MB/s\n"),
+					ToString(videoFrameEncoding),
+					BenchmarkFormatter(ffmpeg, vs, frames) / 1e6);
+				Logger::WriteMessage(s);
+			}
+		}
+
+		TEST_METHOD(StripedFormattingSpeedupBenchmark)
+		{
+			const int frames = 30;
+
+			struct Case
+			{
+				const TCHAR* name;
+				VideoFrameEncoding videoFrameEncoding;
+				std::function<IVideoFrameFormatter*()> build;
+			};
+
+			const Case cases[] = {
+				{ TEXT("V210->P010"), VideoFrameEncoding::V210, [] { return new CV210toP010VideoFrameFormatter(); } },
+				{ TEXT("V210->P210"), VideoFrameEncoding::V210, [] { return new CV210toP210VideoFrameFormatter(); } },
+				{ TEXT("R210->RGB48LE"), VideoFrameEncoding::R210, [] { return new CFFMpegDecoderVideoFrameFormatter(AV_CODEC_ID_R210, AV_PIX_FMT_RGB48LE); } },
+				{ TEXT("R12B->RGB48LE"), VideoFrameEncoding::R12B, [] { return new CFFMpegDecoderVideoFrameFormatter(AV_CODEC_ID_R12B, AV_PIX_FMT_RGB48LE); } },
+				{ TEXT("R210->RGB48"), VideoFrameEncoding::R210, [] { return new CRGBtoRGB48VideoFrameFormatter(); } },
+				{ TEXT("R12B->RGB48"), VideoFrameEncoding::R12B, [] { return new CRGBtoRGB48VideoFrameFormatter(); } },
+				{ TEXT("Noop"), VideoFrameEncoding::V210, [] { return new CNoopVideoFrameFormatter(); } }
+			};
+
+			const unsigned int maxWorkers = std::max(std::thread::hardware_concurrency(), 1u);
+
+			for (const Case& c : cases)
+			{
+				VideoStateComPtr vs = new VideoState();
+				vs->valid = true;
+				vs->displayMode = std::make_shared<DisplayMode>(3840, 2160, false /* interlaced */, 60000, 1000);
+				vs->videoFrameEncoding = c.videoFrameEncoding;
+
+				double singleBytesPerSecond = 0.0;
+
+				for (unsigned int workers = 1; workers <= maxWorkers; workers *= 2)
+				{
+					std::unique_ptr<IVideoFrameFormatter> vff(c.build());
+					std::unique_ptr<CWorkerPool> workerPool;
+
+					if (workers > 1)
+					{
+						workerPool.reset(new CWorkerPool(workers));
+						vff->SetWorkerPool(workerPool.get());
+					}
+
+					const double bytesPerSecond = BenchmarkFormatter(*vff, vs, frames);
+					if (workers == 1)
+						singleBytesPerSecond = bytesPerSecond;
+
+					CString s;
+					s.Format(
+						TEXT("2160p60 %-14s %2u workers %7.2f ms/frame, speedup %.2fx\n"),
+						c.name, workers,
+						vs->BytesPerFrame() / bytesPerSecond * 1000.0,
+						bytesPerSecond / singleBytesPerSecond);
+					Logger::WriteMessage(s);
+
+					// Formatter goes before the pool
+					vff.reset();
+				}
+			}
+		}
+	};
+}
@@ -1,16 +1,174 @@
 #include "pch.h"
 #include "CppUnitTest.h"
 
+#include <vector>
+#include <random>
+
 #include <video_frame_formatter/CNoopVideoFrameFormatter.h>
 #include <video_frame_formatter/CFFMpegDecoderVideoFrameFormatter.h>
 #include <video_frame_formatter/CV210toP010VideoFrameFormatter.h>
 #include <video_frame_formatter/CV210toP210VideoFrameFormatter.h>
+#include <video_frame_formatter/CRGBtoRGB48VideoFrameFormatter.h>
+#include <WorkerPool.h>
 
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace Tests
 {
+	// Formats a random frame with every instruction set and checks the output is identical to the scalar version
+	template<class T>
+	static void AssertInstructionSetsIdentical(VideoFrameEncoding videoFrameEncoding)
+	{
+		VideoStateComPtr vs = new VideoState();
+		vs->valid = true;
+		vs->displayMode = std::make_shared<DisplayMode>(1920, 1080, false /* interlaced */, 24000, 1000);
+		vs->videoFrameEncoding = videoFrameEncoding;
+
+		// Random input, every bit pattern has to come out the same
+		std::vector<uint8_t> in(vs->BytesPerFrame());
+		std::mt19937 rng(42);
+		for (auto& b : in)
+			b = (uint8_t)rng();
+
+		const VideoFrame videoFrame(in.data(), 0, 0, nullptr);
+
+		T reference(CpuInstructionSet::SCALAR);
+		reference.OnVideoState(vs);
+		std::vector<uint8_t> referenceOut(reference.GetOutFrameSize());
+		Assert::IsTrue(reference.FormatVideoFrame(videoFrame, referenceOut.data()));
+
+		for (const CpuInstructionSet instructionSet : { CpuInstructionSet::SSE41, CpuInstructionSet::AVX2 })
+		{
+			T vff(instructionSet);
+			vff.OnVideoState(vs);
+
+			// Guard area after the frame to catch overruns
+			std::vector<uint8_t> out(vff.GetOutFrameSize() + 64, 0xAB);
+			Assert::IsTrue(vff.FormatVideoFrame(videoFrame, out.data()));
+
+			Assert::IsTrue(std::equal(referenceOut.begin(), referenceOut.end(), out.begin()));
+			for (size_t i = referenceOut.size(); i < out.size(); i++)
+				Assert::AreEqual((uint8_t)0xAB, out[i]);
+		}
+	}
+
+
+	// Formats a black frame where only the first pixel is given, checks the first RGB48 pixel and that the rest is black
+	static void AssertRGB48FirstPixel(VideoFrameEncoding videoFrameEncoding, std::vector<uint8_t> firstPixelBytes, uint16_t r, uint16_t g, uint16_t b)
+	{
+		VideoStateComPtr vs = new VideoState();
+		vs->valid = true;
+		vs->displayMode = std::make_shared<DisplayMode>(128, 128, false /* interlaced */, 24000, 1000);
+		vs->videoFrameEncoding = videoFrameEncoding;
+
+		std::vector<uint8_t> in(vs->BytesPerFrame(), 0);
+		std::copy(firstPixelBytes.begin(), firstPixelBytes.end(), in.begin());
+		const VideoFrame videoFrame(in.data(), 0, 0, nullptr);
+
+		for (const CpuInstructionSet instructionSet : { CpuInstructionSet::SCALAR, CpuInstructionSet::SSE41, CpuInstructionSet::AVX2 })
+		{
+			CRGBtoRGB48VideoFrameFormatter vff(instructionSet);
+			vff.OnVideoState(vs);
+			Assert::AreEqual(128L * 128 * 6, vff.GetOutFrameSize());
+
+			std::vector<uint16_t> out(128 * 128 * 3, 0xABAB);
+			Assert::IsTrue(vff.FormatVideoFrame(videoFrame, (BYTE*)out.data()));
+
+			Assert::AreEqual(r, out[0]);
+			Assert::AreEqual(g, out[1]);
+			Assert::AreEqual(b, out[2]);
+			for (size_t i = 3; i < out.size(); i++)
+				Assert::AreEqual((uint16_t)0, out[i]);
+		}
+	}
+
+
+	// Formats a random frame with the ffmpeg decoder the renderers used to convert to RGB48 with and with the native
+	// formatter, the output has to be identical. ffmpeg has no decoders for the little endian encodings, those are
+	// given to the decoder of their big endian twin with every 32-bit word byte swapped.
+	static void AssertRGB48SameAsFFMpeg(VideoFrameEncoding videoFrameEncoding, AVCodecID codecId, VideoFrameEncoding codecVideoFrameEncoding)
+	{
+		const DisplayModeSharedPtr displayMode = std::make_shared<DisplayMode>(1920, 1080, false /* interlaced */, 24000, 1000);
+
+		VideoStateComPtr vs = new VideoState();
+		vs->valid = true;
+		vs->displayMode = displayMode;
+		vs->videoFrameEncoding = videoFrameEncoding;
+
+		std::vector<uint8_t> in(vs->BytesPerFrame());
+		std::mt19937 rng(42);
+		for (auto& b : in)
+			b = (uint8_t)rng();
+
+		std::vector<uint8_t> codecIn(in);
+		if (codecVideoFrameEncoding != videoFrameEncoding)
+		{
+			for (size_t i = 0; i + 4 <= codecIn.size(); i += 4)
+			{
+				std::swap(codecIn[i], codecIn[i + 3]);
+				std::swap(codecIn[i + 1], codecIn[i + 2]);
+			}
+		}
+
+		VideoStateComPtr codecVs = new VideoState();
+		codecVs->valid = true;
+		codecVs->displayMode = displayMode;
+		codecVs->videoFrameEncoding = codecVideoFrameEncoding;
+		Assert::AreEqual(vs->BytesPerFrame(), codecVs->BytesPerFrame());
+
+		CFFMpegDecoderVideoFrameFormatter reference(codecId, AV_PIX_FMT_RGB48LE);
+		reference.OnVideoState(codecVs);
+		std::vector<uint8_t> referenceOut(reference.GetOutFrameSize());
+		Assert::IsTrue(reference.FormatVideoFrame(VideoFrame(codecIn.data(), 0, 0, nullptr), referenceOut.data()));
+
+		for (const CpuInstructionSet instructionSet : { CpuInstructionSet::SCALAR, CpuInstructionSet::SSE41, CpuInstructionSet::AVX2 })
+		{
+			CRGBtoRGB48VideoFrameFormatter vff(instructionSet);
+			vff.OnVideoState(vs);
+			Assert::AreEqual(reference.GetOutFrameSize(), vff.GetOutFrameSize());
+
+			std::vector<uint8_t> out(vff.GetOutFrameSize(), 0xAB);
+			Assert::IsTrue(vff.FormatVideoFrame(VideoFrame(in.data(), 0, 0, nullptr), out.data()));
+			Assert::IsTrue(referenceOut == out);
+		}
+	}
+
+
+	// Formats a random frame with the formatter on its own and striped over a worker pool, output has to be identical
+	static void AssertStripedIdentical(IVideoFrameFormatter& vff, VideoFrameEncoding videoFrameEncoding)
+	{
+		VideoStateComPtr vs = new VideoState();
+		vs->valid = true;
+		vs->displayMode = std::make_shared<DisplayMode>(1920, 1080, false /* interlaced */, 24000, 1000);
+		vs->videoFrameEncoding = videoFrameEncoding;
+
+		std::vector<uint8_t> in(vs->BytesPerFrame());
+		std::mt19937 rng(42);
+		for (auto& b : in)
+			b = (uint8_t)rng();
+
+		const VideoFrame videoFrame(in.data(), 0, 0, nullptr);
+
+		vff.OnVideoState(vs);
+		std::vector<uint8_t> referenceOut(vff.GetOutFrameSize());
+		Assert::IsTrue(vff.FormatVideoFrame(videoFrame, referenceOut.data()));
+
+		// Includes worker counts which do not divide the frame evenly
+		for (const unsigned int workers : { 2u, 3u, 7u })
+		{
+			CWorkerPool workerPool(workers);
+			vff.SetWorkerPool(&workerPool);
+
+			std::vector<uint8_t> out(vff.GetOutFrameSize(), 0xAB);
+			Assert::IsTrue(vff.FormatVideoFrame(videoFrame, out.data()));
+			Assert::IsTrue(referenceOut == out);
+
+			vff.SetWorkerPool(nullptr);
+		}
+	}
+
+
 	TEST_CLASS(VideoFrameFormatterTests)
 	{
 	public:
@@ -45,6 +203,11 @@ namespace Tests
 			Assert::AreEqual(6220800L, vff.GetOutFrameSize());
 		}
 
+		TEST_METHOD(CV210toP010VideoFrameFormatterInstructionSetTest)
+		{
+			AssertInstructionSetsIdentical<CV210toP010VideoFrameFormatter>(VideoFrameEncoding::V210);
+		}
+
 		TEST_METHOD(CV210toP210VideoFrameFormatterTest)
 		{
 			CV210toP210VideoFrameFormatter vff;
@@ -60,6 +223,41 @@ namespace Tests
 			Assert::AreEqual(8294400L, vff.GetOutFrameSize());
 		}
 
+		TEST_METHOD(CV210toP210VideoFrameFormatterInstructionSetTest)
+		{
+			AssertInstructionSetsIdentical<CV210toP210VideoFrameFormatter>(VideoFrameEncoding::V210);
+		}
+
+		TEST_METHOD(CRGBtoRGB48VideoFrameFormatterTest)
+		{
+			// R 0x3FF, G 0x200, B 0x001 and the 12-bit R 0xFFF, G 0x800, B 0x001, scaled up to 16 bits
+			AssertRGB48FirstPixel(VideoFrameEncoding::R210, { 0x3F, 0xF8, 0x00, 0x01 }, 0xFFFF, 0x8020, 0x0040);
+			AssertRGB48FirstPixel(VideoFrameEncoding::R10b, { 0xFF, 0xE0, 0x00, 0x04 }, 0xFFFF, 0x8020, 0x0040);
+			AssertRGB48FirstPixel(VideoFrameEncoding::R10l, { 0x04, 0x00, 0xE0, 0xFF }, 0xFFFF, 0x8020, 0x0040);
+			AssertRGB48FirstPixel(VideoFrameEncoding::R12B, { 0x01, 0x80, 0x0F, 0xFF }, 0xFFFF, 0x8008, 0x0010);
+			AssertRGB48FirstPixel(VideoFrameEncoding::R12L, { 0xFF, 0x0F, 0x80, 0x01 }, 0xFFFF, 0x8008, 0x0010);
+		}
+
+		TEST_METHOD(CRGBtoRGB48VideoFrameFormatterInstructionSetTest)
+		{
+			for (const VideoFrameEncoding videoFrameEncoding : {
+				VideoFrameEncoding::R210, VideoFrameEncoding::R10b, VideoFrameEncoding::R10l,
+				VideoFrameEncoding::R12B, VideoFrameEncoding::R12L })
+			{
+				AssertInstructionSetsIdentical<CRGBtoRGB48VideoFrameFormatter>(videoFrameEncoding);
+			}
+		}
+
+		// Replaces the ffmpeg conversion in the HDR renderers, so it has to come out the same
+		TEST_METHOD(CRGBtoRGB48VideoFrameFormatterFFMpegEquivalenceTest)
+		{
+			AssertRGB48SameAsFFMpeg(VideoFrameEncoding::R210, AV_CODEC_ID_R210, VideoFrameEncoding::R210);
+			AssertRGB48SameAsFFMpeg(VideoFrameEncoding::R10b, AV_CODEC_ID_R10K, VideoFrameEncoding::R10b);
+			AssertRGB48SameAsFFMpeg(VideoFrameEncoding::R10l, AV_CODEC_ID_R10K, VideoFrameEncoding::R10b);
+			AssertRGB48SameAsFFMpeg(VideoFrameEncoding::R12B, AV_CODEC_ID_R12B, VideoFrameEncoding::R12B);
+			AssertRGB48SameAsFFMpeg(VideoFrameEncoding::R12L, AV_CODEC_ID_R12B, VideoFrameEncoding::R12B);
+		}
+
 		TEST_METHOD(CFFMpegDecoderVideoFrameFormatterR210RGB48LETest)
 		{
 			CFFMpegDecoderVideoFrameFormatter vff(
@@ -93,5 +291,48 @@ namespace Tests
 
 			Assert::AreEqual(12441600L, vff.GetOutFrameSize());
 		}
+
+		TEST_METHOD(StripedVideoFrameFormatterTest)
+		{
+			CNoopVideoFrameFormatter noop;
+			AssertStripedIdentical(noop, VideoFrameEncoding::V210);
+
+			CV210toP010VideoFrameFormatter p010;
+			AssertStripedIdentical(p010, VideoFrameEncoding::V210);
+
+			CV210toP210VideoFrameFormatter p210;
+			AssertStripedIdentical(p210, VideoFrameEncoding::V210);
+
+			CFFMpegDecoderVideoFrameFormatter r210(AV_CODEC_ID_R210, AV_PIX_FMT_RGB48LE);
+			AssertStripedIdentical(r210, VideoFrameEncoding::R210);
+
+			CFFMpegDecoderVideoFrameFormatter r12b(AV_CODEC_ID_R12B, AV_PIX_FMT_RGB48LE);
+			AssertStripedIdentical(r12b, VideoFrameEncoding::R12B);
+
+			CRGBtoRGB48VideoFrameFormatter rgb48;
+			AssertStripedIdentical(rgb48, VideoFrameEncoding::R210);
+			AssertStripedIdentical(rgb48, VideoFrameEncoding::R12L);
+		}
+
+		TEST_METHOD(WorkerPoolSplitTest)
+		{
+			// Covers everything exactly once, aligned
+			for (const uint32_t parts : { 1u, 2u, 3u, 7u, 16u })
+			{
+				uint32_t expectedBegin = 0;
+				for (uint32_t part = 0; part < parts; part++)
+				{
+					uint32_t begin, end;
+					WorkerPoolSplit(1080, parts, part, 2, begin, end);
+
+					Assert::AreEqual(expectedBegin, begin);
+					Assert::AreEqual(0u, begin % 2);
+					Assert::IsTrue(end >= begin);
+					expectedBegin = end;
+				}
+
+				Assert::AreEqual(1080u, expectedBegin);
+			}
+		}
 	};
 }
@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include <utility>
+#include <vector>
+
+#include <VideoFrame.h>
+
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace Tests
+{
+	/**
+	 * Source buffer which only counts its references
+	 */
+	class CountingSourceBuffer:
+		public IUnknown
+	{
+	public:
+
+		HRESULT QueryInterface(REFIID iid, LPVOID* ppv) override { return E_NOINTERFACE; }
+		ULONG AddRef() override { return ++m_refCount; }
+		ULONG Release() override { return --m_refCount; }
+
+		ULONG m_refCount = 0;
+	};
+
+
+	TEST_CLASS(VideoFrameTests)
+	{
+	public:
+
+		// Holds a reference for as long as it lives
+		TEST_METHOD(VideoFrameLifetimeTest)
+		{
+			const uint8_t data[4] = { 0 };
+			CountingSourceBuffer sourceBuffer;
+
+			{
+				VideoFrame videoFrame(data, 1, 2, &sourceBuffer);
+				Assert::AreEqual((ULONG)1, sourceBuffer.m_refCount);
+				Assert::IsTrue(videoFrame.GetData() == data);
+				Assert::IsTrue(videoFrame.GetSourceBuffer() == &sourceBuffer);
+			}
+
+			Assert::AreEqual((ULONG)0, sourceBuffer.m_refCount);
+
+			// Also when unwinding
+			try
+			{
+				VideoFrame videoFrame(data, 1, 2, &sourceBuffer);
+				throw std::runtime_error("Unwind");
+			}
+			catch (std::runtime_error&)
+			{
+			}
+
+			Assert::AreEqual((ULONG)0, sourceBuffer.m_refCount);
+
+			// Unowned data is fine as well
+			VideoFrame unowned(data, 1, 2, nullptr);
+			Assert::IsTrue(unowned.GetSourceBuffer() == nullptr);
+		}
+
+		// Moving hands the reference over, the moved from frame is empty
+		TEST_METHOD(VideoFrameMoveTest)
+		{
+			const uint8_t data[4] = { 0 };
+			CountingSourceBuffer sourceBuffer;
+
+			VideoFrame videoFrame(data, 3, 4, &sourceBuffer);
+			VideoFrame moved(std::move(videoFrame));
+
+			Assert::AreEqual((ULONG)1, sourceBuffer.m_refCount);
+			Assert::IsTrue(videoFrame.GetData() == nullptr);
+			Assert::IsTrue(videoFrame.GetSourceBuffer() == nullptr);
+			Assert::IsTrue(moved.GetData() == data);
+			Assert::AreEqual((uint64_t)3, moved.GetCounter());
+			Assert::AreEqual((timingclocktime_t)4, moved.GetTimingTimestamp());
+
+			// Assigning over a frame gives back what it held
+			CountingSourceBuffer otherSourceBuffer;
+			VideoFrame other(data, 5, 6, &otherSourceBuffer);
+			other = std::move(moved);
+
+			Assert::AreEqual((ULONG)0, otherSourceBuffer.m_refCount);
+			Assert::AreEqual((ULONG)1, sourceBuffer.m_refCount);
+			Assert::AreEqual((uint64_t)3, other.GetCounter());
+
+			// Frames can live in containers without copies
+			std::vector<VideoFrame> frames;
+			frames.push_back(std::move(other));
+			frames.emplace_back(data, 7, 8, &sourceBuffer);
+			frames.emplace_back(data, 9, 10, &sourceBuffer);
+			Assert::AreEqual((ULONG)3, sourceBuffer.m_refCount);
+
+			frames.clear();
+			Assert::AreEqual((ULONG)0, sourceBuffer.m_refCount);
+		}
+
+		// Sharing is a second reference on the same data
+		TEST_METHOD(VideoFrameShareTest)
+		{
+			const uint8_t data[4] = { 0 };
+			CountingSourceBuffer sourceBuffer;
+
+			VideoFrame videoFrame(data, 11, 12, &sourceBuffer);
+
+			{
+				const VideoFrame shared = videoFrame.Share();
+				Assert::AreEqual((ULONG)2, sourceBuffer.m_refCount);
+				Assert::IsTrue(shared.GetData() == data);
+				Assert::AreEqual((uint64_t)11, shared.GetCounter());
+				Assert::AreEqual((timingclocktime_t)12, shared.GetTimingTimestamp());
+			}
+
+			Assert::AreEqual((ULONG)1, sourceBuffer.m_refCount);
+
+			// Nothing to share once moved from
+			VideoFrame moved(std::move(videoFrame));
+			Assert::ExpectException<std::runtime_error>([&]() { videoFrame.Share(); });
+		}
+	};
+}